@@ -38,8 +38,11 @@
  * 	Nicolas Tsiftes <nvt@sics.se>
  */
 
+#include <limits.h>
 #include <stdio.h>
 
+#include "sys/rtimer.h"
+
 #include "antelope.h"
 
 static db_output_function_t output = printf;
@@ -158,3 +161,87 @@ db_processing(db_handle_t *handle)
 {
   return handle->flags & DB_HANDLE_FLAG_PROCESSING;
 }
+
+#if DB_FEATURE_EXPLAIN
+static const char *
+index_type_name(index_type_t type)
+{
+  switch(type) {
+  case INDEX_INLINE:
+    return "inline";
+  case INDEX_MEMHASH:
+    return "memhash";
+  case INDEX_MAXHEAP:
+    return "maxheap";
+  case INDEX_BTREE:
+    return "btree";
+  default:
+    return "unknown";
+  }
+}
+
+db_result_t
+db_print_plan(db_handle_t *handle)
+{
+  struct db_plan *plan;
+  unsigned i;
+
+  plan = &handle->plan;
+
+  switch(plan->access) {
+  case DB_PLAN_SCAN:
+    output("[access = scan");
+    break;
+  case DB_PLAN_INDEX:
+    output("[access = %s index on %s", index_type_name(plan->index_type),
+           plan->index_attribute);
+    break;
+  case DB_PLAN_JOIN_INDEX:
+    output("[access = index join using the %s index on %s",
+           index_type_name(plan->index_type), plan->index_attribute);
+    break;
+  case DB_PLAN_JOIN_HASH:
+    output("[access = hash join on %s", plan->index_attribute);
+    if(plan->partitions > 0) {
+      output(" in %u partitions", plan->partitions);
+    }
+    break;
+  case DB_PLAN_JOIN_MERGE:
+    output("[access = merge join on %s", plan->index_attribute);
+    break;
+  default:
+    return DB_IMPLEMENTATION_ERROR;
+  }
+
+  for(i = 0; i < plan->range_count; i++) {
+    output("%s%s in ", i == 0 ? ", ranges = " : ", ", plan->ranges[i].name);
+    /* The bounds that the condition leaves open are the extremes of
+       the long type. */
+    if(plan->ranges[i].min == LONG_MIN) {
+      output("(-inf, ");
+    } else {
+      output("[%ld, ", plan->ranges[i].min);
+    }
+    if(plan->ranges[i].max == LONG_MAX) {
+      output("inf)");
+    } else {
+      output("%ld]", plan->ranges[i].max);
+    }
+  }
+  output("]\n");
+
+  if(plan->flags & DB_PLAN_FLAG_ANALYZE) {
+    output("[rows = %lu returned, %lu examined; index steps = %lu]\n",
+           (unsigned long)handle->current_row,
+           (unsigned long)handle->processed_rows, plan->index_steps);
+    output("[storage = %lu reads (%lu bytes), %lu writes (%lu bytes)]\n",
+           plan->reads, plan->read_bytes, plan->writes, plan->write_bytes);
+  }
+
+  output("[time = parse %lu, plan %lu, execute %lu ticks of 1/%lu s]\n",
+         plan->time[DB_PLAN_PHASE_PARSE], plan->time[DB_PLAN_PHASE_PLAN],
+         plan->time[DB_PLAN_PHASE_EXECUTE], (unsigned long)DB_PLAN_CLOCK_SECOND);
+
+  return DB_OK;
+}
+#endif /* DB_FEATURE_EXPLAIN */
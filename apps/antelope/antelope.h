@@ -49,5 +49,8 @@ const char *db_get_result_message(db_result_t code);
 db_result_t db_print_header(db_handle_t *handle);
 db_result_t db_print_tuple(db_handle_t *handle);
 int db_processing(db_handle_t *handle);
+#if DB_FEATURE_EXPLAIN
+db_result_t db_print_plan(db_handle_t *handle);
+#endif /* DB_FEATURE_EXPLAIN */
 
 #endif /* DB_H */
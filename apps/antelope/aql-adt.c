@@ -86,6 +86,7 @@ aql_clear(aql_adt_t *adt)
   adt->relation_count = 0;
   adt->attribute_count = 0;
   adt->value_count = 0;
+  adt->row_count = 0;
   adt->flags = 0;
   memset(adt->aggregators, 0, sizeof(adt->aggregators));
 }
@@ -120,12 +121,38 @@ aql_add_attribute(aql_adt_t *adt, char *name, domain_t domain,
   return DB_OK;
 }
 
+db_result_t
+aql_add_group_attribute(aql_adt_t *adt, char *name)
+{
+  int i;
+
+  AQL_SET_FLAG(adt, AQL_FLAG_GROUP);
+
+  for(i = 0; i < AQL_ATTRIBUTE_COUNT(adt); i++) {
+    if(strcmp(adt->attributes[i].name, name) == 0 &&
+       adt->aggregators[i] == AQL_NONE) {
+      adt->attributes[i].flags |= ATTRIBUTE_FLAG_GROUP;
+      return DB_OK;
+    }
+  }
+
+  /* The groups may be formed by attributes that are not projected
+     into the result. */
+  if(DB_ERROR(aql_add_attribute(adt, name, DOMAIN_UNSPECIFIED, 0, 0))) {
+    return DB_LIMIT_ERROR;
+  }
+  adt->attributes[adt->attribute_count - 1].flags =
+    ATTRIBUTE_FLAG_NO_STORE | ATTRIBUTE_FLAG_GROUP;
+
+  return DB_OK;
+}
+
 db_result_t
 aql_add_value(aql_adt_t *adt, domain_t domain, void *value_ptr)
 {
   attribute_value_t *value;
 
-  if(adt->value_count == AQL_ATTRIBUTE_LIMIT) {
+  if(adt->value_count == AQL_VALUE_LIMIT) {
     return DB_LIMIT_ERROR;
   }
 
@@ -40,17 +40,72 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#ifdef CONTIKI_TARGET_NATIVE
+#include <sys/time.h>
+#endif /* CONTIKI_TARGET_NATIVE */
 
 #define DEBUG DEBUG_NONE
 #include "net/uip-debug.h"
 
+#include "sys/rtimer.h"
+
 #include "index.h"
 #include "relation.h"
 #include "result.h"
+#include "storage.h"
 #include "aql.h"
 
 static aql_adt_t adt;
 
+#if DB_FEATURE_EXPLAIN
+#ifdef CONTIKI_TARGET_NATIVE
+/* The rtimer of the native platform counts milliseconds, in which
+   most queries take no time at all. */
+typedef unsigned long plan_clock_t;
+
+static plan_clock_t
+plan_clock(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+#else
+typedef rtimer_clock_t plan_clock_t;
+#define plan_clock()	RTIMER_NOW()
+#endif /* CONTIKI_TARGET_NATIVE */
+
+static plan_clock_t phase_start;
+static struct storage_stats phase_stats;
+
+static void
+phase_begin(void)
+{
+  phase_start = plan_clock();
+  phase_stats = storage_stats;
+}
+
+/* Charge the time and the I/O since phase_begin() to a phase of the
+   query in the handle. */
+static void
+phase_end(db_handle_t *handle, unsigned phase)
+{
+  struct db_plan *plan;
+
+  if(handle == NULL) {
+    return;
+  }
+
+  plan = &handle->plan;
+  plan->time[phase] += (plan_clock_t)(plan_clock() - phase_start);
+  plan->reads += storage_stats.reads - phase_stats.reads;
+  plan->read_bytes += storage_stats.read_bytes - phase_stats.read_bytes;
+  plan->writes += storage_stats.writes - phase_stats.writes;
+  plan->write_bytes += storage_stats.write_bytes - phase_stats.write_bytes;
+}
+#endif /* DB_FEATURE_EXPLAIN */
+
 static void
 clear_handle(db_handle_t *handle)
 {
@@ -71,6 +126,9 @@ aql_execute(db_handle_t *handle, aql_adt_t *adt)
   relation_t *rel;
   aql_attribute_t *attr;
   attribute_t *relattr;
+#if !DB_FEATURE_BULK_INSERT
+  unsigned i;
+#endif /* !DB_FEATURE_BULK_INSERT */
 
   optype = AQL_GET_TYPE(adt);
   if(optype == AQL_TYPE_NONE) {
@@ -154,7 +212,25 @@ aql_execute(db_handle_t *handle, aql_adt_t *adt)
     result = relation_select(handle, rel, adt);
     break;
   case AQL_TYPE_INSERT:
-    result = relation_insert(rel, adt->values);
+    if(adt->row_count == 1) {
+      result = relation_insert(rel, adt->values);
+      break;
+    }
+    /* Each of the rows must have a value for every attribute. */
+    if(adt->value_count != adt->row_count * rel->attribute_count) {
+      result = DB_RELATIONAL_ERROR;
+      break;
+    }
+#if DB_FEATURE_BULK_INSERT
+    result = relation_insert_rows(rel, adt->values, adt->row_count);
+#else
+    for(i = 0; i < adt->row_count; i++) {
+      result = relation_insert(rel, adt->values + i * rel->attribute_count);
+      if(DB_ERROR(result)) {
+        break;
+      }
+    }
+#endif /* DB_FEATURE_BULK_INSERT */
     break;
 #if DB_FEATURE_JOIN
   case AQL_TYPE_JOIN:
@@ -192,6 +268,7 @@ db_query(db_handle_t *handle, const char *format, ...)
 {
   va_list ap;
   char query_string[AQL_MAX_QUERY_LENGTH];
+  db_result_t result;
 
   va_start(ap, format);
   vsnprintf(query_string, sizeof(query_string), format, ap);
@@ -201,17 +278,42 @@ db_query(db_handle_t *handle, const char *format, ...)
     clear_handle(handle);
   }
 
+#if DB_FEATURE_EXPLAIN
+  phase_begin();
+#endif /* DB_FEATURE_EXPLAIN */
+
   if(AQL_ERROR(aql_parse(&adt, query_string))) {
     return DB_PARSING_ERROR;
   }
 
   /*aql_optimize(&adt);*/
 
-  return aql_execute(handle, &adt);
+#if DB_FEATURE_EXPLAIN
+  phase_end(handle, DB_PLAN_PHASE_PARSE);
+  phase_begin();
+#endif /* DB_FEATURE_EXPLAIN */
+
+  result = aql_execute(handle, &adt);
+
+#if DB_FEATURE_EXPLAIN
+  phase_end(handle, DB_PLAN_PHASE_PLAN);
+
+  if(handle != NULL && (adt.flags & AQL_FLAG_EXPLAIN)) {
+    handle->plan.flags = DB_PLAN_FLAG_EXPLAIN;
+    if(adt.flags & AQL_FLAG_ANALYZE) {
+      handle->plan.flags |= DB_PLAN_FLAG_ANALYZE;
+    } else if(handle->flags & DB_HANDLE_FLAG_PROCESSING) {
+      /* The query has been planned, but shall not be executed. */
+      db_free(handle);
+    }
+  }
+#endif /* DB_FEATURE_EXPLAIN */
+
+  return result;
 }
 
-db_result_t
-db_process(db_handle_t *handle)
+static db_result_t
+process(db_handle_t *handle)
 {
   uint8_t optype;
 
@@ -238,3 +340,22 @@ db_process(db_handle_t *handle)
 
   return DB_INCONSISTENCY_ERROR;
 }
+
+db_result_t
+db_process(db_handle_t *handle)
+{
+#if DB_FEATURE_EXPLAIN
+  db_result_t result;
+
+  /* Reading the clock costs as much as processing a few rows, so the
+     execution is only measured for EXPLAIN ANALYZE. */
+  if(handle->plan.flags & DB_PLAN_FLAG_ANALYZE) {
+    phase_begin();
+    result = process(handle);
+    phase_end(handle, DB_PLAN_PHASE_EXECUTE);
+    return result;
+  }
+#endif /* DB_FEATURE_EXPLAIN */
+
+  return process(handle);
+}
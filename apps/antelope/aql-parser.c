@@ -479,6 +479,29 @@ PARSER(join)
   RETURN(OK);
 }
 
+#if DB_FEATURE_GROUP
+PARSER(group_attributes)
+{
+  /* Parse comma-separated identifiers for the group attributes. */
+  CONSUME(IDENTIFIER);
+
+  if(DB_ERROR(AQL_ADD_GROUP_ATTRIBUTE(adt, VALUE))) {
+    RETURN(SYNTAX_ERROR);
+  }
+
+  NEXT;
+  if(TOKEN == COMMA) {
+    if(!PARSE(group_attributes)) {
+      RETURN(SYNTAX_ERROR);
+    }
+  } else {
+    REWIND;
+  }
+
+  RETURN(OK);
+}
+#endif /* DB_FEATURE_GROUP */
+
 PARSER(select)
 {
   AQL_SET_TYPE(adt, AQL_TYPE_SELECT);
@@ -494,6 +517,11 @@ PARSER(select)
   }
 
   NEXT;
+  if(TOKEN != WHERE && TOKEN != GROUP) {
+    REWIND;
+    RETURN(OK);
+  }
+
   if(TOKEN == WHERE) {
     lvm_reset(&p, vmcode, sizeof(vmcode));
 
@@ -502,27 +530,54 @@ PARSER(select)
     }
 
     AQL_SET_CONDITION(adt, &p);
-  } else {
-    REWIND;
-    RETURN(OK);
+    NEXT;
   }
 
-  CONSUME(END);
+#if DB_FEATURE_GROUP
+  if(TOKEN == GROUP) {
+    CONSUME(BY);
+    if(!PARSE(group_attributes)) {
+      RETURN(SYNTAX_ERROR);
+    }
+    NEXT;
+  }
+#endif /* DB_FEATURE_GROUP */
+
+  if(TOKEN != END) {
+    RETURN(SYNTAX_ERROR);
+  }
 
   return OK;
 }
 
 PARSER(insert)
 {
+  uint8_t row_values;
+
   AQL_SET_TYPE(adt, AQL_TYPE_INSERT);
 
-  CONSUME(LEFT_PAREN);
+  /* Parse one or more comma-separated rows, which must have the same
+     number of values. */
+  row_values = 0;
+  do {
+    CONSUME(LEFT_PAREN);
 
-  if(!PARSE(values)) {
-    RETURN(SYNTAX_ERROR);
-  }
+    if(!PARSE(values)) {
+      RETURN(SYNTAX_ERROR);
+    }
+
+    CONSUME(RIGHT_PAREN);
+
+    adt->row_count++;
+    if(row_values == 0) {
+      row_values = adt->value_count;
+    } else if(adt->value_count != adt->row_count * row_values) {
+      RETURN(SYNTAX_ERROR);
+    }
+    NEXT;
+  } while(TOKEN == COMMA);
+  REWIND;
 
-  CONSUME(RIGHT_PAREN);
   CONSUME(INTO);
 
   if(!PARSE(relations)) {
@@ -645,6 +700,9 @@ PARSER_TOKEN(index_type)
   case MEMHASH:
     type = INDEX_MEMHASH;
     break;
+  case BTREE:
+    type = INDEX_BTREE;
+    break;
   default:
     return NONE;
   };
@@ -793,6 +851,23 @@ aql_parse(aql_adt_t *external_adt, char *input_string)
   lexer_start(&lex, input_string, &token, &value);
 
   result = lexer_next(&lex);
+#if DB_FEATURE_EXPLAIN
+  /* EXPLAIN [ANALYZE] <query> */
+  if(!AQL_ERROR(result) && token == EXPLAIN) {
+    AQL_SET_FLAG(adt, AQL_FLAG_EXPLAIN);
+    result = lexer_next(&lex);
+    if(!AQL_ERROR(result) && token == ANALYZE) {
+      AQL_SET_FLAG(adt, AQL_FLAG_ANALYZE);
+      result = lexer_next(&lex);
+    }
+    /* Only queries can be explained. An assignment is only accepted
+       with ANALYZE, since it replaces the relation that it assigns. */
+    if(!AQL_ERROR(result) && token != JOIN && token != SELECT &&
+       (token != IDENTIFIER || !(adt->flags & AQL_FLAG_ANALYZE))) {
+      result = SYNTAX_ERROR;
+    }
+  }
+#endif /* DB_FEATURE_EXPLAIN */
   if(!AQL_ERROR(result)) {
     switch(token) {
     case IDENTIFIER:
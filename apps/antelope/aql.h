@@ -104,6 +104,11 @@ enum token {
   MEMHASH = 46,
   RELATION = 47,
   ATTRIBUTE = 48,
+  BTREE = 49,
+  GROUP = 50,
+  BY = 51,
+  EXPLAIN = 52,
+  ANALYZE = 53,
 
   INTEGER_VALUE = 251,
   FLOAT_VALUE = 252,
@@ -149,11 +154,12 @@ struct aql_adt {
   char relations[AQL_RELATION_LIMIT][RELATION_NAME_LENGTH + 1];
   aql_attribute_t attributes[AQL_ATTRIBUTE_LIMIT];
   aql_aggregator_t aggregators[AQL_ATTRIBUTE_LIMIT];
-  attribute_value_t values[AQL_ATTRIBUTE_LIMIT];
+  attribute_value_t values[AQL_VALUE_LIMIT];
   index_type_t index_type;
   uint8_t relation_count;
   uint8_t attribute_count;
   uint8_t value_count;
+  uint8_t row_count;
   uint8_t optype;
   uint8_t flags;
   void *lvm_instance;
@@ -179,6 +185,9 @@ typedef struct aql_adt aql_adt_t;
 #define AQL_FLAG_AGGREGATE		1
 #define AQL_FLAG_ASSIGN			2
 #define AQL_FLAG_INVERSE_LOGIC		4
+#define AQL_FLAG_GROUP			8
+#define AQL_FLAG_EXPLAIN		16
+#define AQL_FLAG_ANALYZE		32
 
 #define AQL_CLEAR(adt)			aql_clear(adt)
 #define AQL_SET_TYPE(adt, type)	(((adt))->optype = (type))
@@ -200,6 +209,8 @@ typedef struct aql_adt aql_adt_t;
     (adt)->aggregators[(adt)->attribute_count] = (function);		\
     aql_add_attribute((adt), (attr), DOMAIN_UNSPECIFIED, 0, 0);	\
   } while(0)  
+#define AQL_ADD_GROUP_ATTRIBUTE(adt, attr)				\
+    aql_add_group_attribute((adt), (attr))
 #define AQL_ATTRIBUTE_COUNT(adt)	((adt)->attribute_count)
 #define AQL_SET_CONDITION(adt, cond)	((adt)->lvm_instance = (cond))
 #define AQL_ADD_VALUE(adt, domain, value)				\
@@ -214,6 +225,7 @@ aql_status_t aql_parse(aql_adt_t *adt, char *query_string);
 db_result_t aql_add_attribute(aql_adt_t *adt, char *name,
                                domain_t domain, unsigned element_size,
                                int processed_only);
+db_result_t aql_add_group_attribute(aql_adt_t *adt, char *name);
 db_result_t aql_add_value(aql_adt_t *adt, domain_t domain, void *value);
 db_result_t db_query(db_handle_t *handle, const char *format, ...);
 db_result_t db_process(db_handle_t *handle);
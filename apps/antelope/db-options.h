@@ -40,14 +40,48 @@
 #include "contiki-conf.h"
 
 /* Features. Include only what is needed in order to save space. */
+
+/* The default of the larger features, which are left out on sensor
+   nodes to fit their ROM and RAM, and included on the native
+   platform. */
+#ifdef CONTIKI_TARGET_NATIVE
+#define DB_FEATURE_EXTENDED_DEFAULT	1
+#else
+#define DB_FEATURE_EXTENDED_DEFAULT	0
+#endif /* CONTIKI_TARGET_NATIVE */
+
 #ifndef DB_FEATURE_JOIN
 #define DB_FEATURE_JOIN			1
 #endif /* DB_FEATURE_JOIN */
 
+#ifndef DB_FEATURE_HASH_JOIN
+#define DB_FEATURE_HASH_JOIN		DB_FEATURE_EXTENDED_DEFAULT
+#endif /* DB_FEATURE_HASH_JOIN */
+
+#ifndef DB_FEATURE_MERGE_JOIN
+#define DB_FEATURE_MERGE_JOIN		DB_FEATURE_EXTENDED_DEFAULT
+#endif /* DB_FEATURE_MERGE_JOIN */
+
+#ifndef DB_FEATURE_GROUP
+#define DB_FEATURE_GROUP		DB_FEATURE_EXTENDED_DEFAULT
+#endif /* DB_FEATURE_GROUP */
+
+#ifndef DB_FEATURE_BTREE
+#define DB_FEATURE_BTREE		DB_FEATURE_EXTENDED_DEFAULT
+#endif /* DB_FEATURE_BTREE */
+
+#ifndef DB_FEATURE_BULK_INSERT
+#define DB_FEATURE_BULK_INSERT		DB_FEATURE_EXTENDED_DEFAULT
+#endif /* DB_FEATURE_BULK_INSERT */
+
 #ifndef DB_FEATURE_REMOVE
 #define DB_FEATURE_REMOVE		1
 #endif /* DB_FEATURE_REMOVE */
 
+#ifndef DB_FEATURE_LVM_COMPILER
+#define DB_FEATURE_LVM_COMPILER		DB_FEATURE_EXTENDED_DEFAULT
+#endif /* DB_FEATURE_LVM_COMPILER */
+
 #ifndef DB_FEATURE_FLOATS
 #define DB_FEATURE_FLOATS		0
 #endif /* DB_FEATURE_FLOATS */
@@ -56,10 +90,20 @@
 #define DB_FEATURE_COFFEE		1
 #endif /* DB_FEATURE_COFFEE */
 
+#ifndef DB_FEATURE_COLUMNS
+#define DB_FEATURE_COLUMNS		0
+#endif /* DB_FEATURE_COLUMNS */
+
 #ifndef DB_FEATURE_INTEGRITY
 #define DB_FEATURE_INTEGRITY		0
 #endif /* DB_FEATURE_INTEGRITY */
 
+/* Record the plan and the costs of each query in its handle, and accept
+   the EXPLAIN and EXPLAIN ANALYZE prefixes in AQL. */
+#ifndef DB_FEATURE_EXPLAIN
+#define DB_FEATURE_EXPLAIN		0
+#endif /* DB_FEATURE_EXPLAIN */
+
 
 /* Configuration parameters that may be trimmed to save space. */
 #ifndef DB_ERROR_BUF_SIZE
@@ -87,10 +131,39 @@
 #endif /* DB_MAX_ELEMENT_SIZE */
 
 
+#ifndef DB_SCAN_BUFFER_SIZE
+#define DB_SCAN_BUFFER_SIZE		128
+#endif /* DB_SCAN_BUFFER_SIZE */
+
+#ifndef DB_JOIN_MEMORY_SIZE
+#define DB_JOIN_MEMORY_SIZE		512
+#endif /* DB_JOIN_MEMORY_SIZE */
+
+#ifndef DB_JOIN_PARTITIONS
+#define DB_JOIN_PARTITIONS		8
+#endif /* DB_JOIN_PARTITIONS */
+
+#ifndef DB_GROUP_MEMORY_SIZE
+#define DB_GROUP_MEMORY_SIZE		512
+#endif /* DB_GROUP_MEMORY_SIZE */
+
+#ifndef DB_BULK_INSERT_SIZE
+#define DB_BULK_INSERT_SIZE		256
+#endif /* DB_BULK_INSERT_SIZE */
+
+/* The number of keys that are sorted together in a bulk index build. */
+#ifndef DB_BULK_INDEX_SIZE
+#define DB_BULK_INDEX_SIZE		128
+#endif /* DB_BULK_INDEX_SIZE */
+
 #ifndef DB_VM_BYTECODE_SIZE
 #define DB_VM_BYTECODE_SIZE		128
 #endif /* DB_VM_BYTECODE_SIZE */
 
+#ifndef DB_VM_PROGRAM_SIZE
+#define DB_VM_PROGRAM_SIZE		16
+#endif /* DB_VM_PROGRAM_SIZE */
+
 /* Language options. */
 #ifndef AQL_MAX_QUERY_LENGTH
 #define AQL_MAX_QUERY_LENGTH        	128
@@ -108,12 +181,28 @@
 #define AQL_ATTRIBUTE_LIMIT    		5
 #endif /* AQL_ATTRIBUTE_LIMIT */
 
+#ifndef AQL_VALUE_LIMIT
+#if DB_FEATURE_BULK_INSERT
+#define AQL_VALUE_LIMIT    		(3 * AQL_ATTRIBUTE_LIMIT)
+#else
+#define AQL_VALUE_LIMIT    		AQL_ATTRIBUTE_LIMIT
+#endif /* DB_FEATURE_BULK_INSERT */
+#endif /* AQL_VALUE_LIMIT */
+
 
 /* Physical storage options. Changing these may cause compatibility problems. */
 #ifndef DB_COFFEE_RESERVE_SIZE
 #define DB_COFFEE_RESERVE_SIZE          (128 * 1024UL)
 #endif /* DB_COFFEE_RESERVE_SIZE */
 
+#ifndef DB_COLUMN_RESERVE_SIZE
+#define DB_COLUMN_RESERVE_SIZE          (32 * 1024UL)
+#endif /* DB_COLUMN_RESERVE_SIZE */
+
+#ifndef DB_COLUMN_CHUNK_ROWS
+#define DB_COLUMN_CHUNK_ROWS		128
+#endif /* DB_COLUMN_CHUNK_ROWS */
+
 #ifndef DB_MAX_CHAR_SIZE_PER_ROW
 #define DB_MAX_CHAR_SIZE_PER_ROW	64
 #endif /* DB_MAX_CHAR_SIZE_PER_ROW */
@@ -138,6 +227,14 @@
 #define TEMP_RELATION			"db-temp"
 #endif /* TEMP_RELATION */
 
+#ifndef JOIN_PARTITION_FILE
+#define JOIN_PARTITION_FILE		"db-join"
+#endif /* JOIN_PARTITION_FILE */
+
+#ifndef GROUP_SPILL_FILE
+#define GROUP_SPILL_FILE		"db-group"
+#endif /* GROUP_SPILL_FILE */
+
 /* Index options. */
 #ifndef DB_INDEX_COST
 #define DB_INDEX_COST			64
@@ -155,10 +252,27 @@
 #define DB_HEAP_INDEX_LIMIT		1
 #endif /* DB_HEAP_INDEX_LIMIT */
 
+/* The number of max-heap buckets of 512 bytes that are cached in
+   memory. Pairs inserted into a cached bucket are written back when
+   the bucket is evicted or the index is released. */
 #ifndef DB_HEAP_CACHE_LIMIT
 #define DB_HEAP_CACHE_LIMIT		1
 #endif /* DB_HEAP_CACHE_LIMIT */
 
+#ifndef DB_BTREE_INDEX_LIMIT
+#define DB_BTREE_INDEX_LIMIT		1
+#endif /* DB_BTREE_INDEX_LIMIT */
+
+/* The size in bytes of a B+-tree node on storage. */
+#ifndef DB_BTREE_NODE_SIZE
+#define DB_BTREE_NODE_SIZE		256
+#endif /* DB_BTREE_NODE_SIZE */
+
+/* The number of B+-tree nodes that are cached in memory. */
+#ifndef DB_BTREE_CACHE_LIMIT
+#define DB_BTREE_CACHE_LIMIT		4
+#endif /* DB_BTREE_CACHE_LIMIT */
+
 
 /* Propositional Logic Engine options. */
 #ifndef PLE_MAX_NAME_LENGTH
@@ -0,0 +1,796 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *	A B+-tree for data indexing over flash memory.
+ *
+ *     The tree is stored in a single file of fixed-size nodes. Node 0
+ *     holds the root ID and the number of allocated nodes, and the
+ *     other nodes are either inner nodes or leaves. The leaves are
+ *     linked in key order, so that a range of keys can be iterated
+ *     over after a single search from the root.
+ *
+ *     Nodes are read and modified in a small cache of whole nodes. A
+ *     modified node is written back when it is evicted from the cache
+ *     or when the index is released. Full nodes are split on the way
+ *     down during an insertion, so an insertion never has to revisit
+ *     a node. When the inserted key is the largest in the last child
+ *     of a node, the full node keeps all but one of its entries, which
+ *     fills the nodes for keys that arrive in ascending order.
+ *
+ *     Deletions remove entries from the leaves without merging nodes.
+ *     Equal keys may be stored in several leaves, so searches start
+ *     in the leftmost leaf that can hold the key.
+ */
+
+#include <string.h>
+
+#include "lib/memb.h"
+
+#include "db-options.h"
+#include "index.h"
+#include "result.h"
+#include "storage.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+typedef int32_t btree_key_t;
+typedef uint16_t btree_node_id_t;
+
+#define META_NODE	0
+#define INVALID_NODE	0
+
+#define NODE_HEADER_SIZE	4
+#define LEAF_ORDER							\
+  ((DB_BTREE_NODE_SIZE - NODE_HEADER_SIZE) /				\
+   (sizeof(btree_key_t) + sizeof(tuple_id_t)))
+#define INNER_ORDER							\
+  ((DB_BTREE_NODE_SIZE - NODE_HEADER_SIZE - sizeof(btree_node_id_t)) /	\
+   (sizeof(btree_key_t) + sizeof(btree_node_id_t)))
+
+struct btree_node {
+  uint8_t leaf;
+  uint8_t count;
+  /* The next leaf in key order. */
+  btree_node_id_t next;
+  union {
+    struct {
+      btree_key_t keys[LEAF_ORDER];
+      tuple_id_t values[LEAF_ORDER];
+    } leaf;
+    struct {
+      btree_key_t keys[INNER_ORDER];
+      btree_node_id_t children[INNER_ORDER + 1];
+    } inner;
+  } u;
+};
+typedef struct btree_node btree_node_t;
+
+#define NODE_FULL(node)							\
+  ((node)->count == ((node)->leaf ? LEAF_ORDER : INNER_ORDER))
+#define NODE_KEYS(node)							\
+  ((node)->leaf ? (node)->u.leaf.keys : (node)->u.inner.keys)
+
+/* The contents of node 0. */
+struct btree_meta {
+  btree_node_id_t root;
+  btree_node_id_t node_count;
+};
+
+struct btree {
+  db_storage_id_t storage;
+  struct btree_meta meta;
+  uint8_t meta_dirty;
+};
+typedef struct btree btree_t;
+
+struct node_cache {
+  btree_t *tree;
+  btree_node_id_t id;
+  uint8_t dirty;
+  uint16_t last_use;
+  btree_node_t node;
+};
+
+/* The leaf that a key went into, and the separator at its right. */
+struct leaf_hint {
+  btree_node_id_t leaf;
+  btree_key_t limit;
+  uint8_t bounded;
+};
+
+static struct node_cache node_cache[DB_BTREE_CACHE_LIMIT];
+static uint16_t use_counter;
+MEMB(btrees, btree_t, DB_BTREE_INDEX_LIMIT);
+
+#if DB_BTREE_CACHE_LIMIT < 3
+#error "The B+-tree needs a cache of at least three nodes."
+#endif
+
+static db_result_t create(index_t *);
+static db_result_t destroy(index_t *);
+static db_result_t load(index_t *);
+static db_result_t release(index_t *);
+static db_result_t insert(index_t *, attribute_value_t *, tuple_id_t);
+static db_result_t delete(index_t *, attribute_value_t *);
+static tuple_id_t get_next(index_iterator_t *);
+#if DB_FEATURE_BULK_INSERT
+static db_result_t insert_pairs(index_t *, struct index_pair *, unsigned);
+#endif /* DB_FEATURE_BULK_INSERT */
+
+index_api_t index_btree = {
+  INDEX_BTREE,
+  INDEX_API_EXTERNAL | INDEX_API_COMPLETE | INDEX_API_RANGE_QUERIES,
+  create,
+  destroy,
+  load,
+  release,
+  insert,
+  delete,
+  get_next
+#if DB_FEATURE_BULK_INSERT
+  , insert_pairs
+#endif /* DB_FEATURE_BULK_INSERT */
+};
+
+static db_result_t
+write_node(struct node_cache *cache)
+{
+  if(DB_ERROR(storage_write(cache->tree->storage, &cache->node,
+                            (unsigned long)cache->id * DB_BTREE_NODE_SIZE,
+                            sizeof(cache->node)))) {
+    PRINTF("DB: Failed to write B+-tree node %u\n", (unsigned)cache->id);
+    return DB_STORAGE_ERROR;
+  }
+
+  cache->dirty = 0;
+  return DB_OK;
+}
+
+/* Take the least recently used cache slot, and write back its node. */
+static struct node_cache *
+cache_evict(void)
+{
+  struct node_cache *cache;
+  struct node_cache *victim;
+  int i;
+
+  victim = &node_cache[0];
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    cache = &node_cache[i];
+    if(cache->tree == NULL) {
+      return cache;
+    }
+    if((uint16_t)(use_counter - cache->last_use) >
+       (uint16_t)(use_counter - victim->last_use)) {
+      victim = cache;
+    }
+  }
+
+  if(victim->dirty && DB_ERROR(write_node(victim))) {
+    return NULL;
+  }
+  victim->tree = NULL;
+
+  return victim;
+}
+
+static btree_node_t *
+node_get(btree_t *tree, btree_node_id_t id)
+{
+  struct node_cache *cache;
+  int i;
+
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    cache = &node_cache[i];
+    if(cache->tree == tree && cache->id == id) {
+      cache->last_use = ++use_counter;
+      return &cache->node;
+    }
+  }
+
+  cache = cache_evict();
+  if(cache == NULL) {
+    return NULL;
+  }
+
+  if(DB_ERROR(storage_read(tree->storage, &cache->node,
+                           (unsigned long)id * DB_BTREE_NODE_SIZE,
+                           sizeof(cache->node)))) {
+    PRINTF("DB: Failed to read B+-tree node %u\n", (unsigned)id);
+    return NULL;
+  }
+
+  cache->tree = tree;
+  cache->id = id;
+  cache->dirty = 0;
+  cache->last_use = ++use_counter;
+
+  return &cache->node;
+}
+
+/* Mark a node that has been returned by node_get() as modified. */
+static void
+node_modified(btree_node_t *node)
+{
+  int i;
+
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(&node_cache[i].node == node) {
+      node_cache[i].dirty = 1;
+      return;
+    }
+  }
+}
+
+static btree_node_t *
+node_allocate(btree_t *tree, int leaf, btree_node_id_t *id)
+{
+  struct node_cache *cache;
+
+  if(tree->meta.node_count == (btree_node_id_t)-1) {
+    PRINTF("DB: No more B+-tree nodes available\n");
+    return NULL;
+  }
+
+  cache = cache_evict();
+  if(cache == NULL) {
+    return NULL;
+  }
+
+  *id = tree->meta.node_count++;
+  tree->meta_dirty = 1;
+
+  memset(&cache->node, 0, sizeof(cache->node));
+  cache->node.leaf = leaf;
+  cache->tree = tree;
+  cache->id = *id;
+  cache->dirty = 1;
+  cache->last_use = ++use_counter;
+
+  return &cache->node;
+}
+
+static db_result_t
+flush(btree_t *tree)
+{
+  int i;
+
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree == tree && node_cache[i].dirty &&
+       DB_ERROR(write_node(&node_cache[i]))) {
+      return DB_STORAGE_ERROR;
+    }
+  }
+
+  if(tree->meta_dirty) {
+    if(DB_ERROR(storage_write(tree->storage, &tree->meta, 0,
+                              sizeof(tree->meta)))) {
+      return DB_STORAGE_ERROR;
+    }
+    tree->meta_dirty = 0;
+  }
+
+  return DB_OK;
+}
+
+/* The position of the first key that is not less than the given key. */
+static unsigned
+lower_bound(btree_key_t *keys, unsigned count, btree_key_t key)
+{
+  unsigned low, high, middle;
+
+  for(low = 0, high = count; low < high;) {
+    middle = (low + high) / 2;
+    if(keys[middle] < key) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/* The position of the first key that is greater than the given key. */
+static unsigned
+upper_bound(btree_key_t *keys, unsigned count, btree_key_t key)
+{
+  unsigned low, high, middle;
+
+  for(low = 0, high = count; low < high;) {
+    middle = (low + high) / 2;
+    if(keys[middle] <= key) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/* Find the leftmost leaf that can contain the key. */
+static btree_node_id_t
+find_leaf(btree_t *tree, btree_key_t key)
+{
+  btree_node_t *node;
+  btree_node_id_t id;
+
+  for(id = tree->meta.root;;) {
+    node = node_get(tree, id);
+    if(node == NULL) {
+      return INVALID_NODE;
+    }
+    if(node->leaf) {
+      return id;
+    }
+    id = node->u.inner.children[lower_bound(node->u.inner.keys,
+                                            node->count, key)];
+  }
+}
+
+/*
+ * Split the full child at the given position in a parent that is not
+ * full, and insert the separator key into the parent.
+ */
+static db_result_t
+split_child(btree_t *tree, btree_node_id_t parent_id, unsigned position,
+            btree_key_t key)
+{
+  btree_node_t *parent;
+  btree_node_t *child;
+  btree_node_t *sibling;
+  btree_node_id_t sibling_id;
+  btree_key_t separator;
+  unsigned split;
+  unsigned moved;
+
+  parent = node_get(tree, parent_id);
+  if(parent == NULL) {
+    return DB_STORAGE_ERROR;
+  }
+  child = node_get(tree, parent->u.inner.children[position]);
+  if(child == NULL) {
+    return DB_STORAGE_ERROR;
+  }
+  /* The parent and the child are the most recently used nodes, so
+     they stay in the cache when the sibling is allocated. */
+  sibling = node_allocate(tree, child->leaf, &sibling_id);
+  if(sibling == NULL) {
+    return DB_INDEX_ERROR;
+  }
+
+  if(position == parent->count &&
+     key >= NODE_KEYS(child)[child->count - 1]) {
+    split = child->count - 1;
+  } else {
+    split = child->count / 2;
+  }
+
+  if(child->leaf) {
+    moved = child->count - split;
+    memcpy(sibling->u.leaf.keys, &child->u.leaf.keys[split],
+           moved * sizeof(btree_key_t));
+    memcpy(sibling->u.leaf.values, &child->u.leaf.values[split],
+           moved * sizeof(tuple_id_t));
+    sibling->count = moved;
+    sibling->next = child->next;
+    child->next = sibling_id;
+    separator = sibling->u.leaf.keys[0];
+  } else {
+    /* The key at the split point moves up to the parent. */
+    moved = child->count - split - 1;
+    memcpy(sibling->u.inner.keys, &child->u.inner.keys[split + 1],
+           moved * sizeof(btree_key_t));
+    memcpy(sibling->u.inner.children, &child->u.inner.children[split + 1],
+           (moved + 1) * sizeof(btree_node_id_t));
+    sibling->count = moved;
+    separator = child->u.inner.keys[split];
+  }
+  child->count = split;
+
+  memmove(&parent->u.inner.keys[position + 1],
+          &parent->u.inner.keys[position],
+          (parent->count - position) * sizeof(btree_key_t));
+  memmove(&parent->u.inner.children[position + 2],
+          &parent->u.inner.children[position + 1],
+          (parent->count - position) * sizeof(btree_node_id_t));
+  parent->u.inner.keys[position] = separator;
+  parent->u.inner.children[position + 1] = sibling_id;
+  parent->count++;
+
+  node_modified(parent);
+  node_modified(child);
+
+  PRINTF("DB: Split B+-tree node %u at %u, new node %u\n",
+         (unsigned)parent->u.inner.children[position], split,
+         (unsigned)sibling_id);
+
+  return DB_OK;
+}
+
+static void
+leaf_insert(btree_node_t *node, btree_key_t key, tuple_id_t value)
+{
+  unsigned position;
+
+  /* Equal keys are kept in insertion order. */
+  position = upper_bound(node->u.leaf.keys, node->count, key);
+  memmove(&node->u.leaf.keys[position + 1], &node->u.leaf.keys[position],
+          (node->count - position) * sizeof(btree_key_t));
+  memmove(&node->u.leaf.values[position + 1], &node->u.leaf.values[position],
+          (node->count - position) * sizeof(tuple_id_t));
+  node->u.leaf.keys[position] = key;
+  node->u.leaf.values[position] = value;
+  node->count++;
+  node_modified(node);
+}
+
+/*
+ * Insert a key. If a hint is given, it receives the leaf that the key
+ * went into, and the separator below which the keys belong to the leaf.
+ */
+static db_result_t
+insert_item(btree_t *tree, btree_key_t key, tuple_id_t value,
+            struct leaf_hint *hint)
+{
+  btree_node_t *node;
+  btree_node_t *child;
+  btree_node_t *root;
+  btree_node_id_t id;
+  btree_node_id_t root_id;
+  btree_key_t limit;
+  uint8_t bounded;
+  unsigned position;
+  db_result_t result;
+
+  node = node_get(tree, tree->meta.root);
+  if(node == NULL) {
+    return DB_STORAGE_ERROR;
+  }
+
+  if(NODE_FULL(node)) {
+    /* Grow the tree by one level. */
+    root = node_allocate(tree, 0, &root_id);
+    if(root == NULL) {
+      return DB_INDEX_ERROR;
+    }
+    root->u.inner.children[0] = tree->meta.root;
+    tree->meta.root = root_id;
+    result = split_child(tree, root_id, 0, key);
+    if(DB_ERROR(result)) {
+      return result;
+    }
+  }
+
+  limit = 0;
+  bounded = 0;
+  for(id = tree->meta.root;;) {
+    node = node_get(tree, id);
+    if(node == NULL) {
+      return DB_STORAGE_ERROR;
+    }
+
+    if(node->leaf) {
+      leaf_insert(node, key, value);
+      if(hint != NULL) {
+        hint->leaf = id;
+        hint->limit = limit;
+        hint->bounded = bounded;
+      }
+      return DB_OK;
+    }
+
+    position = upper_bound(node->u.inner.keys, node->count, key);
+    child = node_get(tree, node->u.inner.children[position]);
+    if(child == NULL) {
+      return DB_STORAGE_ERROR;
+    }
+
+    if(NODE_FULL(child)) {
+      result = split_child(tree, id, position, key);
+      if(DB_ERROR(result)) {
+        return result;
+      }
+      node = node_get(tree, id);
+      if(node == NULL) {
+        return DB_STORAGE_ERROR;
+      }
+      if(key >= node->u.inner.keys[position]) {
+        position++;
+      }
+    }
+
+    /* The keys of a subtree are less than the separator at its right. */
+    if(position < node->count) {
+      limit = node->u.inner.keys[position];
+      bounded = 1;
+    }
+    id = node->u.inner.children[position];
+  }
+}
+
+/* Remove all entries with the key. */
+static db_result_t
+delete_items(btree_t *tree, btree_key_t key)
+{
+  btree_node_t *node;
+  btree_node_id_t id;
+  unsigned first;
+  unsigned last;
+
+  for(id = find_leaf(tree, key); id != INVALID_NODE; id = node->next) {
+    node = node_get(tree, id);
+    if(node == NULL) {
+      return DB_STORAGE_ERROR;
+    }
+
+    first = lower_bound(node->u.leaf.keys, node->count, key);
+    last = upper_bound(node->u.leaf.keys, node->count, key);
+    if(last > first) {
+      memmove(&node->u.leaf.keys[first], &node->u.leaf.keys[last],
+              (node->count - last) * sizeof(btree_key_t));
+      memmove(&node->u.leaf.values[first], &node->u.leaf.values[last],
+              (node->count - last) * sizeof(tuple_id_t));
+      node->count -= last - first;
+      node_modified(node);
+    }
+
+    if(first < node->count) {
+      /* The next key in this leaf is greater. */
+      break;
+    }
+  }
+
+  return DB_OK;
+}
+
+static db_result_t
+create(index_t *index)
+{
+  char *filename;
+  btree_t *tree;
+  btree_node_t *root;
+  btree_node_id_t root_id;
+
+  filename = storage_generate_file("btree", DB_COFFEE_RESERVE_SIZE);
+  if(filename == NULL) {
+    PRINTF("DB: Failed to generate a B+-tree file\n");
+    return DB_INDEX_ERROR;
+  }
+  memcpy(index->descriptor_file, filename, sizeof(index->descriptor_file));
+
+  index->opaque_data = tree = memb_alloc(&btrees);
+  if(tree == NULL) {
+    PRINTF("DB: Failed to allocate a B+-tree\n");
+    storage_remove_file(index->descriptor_file);
+    return DB_ALLOCATION_ERROR;
+  }
+
+  tree->storage = storage_open(index->descriptor_file);
+  if(tree->storage < 0) {
+    memb_free(&btrees, tree);
+    storage_remove_file(index->descriptor_file);
+    return DB_STORAGE_ERROR;
+  }
+
+  /* Node 0 is reserved for the meta data. */
+  tree->meta.node_count = 1;
+  root = node_allocate(tree, 1, &root_id);
+  if(root == NULL) {
+    release(index);
+    storage_remove_file(index->descriptor_file);
+    return DB_INDEX_ERROR;
+  }
+  root->next = INVALID_NODE;
+  tree->meta.root = root_id;
+
+  if(DB_ERROR(flush(tree))) {
+    release(index);
+    storage_remove_file(index->descriptor_file);
+    return DB_STORAGE_ERROR;
+  }
+
+  PRINTF("DB: Created a B+-tree index in %s\n", index->descriptor_file);
+
+  return DB_OK;
+}
+
+static db_result_t
+destroy(index_t *index)
+{
+  /* The index has already been released if it is destroyed through
+     index_destroy(). */
+  if(index->opaque_data != NULL) {
+    release(index);
+  }
+  storage_remove_file(index->descriptor_file);
+  return DB_OK;
+}
+
+static db_result_t
+load(index_t *index)
+{
+  btree_t *tree;
+
+  index->opaque_data = tree = memb_alloc(&btrees);
+  if(tree == NULL) {
+    PRINTF("DB: Failed to allocate a B+-tree\n");
+    return DB_ALLOCATION_ERROR;
+  }
+
+  tree->storage = storage_open(index->descriptor_file);
+  if(tree->storage < 0) {
+    memb_free(&btrees, tree);
+    return DB_STORAGE_ERROR;
+  }
+
+  if(DB_ERROR(storage_read(tree->storage, &tree->meta, 0,
+                           sizeof(tree->meta)))) {
+    storage_close(tree->storage);
+    memb_free(&btrees, tree);
+    return DB_STORAGE_ERROR;
+  }
+  tree->meta_dirty = 0;
+
+  PRINTF("DB: Loaded a B+-tree index from %s with %u nodes\n",
+         index->descriptor_file, (unsigned)tree->meta.node_count);
+
+  return DB_OK;
+}
+
+static db_result_t
+release(index_t *index)
+{
+  btree_t *tree;
+  db_result_t result;
+  int i;
+
+  tree = index->opaque_data;
+
+  result = flush(tree);
+  for(i = 0; i < DB_BTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree == tree) {
+      node_cache[i].tree = NULL;
+    }
+  }
+
+  storage_close(tree->storage);
+  memb_free(&btrees, tree);
+  index->opaque_data = NULL;
+
+  return result;
+}
+
+static db_result_t
+insert(index_t *index, attribute_value_t *key, tuple_id_t value)
+{
+  return insert_item(index->opaque_data, (btree_key_t)db_value_to_long(key),
+                     value, NULL);
+}
+
+static db_result_t
+delete(index_t *index, attribute_value_t *key)
+{
+  return delete_items(index->opaque_data, (btree_key_t)db_value_to_long(key));
+}
+
+#if DB_FEATURE_BULK_INSERT
+/*
+ * Insert pairs in key order. A key that belongs to the leaf of the
+ * previous key goes straight into the leaf while it has room, without
+ * a descent from the root.
+ */
+static db_result_t
+insert_pairs(index_t *index, struct index_pair *pairs, unsigned count)
+{
+  btree_t *tree;
+  btree_node_t *node;
+  btree_key_t key;
+  struct leaf_hint hint;
+  unsigned i;
+  db_result_t result;
+
+  tree = index->opaque_data;
+  index_sort_pairs(pairs, count);
+
+  hint.leaf = INVALID_NODE;
+  for(i = 0; i < count; i++) {
+    key = (btree_key_t)pairs[i].key;
+    if(hint.leaf != INVALID_NODE && (!hint.bounded || key < hint.limit)) {
+      node = node_get(tree, hint.leaf);
+      if(node == NULL) {
+        return DB_STORAGE_ERROR;
+      }
+      if(!NODE_FULL(node)) {
+        leaf_insert(node, key, pairs[i].row);
+        continue;
+      }
+    }
+
+    result = insert_item(tree, key, pairs[i].row, &hint);
+    if(DB_ERROR(result)) {
+      return result;
+    }
+  }
+
+  return DB_OK;
+}
+#endif /* DB_FEATURE_BULK_INSERT */
+
+static tuple_id_t
+get_next(index_iterator_t *iterator)
+{
+  struct iteration_cache {
+    index_iterator_t *index_iterator;
+    btree_node_id_t leaf;
+    unsigned position;
+  };
+  static struct iteration_cache cache;
+  btree_t *tree;
+  btree_node_t *node;
+  long min;
+  long max;
+
+  tree = (btree_t *)iterator->index->opaque_data;
+  min = db_value_to_long(&iterator->min_value);
+  max = db_value_to_long(&iterator->max_value);
+
+  if(cache.index_iterator != iterator || iterator->next_item_no == 0) {
+    /* Start from the first key that is not less than the minimum. */
+    cache.index_iterator = iterator;
+    cache.leaf = find_leaf(tree, min < INT32_MIN ? INT32_MIN : (btree_key_t)min);
+    cache.position = 0;
+  }
+
+  /* Follow the leaf chain until a key is greater than the maximum. */
+  while(cache.leaf != INVALID_NODE) {
+    node = node_get(tree, cache.leaf);
+    if(node == NULL) {
+      return INVALID_TUPLE;
+    }
+
+    for(; cache.position < node->count; cache.position++) {
+      if(node->u.leaf.keys[cache.position] > max) {
+        cache.leaf = INVALID_NODE;
+        return INVALID_TUPLE;
+      }
+      if(node->u.leaf.keys[cache.position] >= min) {
+        iterator->next_item_no++;
+        return node->u.leaf.values[cache.position++];
+      }
+    }
+
+    cache.leaf = node->next;
+    cache.position = 0;
+  }
+
+  return INVALID_TUPLE;
+}
@@ -44,6 +44,12 @@
  *     (a,mean) and (mean+1, b), respectively. The entries from the 
  *     original bucket are then copied into the appropriate new bucket 
  *     before the old bucket gets deleted.
+ *
+ *     Buckets are read and appended to in a cache of DB_HEAP_CACHE_LIMIT
+ *     buckets. The pairs appended to a cached bucket are written back
+ *     when the least recently used bucket is evicted from the cache, or
+ *     when the index is released, so that each bucket is still written
+ *     sequentially.
  * \author
  * 	Nicolas Tsiftes <nvt@sics.se>
  */
@@ -111,15 +117,20 @@ typedef struct heap heap_t;
 struct bucket_cache {
   heap_t *heap;
   uint16_t bucket_id;
+  uint16_t last_use;
+  /* The pairs from this slot on have not been written back. */
+  uint8_t dirty_slot;
   bucket_t bucket;
 };
 
 static struct bucket_cache bucket_cache[DB_HEAP_CACHE_LIMIT];
+static uint16_t use_counter;
+static struct index_cache_stats cache_stats;
 MEMB(heaps, heap_t, DB_HEAP_INDEX_LIMIT);
 
 static struct bucket_cache *get_cache(heap_t *, int);
-static struct bucket_cache *get_cache_free(void);
-static void invalidate_cache(void);
+static struct bucket_cache *cache_evict(void);
+static int cache_flush(heap_t *);
 static maxheap_key_t transform_key(maxheap_key_t);
 static int heap_read(heap_t *, int, heap_node_t *);
 static int heap_write(heap_t *, int, heap_node_t *);
@@ -140,6 +151,9 @@ static db_result_t release(index_t *);
 static db_result_t insert(index_t *, attribute_value_t *, tuple_id_t);
 static db_result_t delete(index_t *, attribute_value_t *);
 static tuple_id_t get_next(index_iterator_t *);
+#if DB_FEATURE_BULK_INSERT
+static db_result_t insert_pairs(index_t *, struct index_pair *, unsigned);
+#endif /* DB_FEATURE_BULK_INSERT */
 
 index_api_t index_maxheap = {
   INDEX_MAXHEAP,
@@ -151,6 +165,9 @@ index_api_t index_maxheap = {
   insert,
   delete,
   get_next
+#if DB_FEATURE_BULK_INSERT
+  , insert_pairs
+#endif /* DB_FEATURE_BULK_INSERT */
 };
 
 static struct bucket_cache *
@@ -160,36 +177,90 @@ get_cache(heap_t *heap, int bucket_id)
 
   for(i = 0; i < DB_HEAP_CACHE_LIMIT; i++) {
     if(bucket_cache[i].heap == heap && bucket_cache[i].bucket_id == bucket_id) {
+      bucket_cache[i].last_use = ++use_counter;
       return &bucket_cache[i];
     }
   }
   return NULL;
 }
 
+/* Write the pairs that have been appended to a cached bucket. */
+static int
+write_back(struct bucket_cache *cache)
+{
+  heap_t *heap;
+  uint8_t next_free_slot;
+  unsigned long offset;
+
+  heap = cache->heap;
+  next_free_slot = heap->next_free_slot[cache->bucket_id];
+  if(cache->dirty_slot >= next_free_slot) {
+    return 1;
+  }
+
+  offset = (unsigned long)cache->bucket_id * sizeof(bucket_t);
+  offset += cache->dirty_slot * sizeof(struct key_value_pair);
+
+  if(DB_ERROR(storage_write(heap->bucket_storage,
+                            &cache->bucket.pairs[cache->dirty_slot], offset,
+                            (next_free_slot - cache->dirty_slot) *
+                            sizeof(struct key_value_pair)))) {
+    PRINTF("DB: Failed to write back bucket %u\n",
+           (unsigned)cache->bucket_id);
+    return 0;
+  }
+
+  cache->dirty_slot = next_free_slot;
+  cache_stats.writes++;
+  return 1;
+}
+
+/* Take the least recently used cache slot, and write back its bucket. */
 static struct bucket_cache *
-get_cache_free(void)
+cache_evict(void)
 {
+  struct bucket_cache *cache;
+  struct bucket_cache *victim;
   int i;
 
+  victim = &bucket_cache[0];
   for(i = 0; i < DB_HEAP_CACHE_LIMIT; i++) {
-    if(bucket_cache[i].heap == NULL) {
-      return &bucket_cache[i];
+    cache = &bucket_cache[i];
+    if(cache->heap == NULL) {
+      return cache;
+    }
+    if((uint16_t)(use_counter - cache->last_use) >
+       (uint16_t)(use_counter - victim->last_use)) {
+      victim = cache;
     }
   }
-  return NULL;
+
+  if(write_back(victim) == 0) {
+    return NULL;
+  }
+  victim->heap = NULL;
+
+  return victim;
 }
 
-static void
-invalidate_cache(void)
+/* Write back all cached buckets of a heap. */
+static int
+cache_flush(heap_t *heap)
 {
   int i;
 
   for(i = 0; i < DB_HEAP_CACHE_LIMIT; i++) {
-    if(bucket_cache[i].heap != NULL) {
-      bucket_cache[i].heap = NULL;
-      break;
+    if(bucket_cache[i].heap == heap && write_back(&bucket_cache[i]) == 0) {
+      return 0;
     }
   }
+  return 1;
+}
+
+void
+index_maxheap_cache_stats(struct index_cache_stats *stats)
+{
+  memcpy(stats, &cache_stats, sizeof(*stats));
 }
 
 static maxheap_key_t
@@ -263,7 +334,6 @@ heap_find(heap_t *heap, maxheap_key_t key, int *iterator)
 {
   maxheap_key_t hashed_key;
   int i;
-  int first_child;
   static heap_node_t node;
 
   hashed_key = transform_key(key);
@@ -275,12 +345,9 @@ heap_find(heap_t *heap, maxheap_key_t key, int *iterator)
     if(EMPTY_NODE(&node)) {
       break;
     } else if(node.min <= hashed_key && hashed_key <= node.max) {
-      first_child = BRANCH_FACTOR * i + 1;
-
-      if(first_child >= NODE_LIMIT) {
-	break;
-      }
-      *iterator = first_child;
+      /* The nodes at the lowest level have no children, so the next
+         search from the iterator fails. */
+      *iterator = BRANCH_FACTOR * i + 1;
       return i;
     } else {
       i++;
@@ -355,25 +422,20 @@ bucket_load(heap_t *heap, int bucket_id)
 
   cache = get_cache(heap, bucket_id);
   if(cache != NULL) {
+    cache_stats.hits++;
     return cache;
   }
+  cache_stats.misses++;
 
-  cache = get_cache_free();
+  cache = cache_evict();
   if(cache == NULL) {
-    invalidate_cache();
-    cache = get_cache_free();
-    if(cache == NULL) {
-      return NULL;
-    }
+    return NULL;
   }
 
   if(bucket_read(heap, bucket_id, &cache->bucket) == 0) {
     return NULL;
   }
 
-  cache->heap = heap;
-  cache->bucket_id = bucket_id;
-
   if(heap->next_free_slot[bucket_id] == 0) {
     for(i = 0; i < BUCKET_SIZE; i++) {
       if(EMPTY_PAIR(&cache->bucket.pairs[i])) {
@@ -384,6 +446,11 @@ bucket_load(heap_t *heap, int bucket_id)
     heap->next_free_slot[bucket_id] = i;
   }
 
+  cache->heap = heap;
+  cache->bucket_id = bucket_id;
+  cache->dirty_slot = heap->next_free_slot[bucket_id];
+  cache->last_use = ++use_counter;
+
   PRINTF("DB: Loaded bucket %d, the next free slot is %u\n", bucket_id,
 	 (unsigned)heap->next_free_slot[bucket_id]);
 
@@ -393,20 +460,20 @@ bucket_load(heap_t *heap, int bucket_id)
 static int
 bucket_append(heap_t *heap, int bucket_id, struct key_value_pair *pair)
 {
-  unsigned long offset;
+  struct bucket_cache *cache;
 
-  if(heap->next_free_slot[bucket_id] >= BUCKET_SIZE) {
-    PRINTF("DB: Invalid write attempt to the full bucket %d\n", bucket_id);
+  cache = bucket_load(heap, bucket_id);
+  if(cache == NULL) {
     return 0;
   }
 
-  offset = (unsigned long)bucket_id * sizeof(bucket_t);
-  offset += heap->next_free_slot[bucket_id] * sizeof(struct key_value_pair);
-
-  if(DB_ERROR(storage_write(heap->bucket_storage, pair, offset, sizeof(*pair)))) {
+  if(heap->next_free_slot[bucket_id] >= BUCKET_SIZE) {
+    PRINTF("DB: Invalid write attempt to the full bucket %d\n", bucket_id);
     return 0;
   }
 
+  memcpy(&cache->bucket.pairs[heap->next_free_slot[bucket_id]], pair,
+         sizeof(*pair));
   heap->next_free_slot[bucket_id]++;
 
   return 1;
@@ -443,6 +510,7 @@ bucket_split(heap_t *heap, int bucket_id)
   return 1;
 }
 
+/* Insert a pair, and return the bucket that it went into, or -1. */
 int
 insert_item(heap_t *heap, maxheap_key_t key, maxheap_value_t value)
 {
@@ -461,33 +529,38 @@ insert_item(heap_t *heap, maxheap_key_t key, maxheap_value_t value)
 
   if(bucket_id < 0) {
     PRINTF("DB: No bucket for key %ld\n", (long)key);
-    return 0;
+    return -1;
   }
 
   pair.key = key;
   pair.value = value;
 
+  /* The number of pairs in a bucket is known once it has been loaded. */
+  if(bucket_load(heap, bucket_id) == NULL) {
+    return -1;
+  }
+
   if(heap->next_free_slot[bucket_id] == BUCKET_SIZE) {
     PRINTF("DB: Bucket %d is full\n", bucket_id);
     if(bucket_split(heap, bucket_id) == 0) {
-      return 0;
+      return -1;
     }
 
     /* Select one of the newly created buckets. */
     bucket_id = heap_find(heap, key, &heap_iterator);
     if(bucket_id < 0) {
-      return 0;
+      return -1;
     }
   }
 
   if(bucket_append(heap, bucket_id, &pair) == 0) {
-    return 0;
+    return -1;
   }
 
   PRINTF("DB: Inserted key %ld (hash %ld) into the heap at bucket_id %d\n",
 	 (long)key, (long)transform_key(key), bucket_id);
 
-  return 1;
+  return bucket_id;
 }
 
 static db_result_t
@@ -605,12 +678,13 @@ load(index_t *index)
 
   fd = storage_open(index->descriptor_file);
   if(fd < 0) {
+    memb_free(&heaps, heap);
     return DB_STORAGE_ERROR;
   }
 
-  if(storage_read(fd, bucket_file, 0, sizeof(bucket_file)) !=
-     sizeof(bucket_file)) {
+  if(DB_ERROR(storage_read(fd, bucket_file, 0, sizeof(bucket_file)))) {
     storage_close(fd);
+    memb_free(&heaps, heap);
     return DB_STORAGE_ERROR;
   }
 
@@ -631,13 +705,23 @@ static db_result_t
 release(index_t *index)
 {
   heap_t *heap;
+  db_result_t result;
+  int i;
 
   heap = index->opaque_data;
 
+  result = cache_flush(heap) ? DB_OK : DB_STORAGE_ERROR;
+  for(i = 0; i < DB_HEAP_CACHE_LIMIT; i++) {
+    if(bucket_cache[i].heap == heap) {
+      bucket_cache[i].heap = NULL;
+    }
+  }
+
   storage_close(heap->bucket_storage);
   storage_close(heap->heap_storage);
   memb_free(&heaps, index->opaque_data);
-  return DB_INDEX_ERROR;
+  index->opaque_data = NULL;
+  return result;
 }
 
 static db_result_t
@@ -651,13 +735,62 @@ insert(index_t *index, attribute_value_t *key, tuple_id_t value)
   long_key = db_value_to_long(key);
 
   if(insert_item(heap, (maxheap_key_t)long_key,
-		 (maxheap_value_t)value) == 0) {
+		 (maxheap_value_t)value) < 0) {
     PRINTF("DB: Failed to insert key %ld into a max-heap index\n", long_key);
     return DB_INDEX_ERROR;
   }
   return DB_OK;
 }
 
+#if DB_FEATURE_BULK_INSERT
+/*
+ * Insert pairs sorted by their hashed keys, so that the pairs of a
+ * bucket are appended one after another while the bucket is cached.
+ * The bucket that a key went into takes the following keys of its hash
+ * range without a search of the heap until it is full. A bucket that is
+ * not full has not been split, so no deeper bucket covers its range.
+ */
+static db_result_t
+insert_pairs(index_t *index, struct index_pair *pairs, unsigned count)
+{
+  heap_t *heap;
+  heap_node_t node;
+  struct key_value_pair pair;
+  int bucket_id;
+  unsigned i;
+
+  heap = (heap_t *)index->opaque_data;
+
+  for(i = 0; i < count; i++) {
+    pairs[i].order = transform_key((maxheap_key_t)pairs[i].key);
+  }
+  index_sort_pairs(pairs, count);
+
+  node.max = 0;
+  for(i = 0, bucket_id = -1; i < count; i++) {
+    pair.key = (maxheap_key_t)pairs[i].key;
+    pair.value = (maxheap_value_t)pairs[i].row;
+
+    if(bucket_id >= 0 && pairs[i].order <= node.max &&
+       heap->next_free_slot[bucket_id] < BUCKET_SIZE) {
+      if(bucket_append(heap, bucket_id, &pair) == 0) {
+        return DB_INDEX_ERROR;
+      }
+      continue;
+    }
+
+    bucket_id = insert_item(heap, pair.key, pair.value);
+    if(bucket_id < 0 || heap_read(heap, bucket_id, &node) == 0) {
+      PRINTF("DB: Failed to insert key %ld into a max-heap index\n",
+             pairs[i].key);
+      return DB_INDEX_ERROR;
+    }
+  }
+
+  return DB_OK;
+}
+#endif /* DB_FEATURE_BULK_INSERT */
+
 static db_result_t
 delete(index_t *index, attribute_value_t *value)
 {
@@ -709,7 +842,7 @@ get_next(index_iterator_t *iterator)
    * of the heap. There is a much higher chance that the key will be
    * there rather than at the top.
    */
-  for(; cache.heap_iterator >= 0; cache.heap_iterator--) {
+  for(; cache.heap_iterator >= 0; cache.heap_iterator--, cache.start = 0) {
     bucket_id = cache.visited_buckets[cache.heap_iterator];
 
     PRINTF("DB: Find key %lu in bucket %d\n", (unsigned long)key, bucket_id);
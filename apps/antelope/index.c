@@ -49,7 +49,11 @@
 #include "storage.h"
 
 static index_api_t *index_components[] = {&index_inline,
-	&index_maxheap};
+	&index_maxheap
+#if DB_FEATURE_BTREE
+	, &index_btree
+#endif /* DB_FEATURE_BTREE */
+	};
 
 LIST(indices);
 MEMB(index_memb, index_t, DB_INDEX_POOL_SIZE);
@@ -223,6 +227,102 @@ index_insert(index_t *index, attribute_value_t *value,
   return index->api->insert(index, value, tuple_id);
 }
 
+#if DB_FEATURE_BULK_INSERT
+static struct index_pair bulk_pairs[DB_BULK_INDEX_SIZE];
+
+static int
+pair_before(struct index_pair *a, struct index_pair *b)
+{
+  return a->order < b->order || (a->order == b->order && a->row < b->row);
+}
+
+static void
+sift_down(struct index_pair *pairs, unsigned root, unsigned count)
+{
+  struct index_pair pair;
+  unsigned child;
+
+  pair = pairs[root];
+  for(; (child = 2 * root + 1) < count; root = child) {
+    if(child + 1 < count && pair_before(&pairs[child], &pairs[child + 1])) {
+      child++;
+    }
+    if(!pair_before(&pair, &pairs[child])) {
+      break;
+    }
+    pairs[root] = pairs[child];
+  }
+  pairs[root] = pair;
+}
+
+/*
+ * Sort pairs by their order, and pairs of the same order by their rows,
+ * so that equal keys stay in insertion order. A heapsort needs no memory
+ * besides the pairs.
+ */
+void
+index_sort_pairs(struct index_pair *pairs, unsigned count)
+{
+  struct index_pair pair;
+  unsigned i;
+
+  for(i = count / 2; i > 0; i--) {
+    sift_down(pairs, i - 1, count);
+  }
+  for(i = count; i > 1; i--) {
+    pair = pairs[0];
+    pairs[0] = pairs[i - 1];
+    pairs[i - 1] = pair;
+    sift_down(pairs, 0, i - 1);
+  }
+}
+
+/*
+ * Insert the keys of consecutive rows, which are given with a stride of
+ * values between them. An index with a bulk insertion function receives
+ * the keys in slices of up to DB_BULK_INDEX_SIZE pairs, which it sorts
+ * into the order in which it inserts them with the least work.
+ */
+db_result_t
+index_insert_rows(index_t *index, attribute_value_t *keys, unsigned stride,
+                  tuple_id_t first_row, unsigned count)
+{
+  unsigned slice;
+  unsigned i;
+  db_result_t result;
+
+  if(index->api->insert_pairs == NULL) {
+    for(i = 0; i < count; i++) {
+      result = index_insert(index, &keys[i * stride], first_row + i);
+      if(DB_ERROR(result)) {
+        return result;
+      }
+    }
+    return DB_OK;
+  }
+
+  while(count > 0) {
+    slice = count < DB_BULK_INDEX_SIZE ? count : DB_BULK_INDEX_SIZE;
+    for(i = 0; i < slice; i++) {
+      bulk_pairs[i].key = db_value_to_long(&keys[i * stride]);
+      bulk_pairs[i].order = bulk_pairs[i].key;
+      bulk_pairs[i].row = first_row + i;
+    }
+
+    result = index->api->insert_pairs(index, bulk_pairs, slice);
+    if(DB_ERROR(result)) {
+      return result;
+    }
+
+    keys += slice * stride;
+    first_row += slice;
+    count -= slice;
+  }
+
+  return DB_OK;
+}
+#endif /* DB_FEATURE_BULK_INSERT */
+
 db_result_t
 index_delete(index_t *index, attribute_value_t *value)
 {
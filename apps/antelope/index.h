@@ -43,7 +43,8 @@ typedef enum {
   INDEX_NONE = 0,
   INDEX_INLINE = 1,
   INDEX_MEMHASH = 2,
-  INDEX_MAXHEAP = 3
+  INDEX_MAXHEAP = 3,
+  INDEX_BTREE = 4
 } index_type_t;
 
 #define INDEX_READY		0x00
@@ -80,6 +81,14 @@ struct index_iterator {
 };
 typedef struct index_iterator index_iterator_t;
 
+/* A key and its row in a bulk insertion. The order is the value by
+   which an index sorts the pairs before it inserts them. */
+struct index_pair {
+  long order;
+  long key;
+  tuple_id_t row;
+};
+
 struct index_api {
   index_type_t type;
   uint8_t flags;
@@ -90,13 +99,23 @@ struct index_api {
   db_result_t (*insert)(index_t *, attribute_value_t *, tuple_id_t);
   db_result_t (*delete)(index_t *, attribute_value_t *);
   tuple_id_t (*get_next)(index_iterator_t *);
+  /* Optional: insert a slice of pairs, in any order. */
+  db_result_t (*insert_pairs)(index_t *, struct index_pair *, unsigned);
 };
 
 typedef struct index_api index_api_t;
 
+/* Counters of the bucket cache of the max-heap index. */
+struct index_cache_stats {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long writes;
+};
+
 extern index_api_t index_inline;
 extern index_api_t index_maxheap;
 extern index_api_t index_memhash;
+extern index_api_t index_btree;
 
 void index_init(void);
 db_result_t index_create(index_type_t, relation_t *, attribute_t *);
@@ -104,10 +123,14 @@ db_result_t index_destroy(index_t *);
 db_result_t index_load(relation_t *, attribute_t *);
 db_result_t index_release(index_t *);
 db_result_t index_insert(index_t *, attribute_value_t *, tuple_id_t);
+db_result_t index_insert_rows(index_t *, attribute_value_t *, unsigned,
+                              tuple_id_t, unsigned);
+void index_sort_pairs(struct index_pair *, unsigned);
 db_result_t index_delete(index_t *, attribute_value_t *);
 db_result_t index_get_iterator(index_iterator_t *, index_t *, 
                                attribute_value_t *, attribute_value_t *);
 tuple_id_t index_get_next(index_iterator_t *);
 int index_exists(attribute_t *);
+void index_maxheap_cache_stats(struct index_cache_stats *);
 
 #endif /* !INDEX_H */
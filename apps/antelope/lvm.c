@@ -70,6 +70,11 @@ struct variable {
   operand_type_t type;
   operand_value_t value;
   char name[LVM_MAX_NAME_LENGTH + 1];
+#if DB_FEATURE_LVM_COMPILER
+  /* The location of the value in a row, if the variable is bound. */
+  uint16_t offset;
+  uint8_t size;
+#endif /* DB_FEATURE_LVM_COMPILER */
 };
 typedef struct variable variable_t;
 
@@ -306,6 +311,7 @@ lvm_reset(lvm_instance_t *p, unsigned char *code, lvm_ip_t size)
   p->end = 0;
   p->ip = 0;
   p->error = 0;
+  p->compiled = 0;
 
   memset(variables, 0, sizeof(variables));
   memset(derivations, 0, sizeof(derivations));
@@ -403,6 +409,404 @@ lvm_execute(lvm_instance_t *p)
   return status;
 }
 
+#if DB_FEATURE_LVM_COMPILER
+/*
+ * The compiler translates the prefix byte code of an instance into a
+ * flat postfix program, which is run for each row without parsing the
+ * byte code again. Variables that are bound to an attribute are loaded
+ * directly from the row, so no variable is looked up by name during the
+ * execution. A logical connective skips its second argument when the
+ * first one decides the result, unless the second argument contains a
+ * division, which may fail. A single comparison of a bound variable
+ * with a constant is run without the program.
+ */
+#ifndef LVM_STACK_SIZE
+#define LVM_STACK_SIZE			8
+#endif
+
+enum opcode {
+  OP_CONST,
+  OP_LOAD_VARIABLE,
+  OP_LOAD_INT,
+  OP_LOAD_LONG,
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_EQ,
+  OP_NEQ,
+  OP_GE,
+  OP_GEQ,
+  OP_LE,
+  OP_LEQ,
+  OP_AND,
+  OP_OR,
+  OP_NOT,
+  OP_JUMP_IF_FALSE,
+  OP_JUMP_IF_TRUE
+};
+
+struct instruction {
+  uint8_t opcode;
+  uint8_t target;
+  uint16_t offset;
+  long value;
+};
+
+static struct {
+  struct instruction code[DB_VM_PROGRAM_SIZE];
+  uint8_t length;
+  uint8_t depth;
+  uint8_t divisions;
+  /* The single comparison of a bound variable with a constant. */
+  uint8_t compare_op;
+  uint8_t compare_size;
+  uint16_t compare_offset;
+  long compare_value;
+} program;
+
+static int
+emit(uint8_t opcode, uint16_t offset, long value)
+{
+  struct instruction *instruction;
+
+  if(program.length == DB_VM_PROGRAM_SIZE) {
+    return -1;
+  }
+  instruction = &program.code[program.length];
+  instruction->opcode = opcode;
+  instruction->target = 0;
+  instruction->offset = offset;
+  instruction->value = value;
+  return program.length++;
+}
+
+/* Account for an instruction that pushes a value on the stack. */
+static lvm_status_t
+push(void)
+{
+  if(++program.depth > LVM_STACK_SIZE) {
+    return STACK_OVERFLOW;
+  }
+  return TRUE;
+}
+
+static lvm_status_t
+compile_operand(operand_t *operand)
+{
+  variable_t *var;
+
+  switch(operand->type) {
+  case LVM_LONG:
+    if(emit(OP_CONST, 0, operand->value.l) < 0) {
+      return STACK_OVERFLOW;
+    }
+    break;
+  case LVM_VARIABLE:
+    if(operand->value.id >= LVM_MAX_VARIABLE_ID - 1) {
+      return INVALID_IDENTIFIER;
+    }
+    var = &variables[operand->value.id];
+    if(emit(var->size == 4 ? OP_LOAD_LONG :
+            var->size == 2 ? OP_LOAD_INT : OP_LOAD_VARIABLE,
+            var->size == 0 ? operand->value.id : var->offset, 0) < 0) {
+      return STACK_OVERFLOW;
+    }
+    break;
+  default:
+    return TYPE_ERROR;
+  }
+  return push();
+}
+
+static lvm_status_t
+compile_expr(lvm_instance_t *p)
+{
+  operator_t operator;
+  operand_t operand;
+  lvm_status_t r;
+  int i;
+
+  switch(get_type(p)) {
+  case LVM_ARITH_OP:
+    operator = *get_operator(p);
+    for(i = 0; i < 2; i++) {
+      r = compile_expr(p);
+      if(LVM_ERROR(r)) {
+        return r;
+      }
+    }
+    if(operator < LVM_ADD || operator > LVM_DIV ||
+       emit(OP_ADD + (operator - LVM_ADD), 0, 0) < 0) {
+      return SEMANTIC_ERROR;
+    }
+    if(operator == LVM_DIV) {
+      program.divisions++;
+    }
+    program.depth--;
+    return TRUE;
+  case LVM_OPERAND:
+    get_operand(p, &operand);
+    return compile_operand(&operand);
+  default:
+    return SEMANTIC_ERROR;
+  }
+}
+
+static lvm_status_t
+compile_logic(lvm_instance_t *p)
+{
+  operator_t operator;
+  lvm_status_t r;
+  uint8_t divisions;
+  int jump;
+  int i;
+
+  if(get_type(p) != LVM_CMP_OP) {
+    return SEMANTIC_ERROR;
+  }
+  operator = *get_operator(p);
+
+  if(IS_CONNECTIVE(operator)) {
+    r = compile_logic(p);
+    if(LVM_ERROR(r)) {
+      return r;
+    }
+    if(operator == LVM_NOT) {
+      return emit(OP_NOT, 0, 0) < 0 ? STACK_OVERFLOW : TRUE;
+    }
+    if(operator != LVM_AND && operator != LVM_OR) {
+      return SEMANTIC_ERROR;
+    }
+
+    jump = emit(operator == LVM_AND ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE,
+                0, 0);
+    divisions = program.divisions;
+    r = compile_logic(p);
+    if(jump < 0 || LVM_ERROR(r) ||
+       emit(operator == LVM_AND ? OP_AND : OP_OR, 0, 0) < 0) {
+      return LVM_ERROR(r) ? r : STACK_OVERFLOW;
+    }
+    program.depth--;
+
+    /* A jump to the next instruction keeps the evaluation of both
+       arguments, so that a failing division is reported. */
+    program.code[jump].target = program.divisions == divisions ?
+      program.length : jump + 1;
+    return TRUE;
+  }
+
+  for(i = 0; i < 2; i++) {
+    r = compile_expr(p);
+    if(LVM_ERROR(r)) {
+      return r;
+    }
+  }
+  if(operator < LVM_EQ || operator > LVM_LEQ ||
+     emit(OP_EQ + (operator - LVM_EQ), 0, 0) < 0) {
+    return SEMANTIC_ERROR;
+  }
+  program.depth--;
+  return TRUE;
+}
+
+/* Mirror a comparison so that its operands can be swapped. */
+static uint8_t
+mirror(uint8_t opcode)
+{
+  switch(opcode) {
+  case OP_GE:
+    return OP_LE;
+  case OP_GEQ:
+    return OP_LEQ;
+  case OP_LE:
+    return OP_GE;
+  case OP_LEQ:
+    return OP_GEQ;
+  default:
+    return opcode;
+  }
+}
+
+static int
+compare(uint8_t opcode, long l1, long l2)
+{
+  switch(opcode) {
+  case OP_EQ:
+    return l1 == l2;
+  case OP_NEQ:
+    return l1 != l2;
+  case OP_GE:
+    return l1 > l2;
+  case OP_GEQ:
+    return l1 >= l2;
+  case OP_LE:
+    return l1 < l2;
+  default:
+    return l1 <= l2;
+  }
+}
+
+static long
+load(const unsigned char *row, uint8_t size, uint16_t offset)
+{
+  row += offset;
+  if(size == 2) {
+    return row[0] << 8 | row[1];
+  }
+  return (uint32_t)row[0] << 24 | (uint32_t)row[1] << 16 |
+         (uint32_t)row[2] << 8 | row[3];
+}
+
+lvm_status_t
+lvm_bind_variable(char *name, unsigned offset, unsigned size)
+{
+  variable_id_t id;
+
+  id = lookup(name);
+  if(id >= LVM_MAX_VARIABLE_ID - 1 || variables[id].name[0] == '\0') {
+    return INVALID_IDENTIFIER;
+  }
+  if(size != 2 && size != 4) {
+    return TYPE_ERROR;
+  }
+  variables[id].offset = offset;
+  variables[id].size = size;
+  return TRUE;
+}
+
+lvm_status_t
+lvm_compile(lvm_instance_t *p)
+{
+  struct instruction *code;
+  lvm_status_t r;
+  int variable;
+
+  p->compiled = 0;
+  memset(&program, 0, sizeof(program));
+  p->ip = 0;
+  r = compile_logic(p);
+  if(LVM_ERROR(r)) {
+    PRINTF("LVM: Failed to compile the code: %d\n", (int)r);
+    return r;
+  }
+
+  /* Check for a single comparison of a bound variable with a constant. */
+  code = program.code;
+  if(program.length == 3 && code[2].opcode >= OP_EQ &&
+     code[2].opcode <= OP_LEQ) {
+    variable = -1;
+    if((code[0].opcode == OP_LOAD_INT || code[0].opcode == OP_LOAD_LONG) &&
+       code[1].opcode == OP_CONST) {
+      variable = 0;
+      program.compare_op = code[2].opcode;
+    } else if(code[0].opcode == OP_CONST &&
+              (code[1].opcode == OP_LOAD_INT ||
+               code[1].opcode == OP_LOAD_LONG)) {
+      variable = 1;
+      program.compare_op = mirror(code[2].opcode);
+    }
+    if(variable >= 0) {
+      program.compare_size = code[variable].opcode == OP_LOAD_INT ? 2 : 4;
+      program.compare_offset = code[variable].offset;
+      program.compare_value = code[variable ^ 1].value;
+    }
+  }
+
+  PRINTF("LVM: Compiled %u instructions%s\n", (unsigned)program.length,
+         program.compare_size ? ", single comparison" : "");
+  p->compiled = 1;
+  return TRUE;
+}
+
+lvm_status_t
+lvm_execute_row(lvm_instance_t *p, const unsigned char *row)
+{
+  long stack[LVM_STACK_SIZE];
+  struct instruction *instruction, *end;
+  long *top;
+
+  if(!p->compiled) {
+    return EXECUTION_ERROR;
+  }
+
+  if(program.compare_size != 0) {
+    return compare(program.compare_op,
+                   load(row, program.compare_size, program.compare_offset),
+                   program.compare_value);
+  }
+
+  top = stack - 1;
+  instruction = program.code;
+  end = program.code + program.length;
+  while(instruction < end) {
+    switch(instruction->opcode) {
+    case OP_CONST:
+      *++top = instruction->value;
+      break;
+    case OP_LOAD_VARIABLE:
+      *++top = variables[instruction->offset].value.l;
+      break;
+    case OP_LOAD_INT:
+      *++top = load(row, 2, instruction->offset);
+      break;
+    case OP_LOAD_LONG:
+      *++top = load(row, 4, instruction->offset);
+      break;
+    case OP_ADD:
+      top--;
+      top[0] += top[1];
+      break;
+    case OP_SUB:
+      top--;
+      top[0] -= top[1];
+      break;
+    case OP_MUL:
+      top--;
+      top[0] *= top[1];
+      break;
+    case OP_DIV:
+      top--;
+      if(top[1] == 0) {
+        return MATH_ERROR;
+      }
+      top[0] /= top[1];
+      break;
+    case OP_AND:
+      top--;
+      top[0] = top[0] && top[1];
+      break;
+    case OP_OR:
+      top--;
+      top[0] = top[0] || top[1];
+      break;
+    case OP_NOT:
+      top[0] = !top[0];
+      break;
+    case OP_JUMP_IF_FALSE:
+      if(!top[0]) {
+        instruction = program.code + instruction->target;
+        continue;
+      }
+      break;
+    case OP_JUMP_IF_TRUE:
+      if(top[0]) {
+        instruction = program.code + instruction->target;
+        continue;
+      }
+      break;
+    default:
+      top--;
+      top[0] = compare(instruction->opcode, top[0], top[1]);
+      break;
+    }
+    instruction++;
+  }
+
+  return top[0] ? TRUE : FALSE;
+}
+#endif /* DB_FEATURE_LVM_COMPILER */
+
 void
 lvm_set_op(lvm_instance_t *p, operator_t op)
 {
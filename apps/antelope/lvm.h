@@ -69,6 +69,7 @@ struct lvm_instance {
   lvm_ip_t end;
   lvm_ip_t ip;
   unsigned error;
+  unsigned char compiled;
 };
 typedef struct lvm_instance lvm_instance_t;
 
@@ -128,6 +129,11 @@ lvm_status_t lvm_get_derived_range(lvm_instance_t *p, char *name,
                                    operand_value_t *max);
 void lvm_print_derivations(lvm_instance_t *p);
 lvm_status_t lvm_execute(lvm_instance_t *p);
+#if DB_FEATURE_LVM_COMPILER
+lvm_status_t lvm_bind_variable(char *name, unsigned offset, unsigned size);
+lvm_status_t lvm_compile(lvm_instance_t *p);
+lvm_status_t lvm_execute_row(lvm_instance_t *p, const unsigned char *row);
+#endif /* DB_FEATURE_LVM_COMPILER */
 lvm_status_t lvm_register_variable(char *name, operand_type_t type);
 lvm_status_t lvm_set_variable_value(char *name, operand_value_t value);
 void lvm_print_code(lvm_instance_t *p);
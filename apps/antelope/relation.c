@@ -35,6 +35,7 @@
  */
 
 #include <limits.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "lib/crc16.h"
@@ -81,6 +82,16 @@ struct source_map {
 static struct source_map source_map[AQL_ATTRIBUTE_LIMIT];
 #endif /* DB_FEATURE_JOIN */
 
+#if DB_FEATURE_EXPLAIN
+#define PLAN_INDEX_STEP(handle)		((handle)->plan.index_steps++)
+/* A query that is explained without ANALYZE is planned, but not run. */
+#define PLAN_ONLY(handle)						\
+  ((AQL_GET_FLAGS((aql_adt_t *)(handle)->adt) &				\
+    (AQL_FLAG_EXPLAIN | AQL_FLAG_ANALYZE)) == AQL_FLAG_EXPLAIN)
+#else
+#define PLAN_INDEX_STEP(handle)
+#endif /* DB_FEATURE_EXPLAIN */
+
 static unsigned char row[DB_MAX_ATTRIBUTES_PER_RELATION * DB_MAX_ELEMENT_SIZE];
 static unsigned char extra_row[DB_MAX_ATTRIBUTES_PER_RELATION * DB_MAX_ELEMENT_SIZE];
 static unsigned char result_row[AQL_ATTRIBUTE_LIMIT * DB_MAX_ELEMENT_SIZE];
@@ -472,11 +483,11 @@ relation_remove(char *name, int remove_tuples)
   return result;
 }
 
-db_result_t
-relation_insert(relation_t *rel, attribute_value_t *values)
+/* Convert the values of a row into its physical representation. */
+static db_result_t
+encode_row(relation_t *rel, attribute_value_t *values, unsigned char *record)
 {
   attribute_t *attr;
-  unsigned char record[rel->row_length];
   unsigned char *ptr;
   attribute_value_t *value;
   db_result_t result;
@@ -533,22 +544,120 @@ relation_insert(relation_t *rel, attribute_value_t *values)
 #endif /* DEBUG */
 
     ptr += attr->element_size;
-    if(attr->index != NULL) {
-      if(DB_ERROR(index_insert(attr->index, value, rel->next_row))) {
-        return DB_INDEX_ERROR;
-      }
-    }
   }
 
   PRINTF(")\n");
 
+  return DB_OK;
+}
+
+db_result_t
+relation_insert(relation_t *rel, attribute_value_t *values)
+{
+  attribute_t *attr;
+  unsigned char record[rel->row_length];
+  attribute_value_t *value;
+  db_result_t result;
+
+  result = encode_row(rel, values, record);
+  if(DB_ERROR(result)) {
+    return result;
+  }
+
+  for(attr = list_head(rel->attributes), value = values;
+      attr != NULL;
+      attr = attr->next, value++) {
+    if(attr->index != NULL &&
+       DB_ERROR(index_insert(attr->index, value, rel->next_row))) {
+      return DB_INDEX_ERROR;
+    }
+  }
+
   rel->cardinality++;
   rel->next_row++;
   return storage_put_row(rel, record);
 }
 
+#if DB_FEATURE_BULK_INSERT
+/*
+ * Bulk insertion. The rows of a batch are encoded into a buffer that is
+ * appended to the relation with a single write. The indexes are built
+ * after all rows of the batch have been stored, with one pass over the
+ * batch per index, in which the index sorts the keys into the order in
+ * which it inserts them with the least work.
+ */
+static unsigned char bulk_rows[DB_BULK_INSERT_SIZE];
+
+/*
+ * Insert a batch of rows, whose values are given row after row. If
+ * storing a buffer fails, the rows of the previous buffers remain in
+ * the relation and are indexed before the error is returned.
+ */
+db_result_t
+relation_insert_rows(relation_t *rel, attribute_value_t *values,
+                     unsigned count)
+{
+  attribute_t *attr;
+  attribute_value_t *keys;
+  unsigned buffer_rows;
+  unsigned rows;
+  unsigned stored;
+  unsigned i;
+  tuple_id_t first_row;
+  db_result_t result;
+  db_result_t index_result;
+
+  buffer_rows = sizeof(bulk_rows) / rel->row_length;
+  if(buffer_rows == 0) {
+    return DB_LIMIT_ERROR;
+  }
+
+  first_row = rel->next_row;
+  result = DB_OK;
+  for(stored = 0; stored < count; stored += rows) {
+    rows = count - stored < buffer_rows ? count - stored : buffer_rows;
+    for(i = 0; i < rows; i++) {
+      result = encode_row(rel,
+                          values + (stored + i) * rel->attribute_count,
+                          bulk_rows + i * rel->row_length);
+      if(DB_ERROR(result)) {
+        break;
+      }
+    }
+    if(!DB_ERROR(result)) {
+      result = storage_put_rows(rel, bulk_rows, rows);
+    }
+    if(DB_ERROR(result)) {
+      break;
+    }
+    rel->cardinality += rows;
+    rel->next_row += rows;
+  }
+
+  if(stored == 0) {
+    return result;
+  }
+
+  for(attr = list_head(rel->attributes), keys = values;
+      attr != NULL;
+      attr = attr->next, keys++) {
+    if(attr->index != NULL) {
+      index_result = index_insert_rows(attr->index, keys,
+                                       rel->attribute_count, first_row,
+                                       stored);
+      if(DB_ERROR(index_result)) {
+        return DB_INDEX_ERROR;
+      }
+    }
+  }
+
+  return result;
+}
+#endif /* DB_FEATURE_BULK_INSERT */
+
 static void
-aggregate(attribute_t *attr, attribute_value_t *value)
+aggregate(aql_aggregator_t aggregator, long *aggregation_value,
+          attribute_value_t *value)
 {
   long long_value;
 
@@ -563,25 +672,25 @@ aggregate(attribute_t *attr, attribute_value_t *value)
     return;
   }
 
-  switch(attr->aggregator) {
+  switch(aggregator) {
   case AQL_COUNT:
-    attr->aggregation_value++;
+    (*aggregation_value)++;
     break;
   case AQL_SUM:
-    attr->aggregation_value += long_value;
+    *aggregation_value += long_value;
     break;
   case AQL_MEAN:
     break;
   case AQL_MEDIAN:
     break;
   case AQL_MAX:
-    if(long_value > attr->aggregation_value) {
-      attr->aggregation_value = long_value;
+    if(long_value > *aggregation_value) {
+      *aggregation_value = long_value;
     }
     break;
   case AQL_MIN:
-    if(long_value < attr->aggregation_value) {
-      attr->aggregation_value = long_value;
+    if(long_value < *aggregation_value) {
+      *aggregation_value = long_value;
     }
     break;
   default:
@@ -654,6 +763,7 @@ select_index(db_handle_t *handle, lvm_instance_t *lvm_instance)
              attr->name, range + 1);
 
       if(range <= min_range) {
+        min_range = range;
         index = attr->index;
         av_min.domain = av_max.domain = DOMAIN_INT;
         VALUE_LONG(&av_min) = min.l;
@@ -667,8 +777,66 @@ select_index(db_handle_t *handle, lvm_instance_t *lvm_instance)
     if(index_get_iterator(&handle->index_iterator, index, 
                           &av_min, &av_max) == DB_OK) {
       handle->flags |= DB_HANDLE_FLAG_SEARCH_INDEX;
+#if DB_FEATURE_EXPLAIN
+      handle->plan.access = DB_PLAN_INDEX;
+      handle->plan.index_type = index->type;
+      strcpy(handle->plan.index_attribute, index->attr->name);
+#endif /* DB_FEATURE_EXPLAIN */
+    }
+  }
+}
+
+#if DB_FEATURE_EXPLAIN
+/* Record the ranges of the attribute values that the condition admits. */
+static void
+plan_ranges(db_handle_t *handle, lvm_instance_t *lvm_instance)
+{
+  struct db_plan_range *range;
+  attribute_t *attr;
+  operand_value_t min;
+  operand_value_t max;
+
+  range = handle->plan.ranges;
+  for(attr = list_head(handle->rel->attributes);
+      attr != NULL && range < handle->plan.ranges + AQL_ATTRIBUTE_LIMIT;
+      attr = attr->next) {
+    if(!LVM_ERROR(lvm_get_derived_range(lvm_instance, attr->name,
+                                        &min, &max))) {
+      strcpy(range->name, attr->name);
+      range->min = min.l;
+      range->max = max.l;
+      range++;
+    }
+  }
+  handle->plan.range_count = range - handle->plan.ranges;
+}
+#endif /* DB_FEATURE_EXPLAIN */
+
+/* Let the scan read only the attributes that the query uses, and skip
+   the rows outside the ranges derived from the condition. */
+static void
+restrict_scan(db_handle_t *handle, lvm_instance_t *lvm_instance)
+{
+  attribute_t *attr;
+  attribute_id_t i;
+  unsigned columns;
+  operand_value_t min;
+  operand_value_t max;
+
+  columns = 0;
+  for(attr = list_head(handle->rel->attributes), i = 0;
+      attr != NULL;
+      attr = attr->next, i++) {
+    if(relation_attribute_get(handle->result_rel, attr->name) != NULL) {
+      columns |= 1 << i;
+    }
+    if(lvm_instance != NULL &&
+       !LVM_ERROR(lvm_get_derived_range(lvm_instance, attr->name,
+                                        &min, &max))) {
+      storage_scan_range(&handle->scan, i, min.l, max.l);
     }
   }
+  storage_scan_columns(&handle->scan, columns);
 }
 
 static db_result_t
@@ -677,6 +845,10 @@ generate_selection_result(db_handle_t *handle, relation_t *rel, aql_adt_t *adt)
   relation_t *result_rel;
   unsigned attribute_count;
   attribute_t *attr;
+  lvm_instance_t *derived;
+#if DB_FEATURE_LVM_COMPILER
+  unsigned i;
+#endif /* DB_FEATURE_LVM_COMPILER */
 
   result_rel = handle->result_rel;
 
@@ -696,11 +868,39 @@ generate_selection_result(db_handle_t *handle, relation_t *rel, aql_adt_t *adt)
     return DB_IMPLEMENTATION_ERROR;
   }
 
-  if(adt->lvm_instance != NULL) {
+  derived = NULL;
+  /* The derived ranges hold the rows that satisfy the condition, so
+     they cannot narrow a search for the rows that do not, as in a
+     removal. */
+  if(adt->lvm_instance != NULL &&
+     !(AQL_GET_FLAGS(adt) & AQL_FLAG_INVERSE_LOGIC)) {
     /* Try to establish acceptable ranges for the attribute values. */
     if(!LVM_ERROR(lvm_derive(adt->lvm_instance))) {
-      select_index(handle, adt->lvm_instance);
+      derived = adt->lvm_instance;
+#if DB_FEATURE_EXPLAIN
+      plan_ranges(handle, derived);
+#endif /* DB_FEATURE_EXPLAIN */
+      select_index(handle, derived);
+    }
+#if DB_FEATURE_LVM_COMPILER
+    /* Let the predicate read the attribute values directly from the
+       rows. If the compilation fails, the byte code is interpreted. */
+    for(i = 0; i < attribute_count; i++) {
+      attr = attr_map[i].to_attr;
+      if(attr->domain == DOMAIN_INT || attr->domain == DOMAIN_LONG) {
+        lvm_bind_variable(attr->name, attr_map[i].from_offset,
+                          attr->domain == DOMAIN_INT ? 2 : 4);
+      }
+    }
+    lvm_compile(adt->lvm_instance);
+#endif /* DB_FEATURE_LVM_COMPILER */
+  }
+
+  if(!(handle->flags & DB_HANDLE_FLAG_SEARCH_INDEX)) {
+    if(DB_ERROR(storage_scan_init(&handle->scan, rel))) {
+      return DB_STORAGE_ERROR;
     }
+    restrict_scan(handle, derived);
   }
 
   handle->flags |= DB_HANDLE_FLAG_PROCESSING;
@@ -731,328 +931,1708 @@ relation_process_remove(void *handle_ptr)
 }
 #endif
 
-db_result_t
-relation_process_select(void *handle_ptr)
+#if DB_FEATURE_GROUP
+/*
+ * Grouped aggregation. The groups are kept in a hash table in the
+ * group memory, which holds a key and one accumulator per aggregated
+ * attribute for each group. When the rows are sorted on the group
+ * attribute through an inline index, only the current group is kept,
+ * and each group is returned as soon as a row of the next group is
+ * read. Otherwise, the groups are returned after a pass over the
+ * relation. The rows of groups that do not fit in the table are
+ * spilled to a file, which is aggregated in another pass.
+ */
+#define GROUP_PHASE_INPUT	0
+#define GROUP_PHASE_SPILL	1
+#define GROUP_PHASE_EMIT	2
+#define GROUP_PHASE_DONE	3
+
+#define GROUP_END		0xffff
+#define GROUP_NO_VALUE		0xff
+
+/* A table entry is followed by the accumulators and the key. */
+struct group_entry {
+  tuple_id_t rows;
+  uint16_t next;
+};
+
+static struct {
+  storage_scan_t scan;
+  void *owner;
+  tuple_id_t spill_rows[2];
+  tuple_id_t input_rows;
+  tuple_id_t read_rows;
+  uint16_t capacity;
+  uint16_t used;
+  uint16_t emitted;
+  uint16_t spill_capacity;
+  uint16_t spill_fill;
+  unsigned entry_size;
+  unsigned key_length;
+  uint8_t phase;
+  uint8_t pass;
+  uint8_t sorted;
+  uint8_t files;
+  uint8_t scan_open;
+  uint8_t key_offset[AQL_ATTRIBUTE_LIMIT];
+  uint8_t value_index[AQL_ATTRIBUTE_LIMIT];
+} group;
+
+static long group_memory[DB_GROUP_MEMORY_SIZE / sizeof(long)];
+
+#define GROUP_ALIGN(size)	(((size) + sizeof(long) - 1) & ~(sizeof(long) - 1))
+#define GROUP_BUCKETS	((uint16_t *)group_memory)
+#define GROUP_ENTRY(i)							\
+  ((struct group_entry *)((unsigned char *)group_memory +		\
+    GROUP_ALIGN(group.capacity * sizeof(uint16_t)) + (i) * group.entry_size))
+#define GROUP_VALUES(entry)						\
+  ((long *)((unsigned char *)(entry) + GROUP_ALIGN(sizeof(struct group_entry))))
+#define GROUP_KEY(entry)						\
+  ((unsigned char *)(entry) + group.entry_size - GROUP_ALIGN(group.key_length))
+#define GROUP_SPILL_BUFFER						\
+  ((unsigned char *)group_memory + sizeof(group_memory) -		\
+   group.spill_capacity * handle->rel->row_length)
+
+static void
+spill_name(char *name, unsigned file)
 {
-  db_handle_t *handle;
-  aql_adt_t *adt;
-  db_result_t result;
-  unsigned attribute_count;
-  struct source_dest_map *attr_map_ptr, *attr_map_end;
-  attribute_t *result_attr;
-  unsigned char *from_ptr;
-  unsigned char *to_ptr;
-  operand_value_t operand_value;
-  uint8_t intbuf[2];
-  attribute_value_t value;
-  lvm_status_t wanted_result;
+  snprintf(name, DB_MAX_FILENAME_LENGTH, "%s.%u", GROUP_SPILL_FILE, file);
+}
 
-  handle = (db_handle_t *)handle_ptr;
-  adt = (aql_adt_t *)handle->adt;
+static void
+group_cleanup(void)
+{
+  char name[DB_MAX_FILENAME_LENGTH];
+  unsigned i;
 
-  attribute_count = handle->result_rel->attribute_count;
-  attr_map_end = attr_map + attribute_count;
+  if(group.scan_open) {
+    storage_scan_close(&group.scan);
+    group.scan_open = 0;
+  }
+  for(i = 0; i < 2; i++) {
+    if(group.files & (1 << i)) {
+      spill_name(name, i);
+      storage_remove_file(name);
+    }
+  }
+  group.files = 0;
+  group.phase = GROUP_PHASE_DONE;
+  group.owner = NULL;
+}
 
-  if(handle->flags & DB_HANDLE_FLAG_SEARCH_INDEX) {
-    handle->tuple_id = index_get_next(&handle->index_iterator);
-    if(handle->tuple_id == INVALID_TUPLE) {
-      PRINTF("DB: An attribute value could not be found in the index\n");
-      if(handle->index_iterator.next_item_no == 0) {
-        return DB_INDEX_ERROR;
-      }
+static void
+group_reset(void)
+{
+  unsigned i;
 
-      if(adt->flags & AQL_FLAG_AGGREGATE) {
-        goto end_aggregation;
-      }
+  for(i = 0; i < group.capacity; i++) {
+    GROUP_BUCKETS[i] = GROUP_END;
+  }
+  group.used = 0;
+  group.read_rows = 0;
+}
 
-      return DB_FINISHED;
+static db_result_t
+group_init(db_handle_t *handle)
+{
+  struct source_dest_map *attr_map_ptr, *attr_map_end;
+  attribute_t *group_attr;
+  unsigned group_attributes;
+  unsigned aggregates;
+  unsigned available;
+  unsigned row_length;
+  int i;
+
+  /* Close the scan and remove the spill files of a grouping that was
+     neither finished nor freed. */
+  group_cleanup();
+
+  memset(group.key_offset, GROUP_NO_VALUE, sizeof(group.key_offset));
+  memset(group.value_index, GROUP_NO_VALUE, sizeof(group.value_index));
+
+  attr_map_end = attr_map + handle->result_rel->attribute_count;
+  group_attr = NULL;
+  group_attributes = aggregates = 0;
+  group.key_length = 0;
+  for(i = 0, attr_map_ptr = attr_map; attr_map_ptr < attr_map_end;
+      i++, attr_map_ptr++) {
+    if(attr_map_ptr->to_attr->flags & ATTRIBUTE_FLAG_GROUP) {
+      group.key_offset[i] = group.key_length;
+      group.key_length += attr_map_ptr->from_attr->element_size;
+      group_attr = attr_map_ptr->from_attr;
+      group_attributes++;
+    } else if(attr_map_ptr->to_attr->aggregator != AQL_NONE) {
+      group.value_index[i] = aggregates++;
     }
   }
 
-  /* Put the tuples fulfilling the given condition into a new relation.
-     The tuples may be projected. */
-  result = storage_get_row(handle->rel, &handle->tuple_id, row);
-  handle->tuple_id++;
-  if(DB_ERROR(result)) {
-    PRINTF("DB: Failed to get a row in relation %s!\n", handle->rel->name);
-    return result;
-  } else if(result == DB_FINISHED) {
-    if(AQL_GET_FLAGS(adt) & AQL_FLAG_AGGREGATE) {
-      goto end_aggregation;
+  group.entry_size = GROUP_ALIGN(sizeof(struct group_entry)) +
+                     aggregates * sizeof(long) +
+                     GROUP_ALIGN(group.key_length);
+
+  /* The rows come in the order of the group attribute if it is the
+     only one, and the relation is sorted on it through an inline
+     index. */
+  group.sorted = group_attributes == 1 && group_attr->index != NULL &&
+    ((index_t *)group_attr->index)->type == INDEX_INLINE &&
+    (!(handle->flags & DB_HANDLE_FLAG_SEARCH_INDEX) ||
+     handle->index_iterator.index == group_attr->index);
+
+  group.input_rows = relation_cardinality(handle->rel);
+  row_length = handle->rel->row_length;
+  available = sizeof(group_memory) - sizeof(long);
+  group.spill_capacity = 0;
+  if(!group.sorted &&
+     group.input_rows > available / (group.entry_size + sizeof(uint16_t))) {
+    /* The groups might not fit, so keep a quarter of the memory as a
+       write buffer for the spilled rows. */
+    group.spill_capacity = sizeof(group_memory) / 4 / row_length;
+    if(group.spill_capacity == 0) {
+      group.spill_capacity = 1;
     }
-    return DB_FINISHED;
+    if(group.spill_capacity * row_length > available) {
+      return DB_LIMIT_ERROR;
+    }
+    available -= group.spill_capacity * row_length;
   }
 
-  /* Process the attributes in the result relation. */
-  for(attr_map_ptr = attr_map; attr_map_ptr < attr_map_end; attr_map_ptr++) {
-    from_ptr = row + attr_map_ptr->from_offset;
-    result_attr = attr_map_ptr->to_attr;
+  group.capacity = available / (group.entry_size + sizeof(uint16_t));
+  if(group.capacity == 0) {
+    PRINTF("DB: The group memory cannot hold a group\n");
+    return DB_LIMIT_ERROR;
+  }
+  if(group.capacity >= GROUP_END) {
+    group.capacity = GROUP_END - 1;
+  }
 
-    /* Update the internal state of the PLE. */
-    if(result_attr->domain == DOMAIN_INT) {
-      operand_value.l = from_ptr[0] << 8 | from_ptr[1];
-      lvm_set_variable_value(result_attr->name, operand_value);
-    } else if(result_attr->domain == DOMAIN_LONG) {
-      operand_value.l = (uint32_t)from_ptr[0] << 24 |
-                        (uint32_t)from_ptr[1] << 16 |
-                        (uint32_t)from_ptr[2] << 8 |
-                        from_ptr[3];
-      lvm_set_variable_value(result_attr->name, operand_value);
-    }
+  PRINTF("DB: Grouping with %u groups per pass%s\n", group.capacity,
+         group.sorted ? " on sorted rows" : "");
 
-    if(result_attr->flags & ATTRIBUTE_FLAG_NO_STORE) {
-      /* The attribute is used just for the predicate,
-         so do not copy the current value into the result. */
+  group.owner = handle;
+  group.pass = 0;
+  group.spill_fill = 0;
+  group.spill_rows[0] = group.spill_rows[1] = 0;
+  group.phase = GROUP_PHASE_INPUT;
+  group_reset();
+
+  return DB_OK;
+}
+
+static uint16_t
+group_hash(unsigned char *key)
+{
+  uint32_t hash;
+  unsigned i;
+
+  hash = 2166136261UL;
+  for(i = 0; i < group.key_length; i++) {
+    hash = (hash ^ key[i]) * 16777619UL;
+  }
+  return (hash ^ (hash >> 16)) % group.capacity;
+}
+
+static struct group_entry *
+group_new(unsigned char *key, uint16_t bucket)
+{
+  struct group_entry *entry;
+  struct source_dest_map *attr_map_ptr;
+  long *values;
+  unsigned i;
+
+  entry = GROUP_ENTRY(group.used);
+  entry->rows = 0;
+  if(!group.sorted) {
+    entry->next = GROUP_BUCKETS[bucket];
+    GROUP_BUCKETS[bucket] = group.used;
+  }
+  group.used++;
+
+  values = GROUP_VALUES(entry);
+  for(i = 0, attr_map_ptr = attr_map; i < AQL_ATTRIBUTE_LIMIT;
+      i++, attr_map_ptr++) {
+    if(group.value_index[i] == GROUP_NO_VALUE) {
       continue;
     }
-
-    if(!(AQL_GET_FLAGS(adt) & AQL_FLAG_AGGREGATE)) {
-      /* No aggregators. Copy the original value into the resulting tuple. */
-      memcpy(result_row + attr_map_ptr->to_offset, from_ptr,
-             result_attr->element_size);
+    switch(attr_map_ptr->to_attr->aggregator) {
+    case AQL_MAX:
+      values[group.value_index[i]] = LONG_MIN;
+      break;
+    case AQL_MIN:
+      values[group.value_index[i]] = LONG_MAX;
+      break;
+    default:
+      values[group.value_index[i]] = 0;
+      break;
     }
   }
+  memcpy(GROUP_KEY(entry), key, group.key_length);
 
-  wanted_result = TRUE;
-  if(AQL_GET_FLAGS(adt) & AQL_FLAG_INVERSE_LOGIC) {
-    wanted_result = FALSE;
-  }
+  return entry;
+}
 
-  /* Check whether the given predicate is true for this tuple. */
-  if(adt->lvm_instance == NULL ||
-     lvm_execute(adt->lvm_instance) == wanted_result) {
-    if(AQL_GET_FLAGS(adt) & AQL_FLAG_AGGREGATE) {
-      for(attr_map_ptr = attr_map; attr_map_ptr < attr_map_end; attr_map_ptr++) {
-        from_ptr = row + attr_map_ptr->from_offset;
-        result = db_phy_to_value(&value, attr_map_ptr->to_attr, from_ptr);
-        if(DB_ERROR(result)) {
-	  return result;
-        }
-        aggregate(attr_map_ptr->to_attr, &value);
-      }
-    } else {
-      if(AQL_GET_FLAGS(adt) & AQL_FLAG_ASSIGN) {
-        if(DB_ERROR(storage_put_row(handle->result_rel, result_row))) {
-          PRINTF("DB: Failed to store a row in the result relation!\n");
-          return DB_STORAGE_ERROR;
-        }
-      }
-      handle->current_row++;
-      return DB_GOT_ROW;
+static db_result_t
+group_update(struct group_entry *entry, unsigned char *row_ptr,
+             unsigned attribute_count)
+{
+  struct source_dest_map *attr_map_ptr;
+  attribute_value_t value;
+  aql_aggregator_t aggregator;
+  long *values;
+  unsigned i;
+
+  entry->rows++;
+  values = GROUP_VALUES(entry);
+  for(i = 0, attr_map_ptr = attr_map; i < attribute_count;
+      i++, attr_map_ptr++) {
+    if(group.value_index[i] == GROUP_NO_VALUE) {
+      continue;
+    }
+    if(DB_ERROR(db_phy_to_value(&value, attr_map_ptr->from_attr,
+                                row_ptr + attr_map_ptr->from_offset))) {
+      return DB_TYPE_ERROR;
     }
+    /* The mean is computed from the sum when the group is returned. */
+    aggregator = attr_map_ptr->to_attr->aggregator;
+    aggregate(aggregator == AQL_MEAN ? AQL_SUM : aggregator,
+              &values[group.value_index[i]], &value);
   }
 
   return DB_OK;
+}
 
-end_aggregation:
-  /* Generate aggregated result if requested. */
-  for(attr_map_ptr = attr_map; attr_map_ptr < attr_map_end; attr_map_ptr++) {
+static db_result_t
+group_emit(db_handle_t *handle, struct group_entry *entry)
+{
+  struct source_dest_map *attr_map_ptr, *attr_map_end;
+  attribute_t *result_attr;
+  attribute_value_t value;
+  long aggregation_value;
+  unsigned i;
+
+  attr_map_end = attr_map + handle->result_rel->attribute_count;
+  for(i = 0, attr_map_ptr = attr_map; attr_map_ptr < attr_map_end;
+      i++, attr_map_ptr++) {
     result_attr = attr_map_ptr->to_attr;
-    to_ptr = result_row + attr_map_ptr->to_offset;
+    if(result_attr->flags & ATTRIBUTE_FLAG_NO_STORE) {
+      continue;
+    }
 
-    intbuf[0] = result_attr->aggregation_value >> 8;
-    intbuf[1] = result_attr->aggregation_value & 0xff;
-    from_ptr = intbuf;
-    memcpy(to_ptr, from_ptr, result_attr->element_size);
+    if(group.key_offset[i] != GROUP_NO_VALUE) {
+      memcpy(result_row + attr_map_ptr->to_offset,
+             GROUP_KEY(entry) + group.key_offset[i],
+             result_attr->element_size);
+    } else {
+      aggregation_value = GROUP_VALUES(entry)[group.value_index[i]];
+      if(result_attr->aggregator == AQL_MEAN) {
+        aggregation_value /= (long)entry->rows;
+      }
+      value.domain = DOMAIN_INT;
+      VALUE_INT(&value) = aggregation_value;
+      db_value_to_phy(result_row + attr_map_ptr->to_offset, result_attr,
+                      &value);
+    }
   }
 
-  if(AQL_GET_FLAGS(adt) & AQL_FLAG_ASSIGN) {
+  if(AQL_GET_FLAGS((aql_adt_t *)handle->adt) & AQL_FLAG_ASSIGN) {
     if(DB_ERROR(storage_put_row(handle->result_rel, result_row))) {
       PRINTF("DB: Failed to store a row in the result relation!\n");
       return DB_STORAGE_ERROR;
     }
   }
 
-  handle->current_row = 1;
-  AQL_GET_FLAGS(adt) &= ~AQL_FLAG_AGGREGATE; /* Stop the aggregation. */
-
+  handle->current_row++;
   return DB_GOT_ROW;
 }
 
-db_result_t
-relation_select(void *handle_ptr, relation_t *rel, void *adt_ptr)
+static db_result_t
+flush_spill(db_handle_t *handle)
 {
-  aql_adt_t *adt;
-  db_handle_t *handle;
-  char *name;
-  db_direction_t dir;
+  char name[DB_MAX_FILENAME_LENGTH];
+  unsigned file;
+  db_result_t result;
+
+  file = group.pass & 1;
+  spill_name(name, file);
+  result = storage_append_rows(name, handle->rel->row_length,
+                               group.spill_rows[file], GROUP_SPILL_BUFFER,
+                               group.spill_fill);
+  group.spill_rows[file] += group.spill_fill;
+  group.spill_fill = 0;
+
+  return result;
+}
+
+static db_result_t
+spill_row(db_handle_t *handle, unsigned char *row_ptr)
+{
+  char name[DB_MAX_FILENAME_LENGTH];
+  unsigned file;
+  unsigned long size;
+
+  file = group.pass & 1;
+  if(!(group.files & (1 << file))) {
+    /* The remaining rows of this pass are an upper bound of the
+       spilled rows. */
+    spill_name(name, file);
+    storage_remove_file(name);
+    size = (unsigned long)(group.input_rows - group.read_rows + 1) *
+           handle->rel->row_length;
+    if(DB_ERROR(storage_create_file(name, size))) {
+      return DB_STORAGE_ERROR;
+    }
+    group.files |= 1 << file;
+  }
+
+  memcpy(GROUP_SPILL_BUFFER + group.spill_fill * handle->rel->row_length,
+         row_ptr, handle->rel->row_length);
+  if(++group.spill_fill == group.spill_capacity) {
+    return flush_spill(handle);
+  }
+  return DB_OK;
+}
+
+/* Add a row that fulfills the condition of the query to its group. */
+static db_result_t
+group_add_row(db_handle_t *handle, unsigned char *row_ptr)
+{
+  struct source_dest_map *attr_map_ptr;
+  struct group_entry *entry;
+  unsigned char *key;
+  unsigned attribute_count;
+  uint16_t bucket;
+  uint16_t i;
+  db_result_t result;
+
+  attribute_count = handle->result_rel->attribute_count;
+
+  key = extra_row;
+  for(i = 0, attr_map_ptr = attr_map; i < attribute_count;
+      i++, attr_map_ptr++) {
+    if(group.key_offset[i] != GROUP_NO_VALUE) {
+      memcpy(key + group.key_offset[i], row_ptr + attr_map_ptr->from_offset,
+             attr_map_ptr->from_attr->element_size);
+    }
+  }
+  group.read_rows++;
+
+  if(group.sorted) {
+    entry = GROUP_ENTRY(0);
+    if(group.used > 0 && memcmp(GROUP_KEY(entry), key, group.key_length) == 0) {
+      return group_update(entry, row_ptr, attribute_count);
+    }
+
+    /* The row starts a new group, so the previous one is complete. */
+    result = DB_OK;
+    if(group.used > 0) {
+      result = group_emit(handle, entry);
+      if(DB_ERROR(result)) {
+        return result;
+      }
+      group.used = 0;
+    }
+    entry = group_new(key, 0);
+    if(DB_ERROR(group_update(entry, row_ptr, attribute_count))) {
+      return DB_TYPE_ERROR;
+    }
+    return result;
+  }
+
+  bucket = group_hash(key);
+  for(i = GROUP_BUCKETS[bucket]; i != GROUP_END; i = entry->next) {
+    entry = GROUP_ENTRY(i);
+    if(memcmp(GROUP_KEY(entry), key, group.key_length) == 0) {
+      return group_update(entry, row_ptr, attribute_count);
+    }
+  }
+
+  if(group.used == group.capacity) {
+    return spill_row(handle, row_ptr);
+  }
+
+  return group_update(group_new(key, bucket), row_ptr, attribute_count);
+}
+
+/* Called when all the rows of the current pass have been read. */
+static db_result_t
+group_input_finished(db_handle_t *handle)
+{
+  if(group.spill_fill > 0 && DB_ERROR(flush_spill(handle))) {
+    group_cleanup();
+    return DB_STORAGE_ERROR;
+  }
+
+  if(group.sorted) {
+    group_cleanup();
+    if(group.used > 0) {
+      group.used = 0;
+      return group_emit(handle, GROUP_ENTRY(0));
+    }
+    return DB_FINISHED;
+  }
+
+  PRINTF("DB: Pass %u found %u groups and spilled %lu rows\n",
+         group.pass, group.used,
+         (unsigned long)group.spill_rows[group.pass & 1]);
+
+  group.phase = GROUP_PHASE_EMIT;
+  group.emitted = 0;
+  return DB_OK;
+}
+
+static db_result_t
+group_next_pass(db_handle_t *handle)
+{
+  char name[DB_MAX_FILENAME_LENGTH];
+  unsigned file;
+
+  /* The spilled rows of this pass are the input of the next one. */
+  file = group.pass & 1;
+  if(group.scan_open) {
+    storage_scan_close(&group.scan);
+    group.scan_open = 0;
+    spill_name(name, file ^ 1);
+    storage_remove_file(name);
+    group.files &= ~(1 << (file ^ 1));
+  }
+
+  spill_name(name, file);
+  if(DB_ERROR(storage_scan_open(&group.scan, name, handle->rel->row_length,
+                                group.spill_rows[file]))) {
+    group_cleanup();
+    return DB_STORAGE_ERROR;
+  }
+  group.scan_open = 1;
+
+  group.input_rows = group.spill_rows[file];
+  group.spill_rows[file ^ 1] = 0;
+  group.pass++;
+  group.phase = GROUP_PHASE_SPILL;
+  group_reset();
+
+  return DB_OK;
+}
+
+static db_result_t
+process_group(db_handle_t *handle)
+{
+  tuple_id_t tuple_id;
+  storage_row_t row_ptr;
+  db_result_t result;
+
+  switch(group.phase) {
+  case GROUP_PHASE_SPILL:
+    do {
+      result = storage_scan_next(&group.scan, &tuple_id, &row_ptr);
+      if(DB_ERROR(result)) {
+        group_cleanup();
+        return result;
+      } else if(result == DB_FINISHED) {
+        return group_input_finished(handle);
+      }
+      handle->processed_rows++;
+
+      result = group_add_row(handle, row_ptr);
+      if(result != DB_OK) {
+        if(DB_ERROR(result)) {
+          group_cleanup();
+        }
+        return result;
+      }
+    } while(STORAGE_SCAN_BUFFERED(&group.scan) > 0);
+    return DB_OK;
+  case GROUP_PHASE_EMIT:
+    if(group.emitted < group.used) {
+      return group_emit(handle, GROUP_ENTRY(group.emitted++));
+    }
+    if(group.spill_rows[group.pass & 1] > 0) {
+      return group_next_pass(handle);
+    }
+    group_cleanup();
+    return DB_FINISHED;
+  default:
+    group_cleanup();
+    return DB_FINISHED;
+  }
+}
+
+/* Close the scan and remove the spill files of a grouping that is
+   freed before it has finished. */
+void
+relation_free_group(void *handle_ptr)
+{
+  if(group.owner == handle_ptr) {
+    group_cleanup();
+  }
+}
+#endif /* DB_FEATURE_GROUP */
+
+static db_result_t
+process_row(db_handle_t *handle, aql_adt_t *adt, unsigned char *row_ptr)
+{
+  struct source_dest_map *attr_map_ptr, *attr_map_end;
+  attribute_t *result_attr;
+  unsigned char *from_ptr;
+  operand_value_t operand_value;
+  attribute_value_t value;
+  lvm_status_t wanted_result;
+  lvm_status_t lvm_result;
+  db_result_t result;
+  int compiled;
+
+  attr_map_end = attr_map + handle->result_rel->attribute_count;
+  compiled = 0;
+#if DB_FEATURE_LVM_COMPILER
+  compiled = adt->lvm_instance != NULL &&
+             ((lvm_instance_t *)adt->lvm_instance)->compiled;
+#endif /* DB_FEATURE_LVM_COMPILER */
+
+  /* Process the attributes in the result relation. */
+  for(attr_map_ptr = attr_map; attr_map_ptr < attr_map_end; attr_map_ptr++) {
+    from_ptr = row_ptr + attr_map_ptr->from_offset;
+    result_attr = attr_map_ptr->to_attr;
+
+    /* Update the internal state of the PLE. */
+    if(compiled) {
+      /* The compiled predicate reads the values from the row. */
+    } else if(result_attr->domain == DOMAIN_INT) {
+      operand_value.l = from_ptr[0] << 8 | from_ptr[1];
+      lvm_set_variable_value(result_attr->name, operand_value);
+    } else if(result_attr->domain == DOMAIN_LONG) {
+      operand_value.l = (uint32_t)from_ptr[0] << 24 |
+                        (uint32_t)from_ptr[1] << 16 |
+                        (uint32_t)from_ptr[2] << 8 |
+                        from_ptr[3];
+      lvm_set_variable_value(result_attr->name, operand_value);
+    }
+
+    if(result_attr->flags & ATTRIBUTE_FLAG_NO_STORE) {
+      /* The attribute is used just for the predicate,
+         so do not copy the current value into the result. */
+      continue;
+    }
+
+    if(!(AQL_GET_FLAGS(adt) & (AQL_FLAG_AGGREGATE | AQL_FLAG_GROUP))) {
+      /* No aggregators. Copy the original value into the resulting tuple. */
+      memcpy(result_row + attr_map_ptr->to_offset, from_ptr,
+             result_attr->element_size);
+    }
+  }
+
+  wanted_result = TRUE;
+  if(AQL_GET_FLAGS(adt) & AQL_FLAG_INVERSE_LOGIC) {
+    wanted_result = FALSE;
+  }
+
+  /* Check whether the given predicate is true for this tuple. */
+  lvm_result = wanted_result;
+  if(adt->lvm_instance != NULL) {
+#if DB_FEATURE_LVM_COMPILER
+    if(compiled) {
+      lvm_result = lvm_execute_row(adt->lvm_instance, row_ptr);
+    } else
+#endif /* DB_FEATURE_LVM_COMPILER */
+    lvm_result = lvm_execute(adt->lvm_instance);
+  }
+  if(lvm_result == wanted_result) {
+#if DB_FEATURE_GROUP
+    if(AQL_GET_FLAGS(adt) & AQL_FLAG_GROUP) {
+      result = group_add_row(handle, row_ptr);
+      if(DB_ERROR(result)) {
+        group_cleanup();
+      }
+      return result;
+    }
+#endif /* DB_FEATURE_GROUP */
+    if(AQL_GET_FLAGS(adt) & AQL_FLAG_AGGREGATE) {
+      for(attr_map_ptr = attr_map; attr_map_ptr < attr_map_end; attr_map_ptr++) {
+        from_ptr = row_ptr + attr_map_ptr->from_offset;
+        result = db_phy_to_value(&value, attr_map_ptr->to_attr, from_ptr);
+        if(DB_ERROR(result)) {
+	  return result;
+        }
+        aggregate(attr_map_ptr->to_attr->aggregator,
+                  &attr_map_ptr->to_attr->aggregation_value, &value);
+      }
+    } else {
+      if(AQL_GET_FLAGS(adt) & AQL_FLAG_ASSIGN) {
+        if(DB_ERROR(storage_put_row(handle->result_rel, result_row))) {
+          PRINTF("DB: Failed to store a row in the result relation!\n");
+          return DB_STORAGE_ERROR;
+        }
+      }
+      handle->current_row++;
+      return DB_GOT_ROW;
+    }
+  }
+
+  return DB_OK;
+}
+
+db_result_t
+relation_process_select(void *handle_ptr)
+{
+  db_handle_t *handle;
+  aql_adt_t *adt;
+  db_result_t result;
+  unsigned attribute_count;
+  struct source_dest_map *attr_map_ptr, *attr_map_end;
+  attribute_t *result_attr;
+  unsigned char *from_ptr;
+  unsigned char *to_ptr;
+  unsigned char *row_ptr;
+  uint8_t intbuf[2];
+
+  handle = (db_handle_t *)handle_ptr;
+  adt = (aql_adt_t *)handle->adt;
+
+  attribute_count = handle->result_rel->attribute_count;
+  attr_map_end = attr_map + attribute_count;
+
+#if DB_FEATURE_GROUP
+  if((AQL_GET_FLAGS(adt) & AQL_FLAG_GROUP) &&
+     group.phase != GROUP_PHASE_INPUT) {
+    return process_group(handle);
+  }
+#endif /* DB_FEATURE_GROUP */
+
+  if(handle->flags & DB_HANDLE_FLAG_SEARCH_INDEX) {
+    handle->tuple_id = index_get_next(&handle->index_iterator);
+    PLAN_INDEX_STEP(handle);
+    if(handle->tuple_id == INVALID_TUPLE) {
+      PRINTF("DB: An attribute value could not be found in the index\n");
+      if(handle->index_iterator.next_item_no == 0) {
+        return DB_INDEX_ERROR;
+      }
+
+#if DB_FEATURE_GROUP
+      if(AQL_GET_FLAGS(adt) & AQL_FLAG_GROUP) {
+        return group_input_finished(handle);
+      }
+#endif /* DB_FEATURE_GROUP */
+      if(adt->flags & AQL_FLAG_AGGREGATE) {
+        goto end_aggregation;
+      }
+
+      return DB_FINISHED;
+    }
+
+    result = storage_get_row(handle->rel, &handle->tuple_id, row);
+    handle->tuple_id++;
+    if(DB_ERROR(result)) {
+      PRINTF("DB: Failed to get a row in relation %s!\n", handle->rel->name);
+      return result;
+    } else if(result == DB_FINISHED) {
+#if DB_FEATURE_GROUP
+      if(AQL_GET_FLAGS(adt) & AQL_FLAG_GROUP) {
+        return group_input_finished(handle);
+      }
+#endif /* DB_FEATURE_GROUP */
+      if(AQL_GET_FLAGS(adt) & AQL_FLAG_AGGREGATE) {
+        goto end_aggregation;
+      }
+      return DB_FINISHED;
+    }
+
+    handle->processed_rows++;
+    return process_row(handle, adt, row);
+  }
+
+  /* Put the tuples fulfilling the given condition into a new relation.
+     The tuples may be projected. Without an index, all the rows that
+     the scan cursor has buffered are processed until one matches. */
+  do {
+    result = storage_scan_next(&handle->scan, &handle->tuple_id, &row_ptr);
+    if(DB_ERROR(result)) {
+      PRINTF("DB: Failed to get a row in relation %s!\n", handle->rel->name);
+      return result;
+    } else if(result == DB_FINISHED) {
+#if DB_FEATURE_GROUP
+      if(AQL_GET_FLAGS(adt) & AQL_FLAG_GROUP) {
+        return group_input_finished(handle);
+      }
+#endif /* DB_FEATURE_GROUP */
+      if(AQL_GET_FLAGS(adt) & AQL_FLAG_AGGREGATE) {
+        goto end_aggregation;
+      }
+      return DB_FINISHED;
+    }
+    handle->tuple_id++;
+    handle->processed_rows++;
+
+    result = process_row(handle, adt, row_ptr);
+    if(result != DB_OK) {
+      return result;
+    }
+  } while(STORAGE_SCAN_BUFFERED(&handle->scan) > 0);
+
+  return DB_OK;
+
+end_aggregation:
+  /* Generate aggregated result if requested. */
+  for(attr_map_ptr = attr_map; attr_map_ptr < attr_map_end; attr_map_ptr++) {
+    result_attr = attr_map_ptr->to_attr;
+    to_ptr = result_row + attr_map_ptr->to_offset;
+
+    intbuf[0] = result_attr->aggregation_value >> 8;
+    intbuf[1] = result_attr->aggregation_value & 0xff;
+    from_ptr = intbuf;
+    memcpy(to_ptr, from_ptr, result_attr->element_size);
+  }
+
+  if(AQL_GET_FLAGS(adt) & AQL_FLAG_ASSIGN) {
+    if(DB_ERROR(storage_put_row(handle->result_rel, result_row))) {
+      PRINTF("DB: Failed to store a row in the result relation!\n");
+      return DB_STORAGE_ERROR;
+    }
+  }
+
+  handle->current_row = 1;
+  AQL_GET_FLAGS(adt) &= ~AQL_FLAG_AGGREGATE; /* Stop the aggregation. */
+
+  return DB_GOT_ROW;
+}
+
+db_result_t
+relation_select(void *handle_ptr, relation_t *rel, void *adt_ptr)
+{
+  aql_adt_t *adt;
+  db_handle_t *handle;
+  char *name;
+  db_direction_t dir;
   char *attribute_name;
   attribute_t *attr;
   int i;
-  int normal_attributes;
+  int normal_attributes;
+  int aggregated_attributes;
+  int group_attributes;
+  db_result_t result;
+
+  adt = (aql_adt_t *)adt_ptr;
+
+  handle = (db_handle_t *)handle_ptr;
+  handle->rel = rel;
+  handle->adt = adt;
+
+  if(AQL_GET_FLAGS(adt) & AQL_FLAG_ASSIGN) {
+    name = adt->relations[0];
+    dir = DB_STORAGE;
+  } else {
+    name = RESULT_RELATION;
+    dir = DB_MEMORY;
+  }
+  relation_remove(name, 1);
+  relation_create(name, dir);
+  handle->result_rel = relation_load(name);
+
+  if(handle->result_rel == NULL) {
+    PRINTF("DB: Failed to load a relation for the query result\n");
+    return DB_ALLOCATION_ERROR;
+  }
+
+  normal_attributes = aggregated_attributes = group_attributes = 0;
+  for(i = 0; i < AQL_ATTRIBUTE_COUNT(adt); i++) {
+    attribute_name = adt->attributes[i].name;
+
+    attr = relation_attribute_get(rel, attribute_name);
+    if(attr == NULL) {
+      PRINTF("DB: Select for invalid attribute %s in relation %s!\n",
+	     attribute_name, rel->name);
+      return DB_NAME_ERROR;
+    }
+
+    PRINTF("DB: Found attribute %s in relation %s\n",
+	attribute_name, rel->name);
+
+    attr = relation_attribute_add(handle->result_rel, dir,
+				  attribute_name, 
+				  adt->aggregators[i] ? DOMAIN_INT : attr->domain,
+				  attr->element_size);
+    if(attr == NULL) {
+      PRINTF("DB: Failed to add a result attribute\n");
+      relation_release(handle->result_rel);
+      return DB_ALLOCATION_ERROR;
+    }
+
+    attr->aggregator = adt->aggregators[i];
+    switch(attr->aggregator) {
+    case AQL_NONE:
+      if(adt->attributes[i].flags & ATTRIBUTE_FLAG_GROUP) {
+        group_attributes++;
+      } else if(!(adt->attributes[i].flags & ATTRIBUTE_FLAG_NO_STORE)) {
+        /* Only count attributes projected into the result set. */
+        normal_attributes++;
+      }
+      break;
+    case AQL_MAX:
+      aggregated_attributes++;
+      attr->aggregation_value = LONG_MIN;
+      break;
+    case AQL_MIN:
+      aggregated_attributes++;
+      attr->aggregation_value = LONG_MAX;
+      break;
+    default:
+      aggregated_attributes++;
+      attr->aggregation_value = 0;
+      break;
+    }
+
+    attr->flags = adt->attributes[i].flags;
+  }
+
+  /* Preclude mixes of normal attributes and aggregated ones in 
+     selection results. In grouped results, all attributes that are
+     not aggregated must be group attributes. */
+  if(normal_attributes > 0 &&
+     (aggregated_attributes > 0 || group_attributes > 0)) {
+     return DB_RELATIONAL_ERROR;
+  }
+
+  result = generate_selection_result(handle, rel, adt);
+#if DB_FEATURE_GROUP
+  if(!DB_ERROR(result) && (AQL_GET_FLAGS(adt) & AQL_FLAG_GROUP)) {
+    result = group_init(handle);
+  }
+#endif /* DB_FEATURE_GROUP */
+  return result;
+}
+
+#if DB_FEATURE_JOIN
+/*
+ * The join methods. The index join looks up the matching rows of the
+ * right relation through an index for each row of the left relation.
+ * The hash join builds a hash table from the smaller relation, and
+ * probes it with the rows of the other relation. If the hash table
+ * does not fit in the join memory, both relations are first
+ * partitioned into files by the hash of the join attribute. The merge
+ * join reads two relations that are sorted on the join attribute in
+ * parallel.
+ */
+#define JOIN_INDEX		0
+#define JOIN_HASH		1
+#define JOIN_MERGE		2
+
+#define JOIN_PHASE_CREATE	0
+#define JOIN_PHASE_PARTITION	1
+#define JOIN_PHASE_BUILD	2
+#define JOIN_PHASE_PROBE	3
+
+#define JOIN_BUILD_SIDE		0
+#define JOIN_PROBE_SIDE		1
+
+#define JOIN_END		0xffff
+
+struct join_side {
+  relation_t *rel;
+  attribute_t *attr;
+  unsigned char *row;
+  unsigned key_offset;
+};
+
+/* A hash table entry is followed by a row of the build relation. */
+struct join_entry {
+  long key;
+  uint16_t next;
+};
+
+/*
+ * The state of the ongoing join. In a hash join, the build side is the
+ * relation stored in the hash table. In a merge join, the build side
+ * is the right relation, and the probe side is the left relation. The
+ * probe side is read with the scan cursor of the handle.
+ */
+static struct {
+  struct join_side build;
+  struct join_side probe;
+  storage_scan_t scan;
+  long key;
+  uint8_t method;
+  uint8_t phase;
+#if DB_FEATURE_HASH_JOIN
+  void *owner;
+  uint8_t side;
+  uint8_t partitions;
+  uint8_t partition;
+  uint8_t build_done;
+  uint8_t yield;
+  uint8_t files_open;
+  uint16_t capacity;
+  uint16_t chain;
+  unsigned entry_size;
+  tuple_id_t rows[2][DB_JOIN_PARTITIONS];
+  uint16_t fill[DB_JOIN_PARTITIONS];
+#endif /* DB_FEATURE_HASH_JOIN */
+#if DB_FEATURE_MERGE_JOIN
+  uint8_t have_left;
+  uint8_t have_right;
+  uint8_t in_group;
+  long right_key;
+  long group_key;
+  tuple_id_t right_id;
+  tuple_id_t mark;
+#endif /* DB_FEATURE_MERGE_JOIN */
+} join;
+
+#if DB_FEATURE_HASH_JOIN
+static long join_memory[DB_JOIN_MEMORY_SIZE / sizeof(long)];
+
+#define JOIN_BUCKETS	((uint16_t *)join_memory)
+#define JOIN_ENTRY(i)							\
+  ((struct join_entry *)((unsigned char *)join_memory +			\
+    JOIN_ALIGN(join.capacity * sizeof(uint16_t)) + (i) * join.entry_size))
+#define JOIN_ALIGN(size)	(((size) + sizeof(long) - 1) & ~(sizeof(long) - 1))
+#endif /* DB_FEATURE_HASH_JOIN */
+
+#if DB_FEATURE_HASH_JOIN || DB_FEATURE_MERGE_JOIN
+static long
+join_key(struct join_side *side, unsigned char *row_ptr)
+{
+  attribute_value_t value;
+
+  db_phy_to_value(&value, side->attr, row_ptr + side->key_offset);
+  return db_value_to_long(&value);
+}
+#endif /* DB_FEATURE_HASH_JOIN || DB_FEATURE_MERGE_JOIN */
+
+static int
+join_key_supported(attribute_t *attr)
+{
+  return attr->domain == DOMAIN_INT || attr->domain == DOMAIN_LONG;
+}
+
+static db_result_t
+emit_join_row(db_handle_t *handle)
+{
+  relation_t *join_rel;
+  unsigned char *join_next_attribute_ptr;
+  size_t element_size;
+  int i;
+
+  join_rel = handle->join_rel;
+
+  /* Use the source attribute map to fill in the physical representation
+     of the resulting tuple. */
+  join_next_attribute_ptr = join_row;
+
+  for(i = 0; i < join_rel->attribute_count; i++) {
+    element_size = source_map[i].attr->element_size;
+
+    memcpy(join_next_attribute_ptr, source_map[i].from_ptr, element_size);
+    join_next_attribute_ptr += element_size;
+  }
+
+  if(((aql_adt_t *)handle->adt)->flags & AQL_FLAG_ASSIGN) {
+    if(DB_ERROR(storage_put_row(join_rel, join_row))) {
+      return DB_STORAGE_ERROR;
+    }
+  }
+
+  handle->current_row++;
+  return DB_GOT_ROW;
+}
+
+static db_result_t
+process_index_join(db_handle_t *handle)
+{
+  db_result_t result;
+  relation_t *left_rel;
+  relation_t *right_rel;
+  tuple_id_t right_tuple_id;
+  storage_row_t row_ptr;
+  attribute_value_t value;
+
+  left_rel = handle->left_rel;
+  right_rel = handle->right_rel;
+
+  if(!(handle->flags & DB_HANDLE_FLAG_INDEX_STEP)) {
+    goto inner_loop;
+  }
+
+  /* Equi-join for indexed attributes only. In the outer loop, we iterate over
+     each tuple in the left relation. */
+  for(;;) {
+    result = storage_scan_next(&handle->scan, &handle->tuple_id, &row_ptr);
+    if(DB_ERROR(result)) {
+      PRINTF("DB: Failed to get a row in left relation %s!\n", left_rel->name);
+      return result;
+    } else if(result == DB_FINISHED) {
+      return DB_FINISHED;
+    }
+    memcpy(left_row, row_ptr, left_rel->row_length);
+    handle->processed_rows++;
+
+    if(DB_ERROR(relation_get_value(left_rel, handle->left_join_attr, left_row, &value))) {
+      PRINTF("DB: Failed to get a value of the attribute \"%s\" to join on\n",
+	handle->left_join_attr->name);
+      return DB_IMPLEMENTATION_ERROR;
+    }
+
+    if(DB_ERROR(index_get_iterator(&handle->index_iterator, 
+                                   handle->right_join_attr->index, 
+                                   &value, &value))) { 
+      PRINTF("DB: Failed to get an index iterator\n");
+      return DB_INDEX_ERROR;
+    }
+    handle->flags &= ~DB_HANDLE_FLAG_INDEX_STEP;
+
+    /* In the inner loop, we iterate over all rows with a matching value for the
+       join attribute. The index component provides an iterator for this purpose. */
+inner_loop:
+    for(;;) {
+      /* Get all rows matching the attribute value in the right relation. */
+      right_tuple_id = index_get_next(&handle->index_iterator);
+      PLAN_INDEX_STEP(handle);
+      if(right_tuple_id == INVALID_TUPLE) {
+        /* Exclude this row from the left relation in the result,
+           and step to the next value in the index iteration. */
+        handle->flags |= DB_HANDLE_FLAG_INDEX_STEP;
+        break;
+      }
+
+      result = storage_get_row(right_rel, &right_tuple_id, right_row);
+      if(DB_ERROR(result)) {
+        PRINTF("DB: Failed to get a row in right relation %s!\n", right_rel->name);
+        return result;
+      } else if(result == DB_FINISHED) {
+	PRINTF("DB: The index refers to an invalid row: %lu\n",
+	       (unsigned long)right_tuple_id);
+        return DB_IMPLEMENTATION_ERROR;
+      }
+
+      return emit_join_row(handle);
+    }
+  }
+
+  return DB_OK;
+}
+
+#if DB_FEATURE_HASH_JOIN
+static unsigned
+join_hash(long key)
+{
+  uint32_t hash;
+
+  hash = (uint32_t)key * 2654435761UL;
+  return hash ^ (hash >> 16);
+}
+
+static void
+partition_name(char *name, int side, unsigned partition)
+{
+  snprintf(name, DB_MAX_FILENAME_LENGTH, "%s.%c%u", JOIN_PARTITION_FILE,
+           side == JOIN_BUILD_SIDE ? 'b' : 'p', partition);
+}
+
+static void
+remove_partitions(void)
+{
+  char name[DB_MAX_FILENAME_LENGTH];
+  unsigned i;
+
+  for(i = 0; i < join.partitions; i++) {
+    partition_name(name, JOIN_BUILD_SIDE, i);
+    storage_remove_file(name);
+    partition_name(name, JOIN_PROBE_SIDE, i);
+    storage_remove_file(name);
+  }
+}
+
+/* The number of build rows that fit in the hash table. */
+static unsigned
+hash_join_capacity(relation_t *rel)
+{
+  unsigned entry_size;
+  unsigned capacity;
+
+  entry_size = JOIN_ALIGN(sizeof(struct join_entry) + rel->row_length);
+
+  /* Each entry also needs a bucket, and the buckets are padded to
+     the alignment of the entries. */
+  capacity = (sizeof(join_memory) - sizeof(long)) /
+             (entry_size + sizeof(uint16_t));
+  return capacity < JOIN_END ? capacity : JOIN_END - 1;
+}
+
+/* The number of partitions to split the relations into. */
+static unsigned
+hash_join_partitions(tuple_id_t build_rows, unsigned capacity,
+                     unsigned row_length)
+{
+  unsigned partitions;
+
+  if(build_rows <= capacity) {
+    return 0;
+  }
+
+  /* Aim for partitions that fit in the memory with a margin for
+     skewed keys. The memory is divided into one write buffer per
+     partition, which must have room for at least one row. */
+  partitions = build_rows / capacity + 1;
+  partitions += partitions / 2;
+  if(partitions > sizeof(join_memory) / row_length) {
+    partitions = sizeof(join_memory) / row_length;
+  }
+  if(partitions > DB_JOIN_PARTITIONS) {
+    partitions = DB_JOIN_PARTITIONS;
+  }
+
+  return partitions > 1 ? partitions : 0;
+}
+
+static db_result_t
+flush_partition(unsigned partition)
+{
+  struct join_side *side;
+  char name[DB_MAX_FILENAME_LENGTH];
+  unsigned chunk_rows;
+  db_result_t result;
+
+  side = join.side == JOIN_BUILD_SIDE ? &join.build : &join.probe;
+  chunk_rows = sizeof(join_memory) / join.partitions / side->rel->row_length;
+
+  partition_name(name, join.side, partition);
+  result = storage_append_rows(name, side->rel->row_length,
+                               join.rows[join.side][partition],
+                               (unsigned char *)join_memory +
+                               partition * chunk_rows * side->rel->row_length,
+                               join.fill[partition]);
+
+  join.rows[join.side][partition] += join.fill[partition];
+  join.fill[partition] = 0;
+
+  return result;
+}
+
+static void
+close_partition(db_handle_t *handle)
+{
+  if(join.files_open) {
+    storage_scan_close(&join.scan);
+    storage_scan_close(&handle->scan);
+    join.files_open = 0;
+  }
+}
+
+static db_result_t
+start_partition(db_handle_t *handle)
+{
+  char name[DB_MAX_FILENAME_LENGTH];
+
+  if(join.partitions == 0) {
+    if(join.partition > 0) {
+      return DB_FINISHED;
+    }
+    if(DB_ERROR(storage_scan_init(&join.scan, join.build.rel)) ||
+       DB_ERROR(storage_scan_init(&handle->scan, join.probe.rel))) {
+      return DB_STORAGE_ERROR;
+    }
+  } else {
+    close_partition(handle);
+
+    /* Partitions in which either side is empty produce no rows. */
+    while(join.partition < join.partitions &&
+          (join.rows[JOIN_BUILD_SIDE][join.partition] == 0 ||
+           join.rows[JOIN_PROBE_SIDE][join.partition] == 0)) {
+      join.partition++;
+    }
+    if(join.partition == join.partitions) {
+      return DB_FINISHED;
+    }
+
+    partition_name(name, JOIN_BUILD_SIDE, join.partition);
+    if(DB_ERROR(storage_scan_open(&join.scan, name,
+                                  join.build.rel->row_length,
+                                  join.rows[JOIN_BUILD_SIDE][join.partition]))) {
+      return DB_STORAGE_ERROR;
+    }
+    partition_name(name, JOIN_PROBE_SIDE, join.partition);
+    if(DB_ERROR(storage_scan_open(&handle->scan, name,
+                                  join.probe.rel->row_length,
+                                  join.rows[JOIN_PROBE_SIDE][join.partition]))) {
+      storage_scan_close(&join.scan);
+      return DB_STORAGE_ERROR;
+    }
+    join.files_open = 1;
+  }
+
+  join.build_done = 0;
+  join.phase = JOIN_PHASE_BUILD;
+  return DB_OK;
+}
+
+/* Size the hash table and the partitions for the build relation. */
+static db_result_t
+hash_join_size(db_handle_t *handle)
+{
+  unsigned row_length;
+
+  join.capacity = hash_join_capacity(join.build.rel);
+  if(join.capacity == 0) {
+    PRINTF("DB: The join memory cannot hold a row of %s\n",
+           join.build.rel->name);
+    return DB_LIMIT_ERROR;
+  }
+  join.entry_size = JOIN_ALIGN(sizeof(struct join_entry) +
+                              join.build.rel->row_length);
+
+  row_length = join.build.rel->row_length > join.probe.rel->row_length ?
+               join.build.rel->row_length : join.probe.rel->row_length;
+  join.partitions = hash_join_partitions(relation_cardinality(join.build.rel),
+                                         join.capacity, row_length);
+#if DB_FEATURE_EXPLAIN
+  handle->plan.partitions = join.partitions;
+#endif /* DB_FEATURE_EXPLAIN */
+
+  return DB_OK;
+}
+
+static db_result_t
+hash_join_init(db_handle_t *handle)
+{
+  unsigned i;
 
-  adt = (aql_adt_t *)adt_ptr;
+  join.files_open = 0;
+  join.partition = 0;
+  join.partitions = 0;
+  join.chain = JOIN_END;
+  join.yield = 0;
 
-  handle = (db_handle_t *)handle_ptr;
-  handle->rel = rel;
-  handle->adt = adt;
+  if(DB_ERROR(hash_join_size(handle))) {
+    return DB_LIMIT_ERROR;
+  }
 
-  if(AQL_GET_FLAGS(adt) & AQL_FLAG_ASSIGN) {
-    name = adt->relations[0];
-    dir = DB_STORAGE;
-  } else {
-    name = RESULT_RELATION;
-    dir = DB_MEMORY;
+  for(i = 0; i < join.partitions; i++) {
+    join.rows[JOIN_BUILD_SIDE][i] = join.rows[JOIN_PROBE_SIDE][i] = 0;
+    join.fill[i] = 0;
   }
-  relation_remove(name, 1);
-  relation_create(name, dir);
-  handle->result_rel = relation_load(name);
 
-  if(handle->result_rel == NULL) {
-    PRINTF("DB: Failed to load a relation for the query result\n");
-    return DB_ALLOCATION_ERROR;
+  PRINTF("DB: Hash join with %u partitions, %u rows per table\n",
+         join.partitions, join.capacity);
+
+  if(join.partitions == 0) {
+    return start_partition(handle);
   }
 
-  for(i = normal_attributes = 0; i < AQL_ATTRIBUTE_COUNT(adt); i++) {
-    attribute_name = adt->attributes[i].name;
+  /* The partition files are created in the first processing step, so
+     that a query which is planned but never processed leaves no
+     files behind. */
+  join.phase = JOIN_PHASE_CREATE;
+  return DB_OK;
+}
 
-    attr = relation_attribute_get(rel, attribute_name);
-    if(attr == NULL) {
-      PRINTF("DB: Select for invalid attribute %s in relation %s!\n",
-	     attribute_name, rel->name);
-      return DB_NAME_ERROR;
+static db_result_t
+create_partitions(db_handle_t *handle)
+{
+  char name[DB_MAX_FILENAME_LENGTH];
+  unsigned long size;
+  unsigned i;
+
+  for(i = 0; i < join.partitions; i++) {
+    /* Remove any files left by a join that was not finished. */
+    partition_name(name, JOIN_BUILD_SIDE, i);
+    storage_remove_file(name);
+    size = 2 * (relation_cardinality(join.build.rel) / join.partitions + 1) *
+           join.build.rel->row_length;
+    if(DB_ERROR(storage_create_file(name, size))) {
+      return DB_STORAGE_ERROR;
+    }
+    partition_name(name, JOIN_PROBE_SIDE, i);
+    storage_remove_file(name);
+    size = 2 * (relation_cardinality(join.probe.rel) / join.partitions + 1) *
+           join.probe.rel->row_length;
+    if(DB_ERROR(storage_create_file(name, size))) {
+      return DB_STORAGE_ERROR;
     }
+  }
 
-    PRINTF("DB: Found attribute %s in relation %s\n",
-	attribute_name, rel->name);
+  join.owner = handle;
+  join.phase = JOIN_PHASE_PARTITION;
+  join.side = JOIN_BUILD_SIDE;
+  return storage_scan_init(&handle->scan, join.build.rel);
+}
 
-    attr = relation_attribute_add(handle->result_rel, dir,
-				  attribute_name, 
-				  adt->aggregators[i] ? DOMAIN_INT : attr->domain,
-				  attr->element_size);
-    if(attr == NULL) {
-      PRINTF("DB: Failed to add a result attribute\n");
-      relation_release(handle->result_rel);
-      return DB_ALLOCATION_ERROR;
-    }
+static db_result_t
+partition_rows(db_handle_t *handle)
+{
+  struct join_side *side;
+  db_result_t result;
+  tuple_id_t tuple_id;
+  storage_row_t row_ptr;
+  unsigned row_length;
+  unsigned chunk_rows;
+  unsigned partition;
+  unsigned i;
+
+  side = join.side == JOIN_BUILD_SIDE ? &join.build : &join.probe;
+  row_length = side->rel->row_length;
+  chunk_rows = sizeof(join_memory) / join.partitions / row_length;
+
+  do {
+    result = storage_scan_next(&handle->scan, &tuple_id, &row_ptr);
+    if(DB_ERROR(result)) {
+      return result;
+    } else if(result == DB_FINISHED) {
+      for(i = 0; i < join.partitions; i++) {
+        if(join.fill[i] > 0 && DB_ERROR(flush_partition(i))) {
+          return DB_STORAGE_ERROR;
+        }
+      }
 
-    attr->aggregator = adt->aggregators[i];
-    switch(attr->aggregator) {
-    case AQL_NONE:
-      if(!(adt->attributes[i].flags & ATTRIBUTE_FLAG_NO_STORE)) {
-        /* Only count attributes projected into the result set. */
-        normal_attributes++;
+      if(join.side == JOIN_BUILD_SIDE) {
+        join.side = JOIN_PROBE_SIDE;
+        return storage_scan_init(&handle->scan, join.probe.rel);
       }
-      break;
-    case AQL_MAX:
-      attr->aggregation_value = LONG_MIN;
-      break;
-    case AQL_MIN:
-      attr->aggregation_value = LONG_MAX;
-      break;
-    default:
-      attr->aggregation_value = 0;
+      return start_partition(handle);
+    }
+
+    partition = join_hash(join_key(side, row_ptr)) % join.partitions;
+    memcpy((unsigned char *)join_memory +
+           (partition * chunk_rows + join.fill[partition]) * row_length,
+           row_ptr, row_length);
+    if(++join.fill[partition] == chunk_rows &&
+       DB_ERROR(flush_partition(partition))) {
+      return DB_STORAGE_ERROR;
+    }
+  } while(STORAGE_SCAN_BUFFERED(&handle->scan) > 0);
+
+  return DB_OK;
+}
+
+static db_result_t
+build_table(void)
+{
+  struct join_entry *entry;
+  db_result_t result;
+  tuple_id_t tuple_id;
+  storage_row_t row_ptr;
+  unsigned entries;
+  unsigned bucket;
+
+  for(bucket = 0; bucket < join.capacity; bucket++) {
+    JOIN_BUCKETS[bucket] = JOIN_END;
+  }
+
+  for(entries = 0; entries < join.capacity; entries++) {
+    result = storage_scan_next(&join.scan, &tuple_id, &row_ptr);
+    if(DB_ERROR(result)) {
+      return result;
+    } else if(result == DB_FINISHED) {
+      join.build_done = 1;
       break;
     }
 
-    attr->flags = adt->attributes[i].flags;
+    entry = JOIN_ENTRY(entries);
+    entry->key = join_key(&join.build, row_ptr);
+    memcpy(entry + 1, row_ptr, join.build.rel->row_length);
+
+    bucket = join_hash(entry->key) / DB_JOIN_PARTITIONS % join.capacity;
+    entry->next = JOIN_BUCKETS[bucket];
+    JOIN_BUCKETS[bucket] = entries;
   }
 
-  /* Preclude mixes of normal attributes and aggregated ones in 
-     selection results. */
-  if(normal_attributes > 0 &&
-     handle->result_rel->attribute_count > normal_attributes) {
-     return DB_RELATIONAL_ERROR;
+  if(entries == join.capacity &&
+     join.scan.row_count == join.scan.first_row + join.scan.next_row) {
+    join.build_done = 1;
   }
 
-  return generate_selection_result(handle, rel, adt);
+  PRINTF("DB: Built a hash table of %u rows\n", entries);
+
+  join.phase = JOIN_PHASE_PROBE;
+  join.chain = JOIN_END;
+  return DB_OK;
 }
 
-#if DB_FEATURE_JOIN
-db_result_t
-relation_process_join(void *handle_ptr)
+static db_result_t
+probe_table(db_handle_t *handle)
 {
-  db_handle_t *handle;
+  struct join_entry *entry;
   db_result_t result;
-  relation_t *left_rel;
-  relation_t *right_rel;
-  relation_t *join_rel;
-  unsigned char *join_next_attribute_ptr;
-  size_t element_size;
-  tuple_id_t right_tuple_id;
-  attribute_value_t value;
-  int i;
-
-  handle = (db_handle_t *)handle_ptr;
-  left_rel = handle->left_rel;
-  right_rel = handle->right_rel;
-  join_rel = handle->join_rel;
+  storage_row_t row_ptr;
+
+  for(;;) {
+    while(join.chain != JOIN_END) {
+      entry = JOIN_ENTRY(join.chain);
+      join.chain = entry->next;
+      if(entry->key == join.key) {
+        memcpy(join.build.row, entry + 1, join.build.rel->row_length);
+        return emit_join_row(handle);
+      }
+    }
 
-  if(!(handle->flags & DB_HANDLE_FLAG_INDEX_STEP)) {
-    goto inner_loop;
-  }
+    /* Let other processes run when the rows buffered by the probe
+       cursor have been processed. */
+    if(join.yield) {
+      join.yield = 0;
+      return DB_OK;
+    }
 
-  /* Equi-join for indexed attributes only. In the outer loop, we iterate over
-     each tuple in the left relation. */
-  for(handle->tuple_id = 0;; handle->tuple_id++) {
-    result = storage_get_row(left_rel, &handle->tuple_id, left_row);
+    result = storage_scan_next(&handle->scan, &handle->tuple_id, &row_ptr);
     if(DB_ERROR(result)) {
-      PRINTF("DB: Failed to get a row in left relation %s!\n", left_rel->name);
       return result;
     } else if(result == DB_FINISHED) {
-      return DB_FINISHED;
+      if(!join.build_done) {
+        /* Probe the rest of the build rows in another round. */
+        storage_scan_seek(&handle->scan, 0);
+        join.phase = JOIN_PHASE_BUILD;
+        return DB_OK;
+      }
+      join.partition++;
+      return start_partition(handle);
     }
 
-    if(DB_ERROR(relation_get_value(left_rel, handle->left_join_attr, left_row, &value))) {
-      PRINTF("DB: Failed to get a value of the attribute \"%s\" to join on\n",
-	handle->left_join_attr->name);
-      return DB_IMPLEMENTATION_ERROR;
-    }
+    handle->processed_rows++;
+    memcpy(join.probe.row, row_ptr, join.probe.rel->row_length);
+    join.key = join_key(&join.probe, join.probe.row);
+    join.chain = JOIN_BUCKETS[join_hash(join.key) / DB_JOIN_PARTITIONS %
+                              join.capacity];
+    join.yield = STORAGE_SCAN_BUFFERED(&handle->scan) == 0;
+  }
+}
 
-    if(DB_ERROR(index_get_iterator(&handle->index_iterator, 
-                                   handle->right_join_attr->index, 
-                                   &value, &value))) { 
-      PRINTF("DB: Failed to get an index iterator\n");
-      return DB_INDEX_ERROR;
+static db_result_t
+process_hash_join(db_handle_t *handle)
+{
+  db_result_t result;
+
+  switch(join.phase) {
+  case JOIN_PHASE_CREATE:
+    result = create_partitions(handle);
+    break;
+  case JOIN_PHASE_PARTITION:
+    result = partition_rows(handle);
+    break;
+  case JOIN_PHASE_BUILD:
+    result = build_table();
+    break;
+  default:
+    result = probe_table(handle);
+    break;
+  }
+
+  if(result == DB_FINISHED || DB_ERROR(result)) {
+    close_partition(handle);
+    if(join.partitions > 0) {
+      remove_partitions();
+      join.partitions = 0;
     }
-    handle->flags &= ~DB_HANDLE_FLAG_INDEX_STEP;
+    join.owner = NULL;
+  }
 
-    /* In the inner loop, we iterate over all rows with a matching value for the
-       join attribute. The index component provides an iterator for this purpose. */
-inner_loop:
-    for(;;) {
-      /* Get all rows matching the attribute value in the right relation. */
-      right_tuple_id = index_get_next(&handle->index_iterator);
-      if(right_tuple_id == INVALID_TUPLE) {
-        /* Exclude this row from the left relation in the result,
-           and step to the next value in the index iteration. */
-        handle->flags |= DB_HANDLE_FLAG_INDEX_STEP;
-        break;
+  return result;
+}
+#endif /* DB_FEATURE_HASH_JOIN */
+
+#if DB_FEATURE_MERGE_JOIN
+static db_result_t
+merge_next(storage_scan_t *scan, struct join_side *side,
+           tuple_id_t *tuple_id, long *key)
+{
+  db_result_t result;
+  storage_row_t row_ptr;
+
+  result = storage_scan_next(scan, tuple_id, &row_ptr);
+  if(result != DB_OK) {
+    return result;
+  }
+
+  memcpy(side->row, row_ptr, side->rel->row_length);
+  *key = join_key(side, side->row);
+  return DB_OK;
+}
+
+/*
+ * Join two relations whose rows are in ascending order of the join
+ * attribute. Each left row is combined with the group of right rows
+ * that have the same key; the right cursor returns to the start of
+ * the group when the next left row has the same key.
+ */
+static db_result_t
+process_merge_join(db_handle_t *handle)
+{
+  db_result_t result;
+  long key;
+
+  for(;;) {
+    if(!join.have_left) {
+      result = merge_next(&handle->scan, &join.probe, &handle->tuple_id, &key);
+      if(result != DB_OK) {
+        return result;
+      }
+      if(key < join.key) {
+        PRINTF("DB: The relation %s is not sorted\n", join.probe.rel->name);
+        return DB_INCONSISTENCY_ERROR;
+      }
+      handle->processed_rows++;
+      join.key = key;
+      join.have_left = 1;
+
+      if(join.in_group) {
+        if(key == join.group_key) {
+          storage_scan_seek(&join.scan, join.mark);
+          join.right_key = key;
+          join.have_right = 0;
+        } else {
+          join.in_group = 0;
+        }
       }
 
-      result = storage_get_row(right_rel, &right_tuple_id, right_row);
+      if(STORAGE_SCAN_BUFFERED(&handle->scan) == 0) {
+        return DB_OK;
+      }
+    }
+
+    if(!join.have_right) {
+      result = merge_next(&join.scan, &join.build, &join.right_id, &key);
       if(DB_ERROR(result)) {
-        PRINTF("DB: Failed to get a row in right relation %s!\n", right_rel->name);
         return result;
       } else if(result == DB_FINISHED) {
-	PRINTF("DB: The index refers to an invalid row: %lu\n",
-	       (unsigned long)right_tuple_id);
-        return DB_IMPLEMENTATION_ERROR;
+        if(!join.in_group) {
+          return DB_FINISHED;
+        }
+        join.have_left = 0;
+        continue;
       }
-
-      /* Use the source attribute map to fill in the physical representation
-	 of the resulting tuple. */
-      join_next_attribute_ptr = join_row;
-
-      for(i = 0; i < join_rel->attribute_count; i++) {
-	element_size = source_map[i].attr->element_size;
-
-	memcpy(join_next_attribute_ptr, source_map[i].from_ptr, element_size);
-	join_next_attribute_ptr += element_size;
+      if(key < join.right_key) {
+        PRINTF("DB: The relation %s is not sorted\n", join.build.rel->name);
+        return DB_INCONSISTENCY_ERROR;
       }
+      join.right_key = key;
+      join.have_right = 1;
+    }
 
-      if(((aql_adt_t *)handle->adt)->flags & AQL_FLAG_ASSIGN) {
-        if(DB_ERROR(storage_put_row(join_rel, join_row))) {
-          return DB_STORAGE_ERROR;
-        }
+    if(join.key == join.right_key) {
+      if(!join.in_group) {
+        join.in_group = 1;
+        join.group_key = join.key;
+        join.mark = join.right_id;
       }
+      join.have_right = 0;
+      return emit_join_row(handle);
+    } else if(join.key < join.right_key) {
+      join.have_left = 0;
+    } else {
+      join.have_right = 0;
+    }
+  }
+}
 
-      handle->current_row++;
-      return DB_GOT_ROW;
+static int
+join_attribute_sorted(attribute_t *attr)
+{
+  return index_exists(attr) &&
+         ((index_t *)attr->index)->type == INDEX_INLINE;
+}
+#endif /* DB_FEATURE_MERGE_JOIN */
+
+/*
+ * Choose the join method from the indexes on the join attributes and
+ * the cardinalities of the relations. The costs are in rows read, and
+ * an index lookup is assumed to cost DB_INDEX_COST rows.
+ */
+static uint8_t
+plan_join(db_handle_t *handle)
+{
+  attribute_t *left_attr;
+  attribute_t *right_attr;
+#if DB_FEATURE_HASH_JOIN
+  tuple_id_t left_rows;
+  tuple_id_t right_rows;
+  tuple_id_t build_rows;
+  tuple_id_t probe_rows;
+  unsigned long hash_cost;
+  unsigned long passes;
+  unsigned capacity;
+  unsigned partitions;
+  unsigned row_length;
+#endif /* DB_FEATURE_HASH_JOIN */
+
+  left_attr = handle->left_join_attr;
+  right_attr = handle->right_join_attr;
+
+  if(!join_key_supported(left_attr) || !join_key_supported(right_attr)) {
+    return JOIN_INDEX;
+  }
+
+#if DB_FEATURE_MERGE_JOIN
+  if(join_attribute_sorted(left_attr) && join_attribute_sorted(right_attr)) {
+    return JOIN_MERGE;
+  }
+#endif /* DB_FEATURE_MERGE_JOIN */
+
+#if DB_FEATURE_HASH_JOIN
+  left_rows = relation_cardinality(handle->left_rel);
+  right_rows = relation_cardinality(handle->right_rel);
+  if(left_rows < right_rows) {
+    build_rows = left_rows;
+    probe_rows = right_rows;
+    capacity = hash_join_capacity(handle->left_rel);
+  } else {
+    build_rows = right_rows;
+    probe_rows = left_rows;
+    capacity = hash_join_capacity(handle->right_rel);
+  }
+  row_length = handle->left_rel->row_length > handle->right_rel->row_length ?
+               handle->left_rel->row_length : handle->right_rel->row_length;
+
+  hash_cost = (unsigned long)left_rows + right_rows;
+  partitions = hash_join_partitions(build_rows, capacity, row_length);
+  if(partitions > 0) {
+    /* Both relations are written to partitions and read again. */
+    hash_cost *= 3;
+    build_rows /= partitions;
+  }
+  if(capacity > 0) {
+    /* The probe rows are read once for each part of the build rows
+       that fits in the hash table. */
+    passes = (build_rows + capacity - 1) / capacity;
+    if(passes > 1) {
+      hash_cost += (passes - 1) * probe_rows;
     }
   }
 
-  return DB_OK;
+  if(!index_exists(right_attr) ||
+     (unsigned long)left_rows * DB_INDEX_COST > hash_cost) {
+    return JOIN_HASH;
+  }
+#endif /* DB_FEATURE_HASH_JOIN */
+
+  return JOIN_INDEX;
+}
+
+db_result_t
+relation_process_join(void *handle_ptr)
+{
+  db_handle_t *handle;
+
+  handle = (db_handle_t *)handle_ptr;
+
+  switch(join.method) {
+#if DB_FEATURE_HASH_JOIN
+  case JOIN_HASH:
+    return process_hash_join(handle);
+#endif /* DB_FEATURE_HASH_JOIN */
+#if DB_FEATURE_MERGE_JOIN
+  case JOIN_MERGE:
+    return process_merge_join(handle);
+#endif /* DB_FEATURE_MERGE_JOIN */
+  default:
+    return process_index_join(handle);
+  }
+}
+
+/* Remove the partition files of a hash join that is freed before it
+   has finished. */
+void
+relation_free_join(void *handle_ptr)
+{
+#if DB_FEATURE_HASH_JOIN
+  if(join.owner == handle_ptr) {
+    close_partition((db_handle_t *)handle_ptr);
+    remove_partitions();
+    join.partitions = 0;
+    join.owner = NULL;
+  }
+#endif /* DB_FEATURE_HASH_JOIN */
 }
 
 static db_result_t
@@ -1067,6 +2647,9 @@ generate_join_result(db_handle_t *handle)
   int i;
   int offset;
   unsigned char *from_ptr;
+#if DB_FEATURE_HASH_JOIN
+  db_result_t result;
+#endif /* DB_FEATURE_HASH_JOIN */
 
   handle->tuple = (tuple_t)join_row;
   handle->tuple_id = 0;
@@ -1102,6 +2685,70 @@ generate_join_result(db_handle_t *handle)
     source_pair->from_ptr = from_ptr;
   }
 
+  if(join.method != JOIN_INDEX) {
+    join.key = LONG_MIN;
+    join.build.attr = handle->right_join_attr;
+    join.build.rel = right_rel;
+    join.build.row = right_row;
+    join.probe.attr = handle->left_join_attr;
+    join.probe.rel = left_rel;
+    join.probe.row = left_row;
+
+#if DB_FEATURE_HASH_JOIN
+    /* Build the hash table from the smaller relation. */
+    if(join.method == JOIN_HASH &&
+       relation_cardinality(left_rel) < relation_cardinality(right_rel)) {
+      join.build.attr = handle->left_join_attr;
+      join.build.rel = left_rel;
+      join.build.row = left_row;
+      join.probe.attr = handle->right_join_attr;
+      join.probe.rel = right_rel;
+      join.probe.row = right_row;
+    }
+#endif /* DB_FEATURE_HASH_JOIN */
+
+    join.build.key_offset = get_attribute_value_offset(join.build.rel,
+                                                       join.build.attr);
+    join.probe.key_offset = get_attribute_value_offset(join.probe.rel,
+                                                       join.probe.attr);
+  }
+
+#if DB_FEATURE_EXPLAIN
+  if(PLAN_ONLY(handle)) {
+#if DB_FEATURE_HASH_JOIN
+    if(join.method == JOIN_HASH && DB_ERROR(hash_join_size(handle))) {
+      return DB_LIMIT_ERROR;
+    }
+#endif /* DB_FEATURE_HASH_JOIN */
+    /* The handle is freed by db_query() without being processed. */
+    handle->flags |= DB_HANDLE_FLAG_PROCESSING;
+    return DB_OK;
+  }
+#endif /* DB_FEATURE_EXPLAIN */
+
+  if(DB_ERROR(storage_scan_init(&handle->scan, left_rel))) {
+    return DB_STORAGE_ERROR;
+  }
+
+#if DB_FEATURE_HASH_JOIN
+  if(join.method == JOIN_HASH) {
+    result = hash_join_init(handle);
+    if(DB_ERROR(result)) {
+      return result;
+    }
+  }
+#endif /* DB_FEATURE_HASH_JOIN */
+
+#if DB_FEATURE_MERGE_JOIN
+  if(join.method == JOIN_MERGE) {
+    if(DB_ERROR(storage_scan_init(&join.scan, right_rel))) {
+      return DB_STORAGE_ERROR;
+    }
+    join.right_key = LONG_MIN;
+    join.have_left = join.have_right = join.in_group = 0;
+  }
+#endif /* DB_FEATURE_MERGE_JOIN */
+
   handle->flags |= DB_HANDLE_FLAG_PROCESSING;
 
   return DB_OK;
@@ -1158,10 +2805,20 @@ relation_join(void *query_result, void *adt_ptr)
     return DB_RELATIONAL_ERROR;
   }
 
-  if(!index_exists(handle->right_join_attr)) {
+  join.method = plan_join(handle);
+  if(join.method == JOIN_INDEX && !index_exists(handle->right_join_attr)) {
     PRINTF("DB: The attribute to join on is not indexed\n");
     return DB_INDEX_ERROR;
   }
+#if DB_FEATURE_EXPLAIN
+  /* The access paths of joins are in the order of the join methods. */
+  handle->plan.access = DB_PLAN_JOIN_INDEX + join.method;
+  strcpy(handle->plan.index_attribute, handle->right_join_attr->name);
+  if(join.method == JOIN_INDEX) {
+    handle->plan.index_type =
+      ((index_t *)handle->right_join_attr->index)->type;
+  }
+#endif /* DB_FEATURE_EXPLAIN */
 
   /*
    * Define the resulting relation. We start from 1 when counting attributes
@@ -82,6 +82,8 @@ db_result_t relation_init(void);
 db_result_t relation_process_remove(void *);
 db_result_t relation_process_select(void *);
 db_result_t relation_process_join(void *);
+void relation_free_join(void *);
+void relation_free_group(void *);
 relation_t *relation_load(char *);
 db_result_t relation_release(relation_t *);
 relation_t *relation_create(char *, db_direction_t);
@@ -95,6 +97,7 @@ db_result_t relation_attribute_remove(relation_t *, char *);
 db_result_t relation_set_primary_key(relation_t *, char *);
 db_result_t relation_remove(char *, int);
 db_result_t relation_insert(relation_t *, attribute_value_t *);
+db_result_t relation_insert_rows(relation_t *, attribute_value_t *, unsigned);
 db_result_t relation_select(void *, relation_t *, void *);
 db_result_t relation_join(void *, void *);
 tuple_id_t relation_cardinality(relation_t *);
@@ -166,6 +166,14 @@ db_value_to_long(attribute_value_t *value)
 db_result_t
 db_free(db_handle_t *handle)
 {
+  if(handle->flags & DB_HANDLE_FLAG_PROCESSING) {
+#if DB_FEATURE_JOIN
+    relation_free_join(handle);
+#endif /* DB_FEATURE_JOIN */
+#if DB_FEATURE_GROUP
+    relation_free_group(handle);
+#endif /* DB_FEATURE_GROUP */
+  }
   if(handle->rel != NULL) {
     relation_release(handle->rel);
   }
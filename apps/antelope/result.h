@@ -50,10 +50,66 @@ typedef unsigned char *tuple_t;
 #define DB_HANDLE_FLAG_SEARCH_INDEX	0x02
 #define DB_HANDLE_FLAG_PROCESSING	0x04
 
+#if DB_FEATURE_EXPLAIN
+/* Access paths. */
+#define DB_PLAN_SCAN			0
+#define DB_PLAN_INDEX			1
+#define DB_PLAN_JOIN_INDEX		2
+#define DB_PLAN_JOIN_HASH		3
+#define DB_PLAN_JOIN_MERGE		4
+
+/* Phases of a query, timed in microseconds on the native platform,
+   and in rtimer ticks elsewhere. */
+#define DB_PLAN_PHASE_PARSE		0
+#define DB_PLAN_PHASE_PLAN		1
+#define DB_PLAN_PHASE_EXECUTE		2
+#define DB_PLAN_PHASES			3
+
+#ifdef CONTIKI_TARGET_NATIVE
+#define DB_PLAN_CLOCK_SECOND		1000000UL
+#else
+#define DB_PLAN_CLOCK_SECOND		RTIMER_SECOND
+#endif /* CONTIKI_TARGET_NATIVE */
+
+/* Plan flags. */
+#define DB_PLAN_FLAG_EXPLAIN		0x01
+#define DB_PLAN_FLAG_ANALYZE		0x02
+
+struct db_plan_range {
+  char name[ATTRIBUTE_NAME_LENGTH + 1];
+  long min;
+  long max;
+};
+
+/*
+ * The plan of a query, and the costs of executing it. The plan is
+ * recorded when the query is started. For EXPLAIN ANALYZE, the costs
+ * are accumulated by each db_process() call on the handle, so they can
+ * be inspected at any time until the handle is reused by another query.
+ */
+struct db_plan {
+  struct db_plan_range ranges[AQL_ATTRIBUTE_LIMIT];
+  char index_attribute[ATTRIBUTE_NAME_LENGTH + 1];
+  unsigned long time[DB_PLAN_PHASES];
+  unsigned long reads;
+  unsigned long read_bytes;
+  unsigned long writes;
+  unsigned long write_bytes;
+  unsigned long index_steps;
+  uint8_t access;
+  uint8_t index_type;
+  uint8_t range_count;
+  uint8_t partitions;
+  uint8_t flags;
+};
+#endif /* DB_FEATURE_EXPLAIN */
+
 struct db_handle {
   index_iterator_t index_iterator;
+  storage_scan_t scan;
   tuple_id_t tuple_id;
   tuple_id_t current_row;
+  tuple_id_t processed_rows;
   relation_t *rel;
   relation_t *left_rel;
   relation_t *join_rel;
@@ -65,6 +121,9 @@ struct db_handle {
   uint8_t flags;
   uint8_t ncolumns;
   void *adt;
+#if DB_FEATURE_EXPLAIN
+  struct db_plan plan;
+#endif /* DB_FEATURE_EXPLAIN */
 };
 typedef struct db_handle db_handle_t;
 
@@ -66,7 +66,16 @@ struct index_record {
                                sizeof(struct attribute_record))
 #endif
 
-#define ROW_XOR 0xf6U
+#if DB_FEATURE_COLUMNS
+/* The tuple file holds the values of the first attribute. */
+#define TUPLE_RESERVE_SIZE DB_COLUMN_RESERVE_SIZE
+#else
+#define TUPLE_RESERVE_SIZE DB_COFFEE_RESERVE_SIZE
+#endif /* DB_FEATURE_COLUMNS */
+
+#if DB_FEATURE_EXPLAIN
+struct storage_stats storage_stats;
+#endif /* DB_FEATURE_EXPLAIN */
 
 static void
 merge_strings(char *dest, char *prefix, char *suffix)
@@ -79,24 +88,31 @@ char *
 storage_generate_file(char *prefix, unsigned long size)
 {
   static char filename[ATTRIBUTE_NAME_LENGTH + sizeof(".ffff")];
-#if !DB_FEATURE_COFFEE
-  int fd;
-#endif
 
   snprintf(filename, sizeof(filename), "%s.%x", prefix,
            (unsigned)(random_rand() & 0xffff));
 
+  return DB_ERROR(storage_create_file(filename, size)) ? NULL : filename;
+}
+
+db_result_t
+storage_create_file(const char *filename, unsigned long size)
+{
+#if !DB_FEATURE_COFFEE
+  int fd;
+#endif
+
 #if DB_FEATURE_COFFEE
   PRINTF("DB: Reserving %lu bytes in %s\n", size, filename);
   if(cfs_coffee_reserve(filename, size) < 0) {
     PRINTF("DB: Failed to reserve\n");
-    return NULL;
+    return DB_STORAGE_ERROR;
   }
-  return filename;
+  return DB_OK;
 #else
   fd = cfs_open(filename, CFS_WRITE);
   cfs_close(fd);
-  return fd < 0 ? NULL : filename;
+  return fd < 0 ? DB_STORAGE_ERROR : DB_OK;
 #endif /* DB_FEATURE_COFFEE */
 }
 
@@ -212,7 +228,7 @@ storage_put_relation(relation_t *rel)
   }
 
   if(rel->tuple_filename[0] == '\0') {
-    str = storage_generate_file("tuple", DB_COFFEE_RESERVE_SIZE);
+    str = storage_generate_file("tuple", TUPLE_RESERVE_SIZE);
     if(str == NULL) {
       cfs_close(fd);
       cfs_remove(rel->name);
@@ -276,6 +292,7 @@ storage_put_attribute(relation_t *rel, attribute_t *attr)
   return DB_OK;
 }
 
+#if !DB_FEATURE_COLUMNS
 db_result_t
 storage_drop_relation(relation_t *rel, int remove_tuples)
 {
@@ -284,6 +301,7 @@ storage_drop_relation(relation_t *rel, int remove_tuples)
   }
   return cfs_remove(rel->name) < 0 ? DB_STORAGE_ERROR : DB_OK;
 }
+#endif /* !DB_FEATURE_COLUMNS */
 
 #if DB_FEATURE_REMOVE
 db_result_t
@@ -400,6 +418,7 @@ storage_put_index(index_t *index)
   return result;
 }
 
+#if !DB_FEATURE_COLUMNS
 db_result_t
 storage_get_row(relation_t *rel, tuple_id_t *tuple_id, storage_row_t row)
 {
@@ -431,19 +450,30 @@ storage_get_row(relation_t *rel, tuple_id_t *tuple_id, storage_row_t row)
   }
 
   row[rel->row_length - 1] ^= ROW_XOR;
+  STORAGE_COUNT_READ(r);
 
   PRINTF("DB: Read %d bytes from relation %s\n", rel->row_length, rel->name);
 
   return DB_OK;
 }
+#endif /* !DB_FEATURE_COLUMNS */
 
 db_result_t
 storage_put_row(relation_t *rel, storage_row_t row)
+{
+  return storage_put_rows(rel, row, 1);
+}
+
+#if !DB_FEATURE_COLUMNS
+/* Append consecutive rows to a relation with a single write. */
+db_result_t
+storage_put_rows(relation_t *rel, storage_row_t rows, unsigned count)
 {
   cfs_offset_t end;
   unsigned remaining;
+  unsigned i;
   int r;
-  unsigned char *last_byte;
+  unsigned char *ptr;
 #if DB_FEATURE_INTEGRITY
   int missing_bytes;
   char buf[rel->row_length];
@@ -465,26 +495,34 @@ storage_put_row(relation_t *rel, storage_row_t row)
   }
 #endif
 
-  /* Ensure that last written byte is separated from 0, to make file
-     lengths correct in Coffee. */
-  last_byte = row + rel->row_length - 1;
-  *last_byte ^= ROW_XOR;
+  /* Ensure that last written byte of each row is separated from 0, to
+     make file lengths correct in Coffee. */
+  for(i = 1; i <= count; i++) {
+    rows[i * rel->row_length - 1] ^= ROW_XOR;
+  }
 
-  remaining = rel->row_length;
+  ptr = rows;
+  remaining = count * rel->row_length;
   do {
-    r = cfs_write(rel->tuple_storage, row, remaining);
+    r = cfs_write(rel->tuple_storage, ptr, remaining);
     if(r < 0) {
       PRINTF("DB: Failed to store %u bytes\n", remaining);
-      *last_byte ^= ROW_XOR;
-      return DB_STORAGE_ERROR;
+      break;
     }
-    row += r;
+    STORAGE_COUNT_WRITE(r);
+    ptr += r;
     remaining -= r;
   } while(remaining > 0);
 
-  PRINTF("DB: Stored a of %d bytes\n", rel->row_length);
+  for(i = 1; i <= count; i++) {
+    rows[i * rel->row_length - 1] ^= ROW_XOR;
+  }
 
-  *last_byte ^= ROW_XOR;
+  if(remaining > 0) {
+    return DB_STORAGE_ERROR;
+  }
+
+  PRINTF("DB: Stored %u rows of %d bytes\n", count, rel->row_length);
 
   return DB_OK;
 }
@@ -507,6 +545,194 @@ storage_get_row_amount(relation_t *rel, tuple_id_t *amount)
 
   return DB_OK;
 }
+#endif /* !DB_FEATURE_COLUMNS */
+
+/* Read the next row of a file of rows. */
+static db_result_t
+read_next_row(storage_scan_t *scan, tuple_id_t *tuple_id, storage_row_t *row)
+{
+  tuple_id_t rows;
+  unsigned i;
+  int r;
+
+  if(scan->next_row == scan->buffered_rows) {
+    /* Refill the buffer with the rows following the buffered ones. */
+    scan->first_row += scan->buffered_rows;
+    scan->buffered_rows = scan->next_row = 0;
+
+    if(scan->first_row >= scan->row_count) {
+      return DB_FINISHED;
+    }
+
+    rows = sizeof(scan->buffer) / scan->row_length;
+    if(rows > scan->row_count - scan->first_row) {
+      rows = scan->row_count - scan->first_row;
+    }
+
+    /* Extend the file to the last row to read, as in storage_read(),
+       in case the end of the file is taken to be earlier. */
+    if(cfs_seek(scan->fd, (scan->first_row + rows) * scan->row_length,
+                CFS_SEEK_SET) == (cfs_offset_t)-1 ||
+       cfs_seek(scan->fd, scan->first_row * scan->row_length,
+                CFS_SEEK_SET) == (cfs_offset_t)-1) {
+      return DB_STORAGE_ERROR;
+    }
+
+    r = cfs_read(scan->fd, scan->buffer, rows * scan->row_length);
+    if(r < 0) {
+      PRINTF("DB: Reading failed on fd %d\n", scan->fd);
+      return DB_STORAGE_ERROR;
+    } else if(r < rows * scan->row_length) {
+      PRINTF("DB: Incomplete read: %d < %u\n", r,
+             (unsigned)(rows * scan->row_length));
+      return DB_STORAGE_ERROR;
+    }
+
+    for(i = 1; i <= rows; i++) {
+      scan->buffer[i * scan->row_length - 1] ^= ROW_XOR;
+    }
+    scan->buffered_rows = rows;
+    STORAGE_COUNT_READ(r);
+
+    PRINTF("DB: Read %u rows from fd %d\n", (unsigned)rows, scan->fd);
+  }
+
+  *tuple_id = scan->first_row + scan->next_row;
+  *row = scan->buffer + scan->next_row * scan->row_length;
+  scan->next_row++;
+
+  return DB_OK;
+}
+
+static void
+scan_file(storage_scan_t *scan, db_storage_id_t fd,
+          unsigned row_length, tuple_id_t row_count)
+{
+  scan->next = read_next_row;
+  scan->fd = fd;
+  scan->row_length = row_length;
+  scan->row_count = row_count;
+  scan->first_row = 0;
+  scan->buffered_rows = 0;
+  scan->next_row = 0;
+}
+
+#if !DB_FEATURE_COLUMNS
+db_result_t
+storage_scan_init(storage_scan_t *scan, relation_t *rel)
+{
+  tuple_id_t row_count;
+
+  if(DB_ERROR(storage_get_row_amount(rel, &row_count))) {
+    return DB_STORAGE_ERROR;
+  }
+
+  scan_file(scan, rel->tuple_storage, rel->row_length, row_count);
+  return DB_OK;
+}
+
+/* A scan of the row storage always reads whole rows. */
+void
+storage_scan_columns(storage_scan_t *scan, unsigned columns)
+{
+}
+
+void
+storage_scan_range(storage_scan_t *scan, attribute_id_t attribute,
+                   long min, long max)
+{
+}
+#endif /* !DB_FEATURE_COLUMNS */
+
+/* Scan a file of rows that has been written by storage_append_rows(). */
+db_result_t
+storage_scan_open(storage_scan_t *scan, const char *filename,
+                  unsigned row_length, tuple_id_t row_count)
+{
+  int fd;
+
+  fd = cfs_open(filename, CFS_READ);
+  if(fd < 0) {
+    return DB_STORAGE_ERROR;
+  }
+
+  scan_file(scan, fd, row_length, row_count);
+  return DB_OK;
+}
+
+void
+storage_scan_close(storage_scan_t *scan)
+{
+  cfs_close(scan->fd);
+}
+
+void
+storage_scan_seek(storage_scan_t *scan, tuple_id_t tuple_id)
+{
+  if(tuple_id >= scan->first_row &&
+     tuple_id < scan->first_row + scan->buffered_rows) {
+    /* The row is still in the buffer. */
+    scan->next_row = tuple_id - scan->first_row;
+  } else {
+    scan->first_row = tuple_id;
+    scan->buffered_rows = 0;
+    scan->next_row = 0;
+  }
+}
+
+db_result_t
+storage_scan_next(storage_scan_t *scan, tuple_id_t *tuple_id,
+                  storage_row_t *row)
+{
+  return scan->next(scan, tuple_id, row);
+}
+
+void
+storage_remove_file(const char *filename)
+{
+  cfs_remove(filename);
+}
+
+/*
+ * Append rows to a file that is later read with a scan cursor. The
+ * last byte of each row is encoded as in storage_put_row(). The caller
+ * keeps track of the number of rows in the file, because the end of a
+ * file in Coffee is not known exactly if the last byte is zero.
+ */
+db_result_t
+storage_append_rows(const char *filename, unsigned row_length,
+                    tuple_id_t row_count, unsigned char *rows, unsigned count)
+{
+  int fd;
+  int r;
+  unsigned i;
+  unsigned length;
+
+  fd = cfs_open(filename, CFS_WRITE | CFS_APPEND);
+  if(fd < 0) {
+    return DB_STORAGE_ERROR;
+  }
+
+  for(i = 1; i <= count; i++) {
+    rows[i * row_length - 1] ^= ROW_XOR;
+  }
+
+  length = count * row_length;
+  if(cfs_seek(fd, row_count * row_length, CFS_SEEK_SET) == (cfs_offset_t)-1) {
+    r = -1;
+  } else {
+    r = cfs_write(fd, rows, length);
+    STORAGE_COUNT_WRITE(length);
+  }
+
+  for(i = 1; i <= count; i++) {
+    rows[i * row_length - 1] ^= ROW_XOR;
+  }
+
+  cfs_close(fd);
+
+  return r == length ? DB_OK : DB_STORAGE_ERROR;
+}
 
 db_storage_id_t
 storage_open(const char *filename)
@@ -551,6 +777,7 @@ storage_read(db_storage_id_t fd,
     if(r <= 0) {
       return DB_STORAGE_ERROR;
     }
+    STORAGE_COUNT_READ(r);
     ptr += r;
     length -= r;
   }
@@ -575,6 +802,7 @@ storage_write(db_storage_id_t fd,
     if(r <= 0) {
       return DB_STORAGE_ERROR;
     }
+    STORAGE_COUNT_WRITE(r);
     ptr += r;
     length -= r;
   }
@@ -0,0 +1,607 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *	Column storage for the database. The values of each attribute
+ *	of a relation are stored in a file of their own, so that a scan
+ *	only reads the attributes that a query uses.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cfs/cfs.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#include "db-options.h"
+#include "result.h"
+#include "storage.h"
+
+#if DB_FEATURE_COLUMNS
+
+/*
+ * The values of the first attribute of a relation are stored in its
+ * tuple file, and the values of attribute i > 0 in the file named
+ * "<tuple file>.<i>". The last byte of each value is encoded as the
+ * last byte of a row in the row storage. Each value in the tuple file is
+ * followed by a row mark that is never zero, because Coffee finds the
+ * end of a file by looking for its last byte that is not zero.
+ *
+ * The values are divided into chunks of DB_COLUMN_CHUNK_ROWS rows. When
+ * a chunk of an INT or a LONG attribute is full, its zone map, which
+ * holds the smallest and the largest value in the chunk, is appended to
+ * the file after the values. A scan skips the chunks whose zone maps
+ * show that no row is in the ranges of the scan. The last chunk of a
+ * relation has no zone map until it is full. Since the files are only
+ * appended to, the number of rows is given by the length of the tuple
+ * file.
+ */
+
+#if DB_MAX_ATTRIBUTES_PER_RELATION > 16
+#error "The column storage supports at most 16 attributes per relation."
+#endif
+
+#define COLUMN_NAME_LENGTH	(RELATION_NAME_LENGTH + sizeof(".f"))
+
+/* A zone map consists of two values encoded as LONG values. */
+#define ZONE_MAP_SIZE		8
+
+#define HAS_ZONE_MAP(attr)	((attr)->domain == DOMAIN_INT || \
+				 (attr)->domain == DOMAIN_LONG)
+#define ZONE_SIZE(attr)		(HAS_ZONE_MAP(attr) ? ZONE_MAP_SIZE : 0)
+#define ROW_MARK		ROW_XOR
+#define VALUE_SIZE(attr, column) ((attr)->element_size + ((column) == 0))
+#define CHUNK_SIZE(attr, column) (DB_COLUMN_CHUNK_ROWS * \
+				  VALUE_SIZE(attr, column) + ZONE_SIZE(attr))
+
+/* The values of one attribute, on their way to or from a file. */
+static unsigned char column_buffer[STORAGE_SCAN_BUFFER_SIZE];
+
+static db_result_t next_row(storage_scan_t *, tuple_id_t *, storage_row_t *);
+
+static char *
+column_name(relation_t *rel, unsigned column)
+{
+  static char name[COLUMN_NAME_LENGTH];
+
+  snprintf(name, sizeof(name), "%s.%x", rel->tuple_filename, column & 0xf);
+  return name;
+}
+
+static db_storage_id_t
+open_column(relation_t *rel, unsigned column, int flags)
+{
+  if(column == 0) {
+    return rel->tuple_storage;
+  }
+  return cfs_open(column_name(rel, column), flags);
+}
+
+static void
+close_column(relation_t *rel, db_storage_id_t fd)
+{
+  if(fd != rel->tuple_storage) {
+    cfs_close(fd);
+  }
+}
+
+static unsigned long
+value_offset(attribute_t *attr, unsigned column, tuple_id_t row)
+{
+  return (unsigned long)(row / DB_COLUMN_CHUNK_ROWS) *
+         CHUNK_SIZE(attr, column) +
+         (row % DB_COLUMN_CHUNK_ROWS) * VALUE_SIZE(attr, column);
+}
+
+/* The number of rows following a row in its chunk, limited to count. */
+static unsigned
+chunk_rows(tuple_id_t row, unsigned count)
+{
+  unsigned rows;
+
+  rows = DB_COLUMN_CHUNK_ROWS - row % DB_COLUMN_CHUNK_ROWS;
+  return rows < count ? rows : count;
+}
+
+/* Read the values of count rows of an attribute. The values buffer must
+   have room for the row marks of the first attribute. */
+static db_result_t
+read_column(db_storage_id_t fd, attribute_t *attr, unsigned column,
+            unsigned char *values, tuple_id_t first_row, unsigned count)
+{
+  unsigned size;
+  unsigned stored_size;
+  unsigned rows;
+  unsigned i;
+
+  size = attr->element_size;
+  stored_size = VALUE_SIZE(attr, column);
+  for(; count > 0; count -= rows, first_row += rows, values += rows * size) {
+    rows = chunk_rows(first_row, count);
+    if(DB_ERROR(storage_read(fd, values,
+                             value_offset(attr, column, first_row),
+                             rows * stored_size))) {
+      return DB_STORAGE_ERROR;
+    }
+    for(i = 0; i < rows; i++) {
+      if(stored_size != size) {
+        memmove(values + i * size, values + i * stored_size, size);
+      }
+      values[(i + 1) * size - 1] ^= ROW_XOR;
+    }
+  }
+  return DB_OK;
+}
+
+static void
+put_long(unsigned char *ptr, long l)
+{
+  ptr[0] = l >> 24;
+  ptr[1] = l >> 16;
+  ptr[2] = l >> 8;
+  ptr[3] = l & 0xff;
+}
+
+static long
+get_long(unsigned char *ptr)
+{
+  return (long)ptr[0] << 24 | (long)ptr[1] << 16 |
+         (long)ptr[2] << 8 | (long)ptr[3];
+}
+
+/* Append the zone map of a full chunk to the file of an attribute. */
+static db_result_t
+put_zone_map(db_storage_id_t fd, attribute_t *attr, unsigned column,
+             tuple_id_t chunk)
+{
+  attribute_value_t value;
+  unsigned char zone[ZONE_MAP_SIZE];
+  tuple_id_t row;
+  unsigned batch;
+  unsigned values;
+  unsigned i;
+  long l;
+  long min;
+  long max;
+
+  min = LONG_MAX;
+  max = LONG_MIN;
+  batch = sizeof(column_buffer) / VALUE_SIZE(attr, column);
+  for(row = chunk * DB_COLUMN_CHUNK_ROWS;
+      row < (chunk + 1) * DB_COLUMN_CHUNK_ROWS;
+      row += values) {
+    values = chunk_rows(row, batch);
+    if(DB_ERROR(read_column(fd, attr, column, column_buffer, row, values))) {
+      return DB_STORAGE_ERROR;
+    }
+    for(i = 0; i < values; i++) {
+      db_phy_to_value(&value, attr, column_buffer + i * attr->element_size);
+      l = db_value_to_long(&value);
+      if(l < min) {
+        min = l;
+      }
+      if(l > max) {
+        max = l;
+      }
+    }
+  }
+
+  put_long(zone, min);
+  put_long(zone + 4, max);
+  zone[ZONE_MAP_SIZE - 1] ^= ROW_XOR;
+
+  return storage_write(fd, zone, (chunk + 1) * CHUNK_SIZE(attr, column) -
+                       ZONE_MAP_SIZE, ZONE_MAP_SIZE);
+}
+
+/* Append the values of an attribute in consecutive rows to its file. */
+static db_result_t
+write_column(relation_t *rel, attribute_t *attr, unsigned column,
+             unsigned offset, storage_row_t rows, unsigned count,
+             tuple_id_t first_row)
+{
+  db_storage_id_t fd;
+  unsigned size;
+  unsigned stored_size;
+  unsigned batch;
+  unsigned values;
+  unsigned i;
+  unsigned j;
+  tuple_id_t row;
+  db_result_t result;
+
+  fd = open_column(rel, column, CFS_READ | CFS_WRITE);
+  if(fd < 0) {
+    return DB_STORAGE_ERROR;
+  }
+
+  result = DB_OK;
+  size = attr->element_size;
+  stored_size = VALUE_SIZE(attr, column);
+  batch = sizeof(column_buffer) / stored_size;
+  for(i = 0; i < count && result == DB_OK; i += values) {
+    row = first_row + i;
+    values = chunk_rows(row, count - i < batch ? count - i : batch);
+    for(j = 0; j < values; j++) {
+      memcpy(column_buffer + j * stored_size,
+             rows + (i + j) * rel->row_length + offset, size);
+      column_buffer[j * stored_size + size - 1] ^= ROW_XOR;
+      if(stored_size != size) {
+        column_buffer[(j + 1) * stored_size - 1] = ROW_MARK;
+      }
+    }
+    result = storage_write(fd, column_buffer, value_offset(attr, column, row),
+                           values * stored_size);
+
+    if(result == DB_OK && HAS_ZONE_MAP(attr) &&
+       (row + values) % DB_COLUMN_CHUNK_ROWS == 0) {
+      result = put_zone_map(fd, attr, column, row / DB_COLUMN_CHUNK_ROWS);
+    }
+  }
+
+  close_column(rel, fd);
+  return result;
+}
+
+/* Check whether the zone maps of a chunk exclude the ranges of a scan.
+   Returns 1 if the chunk can be skipped, 0 if not, and -1 on errors. */
+static int
+skip_chunk(storage_scan_t *scan, tuple_id_t chunk)
+{
+  relation_t *rel;
+  attribute_t *attr;
+  unsigned char zone[ZONE_MAP_SIZE];
+  unsigned column;
+  db_storage_id_t fd;
+  db_result_t result;
+
+  rel = scan->rel;
+  for(attr = list_head(rel->attributes), column = 0;
+      attr != NULL;
+      attr = attr->next, column++) {
+    if(!(scan->ranges & (1 << column)) || !HAS_ZONE_MAP(attr)) {
+      continue;
+    }
+
+    fd = open_column(rel, column, CFS_READ);
+    if(fd < 0) {
+      return -1;
+    }
+    result = storage_read(fd, zone, (chunk + 1) * CHUNK_SIZE(attr, column) -
+                          ZONE_MAP_SIZE, ZONE_MAP_SIZE);
+    close_column(rel, fd);
+    if(DB_ERROR(result)) {
+      return -1;
+    }
+
+    zone[ZONE_MAP_SIZE - 1] ^= ROW_XOR;
+    if(get_long(zone + 4) < scan->min[column] ||
+       get_long(zone) > scan->max[column]) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Read the values of the rows following the buffered ones. The values
+   of each attribute that the scan reads are stored after each other. */
+static db_result_t
+fill_columns(storage_scan_t *scan)
+{
+  relation_t *rel;
+  attribute_t *attr;
+  tuple_id_t chunk_end;
+  tuple_id_t rows;
+  unsigned column;
+  unsigned width;
+  unsigned char *values;
+  int skip;
+  db_storage_id_t fd;
+  db_result_t result;
+
+  rel = scan->rel;
+
+  if(scan->ranges != 0) {
+    /* Skip the full chunks that have no rows in the ranges. */
+    while(scan->first_row >= scan->zone_end) {
+      chunk_end = (scan->first_row / DB_COLUMN_CHUNK_ROWS + 1) *
+                  DB_COLUMN_CHUNK_ROWS;
+      if(chunk_end > scan->row_count) {
+        break;
+      }
+      skip = skip_chunk(scan, scan->first_row / DB_COLUMN_CHUNK_ROWS);
+      if(skip < 0) {
+        return DB_STORAGE_ERROR;
+      } else if(!skip) {
+        scan->zone_end = chunk_end;
+        break;
+      }
+      scan->first_row = chunk_end;
+      if(scan->first_row >= scan->row_count) {
+        return DB_FINISHED;
+      }
+    }
+  }
+
+  width = 0;
+  for(attr = list_head(rel->attributes), column = 0;
+      attr != NULL;
+      attr = attr->next, column++) {
+    if(scan->columns & (1 << column)) {
+      width += VALUE_SIZE(attr, column);
+    }
+  }
+
+  rows = sizeof(scan->buffer) / (width > 0 ? width : 1);
+  if(rows > scan->row_count - scan->first_row) {
+    rows = scan->row_count - scan->first_row;
+  }
+  if(scan->ranges != 0) {
+    /* Do not read past a chunk that has not been checked. */
+    rows = chunk_rows(scan->first_row, rows);
+  }
+
+  values = scan->buffer;
+  for(attr = list_head(rel->attributes), column = 0;
+      attr != NULL;
+      attr = attr->next, column++) {
+    if(!(scan->columns & (1 << column))) {
+      continue;
+    }
+
+    fd = open_column(rel, column, CFS_READ);
+    if(fd < 0) {
+      return DB_STORAGE_ERROR;
+    }
+    result = read_column(fd, attr, column, values, scan->first_row, rows);
+    close_column(rel, fd);
+    if(DB_ERROR(result)) {
+      PRINTF("DB: Reading failed on column %u of relation %s\n",
+             column, rel->name);
+      return result;
+    }
+    values += rows * attr->element_size;
+  }
+  scan->buffered_rows = rows;
+
+  PRINTF("DB: Read %u rows from relation %s\n", (unsigned)rows, rel->name);
+
+  return DB_OK;
+}
+
+/* Assemble the next row from the buffered values. */
+static db_result_t
+next_row(storage_scan_t *scan, tuple_id_t *tuple_id, storage_row_t *row)
+{
+  attribute_t *attr;
+  unsigned column;
+  unsigned offset;
+  unsigned char *values;
+  db_result_t result;
+
+  if(scan->next_row == scan->buffered_rows) {
+    scan->first_row += scan->buffered_rows;
+    scan->buffered_rows = scan->next_row = 0;
+
+    if(scan->first_row >= scan->row_count) {
+      return DB_FINISHED;
+    }
+
+    result = fill_columns(scan);
+    if(result != DB_OK) {
+      return result;
+    }
+  }
+
+  values = scan->buffer;
+  for(attr = list_head(scan->rel->attributes), column = offset = 0;
+      attr != NULL;
+      offset += attr->element_size, attr = attr->next, column++) {
+    if(scan->columns & (1 << column)) {
+      memcpy(scan->row + offset,
+             values + scan->next_row * attr->element_size,
+             attr->element_size);
+      values += scan->buffered_rows * attr->element_size;
+    }
+  }
+
+  *tuple_id = scan->first_row + scan->next_row;
+  *row = scan->row;
+  scan->next_row++;
+
+  return DB_OK;
+}
+
+db_result_t
+storage_drop_relation(relation_t *rel, int remove_tuples)
+{
+  unsigned column;
+
+  if(remove_tuples && RELATION_HAS_TUPLES(rel)) {
+    for(column = 1; column < DB_MAX_ATTRIBUTES_PER_RELATION; column++) {
+      cfs_remove(column_name(rel, column));
+    }
+    cfs_remove(rel->tuple_filename);
+  }
+  return cfs_remove(rel->name) < 0 ? DB_STORAGE_ERROR : DB_OK;
+}
+
+db_result_t
+storage_get_row(relation_t *rel, tuple_id_t *tuple_id, storage_row_t row)
+{
+  attribute_t *attr;
+  tuple_id_t nrows;
+  unsigned column;
+  unsigned char value[DB_MAX_ELEMENT_SIZE + 1];
+  db_storage_id_t fd;
+  db_result_t result;
+
+  if(DB_ERROR(storage_get_row_amount(rel, &nrows))) {
+    return DB_STORAGE_ERROR;
+  }
+
+  if(*tuple_id >= nrows) {
+    return DB_FINISHED;
+  }
+
+  for(attr = list_head(rel->attributes), column = 0;
+      attr != NULL;
+      row += attr->element_size, attr = attr->next, column++) {
+    fd = open_column(rel, column, CFS_READ);
+    if(fd < 0) {
+      return DB_STORAGE_ERROR;
+    }
+    result = read_column(fd, attr, column, value, *tuple_id, 1);
+    close_column(rel, fd);
+    if(DB_ERROR(result)) {
+      PRINTF("DB: Reading failed on column %u of relation %s\n",
+             column, rel->name);
+      return result;
+    }
+    memcpy(row, value, attr->element_size);
+  }
+
+  return DB_OK;
+}
+
+/* Append consecutive rows to a relation with one write per attribute and
+   chunk. */
+db_result_t
+storage_put_rows(relation_t *rel, storage_row_t rows, unsigned count)
+{
+  attribute_t *attr;
+  tuple_id_t row_count;
+  unsigned column;
+  unsigned offset;
+  db_result_t result;
+
+  attr = list_head(rel->attributes);
+  if(attr == NULL || DB_ERROR(storage_get_row_amount(rel, &row_count))) {
+    return DB_STORAGE_ERROR;
+  }
+
+  if(row_count == 0) {
+    /* The files of a new relation may not exist yet. */
+    for(column = 1; column < rel->attribute_count; column++) {
+      storage_create_file(column_name(rel, column), DB_COLUMN_RESERVE_SIZE);
+    }
+  }
+
+  /* The first attribute is written last, because the length of its
+     file gives the number of rows. */
+  for(offset = attr->element_size, attr = attr->next, column = 1;
+      attr != NULL;
+      offset += attr->element_size, attr = attr->next, column++) {
+    result = write_column(rel, attr, column, offset, rows, count, row_count);
+    if(DB_ERROR(result)) {
+      return result;
+    }
+  }
+  result = write_column(rel, list_head(rel->attributes), 0, 0, rows, count,
+                        row_count);
+  if(DB_ERROR(result)) {
+    PRINTF("DB: Failed to store %u rows\n", count);
+    return result;
+  }
+
+  PRINTF("DB: Stored %u rows of %d bytes\n", count, rel->row_length);
+
+  return DB_OK;
+}
+
+db_result_t
+storage_get_row_amount(relation_t *rel, tuple_id_t *amount)
+{
+  attribute_t *attr;
+  cfs_offset_t offset;
+  unsigned long rows;
+
+  attr = list_head(rel->attributes);
+  if(attr == NULL) {
+    *amount = 0;
+  } else {
+    offset = cfs_seek(rel->tuple_storage, 0, CFS_SEEK_END);
+    if(offset == (cfs_offset_t)-1) {
+      return DB_STORAGE_ERROR;
+    }
+
+    rows = (offset % CHUNK_SIZE(attr, 0)) / VALUE_SIZE(attr, 0);
+    if(rows > DB_COLUMN_CHUNK_ROWS) {
+      rows = DB_COLUMN_CHUNK_ROWS;
+    }
+    *amount = (tuple_id_t)((offset / CHUNK_SIZE(attr, 0)) *
+                           DB_COLUMN_CHUNK_ROWS + rows);
+  }
+
+  return DB_OK;
+}
+
+db_result_t
+storage_scan_init(storage_scan_t *scan, relation_t *rel)
+{
+  if(DB_ERROR(storage_get_row_amount(rel, &scan->row_count))) {
+    return DB_STORAGE_ERROR;
+  }
+
+  scan->next = next_row;
+  scan->fd = rel->tuple_storage;
+  scan->row_length = rel->row_length;
+  scan->first_row = 0;
+  scan->buffered_rows = 0;
+  scan->next_row = 0;
+  scan->rel = rel;
+  scan->zone_end = 0;
+  scan->columns = (1 << rel->attribute_count) - 1;
+  scan->ranges = 0;
+  memset(scan->row, 0, sizeof(scan->row));
+  return DB_OK;
+}
+
+/* Read only the attributes whose bits are set in the columns mask. */
+void
+storage_scan_columns(storage_scan_t *scan, unsigned columns)
+{
+  scan->columns = columns;
+}
+
+/* Let the scan skip chunks without values of an attribute in a range. */
+void
+storage_scan_range(storage_scan_t *scan, attribute_id_t attribute,
+                   long min, long max)
+{
+  scan->ranges |= 1 << attribute;
+  scan->min[attribute] = min;
+  scan->max[attribute] = max;
+}
+
+#endif /* DB_FEATURE_COLUMNS */
@@ -50,6 +50,78 @@
 
 typedef unsigned char * storage_row_t;
 
+/* The last byte of each row in a file is encoded with this value, so
+   that the file does not end with a zero byte, which would make Coffee
+   determine a too short length when the file is opened. */
+#define ROW_XOR 0xf6U
+
+#define STORAGE_MAX_ROW_LENGTH (DB_MAX_ATTRIBUTES_PER_RELATION * \
+                                DB_MAX_ELEMENT_SIZE)
+
+/* The scan buffer holds at least one row of the widest relation. */
+#if DB_SCAN_BUFFER_SIZE < STORAGE_MAX_ROW_LENGTH
+#define STORAGE_SCAN_BUFFER_SIZE STORAGE_MAX_ROW_LENGTH
+#else
+#define STORAGE_SCAN_BUFFER_SIZE DB_SCAN_BUFFER_SIZE
+#endif
+
+/*
+ * A scan cursor reads the rows of a relation in tuple ID order, and
+ * fetches as many rows as fit in its buffer at a time. The row count
+ * is read when the scan starts, so rows inserted during the scan are
+ * not visited. A cursor can also read a temporary file of rows, such
+ * as a partition of a join.
+ *
+ * With the column storage, a cursor of a relation buffers the values
+ * of each attribute in the columns mask, and assembles each row that
+ * it returns from them. The other attributes are not read, and rows
+ * whose values are outside the ranges set for the scan may be skipped.
+ */
+struct storage_scan {
+  db_result_t (*next)(struct storage_scan *, tuple_id_t *, storage_row_t *);
+  db_storage_id_t fd;
+  unsigned row_length;
+  tuple_id_t row_count;
+  tuple_id_t first_row;
+  uint16_t buffered_rows;
+  uint16_t next_row;
+#if DB_FEATURE_COLUMNS
+  relation_t *rel;
+  tuple_id_t zone_end;
+  unsigned columns;
+  unsigned ranges;
+  long min[DB_MAX_ATTRIBUTES_PER_RELATION];
+  long max[DB_MAX_ATTRIBUTES_PER_RELATION];
+  unsigned char row[STORAGE_MAX_ROW_LENGTH];
+#endif /* DB_FEATURE_COLUMNS */
+  unsigned char buffer[STORAGE_SCAN_BUFFER_SIZE];
+};
+typedef struct storage_scan storage_scan_t;
+
+/* The number of rows that can be read from the cursor without I/O. */
+#define STORAGE_SCAN_BUFFERED(scan) \
+  ((scan)->buffered_rows - (scan)->next_row)
+
+#if DB_FEATURE_EXPLAIN
+/* The amount of I/O on rows and indexes, for the plans of queries. */
+struct storage_stats {
+  unsigned long reads;
+  unsigned long read_bytes;
+  unsigned long writes;
+  unsigned long write_bytes;
+};
+
+extern struct storage_stats storage_stats;
+
+#define STORAGE_COUNT_READ(bytes)	\
+  (storage_stats.reads++, storage_stats.read_bytes += (bytes))
+#define STORAGE_COUNT_WRITE(bytes)	\
+  (storage_stats.writes++, storage_stats.write_bytes += (bytes))
+#else
+#define STORAGE_COUNT_READ(bytes)
+#define STORAGE_COUNT_WRITE(bytes)
+#endif /* DB_FEATURE_EXPLAIN */
+
 char *storage_generate_file(char *, unsigned long);
 
 db_result_t storage_load(relation_t *);
@@ -66,8 +138,23 @@ db_result_t storage_put_index(index_t *);
 
 db_result_t storage_get_row(relation_t *, tuple_id_t *, storage_row_t);
 db_result_t storage_put_row(relation_t *, storage_row_t);
+db_result_t storage_put_rows(relation_t *, storage_row_t, unsigned);
 db_result_t storage_get_row_amount(relation_t *, tuple_id_t *);
 
+db_result_t storage_scan_init(storage_scan_t *, relation_t *);
+db_result_t storage_scan_open(storage_scan_t *, const char *, unsigned,
+                              tuple_id_t);
+void storage_scan_close(storage_scan_t *);
+db_result_t storage_scan_next(storage_scan_t *, tuple_id_t *, storage_row_t *);
+void storage_scan_seek(storage_scan_t *, tuple_id_t);
+void storage_scan_columns(storage_scan_t *, unsigned);
+void storage_scan_range(storage_scan_t *, attribute_id_t, long, long);
+
+db_result_t storage_create_file(const char *, unsigned long);
+void storage_remove_file(const char *);
+db_result_t storage_append_rows(const char *, unsigned, tuple_id_t,
+                                unsigned char *, unsigned);
+
 db_storage_id_t storage_open(const char *);
 void storage_close(db_storage_id_t);
 db_result_t storage_read(db_storage_id_t, void *, unsigned long, unsigned);
@@ -41,6 +41,7 @@
 
 #include "contiki.h"
 #include "shell-memdebug.h"
+#include "lib/mmem.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -56,6 +57,11 @@ SHELL_COMMAND(peek_command,
 	      "peek",
 	      "peek <address>: read a byte from address <address>",
 	      &shell_peek_process);
+PROCESS(shell_mmem_process, "mmem");
+SHELL_COMMAND(mmem_command,
+	      "mmem",
+	      "mmem: show managed memory fragmentation statistics",
+	      &shell_mmem_process);
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(shell_poke_process, ev, data)
 {
@@ -120,10 +126,33 @@ PROCESS_THREAD(shell_peek_process, ev, data)
   PROCESS_END();
 }
 /*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_mmem_process, ev, data)
+{
+  struct mmem_stats stats;
+  char buf[80];
+
+  PROCESS_BEGIN();
+
+  mmem_stats(&stats);
+
+  /* The fragmentation is the share of the free memory that is
+     scattered in holes rather than available in one piece. */
+  snprintf(buf, sizeof(buf),
+	   "avail %u holes %u hole bytes %u largest %u fragmentation %u%%",
+	   stats.avail, stats.holes, stats.hole_bytes, stats.largest_hole,
+	   stats.avail == 0 ? 0 :
+	   (unsigned)((unsigned long)stats.hole_bytes * 100 / stats.avail));
+
+  shell_output_str(&mmem_command, buf, "");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
 void
 shell_memdebug_init(void)
 {
   shell_register_command(&poke_command);
   shell_register_command(&peek_command);
+  shell_register_command(&mmem_command);
 }
 /*---------------------------------------------------------------------------*/
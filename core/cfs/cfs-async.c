@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Asynchronous I/O for CFS
+ */
+
+#include "contiki.h"
+#include "lib/list.h"
+#include "cfs/cfs-async.h"
+
+/* The largest number of buffers passed to the file system in a step. */
+#define STEP_IOV 8
+
+LIST(requests);
+
+process_event_t cfs_async_event;
+
+PROCESS(cfs_async_process, "CFS async");
+/*---------------------------------------------------------------------------*/
+static void
+submit(struct cfs_async *req, int fd, const struct cfs_iovec *iov,
+       int iovcnt, uint8_t op)
+{
+  req->process = PROCESS_CURRENT();
+  req->fd = fd;
+  req->iov = iov;
+  req->iovcnt = iovcnt;
+  req->op = op;
+  req->result = 0;
+  req->index = 0;
+  req->done = 0;
+
+  if(!process_is_running(&cfs_async_process)) {
+    process_start(&cfs_async_process, NULL);
+  }
+  list_add(requests, req);
+  process_poll(&cfs_async_process);
+}
+/*---------------------------------------------------------------------------*/
+void
+cfs_async_read(struct cfs_async *req, int fd,
+               const struct cfs_iovec *iov, int iovcnt)
+{
+  submit(req, fd, iov, iovcnt, CFS_ASYNC_READ);
+}
+/*---------------------------------------------------------------------------*/
+void
+cfs_async_write(struct cfs_async *req, int fd,
+                const struct cfs_iovec *iov, int iovcnt)
+{
+  submit(req, fd, iov, iovcnt, CFS_ASYNC_WRITE);
+}
+/*---------------------------------------------------------------------------*/
+void
+cfs_async_cancel(struct cfs_async *req)
+{
+  list_remove(requests, req);
+}
+/*---------------------------------------------------------------------------*/
+/* Transfer the next part of a request. Returns non-zero when the
+   request has completed. */
+static int
+step(struct cfs_async *req)
+{
+  struct cfs_iovec v[STEP_IOV];
+  unsigned int len, size;
+  int n, r;
+
+  /* Collect up to CFS_ASYNC_STEP_SIZE bytes from the remaining buffers. */
+  size = 0;
+  for(n = 0; n < STEP_IOV && req->index + n < req->iovcnt &&
+        size < CFS_ASYNC_STEP_SIZE; n++) {
+    v[n] = req->iov[req->index + n];
+    if(n == 0) {
+      v[n].base = (char *)v[n].base + req->done;
+      v[n].len -= req->done;
+    }
+    if(v[n].len > CFS_ASYNC_STEP_SIZE - size) {
+      v[n].len = CFS_ASYNC_STEP_SIZE - size;
+    }
+    size += v[n].len;
+  }
+  if(n == 0) {
+    return 1;
+  }
+
+  if(req->op == CFS_ASYNC_WRITE) {
+    r = cfs_writev(req->fd, v, n);
+  } else {
+    r = cfs_readv(req->fd, v, n);
+  }
+  if(r < 0) {
+    if(req->result == 0) {
+      req->result = -1;
+    }
+    return 1;
+  }
+  req->result += r;
+
+  /* Advance the position among the buffers. */
+  for(len = r + req->done; req->index < req->iovcnt &&
+        len >= req->iov[req->index].len; req->index++) {
+    len -= req->iov[req->index].len;
+  }
+  req->done = len;
+
+  return r < size || req->index == req->iovcnt;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(cfs_async_process, ev, data)
+{
+  struct cfs_async *req;
+
+  PROCESS_BEGIN();
+
+  cfs_async_event = process_alloc_event();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+    /* The first request is always the one in progress, and the list
+       is read again after every pause in case it was cancelled. */
+    while((req = list_head(requests)) != NULL) {
+      if(step(req)) {
+        /* Keep the request and try again if the event queue is full. */
+        req->index = req->iovcnt;
+        if(process_post(req->process, cfs_async_event, req) ==
+           PROCESS_ERR_OK) {
+          list_remove(requests, req);
+        }
+      }
+      PROCESS_PAUSE();
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,147 @@
+/**
+ * \addtogroup cfs
+ * @{
+ */
+
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Asynchronous I/O for CFS
+ *
+ *         Reads and writes are queued and carried out by a process in
+ *         steps of at most CFS_ASYNC_STEP_SIZE bytes. Other processes
+ *         run between the steps, so a large transfer does not keep
+ *         the radio and the rest of the system waiting. The process
+ *         that submitted a request gets a cfs_async_event with the
+ *         request as data when the request has completed.
+ *
+ *         Requests must be submitted from a process. The requests
+ *         of a file descriptor operate on its current
+ *         position, in the order in which they were submitted. The
+ *         file descriptor should not be used in any other way until
+ *         its requests have completed.
+ */
+
+#ifndef CFS_ASYNC_H
+#define CFS_ASYNC_H
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+
+/**
+ * The largest number of bytes transferred in each step of a request.
+ */
+#ifdef CFS_ASYNC_CONF_STEP_SIZE
+#define CFS_ASYNC_STEP_SIZE CFS_ASYNC_CONF_STEP_SIZE
+#else
+#define CFS_ASYNC_STEP_SIZE 256
+#endif
+
+#define CFS_ASYNC_READ  0
+#define CFS_ASYNC_WRITE 1
+
+/**
+ * An asynchronous read or write. The request and its buffers must
+ * remain allocated until the request has completed.
+ */
+struct cfs_async {
+  struct cfs_async *next;
+  struct process *process;
+  const struct cfs_iovec *iov;
+  int iovcnt;
+  int fd;
+  uint8_t op;
+  /** The number of bytes that was transferred, or -1 if nothing
+      could be transferred. Valid when the request has completed. */
+  int result;
+  /* The position of the next step among the buffers. */
+  int index;
+  unsigned int done;
+};
+
+/**
+ * The event posted to the submitting process when a request has
+ * completed. The data of the event is a pointer to the request.
+ */
+extern process_event_t cfs_async_event;
+
+/**
+ * \brief      Submit an asynchronous read.
+ * \param req  The request.
+ * \param fd   The file descriptor of the open file.
+ * \param iov  The buffers in which data should be read from the file.
+ * \param iovcnt The number of buffers.
+ *
+ *             The buffers are filled as by cfs_readv(). A
+ *             cfs_async_event is posted to the calling process when
+ *             the read has completed.
+ */
+void cfs_async_read(struct cfs_async *req, int fd,
+                    const struct cfs_iovec *iov, int iovcnt);
+
+/**
+ * \brief      Submit an asynchronous write.
+ * \param req  The request.
+ * \param fd   The file descriptor of the open file.
+ * \param iov  The buffers from which data should be written to the file.
+ * \param iovcnt The number of buffers.
+ *
+ *             The buffers are written as by cfs_writev(). A
+ *             cfs_async_event is posted to the calling process when
+ *             the write has completed.
+ */
+void cfs_async_write(struct cfs_async *req, int fd,
+                     const struct cfs_iovec *iov, int iovcnt);
+
+/**
+ * \brief      Cancel a request that has not completed.
+ * \param req  The request.
+ *
+ *             The request is removed from the queue and no event is
+ *             posted for it. Steps that have already been carried out
+ *             are not undone.
+ */
+void cfs_async_cancel(struct cfs_async *req);
+
+/**
+ * \brief      Wait for a request to complete.
+ * \param req  The request.
+ *
+ *             This macro blocks the calling process until the
+ *             request has completed. It can only be used in the
+ *             process that submitted the request.
+ */
+#define CFS_ASYNC_WAIT(req) \
+  PROCESS_WAIT_EVENT_UNTIL(ev == cfs_async_event && data == (req))
+
+#endif /* CFS_ASYNC_H */
+
+/** @} */
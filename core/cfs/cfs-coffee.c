@@ -75,6 +75,23 @@
 #error "Cannot have COFFEE_APPEND_ONLY set when COFFEE_MICRO_LOGS is set."
 #endif
 
+/*
+ * The size of a buffer per file descriptor that collects adjacent
+ * writes to the same log record, so that they are written as one log
+ * record instead of one per write. The buffer is written when a write
+ * falls outside of it, and on reads, seeks, closes, and calls to
+ * cfs_coffee_sync(). Files whose log records are larger than the buffer
+ * are written without it. Set to 0 to leave out the buffers.
+ */
+#ifndef COFFEE_WRITE_BUFFER_SIZE
+#define COFFEE_WRITE_BUFFER_SIZE	0
+#endif
+
+#if !COFFEE_MICRO_LOGS
+#undef COFFEE_WRITE_BUFFER_SIZE
+#define COFFEE_WRITE_BUFFER_SIZE	0
+#endif
+
 /* I/O semantics can be set on file descriptors in order to optimize 
    file access on certain storage types. */
 #ifndef COFFEE_IO_SEMANTICS
@@ -90,6 +107,57 @@
 #define COFFEE_EXTENDED_WEAR_LEVELLING	1
 #endif
 
+/*
+ * The number of entries in a directory in RAM that maps the names of
+ * the files to their first pages and their last known ends. Files can
+ * then be opened without scanning the file headers in the storage. It
+ * must be a power of two, or 0 to leave out the directory.
+ */
+#ifndef COFFEE_DIRECTORY_SIZE
+#define COFFEE_DIRECTORY_SIZE	0
+#endif
+
+#if COFFEE_DIRECTORY_SIZE & (COFFEE_DIRECTORY_SIZE - 1)
+#error COFFEE_DIRECTORY_SIZE must be a power of two.
+#endif
+
+/*
+ * Collect garbage in a process, one sector erasure or one file
+ * relocation at a time, whenever fewer than COFFEE_GC_FREE_PAGES pages
+ * are free. The synchronous garbage collection when a reservation
+ * fails is then only needed if the process cannot keep up.
+ */
+#ifndef COFFEE_INCREMENTAL_GC
+#define COFFEE_INCREMENTAL_GC	0
+#endif
+
+#if COFFEE_INCREMENTAL_GC
+#include "sys/process.h"
+
+#ifndef COFFEE_GC_FREE_PAGES
+#define COFFEE_GC_FREE_PAGES	(2 * COFFEE_PAGES_PER_SECTOR)
+#endif
+
+/* Sectors with more active pages than this are only collected when no
+   other sector can be, since the files in them must all be relocated
+   first. */
+#ifndef COFFEE_GC_RELOCATION_LIMIT
+#define COFFEE_GC_RELOCATION_LIMIT	(COFFEE_PAGES_PER_SECTOR / 2)
+#endif
+#endif /* COFFEE_INCREMENTAL_GC */
+
+/*
+ * Reserve files in the smallest free extent that is large enough,
+ * instead of in the first one after next_free. The free extents are
+ * found from the page counts of the sectors in RAM, without reading
+ * any file headers.
+ */
+#ifndef COFFEE_BEST_FIT
+#define COFFEE_BEST_FIT		0
+#endif
+
+#define COFFEE_SECTOR_COUNTS	(COFFEE_INCREMENTAL_GC || COFFEE_BEST_FIT)
+
 #if COFFEE_START & (COFFEE_SECTOR_SIZE - 1)
 #error COFFEE_START must point to the first byte in a sector.
 #endif
@@ -159,6 +227,7 @@ struct sector_status {
   coffee_page_t active;
   coffee_page_t obsolete;
   coffee_page_t free;
+  coffee_page_t carried;
 };
 
 /* The structure of cached file objects. */
@@ -167,6 +236,9 @@ struct file {
   coffee_page_t page;
   coffee_page_t max_pages;
   int16_t record_count;
+#if COFFEE_DIRECTORY_SIZE
+  uint16_t name_hash;
+#endif
   uint8_t references;
   uint8_t flags;
 };
@@ -200,6 +272,22 @@ struct log_param {
   uint16_t size;
 };
 
+#if COFFEE_WRITE_BUFFER_SIZE
+/* Buffered data that has not been written to a log record yet. The
+   data is contiguous and lies within one log record. */
+struct write_buffer {
+  cfs_offset_t offset;		/* The file offset of the data. */
+  uint16_t size;		/* The size of the data, or 0 if empty. */
+  char data[COFFEE_WRITE_BUFFER_SIZE];
+};
+
+static struct write_buffer write_buffers[COFFEE_FD_SET_SIZE];
+#endif /* COFFEE_WRITE_BUFFER_SIZE */
+
+#if COFFEE_STATS
+struct cfs_coffee_stats cfs_coffee_stats;
+#endif
+
 /*
  * The protected memory consists of structures that should not be 
  * overwritten during system checkpointing because they may be used by 
@@ -217,6 +305,67 @@ static struct file_desc * const coffee_fd_set = protected_mem.coffee_fd_set;
 static coffee_page_t * const next_free = &protected_mem.next_free;
 static char * const gc_wait = &protected_mem.gc_wait;
 
+#if COFFEE_DIRECTORY_SIZE
+/*
+ * The directory is a hash table with linear probing. It is built by
+ * scanning the file headers when it is first used, and then kept up
+ * to date when files are reserved and removed. If more files exist than
+ * the directory can hold, files that are not in the directory are
+ * searched for in the storage.
+ */
+#define DIRECTORY_MASK		(COFFEE_DIRECTORY_SIZE - 1)
+#define DIRECTORY_LIMIT		(COFFEE_DIRECTORY_SIZE / 4 * 3)
+
+struct directory_entry {
+  cfs_offset_t end;
+  coffee_page_t page;
+  uint16_t name_hash;
+};
+
+static struct {
+  struct directory_entry entries[COFFEE_DIRECTORY_SIZE];
+  unsigned count;
+  uint8_t built;
+  uint8_t complete;
+} directory;
+#endif /* COFFEE_DIRECTORY_SIZE */
+
+#if COFFEE_SECTOR_COUNTS
+/*
+ * The page counts of each sector are read from the storage once, and
+ * then kept up to date when pages are reserved, removed and erased.
+ * The synchronous garbage collection invalidates them. Since files
+ * are only reserved from the first free page of a sector, the free
+ * pages of a sector are always the last ones.
+ */
+#define SECTOR_ACTIVE		0
+#define SECTOR_OBSOLETE		1
+#define SECTOR_FREE		2
+
+static struct {
+  coffee_page_t pages[COFFEE_SECTOR_COUNT][3];
+  uint8_t skip[COFFEE_SECTOR_COUNT];
+  int victim;			/* The sector being collected, or -1. */
+  uint8_t valid;
+#if COFFEE_INCREMENTAL_GC
+  /* The file that extends into the victim from an earlier sector. */
+  coffee_page_t carried_page;
+  coffee_page_t carried_end;
+#endif /* COFFEE_INCREMENTAL_GC */
+} sectors = { {{0}}, {0}, -1, 0 };
+#endif /* COFFEE_SECTOR_COUNTS */
+
+#if COFFEE_INCREMENTAL_GC
+/* The extents of the files that overlap a sector. */
+struct sector_extents {
+  coffee_page_t active;		/* First page of the first active file. */
+  coffee_page_t carried;	/* Pages of a file from an earlier sector. */
+  coffee_page_t overflow;	/* Pages of a file in the later sectors. */
+};
+
+PROCESS(coffee_gc_process, "Coffee GC");
+#endif /* COFFEE_INCREMENTAL_GC */
+
 /*---------------------------------------------------------------------------*/
 static void
 write_header(struct file_header *hdr, coffee_page_t page)
@@ -273,6 +422,8 @@ get_sector_status(uint16_t sector, struct sector_status *stats)
    * segment that extends into this segment. If the whole segment is 
    * covered, we do not need to continue counting pages in this iteration.
    */
+  stats->carried = skip_pages < COFFEE_PAGES_PER_SECTOR ?
+                   skip_pages : COFFEE_PAGES_PER_SECTOR;
   if(last_pages_are_active) {
     if(skip_pages >= COFFEE_PAGES_PER_SECTOR) {
       stats->active = COFFEE_PAGES_PER_SECTOR;
@@ -362,12 +513,66 @@ isolate_pages(coffee_page_t start, coffee_page_t skip_pages)
 
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_SECTOR_COUNTS
+static void
+sectors_build(void)
+{
+  struct sector_status stats;
+  uint16_t sector;
+
+  for(sector = 0; sector < COFFEE_SECTOR_COUNT; sector++) {
+    get_sector_status(sector, &stats);
+    sectors.pages[sector][SECTOR_ACTIVE] = stats.active;
+    sectors.pages[sector][SECTOR_OBSOLETE] = stats.obsolete;
+    sectors.pages[sector][SECTOR_FREE] = stats.free;
+    sectors.skip[sector] = 0;
+  }
+  sectors.valid = 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Account for a change of state of a range of pages. */
+static void
+sectors_move(coffee_page_t page, coffee_page_t count, int from, int to)
+{
+  uint16_t sector;
+  coffee_page_t n;
+
+  if(!sectors.valid) {
+    return;
+  }
+
+  while(count > 0) {
+    sector = page / COFFEE_PAGES_PER_SECTOR;
+    n = COFFEE_PAGES_PER_SECTOR - page % COFFEE_PAGES_PER_SECTOR;
+    if(n > count) {
+      n = count;
+    }
+    sectors.pages[sector][from] -= n;
+    sectors.pages[sector][to] += n;
+    page += n;
+    count -= n;
+  }
+}
+#endif /* COFFEE_SECTOR_COUNTS */
+/*---------------------------------------------------------------------------*/
+#if COFFEE_INCREMENTAL_GC
+static void
+gc_poll(void)
+{
+  if(!process_is_running(&coffee_gc_process)) {
+    process_start(&coffee_gc_process, NULL);
+  }
+  process_poll(&coffee_gc_process);
+}
+#endif /* COFFEE_INCREMENTAL_GC */
+/*---------------------------------------------------------------------------*/
 static void
 collect_garbage(int mode)
 {
   uint16_t sector;
   struct sector_status stats;
   coffee_page_t first_page, isolation_count;
+  char header_erased;
 
   PRINTF("Coffee: Running the file system garbage collector in %s mode\n",
 	 mode == GC_RELUCTANT ? "reluctant" : "greedy");
@@ -375,6 +580,7 @@ collect_garbage(int mode)
    * The garbage collector erases as many sectors as possible. A sector is
    * erasable if there are only free or obsolete pages in it.
    */
+  header_erased = 0;
   for(sector = 0; sector < COFFEE_SECTOR_COUNT; sector++) {
     isolation_count = get_sector_status(sector, &stats);
     PRINTF("Coffee: Sector %u has %u active, %u obsolete, and %u free pages.\n",
@@ -382,6 +588,7 @@ collect_garbage(int mode)
 	(unsigned)stats.obsolete, (unsigned)stats.free);
 
     if(stats.active > 0) {
+      header_erased = 0;
       continue;
     }
 
@@ -398,10 +605,29 @@ collect_garbage(int mode)
 
       COFFEE_ERASE(sector);
       PRINTF("Coffee: Erased sector %d!\n", sector);
+#if COFFEE_SECTOR_COUNTS
+      sectors.valid = 0;
+      sectors.victim = -1;
+#endif
+
+      /*
+       * If the sector started with pages of an obsolete file whose
+       * header remains in an earlier sector, the header still spans
+       * the erased pages. Isolate them, or a file reserved here later
+       * would be skipped over by next_file().
+       */
+      if(stats.carried > 0 && !header_erased) {
+        isolate_pages(first_page, stats.carried);
+      }
+      if(stats.carried < COFFEE_PAGES_PER_SECTOR) {
+        header_erased = 1;
+      }
 
       if(mode == GC_RELUCTANT && isolation_count > 0) {
         break;
       }
+    } else if(stats.carried < COFFEE_PAGES_PER_SECTOR) {
+      header_erased = 0;
     }
   }
 }
@@ -427,6 +653,136 @@ next_file(coffee_page_t page, struct file_header *hdr)
   return page + hdr->max_pages;    
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_DIRECTORY_SIZE
+static uint16_t
+name_hash(const char *name)
+{
+  uint16_t hash;
+  unsigned i;
+
+  /* Only the part of the name that fits in a file header is hashed. */
+  hash = 0;
+  for(i = 0; i < COFFEE_NAME_LENGTH - 1 && name[i] != '\0'; i++) {
+    hash = hash * 31 + (unsigned char)name[i];
+  }
+  return hash;
+}
+/*---------------------------------------------------------------------------*/
+static struct directory_entry *
+directory_lookup(uint16_t hash, coffee_page_t page)
+{
+  unsigned i;
+
+  for(i = hash & DIRECTORY_MASK;
+      directory.entries[i].page != INVALID_PAGE;
+      i = (i + 1) & DIRECTORY_MASK) {
+    if(directory.entries[i].page == page) {
+      return &directory.entries[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+directory_add(const char *name, coffee_page_t page, cfs_offset_t end)
+{
+  struct directory_entry *entry;
+  uint16_t hash;
+  unsigned i;
+
+  if(!directory.built) {
+    return;
+  }
+
+  if(directory.count >= DIRECTORY_LIMIT) {
+    PRINTF("Coffee: The directory is full\n");
+    directory.complete = 0;
+    return;
+  }
+
+  hash = name_hash(name);
+  for(i = hash & DIRECTORY_MASK;
+      directory.entries[i].page != INVALID_PAGE;
+      i = (i + 1) & DIRECTORY_MASK);
+
+  entry = &directory.entries[i];
+  entry->end = end;
+  entry->page = page;
+  entry->name_hash = hash;
+  directory.count++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+directory_remove(const char *name, coffee_page_t page)
+{
+  struct directory_entry *entry;
+  unsigned i, j, home;
+
+  if(!directory.built) {
+    return;
+  }
+
+  entry = directory_lookup(name_hash(name), page);
+  if(entry == NULL) {
+    return;
+  }
+  directory.count--;
+
+  /*
+   * Move the following entries of the probe sequence back into the
+   * free slot if their home slots precede it, so that every entry can
+   * still be reached from its home slot without crossing a free slot.
+   */
+  i = entry - directory.entries;
+  for(j = (i + 1) & DIRECTORY_MASK;
+      directory.entries[j].page != INVALID_PAGE;
+      j = (j + 1) & DIRECTORY_MASK) {
+    home = directory.entries[j].name_hash & DIRECTORY_MASK;
+    if(((j - home) & DIRECTORY_MASK) >= ((j - i) & DIRECTORY_MASK)) {
+      directory.entries[i] = directory.entries[j];
+      i = j;
+    }
+  }
+  directory.entries[i].page = INVALID_PAGE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+directory_build(void)
+{
+  struct file_header hdr;
+  coffee_page_t page;
+  unsigned i;
+
+  for(i = 0; i < COFFEE_DIRECTORY_SIZE; i++) {
+    directory.entries[i].page = INVALID_PAGE;
+  }
+  directory.count = 0;
+  directory.complete = 1;
+  directory.built = 1;
+
+  for(page = 0; page < COFFEE_PAGE_COUNT; page = next_file(page, &hdr)) {
+    read_header(&hdr, page);
+    if(HDR_ACTIVE(hdr) && !HDR_LOG(hdr)) {
+      directory_add(hdr.name, page, UNKNOWN_OFFSET);
+    }
+  }
+
+  PRINTF("Coffee: Found %u files for the directory\n", directory.count);
+}
+/*---------------------------------------------------------------------------*/
+/* Remember the end of a file whose cached object is about to be reused. */
+static void
+directory_save_end(struct file *file)
+{
+  struct directory_entry *entry;
+
+  entry = directory_lookup(file->name_hash, file->page);
+  if(entry != NULL) {
+    entry->end = file->end;
+  }
+}
+#endif /* COFFEE_DIRECTORY_SIZE */
+/*---------------------------------------------------------------------------*/
 static struct file *
 load_file(coffee_page_t start, struct file_header *hdr)
 {
@@ -456,8 +812,24 @@ load_file(coffee_page_t start, struct file_header *hdr)
   }
 
   file = &coffee_files[i];
+#if COFFEE_DIRECTORY_SIZE
+  if(!FILE_FREE(file)) {
+    directory_save_end(file);
+  }
+  file->name_hash = name_hash(hdr->name);
+#endif /* COFFEE_DIRECTORY_SIZE */
   file->page = start;
   file->end = UNKNOWN_OFFSET;
+#if COFFEE_DIRECTORY_SIZE
+  {
+    struct directory_entry *entry;
+
+    entry = directory_lookup(file->name_hash, start);
+    if(entry != NULL) {
+      file->end = entry->end;
+    }
+  }
+#endif /* COFFEE_DIRECTORY_SIZE */
   file->max_pages = hdr->max_pages;
   file->flags = 0;
   if(HDR_MODIFIED(*hdr)) {
@@ -475,7 +847,42 @@ find_file(const char *name)
   int i;
   struct file_header hdr;
   coffee_page_t page;
-  
+#if COFFEE_DIRECTORY_SIZE
+  struct directory_entry *entry;
+  uint16_t hash;
+  unsigned j;
+
+  if(!directory.built) {
+    directory_build();
+  }
+
+  /* Look up the name in the directory, and read only the headers of
+     the files whose names have the same hash. */
+  hash = name_hash(name);
+  for(j = hash & DIRECTORY_MASK;
+      directory.entries[j].page != INVALID_PAGE;
+      j = (j + 1) & DIRECTORY_MASK) {
+    entry = &directory.entries[j];
+    if(entry->name_hash != hash) {
+      continue;
+    }
+    read_header(&hdr, entry->page);
+    if(HDR_ACTIVE(hdr) && !HDR_LOG(hdr) && strcmp(name, hdr.name) == 0) {
+      for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
+        if(!FILE_FREE(&coffee_files[i]) &&
+           coffee_files[i].page == entry->page) {
+          return &coffee_files[i];
+        }
+      }
+      return load_file(entry->page, &hdr);
+    }
+  }
+
+  if(directory.complete) {
+    return NULL;
+  }
+#endif /* COFFEE_DIRECTORY_SIZE */
+
   /* First check if the file metadata is cached. */
   for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
     if(FILE_FREE(&coffee_files[i])) {
@@ -533,6 +940,53 @@ file_end(coffee_page_t start)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_BEST_FIT
+static coffee_page_t
+find_contiguous_pages(coffee_page_t amount)
+{
+  coffee_page_t start, size, best, best_size;
+  uint16_t sector;
+
+  if(!sectors.valid) {
+    sectors_build();
+  }
+
+  /*
+   * A free extent starts at the first free page of a sector, and
+   * continues through the following sectors that are completely free.
+   * The sector that is being collected is kept out of.
+   */
+  best = INVALID_PAGE;
+  best_size = 0;
+  for(sector = 0; sector < COFFEE_SECTOR_COUNT;) {
+    size = sectors.pages[sector][SECTOR_FREE];
+    if(size == 0 || sector == sectors.victim) {
+      sector++;
+      continue;
+    }
+    start = (sector + 1) * COFFEE_PAGES_PER_SECTOR - size;
+    for(sector++; sector < COFFEE_SECTOR_COUNT &&
+        sector != sectors.victim &&
+        sectors.pages[sector][SECTOR_FREE] == COFFEE_PAGES_PER_SECTOR;
+        sector++) {
+      size += COFFEE_PAGES_PER_SECTOR;
+    }
+
+    /* As in the scan of the headers, the last page is never used. */
+    if(start + size >= COFFEE_PAGE_COUNT) {
+      size = COFFEE_PAGE_COUNT - 1 - start;
+    }
+    if(size >= amount && (best == INVALID_PAGE || size < best_size)) {
+      best = start;
+      best_size = size;
+      if(size == amount) {
+        break;
+      }
+    }
+  }
+  return best;
+}
+#else /* COFFEE_BEST_FIT */
 static coffee_page_t
 find_contiguous_pages(coffee_page_t amount)
 {
@@ -542,6 +996,14 @@ find_contiguous_pages(coffee_page_t amount)
   start = INVALID_PAGE;
   for(page = *next_free; page < COFFEE_PAGE_COUNT;) {
     read_header(&hdr, page);
+#if COFFEE_INCREMENTAL_GC
+    if(page / COFFEE_PAGES_PER_SECTOR == sectors.victim) {
+      /* Keep out of the sector that is being collected. */
+      start = INVALID_PAGE;
+      page = next_file(page, &hdr);
+      continue;
+    }
+#endif /* COFFEE_INCREMENTAL_GC */
     if(HDR_FREE(hdr)) {
       if(start == INVALID_PAGE) {
 	start = page;
@@ -568,6 +1030,7 @@ find_contiguous_pages(coffee_page_t amount)
   }
   return INVALID_PAGE;
 }
+#endif /* COFFEE_BEST_FIT */
 /*---------------------------------------------------------------------------*/
 static int
 remove_by_page(coffee_page_t page, int remove_log, int close_fds,
@@ -589,6 +1052,15 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
 
   hdr.flags |= HDR_FLAG_OBSOLETE;
   write_header(&hdr, page);
+#if COFFEE_DIRECTORY_SIZE
+  directory_remove(hdr.name, page);
+#endif
+#if COFFEE_SECTOR_COUNTS
+  sectors_move(page, hdr.max_pages, SECTOR_ACTIVE, SECTOR_OBSOLETE);
+#endif
+#if COFFEE_INCREMENTAL_GC
+  gc_poll();
+#endif
 
   *gc_wait = 0;
 
@@ -597,6 +1069,9 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
     for(i = 0; i < COFFEE_FD_SET_SIZE; i++) {
       if(coffee_fd_set[i].file != NULL && coffee_fd_set[i].file->page == page) {
 	coffee_fd_set[i].flags = COFFEE_FD_FREE;
+#if COFFEE_WRITE_BUFFER_SIZE
+	write_buffers[i].size = 0;
+#endif
       }
     }
   }
@@ -651,10 +1126,21 @@ reserve(const char *name, coffee_page_t pages,
   }
 
   memset(&hdr, 0, sizeof(hdr));
-  memcpy(hdr.name, name, sizeof(hdr.name) - 1);
+  strncpy(hdr.name, name, sizeof(hdr.name) - 1);
   hdr.max_pages = pages;
   hdr.flags = HDR_FLAG_ALLOCATED | flags;
   write_header(&hdr, page);
+#if COFFEE_DIRECTORY_SIZE
+  if(!(flags & HDR_FLAG_LOG)) {
+    directory_add(hdr.name, page, 0);
+  }
+#endif
+#if COFFEE_SECTOR_COUNTS
+  sectors_move(page, pages, SECTOR_FREE, SECTOR_ACTIVE);
+#endif
+#if COFFEE_INCREMENTAL_GC
+  gc_poll();
+#endif
 
   PRINTF("Coffee: Reserved %u pages starting from %u for file %s\n",
       pages, page, name);
@@ -796,6 +1282,10 @@ create_log(struct file *file, struct file_header *hdr)
 }
 #endif /* COFFEE_MICRO_LOGS */
 /*---------------------------------------------------------------------------*/
+#if COFFEE_WRITE_BUFFER_SIZE
+static coffee_page_t flush_buffers(coffee_page_t file_page);
+#endif
+
 static int
 merge_log(coffee_page_t file_page, int extend)
 {
@@ -806,6 +1296,19 @@ merge_log(coffee_page_t file_page, int extend)
   struct file *new_file;
   int i;
 
+#if COFFEE_WRITE_BUFFER_SIZE
+  /* Writing the buffered data can merge the log by itself. */
+  i = flush_buffers(file_page);
+  if(i == INVALID_PAGE) {
+    return -1;
+  } else if(i != file_page) {
+    if(!extend) {
+      return 0;
+    }
+    file_page = i;
+  }
+#endif
+
   read_header(&hdr, file_page);
 
   fd = cfs_open(hdr.name, CFS_READ);
@@ -863,9 +1366,242 @@ merge_log(coffee_page_t file_page, int extend)
 
   cfs_close(fd);
 
+  COFFEE_STATS_ADD(merges, 1);
+  COFFEE_STATS_ADD(merged_bytes, offset);
+
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_INCREMENTAL_GC
+static int
+select_victim(unsigned long free_pages)
+{
+  uint16_t sector;
+  coffee_page_t active, obsolete;
+  unsigned long score, best_score;
+  int victim;
+  char over_limit, best_over_limit;
+
+  /*
+   * Prefer the sectors that reclaim the most pages per page copied.
+   * Erasing a sector is counted as copying one page, and relocating a
+   * page as copying it twice, since it is read and written. The active
+   * pages of the victim must fit in the free pages of the other sectors.
+   */
+  victim = -1;
+  best_score = 0;
+  best_over_limit = 1;
+  for(sector = 0; sector < COFFEE_SECTOR_COUNT; sector++) {
+    active = sectors.pages[sector][SECTOR_ACTIVE];
+    obsolete = sectors.pages[sector][SECTOR_OBSOLETE];
+    if(sectors.skip[sector] || obsolete <= 0 ||
+       active > free_pages - sectors.pages[sector][SECTOR_FREE]) {
+      continue;
+    }
+    over_limit = active > COFFEE_GC_RELOCATION_LIMIT;
+    score = (unsigned long)obsolete * COFFEE_PAGES_PER_SECTOR /
+            (1 + 2 * active);
+    if(victim < 0 || over_limit < best_over_limit ||
+       (over_limit == best_over_limit && score > best_score)) {
+      best_score = score;
+      best_over_limit = over_limit;
+      victim = sector;
+    }
+  }
+  return victim;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Find the file whose header is in an earlier sector, but whose pages
+ * extend into the victim. The file stays the same until the victim is
+ * erased or abandoned, since no pages are reserved in the victim
+ * meanwhile, so it is found once when the victim is selected. No file
+ * extends past a sector with free pages, since those are its last
+ * pages, so the headers are read from the sector after the last such
+ * sector before the victim.
+ */
+static void
+find_carried(uint16_t sector)
+{
+  struct file_header hdr;
+  coffee_page_t page, end;
+  coffee_page_t sector_start;
+  uint16_t first;
+
+  sector_start = sector * COFFEE_PAGES_PER_SECTOR;
+  sectors.carried_page = INVALID_PAGE;
+  sectors.carried_end = sector_start;
+
+  for(first = sector;
+      first > 0 && sectors.pages[first - 1][SECTOR_FREE] == 0;
+      first--);
+
+  for(page = first * COFFEE_PAGES_PER_SECTOR; page < sector_start;
+      page = end) {
+    read_header(&hdr, page);
+    end = next_file(page, &hdr);
+    if(end > sector_start && !HDR_FREE(hdr)) {
+      sectors.carried_page = page;
+      sectors.carried_end = end;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Read the headers of the victim, starting after the carried file. */
+static void
+find_extents(uint16_t sector, struct sector_extents *ext)
+{
+  struct file_header hdr;
+  coffee_page_t page, end;
+  coffee_page_t sector_start, sector_end;
+
+  sector_start = sector * COFFEE_PAGES_PER_SECTOR;
+  sector_end = sector_start + COFFEE_PAGES_PER_SECTOR;
+  ext->active = INVALID_PAGE;
+  ext->carried = ext->overflow = 0;
+
+  page = sector_start;
+  if(sectors.carried_page != INVALID_PAGE) {
+    read_header(&hdr, sectors.carried_page);
+    if(HDR_ACTIVE(hdr)) {
+      ext->active = sectors.carried_page;
+    }
+    page = sectors.carried_end;
+    ext->carried = (page < sector_end ? page : sector_end) - sector_start;
+    if(page > sector_end) {
+      ext->overflow = page - sector_end;
+    }
+  }
+
+  for(; page < sector_end; page = end) {
+    read_header(&hdr, page);
+    end = next_file(page, &hdr);
+    if(HDR_FREE(hdr)) {
+      continue;
+    }
+    if(HDR_ACTIVE(hdr) && ext->active == INVALID_PAGE) {
+      ext->active = page;
+    }
+    if(end > sector_end) {
+      ext->overflow = end - sector_end;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Move a file, or the file that owns a log, out of its sector. */
+static int
+relocate(coffee_page_t page)
+{
+  struct file_header hdr;
+  struct file *file;
+
+  read_header(&hdr, page);
+  if(HDR_LOG(hdr)) {
+    file = find_file(hdr.name);
+    if(file == NULL) {
+      return -1;
+    }
+    page = file->page;
+  }
+
+  PRINTF("Coffee: Relocating the file %s at page %u\n",
+         hdr.name, (unsigned)page);
+  return merge_log(page, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+erase_sector(uint16_t sector, struct sector_extents *ext)
+{
+  coffee_page_t first_page;
+
+  first_page = sector * COFFEE_PAGES_PER_SECTOR;
+
+  /* As in collect_garbage(), the pages of obsolete files that extend
+     into the erased sector or out of it are isolated. */
+  if(ext->overflow > 0) {
+    isolate_pages(first_page + COFFEE_PAGES_PER_SECTOR, ext->overflow);
+  }
+  COFFEE_ERASE(sector);
+  if(ext->carried > 0) {
+    isolate_pages(first_page, ext->carried);
+  }
+  PRINTF("Coffee: Erased sector %u incrementally\n", sector);
+
+  sectors.pages[sector][SECTOR_ACTIVE] = 0;
+  sectors.pages[sector][SECTOR_OBSOLETE] = ext->carried;
+  sectors.pages[sector][SECTOR_FREE] = COFFEE_PAGES_PER_SECTOR - ext->carried;
+  memset(sectors.skip, 0, sizeof(sectors.skip));
+
+  if(first_page < *next_free) {
+    *next_free = first_page;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Do one bounded step of garbage collection. Returns non-zero if more
+   steps may be needed. */
+static int
+gc_step(void)
+{
+  struct sector_extents ext;
+  unsigned long free_pages;
+  uint16_t sector;
+  int victim;
+
+  if(!sectors.valid) {
+    sectors_build();
+  }
+
+  if(sectors.victim < 0) {
+    free_pages = 0;
+    for(sector = 0; sector < COFFEE_SECTOR_COUNT; sector++) {
+      free_pages += sectors.pages[sector][SECTOR_FREE];
+    }
+    if(free_pages >= COFFEE_GC_FREE_PAGES) {
+      return 0;
+    }
+    sectors.victim = select_victim(free_pages);
+    if(sectors.victim < 0) {
+      return 0;
+    }
+    find_carried(sectors.victim);
+  }
+
+  /* A relocation may run the synchronous garbage collector, which
+     abandons the victim. */
+  victim = sectors.victim;
+  find_extents(victim, &ext);
+  if(ext.active != INVALID_PAGE) {
+    if(relocate(ext.active) < 0 && sectors.valid) {
+      sectors.skip[victim] = 1;
+      sectors.victim = -1;
+    }
+  } else if(ext.carried + sectors.pages[victim][SECTOR_FREE] >=
+            COFFEE_PAGES_PER_SECTOR) {
+    /* The obsolete pages would all be isolated again after erasure. */
+    sectors.skip[victim] = 1;
+    sectors.victim = -1;
+  } else {
+    erase_sector(victim, &ext);
+    sectors.victim = -1;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_gc_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  for(;;) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    while(gc_step()) {
+      PROCESS_PAUSE();
+    }
+  }
+
+  PROCESS_END();
+}
+#endif /* COFFEE_INCREMENTAL_GC */
+/*---------------------------------------------------------------------------*/
 #if COFFEE_MICRO_LOGS
 static int
 find_next_record(struct file *file, coffee_page_t log_page,
@@ -973,12 +1709,119 @@ write_log_page(struct file *file, struct log_param *lp)
     COFFEE_WRITE(copy_buf, sizeof(copy_buf),
 		 offset + log_record * log_record_size);
     file->record_count = log_record + 1;
+    COFFEE_STATS_ADD(log_records, 1);
   }
 
   return lp->size;
 }
 #endif /* COFFEE_MICRO_LOGS */
 /*---------------------------------------------------------------------------*/
+#if COFFEE_WRITE_BUFFER_SIZE
+static int
+flush_buffer(int fd)
+{
+  struct write_buffer *wb;
+  struct log_param lp;
+  unsigned size;
+  int r;
+
+  wb = &write_buffers[fd];
+  if(wb->size == 0) {
+    return 0;
+  }
+
+  /* The buffer looks empty while it is written, since a merge of the
+     log reads the file and would otherwise write the buffer again. If
+     the write fails, the data stays in the buffer. */
+  size = wb->size;
+  wb->size = 0;
+
+  do {
+    lp.offset = wb->offset;
+    lp.buf = wb->data;
+    lp.size = size;
+    r = write_log_page(coffee_fd_set[fd].file, &lp);
+  } while(r == 0);
+
+  if(r < 0) {
+    wb->size = size;
+    return -1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Write the buffered data of a file. Returns the page of the file
+   afterwards, which changes if its log was merged. */
+static coffee_page_t
+flush_buffers(coffee_page_t file_page)
+{
+  int i;
+
+  for(i = 0; i < COFFEE_FD_SET_SIZE; i++) {
+    if(coffee_fd_set[i].flags != COFFEE_FD_FREE &&
+       coffee_fd_set[i].file->page == file_page &&
+       write_buffers[i].size > 0) {
+      /* Only one file descriptor at a time buffers data of a file. */
+      if(flush_buffer(i) < 0) {
+        return INVALID_PAGE;
+      }
+      return coffee_fd_set[i].file->page;
+    }
+  }
+  return file_page;
+}
+/*---------------------------------------------------------------------------*/
+static int
+buffered_write(int fd, const char *buf, unsigned size,
+               uint16_t log_record_size)
+{
+  struct file_desc *fdp;
+  struct write_buffer *wb;
+  cfs_offset_t record_end;
+  unsigned bytes_left, n;
+
+  fdp = &coffee_fd_set[fd];
+  wb = &write_buffers[fd];
+
+  for(bytes_left = size; bytes_left > 0;) {
+    record_end = (fdp->offset / log_record_size + 1) * log_record_size;
+    n = record_end - fdp->offset;
+    if(n > bytes_left) {
+      n = bytes_left;
+    }
+
+    if(wb->size > 0 &&
+       (fdp->offset < wb->offset || fdp->offset > wb->offset + wb->size ||
+        fdp->offset / log_record_size != wb->offset / log_record_size)) {
+      if(flush_buffer(fd) < 0) {
+        break;
+      }
+    }
+    if(wb->size == 0) {
+      if(flush_buffers(fdp->file->page) == INVALID_PAGE) {
+        break;
+      }
+      wb->offset = fdp->offset;
+    }
+
+    memcpy(&wb->data[fdp->offset - wb->offset], buf, n);
+    if(fdp->offset + n > wb->offset + wb->size) {
+      wb->size = fdp->offset + n - wb->offset;
+    }
+    fdp->offset += n;
+    buf += n;
+    bytes_left -= n;
+
+    if(fdp->offset > fdp->file->end) {
+      fdp->file->end = fdp->offset;
+    }
+  }
+
+  /* Return -1 if nothing was written, as for unbuffered writes. */
+  return bytes_left == size ? -1 : size - bytes_left;
+}
+#endif /* COFFEE_WRITE_BUFFER_SIZE */
+/*---------------------------------------------------------------------------*/
 static int
 get_available_fd(void)
 {
@@ -1028,14 +1871,27 @@ cfs_open(const char *name, int flags)
   return fd;
 }
 /*---------------------------------------------------------------------------*/
-void
+int
 cfs_close(int fd)
 {
-  if(FD_VALID(fd)) {
-    coffee_fd_set[fd].flags = COFFEE_FD_FREE;
-    coffee_fd_set[fd].file->references--;
-    coffee_fd_set[fd].file = NULL;
+  int r;
+
+  if(!FD_VALID(fd)) {
+    return -1;
   }
+
+  r = 0;
+#if COFFEE_WRITE_BUFFER_SIZE
+  if(flush_buffer(fd) < 0) {
+    /* The data cannot be kept once the descriptor is closed. */
+    write_buffers[fd].size = 0;
+    r = -1;
+  }
+#endif
+  coffee_fd_set[fd].flags = COFFEE_FD_FREE;
+  coffee_fd_set[fd].file->references--;
+  coffee_fd_set[fd].file = NULL;
+  return r;
 }
 /*---------------------------------------------------------------------------*/
 cfs_offset_t
@@ -1063,6 +1919,13 @@ cfs_seek(int fd, cfs_offset_t offset, int whence)
     return -1;
   }
 
+#if COFFEE_WRITE_BUFFER_SIZE
+  /* A seek to the current offset keeps adjacent writes together. */
+  if(new_offset != fdp->offset && flush_buffer(fd) < 0) {
+    return -1;
+  }
+#endif
+
   if(fdp->file->end < new_offset) {
     fdp->file->end = new_offset;
   }
@@ -1106,6 +1969,11 @@ cfs_read(int fd, void *buf, unsigned size)
   }
 
   fdp = &coffee_fd_set[fd];
+#if COFFEE_WRITE_BUFFER_SIZE
+  if(flush_buffers(fdp->file->page) == INVALID_PAGE) {
+    return -1;
+  }
+#endif
   file = fdp->file;
   if(fdp->offset + size > file->end) {
     size = file->end - fdp->offset;
@@ -1147,6 +2015,60 @@ cfs_read(int fd, void *buf, unsigned size)
 }
 /*---------------------------------------------------------------------------*/
 int
+cfs_readv(int fd, const struct cfs_iovec *iov, int iovcnt)
+{
+  int i, r, total;
+
+  total = 0;
+  for(i = 0; i < iovcnt; i++) {
+    r = cfs_read(fd, iov[i].base, iov[i].len);
+    if(r < 0) {
+      return total > 0 ? total : -1;
+    }
+    total += r;
+    if(r < iov[i].len) {
+      break;
+    }
+  }
+  return total;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Make room for size bytes at the offset of a file descriptor. The
+ * file is moved at most once per call, to the smallest size that is
+ * its current size doubled a number of times.
+ */
+static int
+extend_file(struct file_desc *fdp, cfs_offset_t size)
+{
+  cfs_offset_t needed;
+  int shift;
+
+#if COFFEE_IO_SEMANTICS
+  if(fdp->io_flags & CFS_COFFEE_IO_FIRM_SIZE) {
+    return 0;
+  }
+#endif
+
+  needed = size + fdp->offset + sizeof(struct file_header);
+  while(needed > (cfs_offset_t)fdp->file->max_pages * COFFEE_PAGE_SIZE) {
+    for(shift = 1;
+        needed > ((cfs_offset_t)fdp->file->max_pages << shift) *
+          COFFEE_PAGE_SIZE;
+        shift++) {
+      if(((cfs_offset_t)fdp->file->max_pages << shift) > COFFEE_PAGE_COUNT) {
+        return -1;
+      }
+    }
+    if(merge_log(fdp->file->page, shift) < 0) {
+      return -1;
+    }
+    PRINTF("Extended the file at page %u\n", (unsigned)fdp->file->page);
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
 cfs_write(int fd, const void *buf, unsigned size)
 {
   struct file_desc *fdp;
@@ -1157,29 +2079,22 @@ cfs_write(int fd, const void *buf, unsigned size)
   cfs_offset_t bytes_left;
   const char dummy[1] = { 0xff };
 #endif
+#if COFFEE_WRITE_BUFFER_SIZE
+  struct file_header hdr;
+  uint16_t log_record_size, log_records;
+#endif
 
   if(!(FD_VALID(fd) && FD_WRITABLE(fd))) {
     return -1;
   }
 
   fdp = &coffee_fd_set[fd];
-  file = fdp->file;
 
   /* Attempt to extend the file if we try to write past the end. */
-#if COFFEE_IO_SEMANTICS
-  if(!(fdp->io_flags & CFS_COFFEE_IO_FIRM_SIZE)) {
-#endif
-  while(size + fdp->offset + sizeof(struct file_header) >
-     (file->max_pages * COFFEE_PAGE_SIZE)) {
-    if(merge_log(file->page, 1) < 0) {
-      return -1;
-    }
-    file = fdp->file;
-    PRINTF("Extended the file at page %u\n", (unsigned)file->page);
-  }
-#if COFFEE_IO_SEMANTICS
+  if(extend_file(fdp, size) < 0) {
+    return -1;
   }
-#endif
+  file = fdp->file;
 
 #if COFFEE_MICRO_LOGS
 #if COFFEE_IO_SEMANTICS
@@ -1188,6 +2103,13 @@ cfs_write(int fd, const void *buf, unsigned size)
 #else
   if(FILE_MODIFIED(file) || fdp->offset < file->end) {
 #endif
+#if COFFEE_WRITE_BUFFER_SIZE
+    read_header(&hdr, file->page);
+    adjust_log_config(&hdr, &log_record_size, &log_records);
+    if(log_record_size <= COFFEE_WRITE_BUFFER_SIZE) {
+      return buffered_write(fd, buf, size, log_record_size);
+    }
+#endif /* COFFEE_WRITE_BUFFER_SIZE */
     for(bytes_left = size; bytes_left > 0;) {
       lp.offset = fdp->offset;
       lp.buf = buf;
@@ -1242,6 +2164,40 @@ cfs_write(int fd, const void *buf, unsigned size)
 }
 /*---------------------------------------------------------------------------*/
 int
+cfs_writev(int fd, const struct cfs_iovec *iov, int iovcnt)
+{
+  cfs_offset_t size;
+  int i, r, total;
+
+  if(!(FD_VALID(fd) && FD_WRITABLE(fd))) {
+    return -1;
+  }
+
+  /* Extend the file once for all buffers, rather than in several
+     steps that each copy the file. */
+  size = 0;
+  for(i = 0; i < iovcnt; i++) {
+    size += iov[i].len;
+  }
+  if(extend_file(&coffee_fd_set[fd], size) < 0) {
+    return -1;
+  }
+
+  total = 0;
+  for(i = 0; i < iovcnt; i++) {
+    r = cfs_write(fd, iov[i].base, iov[i].len);
+    if(r < 0) {
+      return total > 0 ? total : -1;
+    }
+    total += r;
+    if(r < iov[i].len) {
+      break;
+    }
+  }
+  return total;
+}
+/*---------------------------------------------------------------------------*/
+int
 cfs_opendir(struct cfs_dir *dir, const char *name)
 {
   /*
@@ -1335,6 +2291,21 @@ cfs_coffee_set_io_semantics(int fd, unsigned flags)
 #endif
 /*---------------------------------------------------------------------------*/
 int
+cfs_coffee_sync(void)
+{
+#if COFFEE_WRITE_BUFFER_SIZE
+  int i;
+
+  for(i = 0; i < COFFEE_FD_SET_SIZE; i++) {
+    if(coffee_fd_set[i].flags != COFFEE_FD_FREE && flush_buffer(i) < 0) {
+      return -1;
+    }
+  }
+#endif
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
 cfs_coffee_format(void)
 {
   unsigned i;
@@ -1350,6 +2321,16 @@ cfs_coffee_format(void)
 
   /* Formatting invalidates the file information. */
   memset(&protected_mem, 0, sizeof(protected_mem));
+#if COFFEE_WRITE_BUFFER_SIZE
+  memset(write_buffers, 0, sizeof(write_buffers));
+#endif
+#if COFFEE_DIRECTORY_SIZE
+  directory.built = 0;
+#endif
+#if COFFEE_SECTOR_COUNTS
+  sectors.valid = 0;
+  sectors.victim = -1;
+#endif
 
   PRINTF(" done!\n");
 
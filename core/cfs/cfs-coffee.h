@@ -116,6 +116,18 @@ int cfs_coffee_configure_log(const char *file, unsigned log_size,
  */
 int cfs_coffee_set_io_semantics(int fd, unsigned flags);
 
+/**
+ * \brief Write the buffered data of all file descriptors.
+ * \return 0 on success, -1 on failure.
+ *
+ * When Coffee is configured with write buffers, small writes that
+ * modify a file are collected in a buffer of the file descriptor,
+ * and are written to the micro log of the file later. This function
+ * writes the buffers of all file descriptors, so that the data is
+ * kept if the system is restarted.
+ */
+int cfs_coffee_sync(void);
+
 /**
  * \brief Format the storage area assigned to Coffee.
  * \return 0 on success, -1 on failure.
@@ -139,6 +151,28 @@ int cfs_coffee_format(void);
 void *cfs_coffee_get_protected_mem(unsigned *size);
 
 /** @} */
+
+#ifdef COFFEE_CONF_STATS
+#define COFFEE_STATS COFFEE_CONF_STATS
+#else
+#define COFFEE_STATS 0
+#endif
+
+#if COFFEE_STATS
+/** Counters of the writes that Coffee makes to modify files. */
+struct cfs_coffee_stats {
+  /** Log records written. */
+  unsigned long log_records;
+  /** Files copied to a new location when their logs were merged. */
+  unsigned long merges;
+  /** Bytes copied when merging logs. */
+  unsigned long merged_bytes;
+};
+extern struct cfs_coffee_stats cfs_coffee_stats;
+#define COFFEE_STATS_ADD(x, n) cfs_coffee_stats.x += (n)
+#else
+#define COFFEE_STATS_ADD(x, n)
+#endif /* COFFEE_STATS */
 /** @} */
 
 #endif /* !COFFEE_H */
@@ -0,0 +1,568 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         A CFS backend for the native platform that maps files into
+ *         memory, so that reads and writes are copies to and from the
+ *         mapping instead of system calls.
+ *
+ *         The first write past the end of a file after it has been
+ *         opened extends the file on disk to the end of the write, and
+ *         further writes grow it in chunks of CFS_POSIX_MMAP_CHUNK_SIZE
+ *         bytes. The last close cuts the file back to its size, so a
+ *         closed file is never left padded, and a file that is opened
+ *         for a single append is grown once and not cut. The
+ *         descriptors of a file share one mapping, which stays cached
+ *         after the file has been closed until its slot is needed for
+ *         another file. Files should not be changed by other programs
+ *         while they are in use.
+ *
+ *         Build with "make TARGET=native CFS=mmap".
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cfs/cfs.h"
+
+/* The number of bytes by which a file is grown on disk. Must be a
+   multiple of the page size. */
+#ifdef CFS_POSIX_MMAP_CONF_CHUNK_SIZE
+#define CFS_POSIX_MMAP_CHUNK_SIZE CFS_POSIX_MMAP_CONF_CHUNK_SIZE
+#else
+#define CFS_POSIX_MMAP_CHUNK_SIZE 65536
+#endif
+
+/* The number of bytes mapped in ahead of sequential reads, or 0 to
+   leave read-ahead to the page faults of the kernel. This pays off
+   for files that are not in the page cache of the host. */
+#ifdef CFS_POSIX_MMAP_CONF_READ_AHEAD
+#define CFS_POSIX_MMAP_READ_AHEAD CFS_POSIX_MMAP_CONF_READ_AHEAD
+#else
+#define CFS_POSIX_MMAP_READ_AHEAD 0
+#endif
+
+/* Write modified pages to disk before the last close of a file
+   returns, rather than leaving this to the kernel. */
+#ifdef CFS_POSIX_MMAP_CONF_SYNC
+#define CFS_POSIX_MMAP_SYNC CFS_POSIX_MMAP_CONF_SYNC
+#else
+#define CFS_POSIX_MMAP_SYNC 0
+#endif
+
+/* The number of files that can be mapped at the same time. */
+#ifdef CFS_POSIX_MMAP_CONF_FILES
+#define CFS_POSIX_MMAP_FILES CFS_POSIX_MMAP_CONF_FILES
+#else
+#define CFS_POSIX_MMAP_FILES 8
+#endif
+
+#ifdef CFS_POSIX_MMAP_CONF_FDS
+#define CFS_POSIX_MMAP_FDS CFS_POSIX_MMAP_CONF_FDS
+#else
+#define CFS_POSIX_MMAP_FDS 16
+#endif
+
+/* Files with longer names are not kept mapped after the last close. */
+#define NAME_LENGTH 64
+
+#define ROUND_UP(x, n) ((((x) + (n) - 1) / (n)) * (n))
+
+struct mapping {
+  char name[NAME_LENGTH];
+  dev_t dev;
+  ino_t ino;
+  char *data;
+  size_t map_size;
+  cfs_offset_t disk_size;
+  cfs_offset_t size;
+  unsigned long last_use;
+  int fd;
+  int refs;
+  uint8_t writable;
+  uint8_t extended;
+};
+
+struct descriptor {
+  struct mapping *mapping;
+  cfs_offset_t offset;
+#if CFS_POSIX_MMAP_READ_AHEAD
+  cfs_offset_t next_read;
+  cfs_offset_t read_ahead;
+#endif
+  uint8_t flags;
+};
+
+/* A slot of mappings is free when its data is NULL. */
+static struct mapping mappings[CFS_POSIX_MMAP_FILES];
+static struct descriptor descriptors[CFS_POSIX_MMAP_FDS];
+static unsigned long use_clock;
+
+#define FD_VALID(fd) ((fd) >= 0 && (fd) < CFS_POSIX_MMAP_FDS && \
+                      descriptors[(fd)].mapping != NULL)
+
+/*---------------------------------------------------------------------------*/
+/* Cut a file that is not open back to its size. The mapping stays
+   valid, and the file is grown again before any page beyond its end
+   is written. */
+static void
+trim(struct mapping *m)
+{
+  if(m->refs == 0 && m->writable && m->disk_size != m->size &&
+     ftruncate(m->fd, m->size) == 0) {
+    m->disk_size = m->size;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+release(struct mapping *m)
+{
+  trim(m);
+  munmap(m->data, m->map_size);
+  close(m->fd);
+  m->data = NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Find the mapping of a name. Mappings of the name whose file has
+   been replaced are dropped, or forgotten if they are in use. */
+static struct mapping *
+lookup(const char *name, const struct stat *st)
+{
+  struct mapping *m;
+  int i;
+
+  for(i = 0; i < CFS_POSIX_MMAP_FILES; i++) {
+    m = &mappings[i];
+    if(m->data == NULL || strcmp(m->name, name) != 0) {
+      continue;
+    }
+    if(st != NULL && m->dev == st->st_dev && m->ino == st->st_ino) {
+      return m;
+    }
+    if(m->refs == 0) {
+      release(m);
+    } else {
+      m->name[0] = '\0';
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static struct mapping *
+allocate(void)
+{
+  struct mapping *m, *oldest;
+  int i;
+
+  oldest = NULL;
+  for(i = 0; i < CFS_POSIX_MMAP_FILES; i++) {
+    m = &mappings[i];
+    if(m->data == NULL) {
+      return m;
+    }
+    if(m->refs == 0 && (oldest == NULL || m->last_use < oldest->last_use)) {
+      oldest = m;
+    }
+  }
+  if(oldest != NULL) {
+    release(oldest);
+  }
+  return oldest;
+}
+/*---------------------------------------------------------------------------*/
+static char *
+map(struct mapping *m, size_t size)
+{
+  char *data;
+
+  data = mmap(NULL, size, m->writable ? PROT_READ | PROT_WRITE : PROT_READ,
+              MAP_SHARED, m->fd, 0);
+  return data == MAP_FAILED ? NULL : data;
+}
+/*---------------------------------------------------------------------------*/
+/* Make the mapping hold at least size bytes. */
+static int
+remap(struct mapping *m, cfs_offset_t size)
+{
+  char *data;
+
+  size = ROUND_UP(size, CFS_POSIX_MMAP_CHUNK_SIZE);
+  if(size <= m->map_size) {
+    return 0;
+  }
+  data = map(m, size);
+  if(data == NULL) {
+    return -1;
+  }
+  munmap(m->data, m->map_size);
+  m->data = data;
+  m->map_size = size;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Make the file on disk, and its mapping, hold at least end bytes. */
+static int
+grow(struct mapping *m, cfs_offset_t end)
+{
+  cfs_offset_t disk_size;
+
+  if(end <= m->disk_size) {
+    return 0;
+  }
+
+  disk_size = ROUND_UP(end, CFS_POSIX_MMAP_CHUNK_SIZE);
+  if(ftruncate(m->fd, disk_size) < 0) {
+    return -1;
+  }
+  m->disk_size = disk_size;
+  return remap(m, disk_size);
+}
+/*---------------------------------------------------------------------------*/
+static struct mapping *
+open_mapping(const char *name, int flags)
+{
+  struct mapping *m;
+  struct stat st;
+  int fd, writable;
+
+  m = lookup(name, stat(name, &st) == 0 ? &st : NULL);
+  if(m != NULL) {
+    return (flags & CFS_WRITE) && !m->writable ? NULL : m;
+  }
+
+  /* Files are mapped writable when possible, so that the mapping can
+     be shared with descriptors that are opened later for writing. */
+  writable = 1;
+  if(flags & CFS_WRITE) {
+    fd = open(name, O_RDWR | O_CREAT, 0600);
+  } else {
+    fd = open(name, O_RDWR);
+    if(fd < 0) {
+      fd = open(name, O_RDONLY);
+      writable = 0;
+    }
+  }
+  if(fd < 0) {
+    return NULL;
+  }
+
+  m = allocate();
+  if(m == NULL || fstat(fd, &st) < 0) {
+    close(fd);
+    return NULL;
+  }
+
+  if(strlen(name) < sizeof(m->name)) {
+    strcpy(m->name, name);
+  } else {
+    m->name[0] = '\0';
+  }
+  m->dev = st.st_dev;
+  m->ino = st.st_ino;
+  m->fd = fd;
+  m->writable = writable;
+  m->refs = 0;
+  m->size = m->disk_size = st.st_size;
+  m->map_size = ROUND_UP(st.st_size + 1, CFS_POSIX_MMAP_CHUNK_SIZE);
+  m->data = map(m, m->map_size);
+  if(m->data == NULL) {
+    close(fd);
+    return NULL;
+  }
+  return m;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_open(const char *n, int f)
+{
+  struct descriptor *d;
+  struct mapping *m;
+  int fd;
+
+  if(f != CFS_READ && !(f & CFS_WRITE)) {
+    return -1;
+  }
+
+  for(fd = 0; fd < CFS_POSIX_MMAP_FDS; fd++) {
+    if(descriptors[fd].mapping == NULL) {
+      break;
+    }
+  }
+  if(fd == CFS_POSIX_MMAP_FDS) {
+    return -1;
+  }
+
+  m = open_mapping(n, f);
+  if(m == NULL) {
+    return -1;
+  }
+  if((f & CFS_WRITE) && !(f & CFS_APPEND)) {
+    m->size = 0;
+  }
+  if(m->refs == 0) {
+    m->extended = 0;
+  }
+  m->refs++;
+  m->last_use = ++use_clock;
+
+  d = &descriptors[fd];
+  d->mapping = m;
+  d->offset = 0;
+  d->flags = f;
+#if CFS_POSIX_MMAP_READ_AHEAD
+  d->next_read = 0;
+  d->read_ahead = 0;
+#endif
+  return fd;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_close(int f)
+{
+  struct mapping *m;
+
+  if(!FD_VALID(f)) {
+    return -1;
+  }
+  m = descriptors[f].mapping;
+  descriptors[f].mapping = NULL;
+
+  if(--m->refs > 0) {
+    return 0;
+  }
+
+#if CFS_POSIX_MMAP_SYNC
+  if(m->size > 0) {
+    msync(m->data, m->size, MS_SYNC);
+  }
+#endif /* CFS_POSIX_MMAP_SYNC */
+  if(m->name[0] == '\0') {
+    release(m);
+    return 0;
+  }
+  trim(m);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+#if CFS_POSIX_MMAP_READ_AHEAD
+/* Map in the pages ahead of sequential reads. */
+static void
+read_ahead(struct descriptor *d, cfs_offset_t offset, cfs_offset_t end)
+{
+  struct mapping *m;
+  cfs_offset_t start, stop;
+  long page_size;
+
+  /* Reads at other positions than where the last one ended are left
+     to the kernel. */
+  if(offset != d->next_read) {
+    d->next_read = end;
+    d->read_ahead = 0;
+    return;
+  }
+  d->next_read = end;
+
+  m = d->mapping;
+  if(end + CFS_POSIX_MMAP_READ_AHEAD / 2 <= d->read_ahead ||
+     d->read_ahead >= m->size) {
+    return;
+  }
+
+  page_size = sysconf(_SC_PAGESIZE);
+  start = d->read_ahead > end ? d->read_ahead : end;
+  start -= start % page_size;
+  stop = start + CFS_POSIX_MMAP_READ_AHEAD;
+  if(stop > m->size) {
+    stop = m->size;
+  }
+  if(stop <= start) {
+    return;
+  }
+#ifdef MADV_POPULATE_READ
+  if(madvise(m->data + start, stop - start, MADV_POPULATE_READ) < 0)
+#endif
+  {
+    madvise(m->data + start, stop - start, MADV_WILLNEED);
+  }
+  d->read_ahead = stop;
+}
+#endif /* CFS_POSIX_MMAP_READ_AHEAD */
+/*---------------------------------------------------------------------------*/
+int
+cfs_read(int f, void *b, unsigned int l)
+{
+  struct descriptor *d;
+  struct mapping *m;
+
+  if(!FD_VALID(f) || !(descriptors[f].flags & CFS_READ)) {
+    return -1;
+  }
+  d = &descriptors[f];
+  m = d->mapping;
+
+  if(d->offset >= m->size) {
+    return 0;
+  }
+  if(l > m->size - d->offset) {
+    l = m->size - d->offset;
+  }
+#if CFS_POSIX_MMAP_READ_AHEAD
+  read_ahead(d, d->offset, d->offset + l);
+#endif
+  memcpy(b, m->data + d->offset, l);
+  d->offset += l;
+  return l;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_write(int f, const void *b, unsigned int l)
+{
+  struct descriptor *d;
+  struct mapping *m;
+
+  if(!FD_VALID(f) || !(descriptors[f].flags & CFS_WRITE)) {
+    return -1;
+  }
+  d = &descriptors[f];
+  m = d->mapping;
+
+  if(d->flags & CFS_APPEND) {
+    d->offset = m->size;
+  }
+  if(l == 0) {
+    return 0;
+  }
+
+  if(d->offset + l > m->disk_size && !m->extended) {
+    /* The first write past the end of the file on disk after the file
+       has been opened is made with a system call, which extends the
+       file to the end of the write at a lower cost than ftruncate().
+       A file that is opened for a single append then need not be cut
+       at the last close. A hole left by a seek past the end reads as
+       zeroes. */
+    if(d->offset > m->size) {
+      memset(m->data + m->size, 0,
+             (d->offset < m->disk_size ? d->offset : m->disk_size) - m->size);
+    }
+    if(remap(m, d->offset + l) < 0 ||
+       pwrite(m->fd, b, l, d->offset) != (ssize_t)l) {
+      return -1;
+    }
+    m->disk_size = d->offset + l;
+    m->extended = 1;
+  } else {
+    if(grow(m, d->offset + l) < 0) {
+      return -1;
+    }
+    if(d->offset > m->size) {
+      memset(m->data + m->size, 0, d->offset - m->size);
+    }
+    memcpy(m->data + d->offset, b, l);
+  }
+  d->offset += l;
+  if(d->offset > m->size) {
+    m->size = d->offset;
+  }
+  return l;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_readv(int f, const struct cfs_iovec *iov, int iovcnt)
+{
+  int i, r, total;
+
+  total = 0;
+  for(i = 0; i < iovcnt; i++) {
+    r = cfs_read(f, iov[i].base, iov[i].len);
+    if(r < 0) {
+      return total > 0 ? total : -1;
+    }
+    total += r;
+    if(r < iov[i].len) {
+      break;
+    }
+  }
+  return total;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_writev(int f, const struct cfs_iovec *iov, int iovcnt)
+{
+  int i, r, total;
+
+  total = 0;
+  for(i = 0; i < iovcnt; i++) {
+    r = cfs_write(f, iov[i].base, iov[i].len);
+    if(r < 0) {
+      return total > 0 ? total : -1;
+    }
+    total += r;
+    if(r < iov[i].len) {
+      break;
+    }
+  }
+  return total;
+}
+/*---------------------------------------------------------------------------*/
+cfs_offset_t
+cfs_seek(int f, cfs_offset_t o, int w)
+{
+  struct descriptor *d;
+
+  if(!FD_VALID(f)) {
+    return (cfs_offset_t)-1;
+  }
+  d = &descriptors[f];
+
+  if(w == CFS_SEEK_CUR) {
+    o += d->offset;
+  } else if(w == CFS_SEEK_END) {
+    o += d->mapping->size;
+  } else if(w != CFS_SEEK_SET) {
+    return (cfs_offset_t)-1;
+  }
+  if(o < 0) {
+    return (cfs_offset_t)-1;
+  }
+  d->offset = o;
+  return o;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_remove(const char *name)
+{
+  lookup(name, NULL);
+  return remove(name);
+}
+/*---------------------------------------------------------------------------*/
@@ -39,10 +39,18 @@
 #include <io.h>
 #else
 #include <unistd.h>
+#include <sys/uio.h>
 #endif
 
 #include "cfs/cfs.h"
 
+/* The number of buffers passed to each readv() or writev() call. */
+#ifdef CFS_POSIX_CONF_IOV_MAX
+#define CFS_POSIX_IOV_MAX CFS_POSIX_CONF_IOV_MAX
+#else
+#define CFS_POSIX_IOV_MAX 16
+#endif
+
 /*---------------------------------------------------------------------------*/
 int
 cfs_open(const char *n, int f)
@@ -67,10 +75,10 @@ cfs_open(const char *n, int f)
   return -1;
 }
 /*---------------------------------------------------------------------------*/
-void
+int
 cfs_close(int f)
 {
-  close(f);
+  return close(f);
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -85,6 +93,79 @@ cfs_write(int f, const void *b, unsigned int l)
   return write(f, b, l);
 }
 /*---------------------------------------------------------------------------*/
+#ifdef _MSC_VER
+static int
+transfer(int f, const struct cfs_iovec *iov, int iovcnt, int write_op)
+{
+  int i, r, total;
+
+  total = 0;
+  for(i = 0; i < iovcnt; i++) {
+    if(write_op) {
+      r = write(f, iov[i].base, iov[i].len);
+    } else {
+      r = read(f, iov[i].base, iov[i].len);
+    }
+    if(r < 0) {
+      return total > 0 ? total : -1;
+    }
+    total += r;
+    if(r < iov[i].len) {
+      break;
+    }
+  }
+  return total;
+}
+#else /* _MSC_VER */
+static int
+transfer(int f, const struct cfs_iovec *iov, int iovcnt, int write_op)
+{
+  struct iovec v[CFS_POSIX_IOV_MAX];
+  int i, n, r, total;
+  unsigned len;
+
+  /* Pass the buffers to the system in batches of CFS_POSIX_IOV_MAX,
+     and stop at the first batch that is not transferred completely. */
+  total = 0;
+  while(iovcnt > 0) {
+    n = iovcnt < CFS_POSIX_IOV_MAX ? iovcnt : CFS_POSIX_IOV_MAX;
+    len = 0;
+    for(i = 0; i < n; i++) {
+      v[i].iov_base = iov[i].base;
+      v[i].iov_len = iov[i].len;
+      len += iov[i].len;
+    }
+    if(write_op) {
+      r = writev(f, v, n);
+    } else {
+      r = readv(f, v, n);
+    }
+    if(r < 0) {
+      return total > 0 ? total : -1;
+    }
+    total += r;
+    if(r < len) {
+      break;
+    }
+    iov += n;
+    iovcnt -= n;
+  }
+  return total;
+}
+#endif /* _MSC_VER */
+/*---------------------------------------------------------------------------*/
+int
+cfs_readv(int f, const struct cfs_iovec *iov, int iovcnt)
+{
+  return transfer(f, iov, iovcnt, 0);
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_writev(int f, const struct cfs_iovec *iov, int iovcnt)
+{
+  return transfer(f, iov, iovcnt, 1);
+}
+/*---------------------------------------------------------------------------*/
 cfs_offset_t
 cfs_seek(int f, cfs_offset_t o, int w)
 {
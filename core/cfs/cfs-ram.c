@@ -77,10 +77,11 @@ cfs_open(const char *n, int f)
   }
 }
 /*---------------------------------------------------------------------------*/
-void
+int
 cfs_close(int f)
 {
   file.flag = FLAG_FILE_CLOSED;
+  return 0;
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -127,6 +128,44 @@ cfs_write(int f, const void *buf, unsigned int len)
   }
 }
 /*---------------------------------------------------------------------------*/
+int
+cfs_readv(int f, const struct cfs_iovec *iov, int iovcnt)
+{
+  int i, r, total;
+
+  total = 0;
+  for(i = 0; i < iovcnt; i++) {
+    r = cfs_read(f, iov[i].base, iov[i].len);
+    if(r < 0) {
+      return total > 0 ? total : -1;
+    }
+    total += r;
+    if(r < iov[i].len) {
+      break;
+    }
+  }
+  return total;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_writev(int f, const struct cfs_iovec *iov, int iovcnt)
+{
+  int i, r, total;
+
+  total = 0;
+  for(i = 0; i < iovcnt; i++) {
+    r = cfs_write(f, iov[i].base, iov[i].len);
+    if(r < 0) {
+      return total > 0 ? total : -1;
+    }
+    total += r;
+    if(r < iov[i].len) {
+      break;
+    }
+  }
+  return total;
+}
+/*---------------------------------------------------------------------------*/
 cfs_offset_t
 cfs_seek(int f, cfs_offset_t o, int w)
 {
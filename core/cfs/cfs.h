@@ -76,6 +76,17 @@ struct cfs_dirent {
   cfs_offset_t size;
 };
 
+/**
+ * A buffer of a vectored read or write.
+ *
+ * \sa cfs_readv()
+ * \sa cfs_writev()
+ */
+struct cfs_iovec {
+  void *base;
+  unsigned int len;
+};
+
 /**
  * Specify that cfs_open() should open a file for reading.
  *
@@ -170,12 +181,15 @@ CCIF int cfs_open(const char *name, int flags);
 /**
  * \brief      Close an open file.
  * \param fd   The file descriptor of the open file.
+ * \return     0, or -1 if data that was buffered for the file could
+ *             not be written.
  *
  *             This function closes a file that has previously been
- *             opened with cfs_open().
+ *             opened with cfs_open(). The file descriptor is closed
+ *             even if the function fails.
  */
 #ifndef cfs_close
-CCIF void cfs_close(int fd);
+CCIF int cfs_close(int fd);
 #endif
 
 /**
@@ -208,6 +222,47 @@ CCIF int cfs_read(int fd, void *buf, unsigned int len);
 CCIF int cfs_write(int fd, const void *buf, unsigned int len);
 #endif
 
+/**
+ * \brief      Read data from an open file into several buffers.
+ * \param fd   The file descriptor of the open file.
+ * \param iov  The buffers in which data should be read from the file.
+ * \param iovcnt The number of buffers.
+ * \return     The number of bytes that was actually read from the file,
+ *             or -1 if nothing could be read.
+ *
+ *             This function fills the buffers in order with data read
+ *             from consecutive positions in the file, as if
+ *             cfs_read() had been called for each buffer. It stops at
+ *             the first buffer that is not filled completely. Not all
+ *             CFS backends implement this function.
+ *
+ * \sa         cfs_read()
+ */
+#ifndef cfs_readv
+CCIF int cfs_readv(int fd, const struct cfs_iovec *iov, int iovcnt);
+#endif
+
+/**
+ * \brief      Write data from several buffers to an open file.
+ * \param fd   The file descriptor of the open file.
+ * \param iov  The buffers from which data should be written to the file.
+ * \param iovcnt The number of buffers.
+ * \return     The number of bytes that was actually written to the file,
+ *             or -1 if nothing could be written.
+ *
+ *             This function writes the buffers in order to
+ *             consecutive positions in the file, as if cfs_write()
+ *             had been called for each buffer. Backends may write the
+ *             buffers with fewer operations than separate calls to
+ *             cfs_write() would need. Not all CFS backends implement
+ *             this function.
+ *
+ * \sa         cfs_write()
+ */
+#ifndef cfs_writev
+CCIF int cfs_writev(int fd, const struct cfs_iovec *iov, int iovcnt);
+#endif
+
 /**
  * \brief      Seek to a specified position in an open file.
  * \param fd   The file descriptor of the open file.
@@ -120,7 +120,7 @@ int cc1100_packets_seen, cc1100_packets_read;
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
 /*---------------------------------------------------------------------------*/
-PROCESS(cc1100_process, "CC1100 driver");
+PROCESS_PRIO(cc1100_process, "CC1100 driver", PROCESS_PRIORITY_NETWORK);
 /*---------------------------------------------------------------------------*/
 
 int cc1100_on(void);
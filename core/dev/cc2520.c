@@ -95,7 +95,7 @@ volatile uint16_t cc2520_sfd_end_time;
 
 static volatile uint16_t last_packet_timestamp;
 /*---------------------------------------------------------------------------*/
-PROCESS(cc2520_process, "CC2520 driver");
+PROCESS_PRIO(cc2520_process, "CC2520 driver", PROCESS_PRIORITY_NETWORK);
 /*---------------------------------------------------------------------------*/
 
 
@@ -54,6 +54,10 @@ memb_init(struct memb *m)
 {
   memset(m->count, 0, m->num);
   memset(m->mem, 0, m->size * m->num);
+#if MEMB_FREELIST
+  m->free = 0;
+  m->fresh = 0;
+#endif /* MEMB_FREELIST */
 }
 /*---------------------------------------------------------------------------*/
 void *
@@ -61,6 +65,21 @@ memb_alloc(struct memb *m)
 {
   int i;
 
+#if MEMB_FREELIST
+  if(m->free != 0) {
+    /* Take the first block from the free list. */
+    i = m->free - 1;
+    m->free = m->next[i];
+  } else if(m->fresh < m->num) {
+    /* The free list is empty, so we use a block that has never been
+       allocated before. */
+    i = m->fresh++;
+  } else {
+    return NULL;
+  }
+  ++(m->count[i]);
+  return (void *)((char *)m->mem + (i * m->size));
+#else /* MEMB_FREELIST */
   for(i = 0; i < m->num; ++i) {
     if(m->count[i] == 0) {
       /* If this block was unused, we increase the reference count to
@@ -74,31 +93,41 @@ memb_alloc(struct memb *m)
   /* No free block was found, so we return NULL to indicate failure to
      allocate block. */
   return NULL;
+#endif /* MEMB_FREELIST */
 }
 /*---------------------------------------------------------------------------*/
 char
 memb_free(struct memb *m, void *ptr)
 {
+  unsigned long offset;
   int i;
-  char *ptr2;
 
-  /* Walk through the list of blocks and try to find the block to
-     which the pointer "ptr" points to. */
-  ptr2 = (char *)m->mem;
-  for(i = 0; i < m->num; ++i) {
-    
-    if(ptr2 == (char *)ptr) {
-      /* We've found to block to which "ptr" points so we decrease the
-	 reference count and return the new value of it. */
-      if(m->count[i] > 0) {
-	/* Make sure that we don't deallocate free memory. */
-	--(m->count[i]);
-      }
-      return m->count[i];
+  /* Compute the index of the block to which the pointer "ptr" points
+     to, and make sure that it points to the start of a block. */
+  if(!memb_inmemb(m, ptr)) {
+    return -1;
+  }
+  offset = (char *)ptr - (char *)m->mem;
+  if(offset % m->size != 0) {
+    return -1;
+  }
+  i = offset / m->size;
+
+  /* We've found to block to which "ptr" points so we decrease the
+     reference count and return the new value of it. */
+  if(m->count[i] > 0) {
+    /* Make sure that we don't deallocate free memory. */
+    --(m->count[i]);
+#if MEMB_FREELIST
+    if(m->count[i] == 0) {
+      /* The last reference is gone, so the block goes back on the
+	 free list. */
+      m->next[i] = m->free;
+      m->free = i + 1;
     }
-    ptr2 += m->size;
+#endif /* MEMB_FREELIST */
   }
-  return -1;
+  return m->count[i];
 }
 /*---------------------------------------------------------------------------*/
 int
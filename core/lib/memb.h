@@ -49,6 +49,13 @@
  * memory by the memb_alloc() function, and are deallocated with the
  * memb_free() function.
  *
+ * By default, memb_alloc() searches the reference count array for an
+ * unused block, which takes time proportional to the number of
+ * blocks. If MEMB_CONF_FREELIST is set to 1, the MEMB() macro also
+ * declares a free list for each memory block, which makes both
+ * memb_alloc() and memb_free() run in constant time at the cost of
+ * one extra unsigned short per block.
+ *
  * @{
  */
 
@@ -66,6 +73,12 @@
 
 #include "sys/cc.h"
 
+#ifdef MEMB_CONF_FREELIST
+#define MEMB_FREELIST MEMB_CONF_FREELIST
+#else
+#define MEMB_FREELIST 0
+#endif /* MEMB_CONF_FREELIST */
+
 /**
  * Declare a memory block.
  *
@@ -87,18 +100,39 @@ MEMB(connections, struct connection, 16);
  * \param num The total number of memory chunks in the block.
  *
  */
+#if MEMB_FREELIST
+#define MEMB(name, structure, num) \
+        static char CC_CONCAT(name,_memb_count)[num]; \
+        static unsigned short CC_CONCAT(name,_memb_next)[num]; \
+        static structure CC_CONCAT(name,_memb_mem)[num]; \
+        static struct memb name = {sizeof(structure), num, \
+                                          CC_CONCAT(name,_memb_count), \
+                                          (void *)CC_CONCAT(name,_memb_mem), \
+                                          CC_CONCAT(name,_memb_next), 0, 0}
+#else /* MEMB_FREELIST */
 #define MEMB(name, structure, num) \
         static char CC_CONCAT(name,_memb_count)[num]; \
         static structure CC_CONCAT(name,_memb_mem)[num]; \
         static struct memb name = {sizeof(structure), num, \
                                           CC_CONCAT(name,_memb_count), \
                                           (void *)CC_CONCAT(name,_memb_mem)}
+#endif /* MEMB_FREELIST */
 
 struct memb {
   unsigned short size;
   unsigned short num;
   char *count;
   void *mem;
+#if MEMB_FREELIST
+  /* The free list is threaded through the next array. Block indices
+     are stored with an offset of one, so that zero marks the end of
+     the list and a zero-initialized memb is valid without a call to
+     memb_init(). Blocks at or above the "fresh" index have never been
+     allocated and are not on the free list. */
+  unsigned short *next;
+  unsigned short free;
+  unsigned short fresh;
+#endif /* MEMB_FREELIST */
 };
 
 /**
@@ -56,9 +56,202 @@
 #define MMEM_SIZE 4096
 #endif
 
-LIST(mmemlist);
+#ifdef MMEM_CONF_INCREMENTAL
+#define MMEM_INCREMENTAL MMEM_CONF_INCREMENTAL
+#else
+#define MMEM_INCREMENTAL 0
+#endif
+
 unsigned int avail_memory;
+
+#if MMEM_INCREMENTAL
+#include "contiki.h"
+
+#ifdef MMEM_CONF_COMPACT_BUDGET
+#define MMEM_COMPACT_BUDGET MMEM_CONF_COMPACT_BUDGET
+#else
+#define MMEM_COMPACT_BUDGET 128
+#endif
+
+/*
+ * The memory is divided into chunks, each starting with a header
+ * that holds the size of the chunk and a pointer to the struct mmem
+ * that owns it. Chunks that are not owned are holes, which are kept
+ * on doubly linked free lists, one per size class.
+ */
+struct chunk {
+  struct mmem *owner;
+  unsigned int size;
+};
+
+struct hole {
+  struct chunk chunk;
+  struct hole *prev, *next;
+};
+
+#define CHUNK_HDR       sizeof(struct chunk)
+#define CHUNK_MIN       ((sizeof(struct hole) + CHUNK_HDR - 1) /       \
+                         CHUNK_HDR * CHUNK_HDR)
+#define NUM_CLASSES     8
+#define CHUNK(offset)   ((struct chunk *)&memory[offset])
+
+/* The memory is declared as an array of chunk headers to get the
+   alignment right. */
+#define ARENA_SIZE      (MMEM_SIZE / CHUNK_HDR * CHUNK_HDR)
+static struct chunk arena[ARENA_SIZE / CHUNK_HDR];
+#define memory          ((char *)arena)
+
+static struct hole *holes[NUM_CLASSES];
+static unsigned int nholes, hole_bytes;
+
+/* Everything from top and upwards is unused. The compaction pass
+   continues from the chunk at scan. */
+static unsigned int top, scan;
+
+PROCESS(mmem_compact_process, "Managed memory compaction");
+#else /* MMEM_INCREMENTAL */
+LIST(mmemlist);
 static char memory[MMEM_SIZE];
+#endif /* MMEM_INCREMENTAL */
+
+#if MMEM_INCREMENTAL
+/*---------------------------------------------------------------------------*/
+static int
+size_class(unsigned int size)
+{
+  int c;
+
+  for(c = 0; c < NUM_CLASSES - 1 && size >= (CHUNK_MIN << (c + 1)); c++);
+  return c;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hole_add(struct hole *h)
+{
+  int c;
+
+  c = size_class(h->chunk.size);
+  h->chunk.owner = NULL;
+  h->prev = NULL;
+  h->next = holes[c];
+  if(h->next != NULL) {
+    h->next->prev = h;
+  }
+  holes[c] = h;
+  nholes++;
+  hole_bytes += h->chunk.size;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hole_remove(struct hole *h)
+{
+  if(h->prev != NULL) {
+    h->prev->next = h->next;
+  } else {
+    holes[size_class(h->chunk.size)] = h->next;
+  }
+  if(h->next != NULL) {
+    h->next->prev = h->prev;
+  }
+  nholes--;
+  hole_bytes -= h->chunk.size;
+}
+/*---------------------------------------------------------------------------*/
+static struct hole *
+hole_find(unsigned int size)
+{
+  struct hole *h;
+  int c;
+
+  /* Holes in the size class of the request may be too small, but any
+     hole in a larger class will do. */
+  c = size_class(size);
+  for(h = holes[c]; h != NULL; h = h->next) {
+    if(h->chunk.size >= size) {
+      return h;
+    }
+  }
+  for(c++; c < NUM_CLASSES; c++) {
+    if(holes[c] != NULL) {
+      return holes[c];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+mmem_compact(unsigned int budget)
+{
+  struct chunk *c, *n;
+  struct hole *h;
+  struct mmem *owner;
+  unsigned int hsize, nsize;
+
+  while(nholes > 0 && budget > 0) {
+    if(scan >= top) {
+      scan = 0;
+    }
+    c = CHUNK(scan);
+
+    if(c->owner != NULL) {
+      /* Skip over allocated chunks. */
+      scan += c->size;
+      budget -= budget < CHUNK_HDR ? budget : CHUNK_HDR;
+      continue;
+    }
+
+    h = (struct hole *)c;
+    hsize = h->chunk.size;
+    if(scan + hsize == top) {
+      /* The hole is at the end of the used memory. */
+      hole_remove(h);
+      top = scan;
+      scan = 0;
+      continue;
+    }
+
+    n = CHUNK(scan + hsize);
+    if(n->owner == NULL) {
+      /* Merge two adjacent holes. */
+      hole_remove((struct hole *)n);
+      hole_remove(h);
+      h->chunk.size = hsize + n->size;
+      hole_add(h);
+      budget--;
+      continue;
+    }
+
+    /* Move the allocated chunk that follows the hole downwards, and
+       leave the hole after it. */
+    hole_remove(h);
+    owner = n->owner;
+    nsize = n->size;
+    memmove(c, n, nsize);
+    owner->ptr = (char *)c + CHUNK_HDR;
+    scan += nsize;
+    h = (struct hole *)CHUNK(scan);
+    h->chunk.size = hsize;
+    hole_add(h);
+    budget -= budget < nsize ? budget : nsize;
+  }
+
+  return nholes > 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mmem_compact_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    if(mmem_compact(MMEM_COMPACT_BUDGET)) {
+      process_poll(&mmem_compact_process);
+    }
+  }
+
+  PROCESS_END();
+}
+#endif /* MMEM_INCREMENTAL */
 
 /*---------------------------------------------------------------------------*/
 /**
@@ -83,6 +276,48 @@ static char memory[MMEM_SIZE];
 int
 mmem_alloc(struct mmem *m, unsigned int size)
 {
+#if MMEM_INCREMENTAL
+  struct hole *h;
+  struct chunk *c;
+  unsigned int csize;
+
+  csize = (size + 2 * CHUNK_HDR - 1) / CHUNK_HDR * CHUNK_HDR;
+  if(csize < CHUNK_MIN) {
+    csize = CHUNK_MIN;
+  }
+  if(avail_memory < csize) {
+    return 0;
+  }
+
+  h = hole_find(csize);
+  if(h != NULL) {
+    /* Reuse a hole, and split off the rest of it if it is large
+       enough to be a hole of its own. */
+    hole_remove(h);
+    c = &h->chunk;
+    if(c->size - csize >= CHUNK_MIN) {
+      h = (struct hole *)((char *)c + csize);
+      h->chunk.size = c->size - csize;
+      hole_add(h);
+    } else {
+      csize = c->size;
+    }
+  } else {
+    if(ARENA_SIZE - top < csize) {
+      /* There is enough memory, but not in one piece. */
+      while(mmem_compact(ARENA_SIZE));
+    }
+    c = CHUNK(top);
+    top += csize;
+  }
+
+  c->owner = m;
+  c->size = csize;
+  m->ptr = (char *)c + CHUNK_HDR;
+  m->size = size;
+  avail_memory -= csize;
+  return 1;
+#else /* MMEM_INCREMENTAL */
   /* Check if we have enough memory left for this allocation. */
   if(avail_memory < size) {
     return 0;
@@ -105,6 +340,7 @@ mmem_alloc(struct mmem *m, unsigned int size)
   /* Return non-zero to indicate that we were able to allocate
      memory. */
   return 1;
+#endif /* MMEM_INCREMENTAL */
 }
 /*---------------------------------------------------------------------------*/
 /**
@@ -119,6 +355,22 @@ mmem_alloc(struct mmem *m, unsigned int size)
 void
 mmem_free(struct mmem *m)
 {
+#if MMEM_INCREMENTAL
+  struct chunk *c;
+  unsigned int offset;
+
+  c = (struct chunk *)((char *)m->ptr - CHUNK_HDR);
+  offset = (char *)c - memory;
+  avail_memory += c->size;
+
+  if(offset + c->size == top) {
+    /* The last chunk can be given back right away. */
+    top = offset;
+  } else {
+    hole_add((struct hole *)c);
+    process_poll(&mmem_compact_process);
+  }
+#else /* MMEM_INCREMENTAL */
   struct mmem *n;
 
   if(m->next != NULL) {
@@ -138,6 +390,7 @@ mmem_free(struct mmem *m)
 
   /* Remove the memory block from the list. */
   list_remove(mmemlist, m);
+#endif /* MMEM_INCREMENTAL */
 }
 /*---------------------------------------------------------------------------*/
 /**
@@ -152,8 +405,48 @@ mmem_free(struct mmem *m)
 void
 mmem_init(void)
 {
+#if MMEM_INCREMENTAL
+  memset(holes, 0, sizeof(holes));
+  nholes = hole_bytes = 0;
+  top = scan = 0;
+  avail_memory = ARENA_SIZE;
+  process_start(&mmem_compact_process, NULL);
+#else /* MMEM_INCREMENTAL */
   list_init(mmemlist);
   avail_memory = MMEM_SIZE;
+#endif /* MMEM_INCREMENTAL */
+}
+/*---------------------------------------------------------------------------*/
+#if !MMEM_INCREMENTAL
+int
+mmem_compact(unsigned int budget)
+{
+  /* The memory is always compact. */
+  return 0;
+}
+#endif /* !MMEM_INCREMENTAL */
+/*---------------------------------------------------------------------------*/
+void
+mmem_stats(struct mmem_stats *stats)
+{
+#if MMEM_INCREMENTAL
+  struct hole *h;
+  int c;
+
+  stats->holes = nholes;
+  stats->hole_bytes = hole_bytes;
+  stats->largest_hole = 0;
+  for(c = 0; c < NUM_CLASSES; c++) {
+    for(h = holes[c]; h != NULL; h = h->next) {
+      if(h->chunk.size > stats->largest_hole) {
+        stats->largest_hole = h->chunk.size;
+      }
+    }
+  }
+#else /* MMEM_INCREMENTAL */
+  stats->holes = stats->hole_bytes = stats->largest_hole = 0;
+#endif /* MMEM_INCREMENTAL */
+  stats->avail = avail_memory;
 }
 /*---------------------------------------------------------------------------*/
 
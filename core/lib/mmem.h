@@ -45,6 +45,16 @@
  * stays in place. Therefore, a level of indirection is used: access
  * to allocated memory must always be done using a special macro.
  *
+ * By default, the memory is compacted as part of mmem_free(), which
+ * takes time proportional to the amount of allocated memory. If
+ * MMEM_CONF_INCREMENTAL is set to 1, mmem_free() instead leaves a
+ * hole that is kept on one of several size-class free lists, and
+ * that can be reused by later allocations. The holes are compacted
+ * away by a background process that moves at most
+ * MMEM_CONF_COMPACT_BUDGET bytes each time it runs, or by explicit
+ * calls to mmem_compact(). Allocated memory can therefore move
+ * whenever the background process has run, not only on mmem_free().
+ *
  * \note This module has not been heavily tested.
  * @{
  */
@@ -84,10 +94,42 @@ struct mmem {
 /* XXX: tagga minne med "interrupt usage", vilke gr att man r
    speciellt varsam under free(). */
 
+/**
+ * Statistics about the managed memory, as reported by mmem_stats().
+ */
+struct mmem_stats {
+  /** The number of bytes that are not allocated. */
+  unsigned int avail;
+  /** The number of holes left by freed blocks. */
+  unsigned int holes;
+  /** The total size of the holes, in bytes. */
+  unsigned int hole_bytes;
+  /** The size of the largest hole, in bytes. */
+  unsigned int largest_hole;
+};
+
 int  mmem_alloc(struct mmem *m, unsigned int size);
 void mmem_free(struct mmem *);
 void mmem_init(void);
 
+/**
+ * \brief      Compact the managed memory incrementally
+ * \param budget The approximate number of bytes that may be moved
+ * \return     Non-zero if there are holes left to compact.
+ *
+ *             This function moves allocated blocks downwards into
+ *             the holes left by freed blocks, stopping once about
+ *             budget bytes have been moved. It does nothing unless
+ *             MMEM_CONF_INCREMENTAL is set.
+ */
+int  mmem_compact(unsigned int budget);
+
+/**
+ * \brief      Get statistics about the managed memory
+ * \param stats A pointer to a structure that is filled in.
+ */
+void mmem_stats(struct mmem_stats *stats);
+
 #endif /* __MMEM_H__ */
 
 /** @} */
@@ -47,6 +47,7 @@
 
 #include "contiki-net.h"
 #include "net/packetbuf.h"
+#include "net/queuebuf.h"
 #include "net/rime.h"
 
 struct packetbuf_attr packetbuf_attrs[PACKETBUF_NUM_ATTRS];
@@ -56,12 +57,36 @@ struct packetbuf_addr packetbuf_addrs[PACKETBUF_NUM_ADDRS];
 static uint16_t buflen, bufptr;
 static uint8_t hdrptr;
 
+#if QUEUEBUF_ZEROCOPY
+/* With zero-copy queuebufs, the packetbuf is one of a pool of
+   reference counted buffers, and a queuebuf holds a reference to a
+   buffer instead of a copy of the packet. Each queuebuf holds at most
+   one buffer, so one more buffer than there are queuebufs ensures
+   that the packetbuf always finds a free buffer when it must stop
+   sharing one. */
+struct packetbuf_block {
+  uint16_t aligned[(PACKETBUF_SIZE + PACKETBUF_HDR_SIZE) / 2 + 1];
+  uint8_t refs;
+  /* Lowest offset of a packet shared with a queuebuf. Header space
+     below it can be allocated without disturbing the queuebufs. */
+  uint8_t shared_start;
+};
+
+#define NUM_BLOCKS (QUEUEBUF_NUM + 1)
+
+static struct packetbuf_block blocks[NUM_BLOCKS] = {
+  { { 0 }, 1, PACKETBUF_HDR_SIZE }
+};
+static struct packetbuf_block *block = &blocks[0];
+static uint8_t *packetbuf = (uint8_t *)blocks[0].aligned;
+#else /* QUEUEBUF_ZEROCOPY */
 /* The declarations below ensure that the packet buffer is aligned on
    an even 16-bit boundary. On some platforms (most notably the
    msp430), having apotentially misaligned packet buffer may lead to
    problems when accessing 16-bit values. */
 static uint16_t packetbuf_aligned[(PACKETBUF_SIZE + PACKETBUF_HDR_SIZE) / 2 + 1];
 static uint8_t *packetbuf = (uint8_t *)packetbuf_aligned;
+#endif /* QUEUEBUF_ZEROCOPY */
 
 static uint8_t *packetbufptr;
 
@@ -73,9 +98,13 @@ static uint8_t *packetbufptr;
 #define PRINTF(...)
 #endif
 
+#if PACKETBUF_STATS
+struct packetbuf_stats packetbuf_stats;
+#endif /* PACKETBUF_STATS */
+
 /*---------------------------------------------------------------------------*/
-void
-packetbuf_clear(void)
+static void
+reset(void)
 {
   buflen = bufptr = 0;
   hdrptr = PACKETBUF_HDR_SIZE;
@@ -83,6 +112,129 @@ packetbuf_clear(void)
   packetbufptr = &packetbuf[PACKETBUF_HDR_SIZE];
   packetbuf_attr_clear();
 }
+#if QUEUEBUF_ZEROCOPY
+/*---------------------------------------------------------------------------*/
+static struct packetbuf_block *
+block_alloc(void)
+{
+  struct packetbuf_block *b;
+
+  for(b = blocks; b < &blocks[NUM_BLOCKS]; b++) {
+    if(b->refs == 0) {
+      b->refs = 1;
+      b->shared_start = PACKETBUF_HDR_SIZE;
+      return b;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Make the packetbuf use the buffer b, to which the caller already
+   holds a reference. */
+static void
+block_use(struct packetbuf_block *b)
+{
+  int is_reference;
+
+  is_reference = packetbuf_is_reference();
+  block->refs--;
+  block = b;
+  packetbuf = (uint8_t *)b->aligned;
+  if(!is_reference) {
+    packetbufptr = &packetbuf[PACKETBUF_HDR_SIZE];
+  }
+}
+/*---------------------------------------------------------------------------*/
+struct packetbuf_block *
+packetbuf_share(uint8_t **ptr, uint16_t *len)
+{
+  struct packetbuf_block *b;
+
+  if(!packetbuf_is_reference() &&
+     (bufptr == 0 || hdrptr == PACKETBUF_HDR_SIZE)) {
+    /* The header and the data are consecutive. */
+    block->refs++;
+    if(hdrptr < block->shared_start) {
+      block->shared_start = hdrptr;
+    }
+    *ptr = hdrptr < PACKETBUF_HDR_SIZE ? &packetbuf[hdrptr] :
+      &packetbuf[PACKETBUF_HDR_SIZE + bufptr];
+    *len = packetbuf_totlen();
+    PACKETBUF_STATS_ADD(shared);
+    return block;
+  }
+
+  b = block_alloc();
+  if(b != NULL) {
+    *ptr = (uint8_t *)b->aligned + PACKETBUF_HDR_SIZE;
+    *len = packetbuf_copyto(*ptr);
+  }
+  return b;
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_attach(struct packetbuf_block *b, uint8_t *ptr, uint16_t len)
+{
+  uint8_t *data;
+
+  data = (uint8_t *)b->aligned + PACKETBUF_HDR_SIZE;
+  if(ptr < data) {
+    packetbuf_copyfrom(ptr, len);
+    return;
+  }
+  b->refs++;
+  block_use(b);
+  reset();
+  bufptr = ptr - data;
+  buflen = len;
+  PACKETBUF_STATS_ADD(shared);
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_release(struct packetbuf_block *b)
+{
+  b->refs--;
+}
+#endif /* QUEUEBUF_ZEROCOPY */
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_unshare(void)
+{
+#if QUEUEBUF_ZEROCOPY
+  struct packetbuf_block *b;
+  uint16_t end;
+
+  if(block->refs > 1) {
+    b = block_alloc();
+    if(b == NULL) {
+      return 0;
+    }
+    end = packetbuf_is_reference() ? PACKETBUF_HDR_SIZE :
+      PACKETBUF_HDR_SIZE + bufptr + buflen;
+    memcpy((uint8_t *)b->aligned + hdrptr, &packetbuf[hdrptr], end - hdrptr);
+    block_use(b);
+    PACKETBUF_STATS_ADD(unshare);
+  }
+#endif /* QUEUEBUF_ZEROCOPY */
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_clear(void)
+{
+#if QUEUEBUF_ZEROCOPY
+  struct packetbuf_block *b;
+
+  /* Leave the buffer to the queuebufs that share it. */
+  if(block->refs > 1) {
+    b = block_alloc();
+    if(b != NULL) {
+      block_use(b);
+    }
+  }
+#endif /* QUEUEBUF_ZEROCOPY */
+  reset();
+}
 /*---------------------------------------------------------------------------*/
 void
 packetbuf_clear_hdr(void)
@@ -99,6 +251,7 @@ packetbuf_copyfrom(const void *from, uint16_t len)
   l = len > PACKETBUF_SIZE? PACKETBUF_SIZE: len;
   memcpy(packetbufptr, from, l);
   buflen = l;
+  PACKETBUF_STATS_ADD(copyfrom);
   return l;
 }
 /*---------------------------------------------------------------------------*/
@@ -107,6 +260,11 @@ packetbuf_compact(void)
 {
   int i, len;
 
+  if(packetbuf_is_reference() || bufptr > 0) {
+    /* The data is about to be moved. */
+    packetbuf_unshare();
+  }
+
   if(packetbuf_is_reference()) {
     memcpy(&packetbuf[PACKETBUF_HDR_SIZE], packetbuf_reference_ptr(),
 	   packetbuf_datalen());
@@ -166,6 +324,7 @@ packetbuf_copyto(void *to)
   memcpy(to, packetbuf + hdrptr, PACKETBUF_HDR_SIZE - hdrptr);
   memcpy((uint8_t *)to + PACKETBUF_HDR_SIZE - hdrptr, packetbufptr + bufptr,
 	 buflen);
+  PACKETBUF_STATS_ADD(copyto);
   return PACKETBUF_HDR_SIZE - hdrptr + buflen;
 }
 /*---------------------------------------------------------------------------*/
@@ -173,6 +332,13 @@ int
 packetbuf_hdralloc(int size)
 {
   if(hdrptr >= size && packetbuf_totlen() + size <= PACKETBUF_SIZE) {
+#if QUEUEBUF_ZEROCOPY
+    /* The new header would overwrite a packet shared with a queuebuf. */
+    if(block->refs > 1 && hdrptr > block->shared_start &&
+       !packetbuf_unshare()) {
+      return 0;
+    }
+#endif /* QUEUEBUF_ZEROCOPY */
     hdrptr -= size;
     return 1;
   }
@@ -314,6 +314,86 @@ int packetbuf_hdralloc(int size);
  */
 int packetbuf_hdrreduce(int size);
 
+/**
+ * \brief      Make sure that the packetbuf data is not shared
+ * \retval     Non-zero if the data is not shared, zero otherwise
+ *
+ *             With QUEUEBUF_CONF_ZEROCOPY, a queuebuf created from
+ *             the packetbuf, or copied into the packetbuf, shares
+ *             the buffer of the packetbuf instead of copying the
+ *             packet. Prepending headers with packetbuf_hdralloc()
+ *             copies the buffer if needed, but a layer that modifies
+ *             the data of such a packet in place must call this
+ *             function first, and fetch packetbuf_dataptr() again
+ *             afterwards as the data may have moved.
+ *
+ *             Without QUEUEBUF_CONF_ZEROCOPY, the data is never
+ *             shared and the function does nothing.
+ *
+ */
+int packetbuf_unshare(void);
+
+/**
+ * A reference counted buffer holding a packet, shared between the
+ * packetbuf and zero-copy queuebufs.
+ */
+struct packetbuf_block;
+
+/**
+ * \brief      Get a shared reference to the packet in the packetbuf
+ * \param ptr  Set to point to the packet (header and data) in the buffer
+ * \param len  Set to the length of the packet
+ * \return     The buffer holding the packet, or NULL if no buffer is free
+ *
+ *             This function is used by queuebuf with
+ *             QUEUEBUF_CONF_ZEROCOPY. If the header and the data of
+ *             the packetbuf are not consecutive, the packet is copied
+ *             to a new buffer.
+ */
+struct packetbuf_block *packetbuf_share(uint8_t **ptr, uint16_t *len);
+
+/**
+ * \brief      Make the packetbuf use a shared buffer
+ * \param b    The buffer, as returned by packetbuf_share()
+ * \param ptr  The packet in the buffer
+ * \param len  The length of the packet
+ *
+ *             The packet is put in the data portion of the
+ *             packetbuf. It is copied if it starts in the header
+ *             portion of the buffer.
+ */
+void packetbuf_attach(struct packetbuf_block *b, uint8_t *ptr, uint16_t len);
+
+/**
+ * \brief      Drop a reference to a shared buffer
+ * \param b    The buffer, as returned by packetbuf_share()
+ */
+void packetbuf_release(struct packetbuf_block *b);
+
+#ifdef PACKETBUF_CONF_STATS
+#define PACKETBUF_STATS PACKETBUF_CONF_STATS
+#else
+#define PACKETBUF_STATS 0
+#endif
+
+#if PACKETBUF_STATS
+/** Counters of the packets copied to and from the packetbuf. */
+struct packetbuf_stats {
+  /** Packets copied into the packetbuf by packetbuf_copyfrom(). */
+  unsigned long copyfrom;
+  /** Packets copied out of the packetbuf by packetbuf_copyto(). */
+  unsigned long copyto;
+  /** Packets copied because a shared buffer was about to be modified. */
+  unsigned long unshare;
+  /** Packets handed to or from a queuebuf without a copy. */
+  unsigned long shared;
+};
+extern struct packetbuf_stats packetbuf_stats;
+#define PACKETBUF_STATS_ADD(x) packetbuf_stats.x++
+#else
+#define PACKETBUF_STATS_ADD(x)
+#endif /* PACKETBUF_STATS */
+
 /* Packet attributes stuff below: */
 
 typedef uint16_t packetbuf_attr_t;
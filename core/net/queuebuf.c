@@ -79,7 +79,13 @@ struct queuebuf {
 /* The actual queuebuf data */
 struct queuebuf_data {
   uint16_t len;
+#if QUEUEBUF_ZEROCOPY
+  /* The packet is in a buffer shared with the packetbuf */
+  struct packetbuf_block *block;
+  uint8_t *ptr;
+#else /* QUEUEBUF_ZEROCOPY */
   uint8_t data[PACKETBUF_SIZE];
+#endif /* QUEUEBUF_ZEROCOPY */
   struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
   struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
 };
@@ -362,7 +368,20 @@ queuebuf_new_from_packetbuf(void)
       buframptr = buf->ram_ptr;
 #endif
 
+#if QUEUEBUF_ZEROCOPY
+      buframptr->block = packetbuf_share(&buframptr->ptr, &buframptr->len);
+      if(buframptr->block == NULL) {
+        PRINTF("queuebuf_new_from_packetbuf: could not share packetbuf\n");
+        memb_free(&buframmem, buf->ram_ptr);
+        memb_free(&bufmem, buf);
+#if QUEUEBUF_DEBUG
+        list_remove(queuebuf_list, buf);
+#endif /* QUEUEBUF_DEBUG */
+        return NULL;
+      }
+#else /* QUEUEBUF_ZEROCOPY */
       buframptr->len = packetbuf_copyto(buframptr->data);
+#endif /* QUEUEBUF_ZEROCOPY */
       packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
 
 #if WITH_SWAP
@@ -416,6 +435,9 @@ queuebuf_free(struct queuebuf *buf)
       queuebuf_remove_from_file(buf->swap_id);
     }
 #else
+#if QUEUEBUF_ZEROCOPY
+    packetbuf_release(buf->ram_ptr->block);
+#endif /* QUEUEBUF_ZEROCOPY */
     memb_free(&buframmem, buf->ram_ptr);
 #endif
     memb_free(&bufmem, buf);
@@ -440,7 +462,11 @@ queuebuf_to_packetbuf(struct queuebuf *b)
   struct queuebuf_ref *r;
   if(memb_inmemb(&bufmem, b)) {
     struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+#if QUEUEBUF_ZEROCOPY
+    packetbuf_attach(buframptr->block, buframptr->ptr, buframptr->len);
+#else /* QUEUEBUF_ZEROCOPY */
     packetbuf_copyfrom(buframptr->data, buframptr->len);
+#endif /* QUEUEBUF_ZEROCOPY */
     packetbuf_attr_copyfrom(buframptr->attrs, buframptr->addrs);
   } else if(memb_inmemb(&refbufmem, b)) {
     r = (struct queuebuf_ref *)b;
@@ -458,7 +484,11 @@ queuebuf_dataptr(struct queuebuf *b)
 
   if(memb_inmemb(&bufmem, b)) {
     struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+#if QUEUEBUF_ZEROCOPY
+    return buframptr->ptr;
+#else /* QUEUEBUF_ZEROCOPY */
     return buframptr->data;
+#endif /* QUEUEBUF_ZEROCOPY */
   } else if(memb_inmemb(&refbufmem, b)) {
     r = (struct queuebuf_ref *)b;
     return r->ref;
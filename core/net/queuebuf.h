@@ -80,6 +80,21 @@
   #define WITH_SWAP 0
 #endif /* QUEUEBUFRAM_CONF_NUM */
 
+/* With QUEUEBUF_CONF_ZEROCOPY set, a queuebuf shares a reference
+   counted buffer with the packetbuf instead of holding a copy of the
+   packet, so that queueing and requeueing a packet does not copy
+   it. See packetbuf_unshare(). This cannot be combined with
+   swapping. */
+#ifdef QUEUEBUF_CONF_ZEROCOPY
+#define QUEUEBUF_ZEROCOPY QUEUEBUF_CONF_ZEROCOPY
+#else /* QUEUEBUF_CONF_ZEROCOPY */
+#define QUEUEBUF_ZEROCOPY 0
+#endif /* QUEUEBUF_CONF_ZEROCOPY */
+
+#if QUEUEBUF_ZEROCOPY && WITH_SWAP
+#error "QUEUEBUF_CONF_ZEROCOPY cannot be used with QUEUEBUFRAM_CONF_NUM < QUEUEBUF_NUM"
+#endif
+
 #ifdef QUEUEBUF_CONF_DEBUG
 #define QUEUEBUF_DEBUG QUEUEBUF_CONF_DEBUG
 #else /* QUEUEBUF_CONF_DEBUG */
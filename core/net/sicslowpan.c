@@ -223,35 +223,51 @@ static int last_tx_status;
  *  @{
  */
 
-static uint16_t sicslowpan_len;
-
 /**
- * The buffer used for the 6lowpan reassembly.
- * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
- * It has a fix size as we do not use dynamic memory allocation.
+ * A reassembly context. Each context holds one IPv6 packet being
+ * reassembled, identified by the link-layer sender, the datagram tag
+ * and the datagram size, as required by RFC 4944. Fragments may
+ * arrive in any order: the bitmap records which 8-byte units of the
+ * packet have been received, and the packet is complete when all of
+ * them are present.
  */
-static uip_buf_t sicslowpan_aligned_buf;
-#define sicslowpan_buf (sicslowpan_aligned_buf.u8)
+struct reass_context {
+  /** The buffer the packet is reassembled in (IPv6 packet only, no
+      MAC header, 6lowpan, etc). */
+  uip_buf_t buf;
+  /** Reassembly timer, started by the first fragment received. */
+  struct timer timer;
+  /** Link-layer address of the sender of the fragments. */
+  rimeaddr_t sender;
+  /** Datagram tag of the fragments. */
+  uint16_t tag;
+  /** Datagram size. 0 if the context is free. */
+  uint16_t size;
+  /** Number of distinct 8-byte units received so far. */
+  uint16_t units;
+  /** One bit per 8-byte unit of the datagram. */
+  uint8_t bitmap[(UIP_BUFSIZE + 63) / 64];
+};
 
-/** The total length of the IPv6 packet in the sicslowpan_buf. */
+/**
+ * The reassembly contexts. They have a fixed size as we do not use
+ * dynamic memory allocation.
+ */
+static struct reass_context reass_contexts[SICSLOWPAN_REASS_CONTEXTS];
 
 /**
- * length of the ip packet already sent / received.
- * It includes IP and transport headers.
+ * The buffer used for the 6lowpan processing. Packets that are not
+ * fragmented are uncompressed directly in uip_buf, fragments in the
+ * buffer of their reassembly context.
  */
-static uint16_t processed_ip_in_len;
+static uint8_t *sicslowpan_buf;
+#define sicslowpan_len uip_len
 
 /** Datagram tag to be put in the fragments I send. */
 static uint16_t my_tag;
 
-/** When reassembling, the tag in the fragments being merged. */
-static uint16_t reass_tag;
-
-/** When reassembling, the source address of the fragments being merged */
-rimeaddr_t frag_sender;
-
-/** Reassembly %process %timer. */
-static struct timer reass_timer;
+/** Reassembly counters. */
+struct sicslowpan_frag_stats sicslowpan_frag_stats;
 
 /** @} */
 #else /* SICSLOWPAN_CONF_FRAG */
@@ -1470,6 +1486,10 @@ output(uip_lladdr_t *localdest)
     queuebuf_to_packetbuf(q);
     queuebuf_free(q);
     q = NULL;
+    /* The MAC layer may still have the fragment queued: do not let the
+       next fragment overwrite it. */
+    packetbuf_unshare();
+    rime_ptr = packetbuf_dataptr();
 
     /* Check tx result. */
     if((last_tx_status == MAC_TX_COLLISION) ||
@@ -1516,6 +1536,8 @@ output(uip_lladdr_t *localdest)
       queuebuf_to_packetbuf(q);
       queuebuf_free(q);
       q = NULL;
+      packetbuf_unshare();
+      rime_ptr = packetbuf_dataptr();
       processed_ip_out_len += rime_payload_len;
 
       /* Check tx result. */
@@ -1543,14 +1565,99 @@ output(uip_lladdr_t *localdest)
   return 1;
 }
 
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Free the reassembly contexts whose timer has expired
+ */
+static void
+reass_timeout(void)
+{
+  struct reass_context *c;
+
+  for(c = reass_contexts; c < &reass_contexts[SICSLOWPAN_REASS_CONTEXTS]; c++) {
+    if(c->size != 0 && timer_expired(&c->timer)) {
+      PRINTFI("sicslowpan input: reassembly of tag %d timed out\n", c->tag);
+      c->size = 0;
+      sicslowpan_frag_stats.timeouts++;
+    }
+  }
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the reassembly context of a fragment, or start a new one
+ * \param tag The datagram tag of the fragment
+ * \param size The datagram size of the fragment
+ * \return The context, or NULL if all contexts are in use
+ */
+static struct reass_context *
+reass_lookup(uint16_t tag, uint16_t size)
+{
+  struct reass_context *c, *free;
+  const rimeaddr_t *sender;
+
+  sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+  free = NULL;
+  for(c = reass_contexts; c < &reass_contexts[SICSLOWPAN_REASS_CONTEXTS]; c++) {
+    if(c->size == 0) {
+      if(free == NULL) {
+        free = c;
+      }
+    } else if(c->size == size && c->tag == tag &&
+              rimeaddr_cmp(&c->sender, sender)) {
+      return c;
+    }
+  }
+
+  if(free != NULL) {
+    free->size = size;
+    free->tag = tag;
+    free->units = 0;
+    memset(free->bitmap, 0, sizeof(free->bitmap));
+    rimeaddr_copy(&free->sender, sender);
+    timer_set(&free->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+    PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
+            size, tag);
+  }
+  return free;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Mark bytes of a datagram as received
+ * \param c The reassembly context
+ * \param start Offset of the first byte received
+ * \param end Offset after the last byte received
+ * \return Non-zero if the datagram is complete
+ *
+ * Fragments other than the last one carry a multiple of 8 bytes, so
+ * counting distinct 8-byte units is enough to tell when every part of
+ * the datagram has been received, even if fragments are duplicated
+ * or arrive out of order.
+ */
+static int
+reass_mark(struct reass_context *c, uint16_t start, uint16_t end)
+{
+  uint16_t u;
+
+  for(u = start >> 3; u < (end + 7) >> 3; u++) {
+    if((c->bitmap[u >> 3] & (1 << (u & 7))) == 0) {
+      c->bitmap[u >> 3] |= 1 << (u & 7);
+      c->units++;
+    }
+  }
+  return c->units == (c->size + 7) >> 3;
+}
+#endif /* SICSLOWPAN_CONF_FRAG */
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
  *
  *  The 6lowpan packet is put in packetbuf by the MAC. If its a frag1 or
- *  a non-fragmented packet we first uncompress the IP header. The
- *  6lowpan payload and possibly the uncompressed IP header are then
- *  copied in siclowpan_buf. If the IP packet is complete it is copied
+ *  a non-fragmented packet we first uncompress the IP header. A
+ *  non-fragmented packet is uncompressed directly in uip_buf and the
+ *  IP layer is called. The payload of a fragment, and for a frag1 the
+ *  uncompressed IP header, are copied in the buffer of the reassembly
+ *  context of the datagram. When the datagram is complete it is copied
  *  to uip_buf and the IP layer is called.
  *
  * \note We do not check for overlapping sicslowpan fragments
@@ -1566,7 +1673,9 @@ input(void)
 #if SICSLOWPAN_CONF_FRAG
   /* tag of the fragment */
   uint16_t frag_tag = 0;
-  uint8_t first_fragment = 0, last_fragment = 0;
+  /* reassembly context of the fragment */
+  struct reass_context *context = NULL;
+  uint16_t start;
 #endif /*SICSLOWPAN_CONF_FRAG*/
 
   /* init */
@@ -1577,11 +1686,8 @@ input(void)
   rime_ptr = packetbuf_dataptr();
 
 #if SICSLOWPAN_CONF_FRAG
-  /* if reassembly timed out, cancel it */
-  if(timer_expired(&reass_timer)) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
+  /* cancel the reassemblies that timed out */
+  reass_timeout();
   /*
    * Since we don't support the mesh and broadcast header, the first header
    * we look for is the fragmentation header
@@ -1597,8 +1703,6 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       rime_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
-      /*      printf("frag1 %d %d\n", reass_tag, frag_tag);*/
-      first_fragment = 1;
       break;
     case SICSLOWPAN_DISPATCH_FRAGN:
       /*
@@ -1612,48 +1716,27 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       rime_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
-
-      /* If this is the last fragment, we may shave off any extrenous
-         bytes at the end. We must be liberal in what we accept. */
-      PRINTFI("last_fragment?: processed_ip_in_len %d rime_payload_len %d frag_size %d\n",
-              processed_ip_in_len, packetbuf_datalen() - rime_hdr_len, frag_size);
-
-      if(processed_ip_in_len + packetbuf_datalen() - rime_hdr_len >= frag_size) {
-        last_fragment = 1;
-      }
       break;
     default:
       break;
   }
 
-  if(processed_ip_in_len > 0) {
-    /* reassembly is ongoing */
-    /*    printf("frag %d %d\n", reass_tag, frag_tag);*/
-    if((frag_size > 0 &&
-        (frag_size != sicslowpan_len ||
-         reass_tag  != frag_tag ||
-         !rimeaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))))  ||
-       frag_size == 0) {
-      /*
-       * the packet is a fragment that does not belong to the packet
-       * being reassembled or the packet is not a fragment.
-       */
-      PRINTFI("sicslowpan input: Dropping 6lowpan packet that is not a fragment of the packet currently being reassembled\n");
+  if(frag_size > 0) {
+    if(frag_size > UIP_BUFSIZE - UIP_LLH_LEN) {
+      PRINTFI("sicslowpan input: Dropping fragment of too large datagram (%d)\n",
+              frag_size);
+      sicslowpan_frag_stats.dropped++;
       return;
     }
-  } else {
-    /*
-     * reassembly is off
-     * start it if we received a fragment
-     */
-    if((frag_size > 0) && (frag_size <= UIP_BUFSIZE)) {
-      sicslowpan_len = frag_size;
-      reass_tag = frag_tag;
-      timer_set(&reass_timer, SICSLOWPAN_REASS_MAXAGE*CLOCK_SECOND);
-      PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
-             sicslowpan_len, reass_tag);
-      rimeaddr_copy(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+    context = reass_lookup(frag_tag, frag_size);
+    if(context == NULL) {
+      PRINTFI("sicslowpan input: Dropping fragment, no free reassembly context\n");
+      sicslowpan_frag_stats.nocontext++;
+      return;
     }
+    sicslowpan_buf = context->buf.u8;
+  } else {
+    sicslowpan_buf = uip_buf;
   }
 
   if(rime_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN) {
@@ -1710,72 +1793,72 @@ input(void)
     return;
   }
   rime_payload_len = packetbuf_datalen() - rime_hdr_len;
-  memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (uint16_t)(frag_offset << 3), rime_ptr + rime_hdr_len, rime_payload_len);
-  
-  /* update processed_ip_in_len if fragment, sicslowpan_len otherwise */
 
 #if SICSLOWPAN_CONF_FRAG
   if(frag_size > 0) {
-    /* Add the size of the header only for the first fragment. */
-    if(first_fragment != 0) {
-      processed_ip_in_len += uncomp_hdr_len;
+    start = (uint16_t)(frag_offset << 3);
+    if(start + uncomp_hdr_len > frag_size) {
+      PRINTFI("sicslowpan input: Dropping fragment beyond datagram end\n");
+      sicslowpan_frag_stats.dropped++;
+      return;
     }
     /* For the last fragment, we are OK if there is extrenous bytes at
        the end of the packet. */
-    if(last_fragment != 0) {
-      processed_ip_in_len = frag_size;
-    } else {
-      processed_ip_in_len += rime_payload_len;
+    if(start + uncomp_hdr_len + rime_payload_len > frag_size) {
+      rime_payload_len = frag_size - start - uncomp_hdr_len;
     }
-    PRINTF("processed_ip_in_len %d, rime_payload_len %d\n", processed_ip_in_len, rime_payload_len);
+  }
+#endif /* SICSLOWPAN_CONF_FRAG */
 
-  } else {
+  memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (uint16_t)(frag_offset << 3), rime_ptr + rime_hdr_len, rime_payload_len);
+
+#if SICSLOWPAN_CONF_FRAG
+  if(frag_size > 0) {
+    if(!reass_mark(context, start,
+                   start + uncomp_hdr_len + rime_payload_len)) {
+      PRINTF("sicslowpan input: %d of %d units of tag %d received\n",
+             context->units, (frag_size + 7) >> 3, frag_tag);
+      return;
+    }
+    /*
+     * We have a full IP packet in the reassembly context, deliver it to
+     * the IP stack
+     */
+    PRINTFI("sicslowpan input: IP packet ready (length %d)\n", frag_size);
+    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, frag_size);
+    uip_len = frag_size;
+    context->size = 0;
+    sicslowpan_frag_stats.reassembled++;
+    sicslowpan_buf = uip_buf;
+  } else
 #endif /* SICSLOWPAN_CONF_FRAG */
+  {
     sicslowpan_len = rime_payload_len + uncomp_hdr_len;
-#if SICSLOWPAN_CONF_FRAG
   }
 
-  /*
-   * If we have a full IP packet in sicslowpan_buf, deliver it to
-   * the IP stack
-   */
-  PRINTF("sicslowpan_init processed_ip_in_len %d, sicslowpan_len %d\n",
-         processed_ip_in_len, sicslowpan_len);
-  if(processed_ip_in_len == 0 || (processed_ip_in_len == sicslowpan_len)) {
-    PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
-           sicslowpan_len);
-    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
-    uip_len = sicslowpan_len;
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-#endif /* SICSLOWPAN_CONF_FRAG */
-
 #if DEBUG
-    {
-      uint16_t ndx;
-      PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
-      for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
-        uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
-        PRINTF("%02x", data);
-      }
-      PRINTF("\n");
+  {
+    uint16_t ndx;
+    PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
+    for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
+      uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
+      PRINTF("%02x", data);
     }
+    PRINTF("\n");
+  }
 #endif
 
 #if SICSLOWPAN_CONF_NEIGHBOR_INFO
-    neighbor_info_packet_received();
+  neighbor_info_packet_received();
 #endif /* SICSLOWPAN_CONF_NEIGHBOR_INFO */
 
-    /* if callback is set then set attributes and call */
-    if(callback) {
-      set_packet_attrs();
-      callback->input_callback();
-    }
-
-    tcpip_input();
-#if SICSLOWPAN_CONF_FRAG
+  /* if callback is set then set attributes and call */
+  if(callback) {
+    set_packet_attrs();
+    callback->input_callback();
   }
-#endif /* SICSLOWPAN_CONF_FRAG */
+
+  tcpip_input();
 }
 /** @} */
 
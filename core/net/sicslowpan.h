@@ -318,6 +318,25 @@ struct sicslowpan_nh_compressor {
 
 };
 
+/**
+ * Counters of the 6lowpan reassembly, used to size
+ * SICSLOWPAN_CONF_REASS_CONTEXTS.
+ */
+struct sicslowpan_frag_stats {
+  /** Packets successfully reassembled. */
+  unsigned long reassembled;
+  /** Reassemblies cancelled because the timer expired. */
+  unsigned long timeouts;
+  /** Fragments dropped because all reassembly contexts were in use. */
+  unsigned long nocontext;
+  /** Fragments dropped because they did not fit in the datagram or
+      the reassembly buffer. */
+  unsigned long dropped;
+};
+
+#if SICSLOWPAN_CONF_FRAG
+extern struct sicslowpan_frag_stats sicslowpan_frag_stats;
+#endif /* SICSLOWPAN_CONF_FRAG */
 
 extern const struct network_driver sicslowpan_driver;
 
@@ -152,7 +152,7 @@ tcpip_set_outputfunc(uint8_t (*f)(void))
 unsigned char tcpip_is_forwarding; /* Forwarding right now? */
 #endif /* UIP_CONF_IP_FORWARD */
 
-PROCESS(tcpip_process, "TCP/IP stack");
+PROCESS_PRIO(tcpip_process, "TCP/IP stack", PROCESS_PRIORITY_NETWORK);
 
 /*---------------------------------------------------------------------------*/
 static void
@@ -100,6 +100,205 @@ static uip_ds6_nbr_t *locnbr;
 static uip_ds6_defrt_t *locdefrt;
 static uip_ds6_route_t *locroute;
 
+#if UIP_DS6_HASH
+/*
+ * Hash indexes over the DS6 tables. Each used slot of a table is linked
+ * into the chain of the bucket given by the hash of the first "len" bits
+ * of its address, compared with the same byte granularity as
+ * uip_ipaddr_prefixcmp(). Some modules clear the isused flag of table
+ * entries directly, so chains may hold stale slots: lookups check the
+ * entry itself, and a slot is unlinked before it is reused.
+ */
+#if UIP_DS6_HASH_BUCKETS & (UIP_DS6_HASH_BUCKETS - 1)
+#error UIP_DS6_CONF_HASH_BUCKETS must be a power of two
+#endif
+#if UIP_DS6_HASH_BUCKETS > 255 || UIP_DS6_NBR_NB > 255 || UIP_DS6_ROUTE_NB > 255
+#error Too many DS6 entries or hash buckets for UIP_DS6_CONF_HASH
+#endif
+
+#define HASH_NONE 0xff
+
+struct ds6_slot {
+  uint8_t next;       /* next slot in the chain */
+  uint8_t bucket;     /* bucket the slot is linked into, or HASH_NONE */
+  uint8_t len;        /* prefix length the slot was indexed with */
+};
+
+struct ds6_index {
+  uip_ds6_element_t *list;
+  uint16_t elementsize;
+  uint8_t size;
+  struct ds6_slot *slots;
+  uint8_t buckets[UIP_DS6_HASH_BUCKETS];
+};
+
+#define DS6_INDEX(name, list, size, type)                               \
+  static struct ds6_slot name##_slots[size];                            \
+  static struct ds6_index name = { (uip_ds6_element_t *)(list),         \
+                                   sizeof(type), size, name##_slots }
+
+DS6_INDEX(nbr_index, uip_ds6_nbr_cache, UIP_DS6_NBR_NB, uip_ds6_nbr_t);
+DS6_INDEX(route_index, uip_ds6_routing_table, UIP_DS6_ROUTE_NB,
+          uip_ds6_route_t);
+DS6_INDEX(addr_index, uip_ds6_if.addr_list, UIP_DS6_ADDR_NB,
+          uip_ds6_addr_t);
+DS6_INDEX(maddr_index, uip_ds6_if.maddr_list, UIP_DS6_MADDR_NB,
+          uip_ds6_maddr_t);
+DS6_INDEX(aaddr_index, uip_ds6_if.aaddr_list, UIP_DS6_AADDR_NB,
+          uip_ds6_aaddr_t);
+
+/* Number of indexed routes of each prefix length */
+static uint8_t route_lengths[129];
+
+#define ELEMENT(index, i) \
+  ((uip_ds6_element_t *)((uint8_t *)(index)->list + (i) * (index)->elementsize))
+#endif /* UIP_DS6_HASH */
+
+#if UIP_DS6_HASH
+/*---------------------------------------------------------------------------*/
+static uint8_t
+index_hash(uip_ipaddr_t *ipaddr, uint8_t len)
+{
+  uint16_t h;
+  uint8_t i;
+
+  h = len;
+  for(i = 0; i < (len >> 3); i++) {
+    h = h * 31 + ipaddr->u8[i];
+  }
+  return (h ^ (h >> 8)) & (UIP_DS6_HASH_BUCKETS - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_reset(struct ds6_index *index)
+{
+  uint8_t i;
+
+  memset(index->buckets, HASH_NONE, sizeof(index->buckets));
+  for(i = 0; i < index->size; i++) {
+    index->slots[i].bucket = HASH_NONE;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_element_t *
+index_lookup(struct ds6_index *index, uip_ipaddr_t *ipaddr, uint8_t len)
+{
+  uip_ds6_element_t *element;
+  uint8_t i;
+
+  for(i = index->buckets[index_hash(ipaddr, len)];
+      i != HASH_NONE;
+      i = index->slots[i].next) {
+    element = ELEMENT(index, i);
+    if(element->isused && index->slots[i].len == len &&
+       uip_ipaddr_prefixcmp(&element->ipaddr, ipaddr, len)) {
+      return element;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Unlink an element from its chain. Returns the prefix length it was
+   indexed with, or HASH_NONE if it was not in the index. */
+static uint8_t
+index_remove(struct ds6_index *index, uip_ds6_element_t *element)
+{
+  struct ds6_slot *slot;
+  uint8_t i, *p;
+
+  i = ((uint8_t *)element - (uint8_t *)index->list) / index->elementsize;
+  slot = &index->slots[i];
+  if(slot->bucket == HASH_NONE) {
+    return HASH_NONE;
+  }
+  for(p = &index->buckets[slot->bucket];
+      *p != HASH_NONE;
+      p = &index->slots[*p].next) {
+    if(*p == i) {
+      *p = slot->next;
+      break;
+    }
+  }
+  slot->bucket = HASH_NONE;
+  return slot->len;
+}
+/*---------------------------------------------------------------------------*/
+/* Index an element that has just got its address. The slot may still be
+   linked under the address of an entry that was cleared behind our back. */
+static void
+index_add(struct ds6_index *index, uip_ds6_element_t *element, uint8_t len)
+{
+  struct ds6_slot *slot;
+  uint8_t i;
+
+  index_remove(index, element);
+  i = ((uint8_t *)element - (uint8_t *)index->list) / index->elementsize;
+  slot = &index->slots[i];
+  slot->len = len;
+  slot->bucket = index_hash(&element->ipaddr, len);
+  slot->next = index->buckets[slot->bucket];
+  index->buckets[slot->bucket] = i;
+}
+/*---------------------------------------------------------------------------*/
+/* The hashed counterpart of uip_ds6_list_loop(). */
+static uint8_t
+index_loop(struct ds6_index *index, uip_ipaddr_t *ipaddr, uint8_t len,
+           uip_ds6_element_t **out_element)
+{
+  uip_ds6_element_t *element;
+  uint8_t i;
+
+  *out_element = index_lookup(index, ipaddr, len);
+  if(*out_element != NULL) {
+    return FOUND;
+  }
+  for(i = index->size; i > 0; i--) {
+    element = ELEMENT(index, i - 1);
+    if(!element->isused) {
+      *out_element = element;
+      return FREESPACE;
+    }
+  }
+  return NOSPACE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_index_rm(uip_ds6_route_t *route)
+{
+  uint8_t len;
+
+  len = index_remove(&route_index, (uip_ds6_element_t *)route);
+  if(len != HASH_NONE) {
+    route_lengths[len]--;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+route_index_add(uip_ds6_route_t *route)
+{
+  route_index_rm(route);
+  index_add(&route_index, (uip_ds6_element_t *)route, route->length);
+  route_lengths[route->length]++;
+}
+/*---------------------------------------------------------------------------*/
+#define DS6_LOOP(index, list, size, type, ipaddr, len, out)               \
+  index_loop(&(index), ipaddr, len, (uip_ds6_element_t **)(out))
+#define DS6_LOOKUP(index, list, size, type, ipaddr, len, out)             \
+  ((*(out) = (void *)index_lookup(&(index), ipaddr, len)) != NULL ?       \
+   FOUND : NOSPACE)
+#define DS6_INDEX_ADD(index, element, len)                              \
+  index_add(&(index), (uip_ds6_element_t *)(element), len)
+#define DS6_INDEX_RM(index, element)                                    \
+  index_remove(&(index), (uip_ds6_element_t *)(element))
+#else /* UIP_DS6_HASH */
+#define DS6_LOOP(index, list, size, type, ipaddr, len, out)               \
+  uip_ds6_list_loop((uip_ds6_element_t *)(list), size, sizeof(type),      \
+                    ipaddr, len, (uip_ds6_element_t **)(out))
+#define DS6_LOOKUP(index, list, size, type, ipaddr, len, out)             \
+  DS6_LOOP(index, list, size, type, ipaddr, len, out)
+#define DS6_INDEX_ADD(index, element, len)
+#define DS6_INDEX_RM(index, element)
+#endif /* UIP_DS6_HASH */
 /*---------------------------------------------------------------------------*/
 void
 uip_ds6_init(void)
@@ -113,6 +312,14 @@ uip_ds6_init(void)
   memset(uip_ds6_prefix_list, 0, sizeof(uip_ds6_prefix_list));
   memset(&uip_ds6_if, 0, sizeof(uip_ds6_if));
   memset(uip_ds6_routing_table, 0, sizeof(uip_ds6_routing_table));
+#if UIP_DS6_HASH
+  index_reset(&nbr_index);
+  index_reset(&route_index);
+  index_reset(&addr_index);
+  index_reset(&maddr_index);
+  index_reset(&aaddr_index);
+  memset(route_lengths, 0, sizeof(route_lengths));
+#endif /* UIP_DS6_HASH */
   uip_ds6_addr_size = sizeof(struct uip_ds6_addr);
   uip_ds6_netif_addr_list_offset = offsetof(struct uip_ds6_netif, addr_list);
 
@@ -294,14 +501,13 @@ uip_ds6_nbr_add(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
 {
   int r;
 
-  r = uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_nbr_cache, UIP_DS6_NBR_NB,
-      sizeof(uip_ds6_nbr_t), ipaddr, 128,
-      (uip_ds6_element_t **)&locnbr);
+  r = DS6_LOOP(nbr_index, uip_ds6_nbr_cache, UIP_DS6_NBR_NB,
+               uip_ds6_nbr_t, ipaddr, 128, &locnbr);
 
   if(r == FREESPACE) {
     locnbr->isused = 1;
     uip_ipaddr_copy(&locnbr->ipaddr, ipaddr);
+    DS6_INDEX_ADD(nbr_index, locnbr, 128);
     if(lladdr != NULL) {
       memcpy(&locnbr->lladdr, lladdr, UIP_LLADDR_LEN);
     } else {
@@ -359,6 +565,7 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
 {
   if(nbr != NULL) {
     nbr->isused = 0;
+    DS6_INDEX_RM(nbr_index, nbr);
 #if UIP_CONF_IPV6_QUEUE_PKT
     uip_packetqueue_free(&nbr->packethandle);
 #endif /* UIP_CONF_IPV6_QUEUE_PKT */
@@ -371,10 +578,8 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
 uip_ds6_nbr_t *
 uip_ds6_nbr_lookup(uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_nbr_cache, UIP_DS6_NBR_NB,
-      sizeof(uip_ds6_nbr_t), ipaddr, 128,
-      (uip_ds6_element_t **)&locnbr) == FOUND) {
+  if(DS6_LOOKUP(nbr_index, uip_ds6_nbr_cache, UIP_DS6_NBR_NB,
+                uip_ds6_nbr_t, ipaddr, 128, &locnbr) == FOUND) {
     locnbr->last_lookup = clock_time();
     return locnbr;
   }
@@ -576,12 +781,11 @@ uip_ds6_is_addr_onlink(uip_ipaddr_t *ipaddr)
 uip_ds6_addr_t *
 uip_ds6_addr_add(uip_ipaddr_t *ipaddr, unsigned long vlifetime, uint8_t type)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_if.addr_list, UIP_DS6_ADDR_NB,
-      sizeof(uip_ds6_addr_t), ipaddr, 128,
-      (uip_ds6_element_t **)&locaddr) == FREESPACE) {
+  if(DS6_LOOP(addr_index, uip_ds6_if.addr_list, UIP_DS6_ADDR_NB,
+              uip_ds6_addr_t, ipaddr, 128, &locaddr) == FREESPACE) {
     locaddr->isused = 1;
     uip_ipaddr_copy(&locaddr->ipaddr, ipaddr);
+    DS6_INDEX_ADD(addr_index, locaddr, 128);
     locaddr->type = type;
     if(vlifetime == 0) {
       locaddr->isinfinite = 1;
@@ -615,6 +819,7 @@ uip_ds6_addr_rm(uip_ds6_addr_t *addr)
       uip_ds6_maddr_rm(locmaddr);
     }
     addr->isused = 0;
+    DS6_INDEX_RM(addr_index, addr);
   }
   return;
 }
@@ -623,10 +828,8 @@ uip_ds6_addr_rm(uip_ds6_addr_t *addr)
 uip_ds6_addr_t *
 uip_ds6_addr_lookup(uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_if.addr_list, UIP_DS6_ADDR_NB,
-      sizeof(uip_ds6_addr_t), ipaddr, 128,
-      (uip_ds6_element_t **)&locaddr) == FOUND) {
+  if(DS6_LOOKUP(addr_index, uip_ds6_if.addr_list, UIP_DS6_ADDR_NB,
+                uip_ds6_addr_t, ipaddr, 128, &locaddr) == FOUND) {
     return locaddr;
   }
   return NULL;
@@ -674,12 +877,11 @@ uip_ds6_get_global(int8_t state)
 uip_ds6_maddr_t *
 uip_ds6_maddr_add(uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_if.maddr_list, UIP_DS6_MADDR_NB,
-      sizeof(uip_ds6_maddr_t), ipaddr, 128,
-      (uip_ds6_element_t **)&locmaddr) == FREESPACE) {
+  if(DS6_LOOP(maddr_index, uip_ds6_if.maddr_list, UIP_DS6_MADDR_NB,
+              uip_ds6_maddr_t, ipaddr, 128, &locmaddr) == FREESPACE) {
     locmaddr->isused = 1;
     uip_ipaddr_copy(&locmaddr->ipaddr, ipaddr);
+    DS6_INDEX_ADD(maddr_index, locmaddr, 128);
     return locmaddr;
   }
   return NULL;
@@ -691,6 +893,7 @@ uip_ds6_maddr_rm(uip_ds6_maddr_t *maddr)
 {
   if(maddr != NULL) {
     maddr->isused = 0;
+    DS6_INDEX_RM(maddr_index, maddr);
   }
   return;
 }
@@ -699,10 +902,8 @@ uip_ds6_maddr_rm(uip_ds6_maddr_t *maddr)
 uip_ds6_maddr_t *
 uip_ds6_maddr_lookup(uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_if.maddr_list, UIP_DS6_MADDR_NB,
-      sizeof(uip_ds6_maddr_t), ipaddr, 128,
-      (uip_ds6_element_t **)&locmaddr) == FOUND) {
+  if(DS6_LOOKUP(maddr_index, uip_ds6_if.maddr_list, UIP_DS6_MADDR_NB,
+                uip_ds6_maddr_t, ipaddr, 128, &locmaddr) == FOUND) {
     return locmaddr;
   }
   return NULL;
@@ -713,12 +914,11 @@ uip_ds6_maddr_lookup(uip_ipaddr_t *ipaddr)
 uip_ds6_aaddr_t *
 uip_ds6_aaddr_add(uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_if.aaddr_list, UIP_DS6_AADDR_NB,
-      sizeof(uip_ds6_aaddr_t), ipaddr, 128,
-      (uip_ds6_element_t **)&locaaddr) == FREESPACE) {
+  if(DS6_LOOP(aaddr_index, uip_ds6_if.aaddr_list, UIP_DS6_AADDR_NB,
+              uip_ds6_aaddr_t, ipaddr, 128, &locaaddr) == FREESPACE) {
     locaaddr->isused = 1;
     uip_ipaddr_copy(&locaaddr->ipaddr, ipaddr);
+    DS6_INDEX_ADD(aaddr_index, locaaddr, 128);
     return locaaddr;
   }
   return NULL;
@@ -730,6 +930,7 @@ uip_ds6_aaddr_rm(uip_ds6_aaddr_t *aaddr)
 {
   if(aaddr != NULL) {
     aaddr->isused = 0;
+    DS6_INDEX_RM(aaddr_index, aaddr);
   }
   return;
 }
@@ -738,9 +939,8 @@ uip_ds6_aaddr_rm(uip_ds6_aaddr_t *aaddr)
 uip_ds6_aaddr_t *
 uip_ds6_aaddr_lookup(uip_ipaddr_t *ipaddr)
 {
-  if(uip_ds6_list_loop((uip_ds6_element_t *)uip_ds6_if.aaddr_list,
-		       UIP_DS6_AADDR_NB, sizeof(uip_ds6_aaddr_t), ipaddr, 128,
-		       (uip_ds6_element_t **)&locaaddr) == FOUND) {
+  if(DS6_LOOKUP(aaddr_index, uip_ds6_if.aaddr_list, UIP_DS6_AADDR_NB,
+                uip_ds6_aaddr_t, ipaddr, 128, &locaaddr) == FOUND) {
     return locaaddr;
   }
   return NULL;
@@ -757,6 +957,18 @@ uip_ds6_route_lookup(uip_ipaddr_t *destipaddr)
   PRINT6ADDR(destipaddr);
   PRINTF("\n");
 
+#if UIP_DS6_HASH
+  /* Probe the prefix lengths in use, longest first. */
+  for(longestmatch = 128; locrt == NULL; longestmatch--) {
+    if(route_lengths[longestmatch] > 0) {
+      locrt = (uip_ds6_route_t *)index_lookup(&route_index, destipaddr,
+                                              longestmatch);
+    }
+    if(longestmatch == 0) {
+      break;
+    }
+  }
+#else /* UIP_DS6_HASH */
   for(locroute = uip_ds6_routing_table;
       locroute < uip_ds6_routing_table + UIP_DS6_ROUTE_NB; locroute++) {
     if((locroute->isused) && (locroute->length >= longestmatch)
@@ -767,6 +979,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *destipaddr)
       locrt = locroute;
     }
   }
+#endif /* UIP_DS6_HASH */
 
   if(locrt != NULL) {
     PRINTF("DS6: Found route:");
@@ -786,13 +999,14 @@ uip_ds6_route_t *
 uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length, uip_ipaddr_t *nexthop,
                   uint8_t metric)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *)uip_ds6_routing_table, UIP_DS6_ROUTE_NB,
-      sizeof(uip_ds6_route_t), ipaddr, length,
-      (uip_ds6_element_t **)&locroute) == FREESPACE) {
+  if(DS6_LOOP(route_index, uip_ds6_routing_table, UIP_DS6_ROUTE_NB,
+              uip_ds6_route_t, ipaddr, length, &locroute) == FREESPACE) {
     locroute->isused = 1;
     uip_ipaddr_copy(&(locroute->ipaddr), ipaddr);
     locroute->length = length;
+#if UIP_DS6_HASH
+    route_index_add(locroute);
+#endif /* UIP_DS6_HASH */
     uip_ipaddr_copy(&(locroute->nexthop), nexthop);
     locroute->metric = metric;
 
@@ -816,6 +1030,9 @@ void
 uip_ds6_route_rm(uip_ds6_route_t *route)
 {
   route->isused = 0;
+#if UIP_DS6_HASH
+  route_index_rm(route);
+#endif /* UIP_DS6_HASH */
 #if (DEBUG & DEBUG_ANNOTATE) == DEBUG_ANNOTATE
   /* we need to check if this was the last route towards "nexthop" */
   /* if so - remove that link (annotation) */
@@ -839,6 +1056,9 @@ uip_ds6_route_rm_by_nexthop(uip_ipaddr_t *nexthop)
       locroute++) {
     if(locroute->isused && uip_ipaddr_cmp(&locroute->nexthop, nexthop)) {
       locroute->isused = 0;
+#if UIP_DS6_HASH
+      route_index_rm(locroute);
+#endif /* UIP_DS6_HASH */
     }
   }
   ANNOTATE("#L %u 0\n",nexthop->u8[sizeof(uip_ipaddr_t) - 1]);
@@ -134,6 +134,25 @@
 #define UIP_DS6_LL_NUD UIP_CONF_DS6_LL_NUD
 #endif
 
+/*--------------------------------------------------*/
+/* Should the neighbor cache, the routing table and the address lists be
+ * indexed by hash tables? Without them, every lookup is a linear search
+ * through the table. With them, exact lookups hash the address and
+ * uip_ds6_route_lookup() probes one hash key per prefix length in use,
+ * longest first. The tables themselves are not changed. */
+#ifndef UIP_DS6_CONF_HASH
+#define UIP_DS6_HASH 0
+#else
+#define UIP_DS6_HASH UIP_DS6_CONF_HASH
+#endif
+
+/* Number of hash buckets per table, a power of two */
+#ifndef UIP_DS6_CONF_HASH_BUCKETS
+#define UIP_DS6_HASH_BUCKETS 32
+#else
+#define UIP_DS6_HASH_BUCKETS UIP_DS6_CONF_HASH_BUCKETS
+#endif
+
 /*--------------------------------------------------*/
 /** \brief Possible states for the nbr cache entries */
 #define  NBR_INCOMPLETE 0
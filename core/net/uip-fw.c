@@ -60,6 +60,7 @@
 #include "net/uip.h"
 #include "net/uip_arch.h"
 #include "net/uip-fw.h"
+#include "net/uiplib.h"
 #ifdef AODV_COMPLIANCE
 #include "net/uaodv-def.h"
 #endif
@@ -462,15 +463,12 @@ uip_fw_forward(void)
     time_exceeded();
   }
   
-  /* Decrement the TTL (time-to-live) value in the IP header */
+  /* Decrement the TTL (time-to-live) value in the IP header and
+     update the IP checksum. */
+  BUF->ipchksum = uiplib_chksum_update16(BUF->ipchksum,
+                                         UIP_HTONS(BUF->ttl << 8),
+                                         UIP_HTONS((BUF->ttl - 1) << 8));
   BUF->ttl = BUF->ttl - 1;
-  
-  /* Update the IP checksum. */
-  if(BUF->ipchksum >= UIP_HTONS(0xffff - 0x0100)) {
-    BUF->ipchksum = BUF->ipchksum + UIP_HTONS(0x0100) + 1;
-  } else {
-    BUF->ipchksum = BUF->ipchksum + UIP_HTONS(0x0100);
-  }
 
   if(uip_len > 0) {
     uip_appdata = &uip_buf[UIP_LLH_LEN + UIP_TCPIP_HLEN];
@@ -134,3 +134,42 @@ uiplib_ipaddrconv(const char *addrstr, uip_ipaddr_t *ipaddr)
 }
 
 /*-----------------------------------------------------------------------------------*/
+uint16_t
+uiplib_chksum_update16(uint16_t chksum, uint16_t old, uint16_t new)
+{
+  uint32_t sum;
+
+  /* RFC 1624, eqn. 3: HC' = ~(~HC + ~m + m') */
+  sum = (uint16_t)~chksum;
+  sum += (uint16_t)~old;
+  sum += new;
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum += sum >> 16;
+  return (uint16_t)~sum;
+}
+/*-----------------------------------------------------------------------------------*/
+uint16_t
+uiplib_chksum_update(uint16_t chksum, const void *old, const void *new,
+                     uint16_t len)
+{
+  const uint8_t *o, *n;
+  uint16_t wo, wn;
+  uint32_t sum;
+
+  o = old;
+  n = new;
+  sum = (uint16_t)~chksum;
+  for(; len >= 2; len -= 2) {
+    memcpy(&wo, o, 2);
+    memcpy(&wn, n, 2);
+    sum += (uint16_t)~wo;
+    sum += wn;
+    o += 2;
+    n += 2;
+  }
+  while(sum >> 16) {
+    sum = (sum >> 16) + (sum & 0xffff);
+  }
+  return (uint16_t)~sum;
+}
+/*-----------------------------------------------------------------------------------*/
@@ -71,4 +71,34 @@ CCIF int uiplib_ipaddrconv(const char *addrstr, uip_ipaddr_t *addr);
 
 /** @} */
 
+/**
+ * Update a checksum after a 16-bit word of the packet has changed.
+ *
+ * This is used to rewrite header fields, for example when forwarding
+ * a packet, without computing the checksum of the whole packet
+ * again (RFC 1624). All values are in network byte order, as they
+ * are stored in the packet.
+ *
+ * \param chksum The checksum, as stored in the packet.
+ * \param old The old value of the word.
+ * \param new The new value of the word.
+ *
+ * \return The new checksum, to be stored in the packet.
+ */
+uint16_t uiplib_chksum_update16(uint16_t chksum, uint16_t old, uint16_t new);
+
+/**
+ * Update a checksum after a field of the packet has changed.
+ *
+ * \param chksum The checksum, as stored in the packet.
+ * \param old A pointer to the old contents of the field.
+ * \param new A pointer to the new contents of the field.
+ * \param len The length of the field. It must start at an even
+ * offset in the checksummed data and have an even length.
+ *
+ * \return The new checksum, to be stored in the packet.
+ */
+uint16_t uiplib_chksum_update(uint16_t chksum, const void *old,
+                              const void *new, uint16_t len);
+
 #endif /* __UIPLIB_H__ */
@@ -51,10 +51,149 @@
 #include "sys/process.h"
 
 static struct etimer *timerlist;
+#if !ETIMER_HEAP
 static clock_time_t next_expiration;
+#endif /* !ETIMER_HEAP */
 
 PROCESS(etimer_process, "Event timer");
 /*---------------------------------------------------------------------------*/
+#if ETIMER_HEAP
+/*
+ * With the heap backend, timerlist points to the root of a pairing
+ * heap, which is always the timer that expires first.
+ */
+#define update_time()
+
+/* Expiration times are compared by their distance, so that the order
+   is correct across clock wraps as long as all pending timers expire
+   within half the clock range of each other. */
+#define EXPIRES_BEFORE(a, b)                                            \
+  ((clock_time_t)(((b)->timer.start + (b)->timer.interval) -            \
+                  ((a)->timer.start + (a)->timer.interval)) <=          \
+   (clock_time_t)((clock_time_t)~0 >> 1))
+/*---------------------------------------------------------------------------*/
+static struct etimer *
+meld(struct etimer *a, struct etimer *b)
+{
+  struct etimer *t;
+
+  if(a == NULL) {
+    return b;
+  }
+  if(b == NULL) {
+    return a;
+  }
+  if(!EXPIRES_BEFORE(a, b)) {
+    t = a;
+    a = b;
+    b = t;
+  }
+
+  /* Make b the first child of a. */
+  b->prev = a;
+  b->next = a->child;
+  if(a->child != NULL) {
+    a->child->prev = b;
+  }
+  a->child = b;
+  return a;
+}
+/*---------------------------------------------------------------------------*/
+static struct etimer *
+merge_pairs(struct etimer *first)
+{
+  struct etimer *a, *b, *pairs, *root;
+
+  /* Meld the siblings pairwise from left to right, collecting the
+     results in reverse order... */
+  pairs = NULL;
+  while(first != NULL) {
+    a = first;
+    b = a->next;
+    if(b != NULL) {
+      first = b->next;
+      b->next = NULL;
+    } else {
+      first = NULL;
+    }
+    a->next = NULL;
+    a = meld(a, b);
+    a->next = pairs;
+    pairs = a;
+  }
+
+  /* ...and meld the results together from right to left. */
+  root = NULL;
+  while(pairs != NULL) {
+    a = pairs;
+    pairs = a->next;
+    a->next = NULL;
+    root = meld(root, a);
+  }
+  if(root != NULL) {
+    root->prev = NULL;
+  }
+  return root;
+}
+/*---------------------------------------------------------------------------*/
+static int
+in_heap(struct etimer *et)
+{
+  return et->p != PROCESS_NONE && (et == timerlist || et->prev != NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_remove(struct etimer *et)
+{
+  if(et == timerlist) {
+    timerlist = merge_pairs(et->child);
+  } else {
+    if(et->prev->child == et) {
+      et->prev->child = et->next;
+    } else {
+      et->prev->next = et->next;
+    }
+    if(et->next != NULL) {
+      et->next->prev = et->prev;
+    }
+    timerlist = meld(timerlist, merge_pairs(et->child));
+  }
+  et->next = et->prev = et->child = NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+heap_remove_process(struct process *p)
+{
+  struct etimer *t, *stack;
+
+  /* Take the heap apart, using the prev pointers as a stack of
+     subtrees that remain to be visited, and put back all timers
+     that do not belong to the exited process. */
+  stack = timerlist;
+  if(stack != NULL) {
+    stack->prev = NULL;
+  }
+  timerlist = NULL;
+
+  while(stack != NULL) {
+    t = stack;
+    stack = t->prev;
+    if(t->child != NULL) {
+      t->child->prev = stack;
+      stack = t->child;
+    }
+    if(t->next != NULL) {
+      t->next->prev = stack;
+      stack = t->next;
+    }
+    t->next = t->prev = t->child = NULL;
+    if(t->p != p) {
+      timerlist = meld(timerlist, t);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+#else /* ETIMER_HEAP */
 static void
 update_time(void)
 {
@@ -77,10 +216,15 @@ update_time(void)
     next_expiration = now + tdist;
   }
 }
+#endif /* ETIMER_HEAP */
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(etimer_process, ev, data)
 {
+#if ETIMER_HEAP
+  struct etimer *t;
+#else /* ETIMER_HEAP */
   struct etimer *t, *u;
+#endif /* ETIMER_HEAP */
 	
   PROCESS_BEGIN();
 
@@ -92,6 +236,9 @@ PROCESS_THREAD(etimer_process, ev, data)
     if(ev == PROCESS_EVENT_EXITED) {
       struct process *p = data;
 
+#if ETIMER_HEAP
+      heap_remove_process(p);
+#else /* ETIMER_HEAP */
       while(timerlist != NULL && timerlist->p == p) {
 	timerlist = timerlist->next;
       }
@@ -105,11 +252,29 @@ PROCESS_THREAD(etimer_process, ev, data)
 	    t = t->next;
 	}
       }
+#endif /* ETIMER_HEAP */
       continue;
     } else if(ev != PROCESS_EVENT_POLL) {
       continue;
     }
 
+#if ETIMER_HEAP
+    /* The root of the heap expires first, so we are done as soon as
+       it has not expired. */
+    while(timerlist != NULL && timer_expired(&timerlist->timer)) {
+      t = timerlist;
+      if(process_post(t->p, PROCESS_EVENT_TIMER, t) == PROCESS_ERR_OK) {
+	heap_remove(t);
+	/* Reset the process ID of the event timer, to signal that the
+	   etimer has expired. This is later checked in the
+	   etimer_expired() function. */
+	t->p = PROCESS_NONE;
+      } else {
+	etimer_request_poll();
+	break;
+      }
+    }
+#else /* ETIMER_HEAP */
   again:
     
     u = NULL;
@@ -136,6 +301,7 @@ PROCESS_THREAD(etimer_process, ev, data)
       }
       u = t;
     }
+#endif /* ETIMER_HEAP */
     
   }
   
@@ -151,10 +317,25 @@ etimer_request_poll(void)
 static void
 add_timer(struct etimer *timer)
 {
+#if !ETIMER_HEAP
   struct etimer *t;
+#endif /* !ETIMER_HEAP */
 
   etimer_request_poll();
 
+#if ETIMER_HEAP
+  if(in_heap(timer)) {
+    /* The expiration time of the timer may have changed, so we put it
+       back in the heap at its new position. */
+    heap_remove(timer);
+    timerlist = meld(timerlist, timer);
+    return;
+  }
+
+  timer->p = PROCESS_CURRENT();
+  timer->next = timer->prev = timer->child = NULL;
+  timerlist = meld(timerlist, timer);
+#else /* ETIMER_HEAP */
   if(timer->p != PROCESS_NONE) {
     /* Timer not on list. */
     
@@ -172,6 +353,7 @@ add_timer(struct etimer *timer)
   timerlist = timer;
 
   update_time();
+#endif /* ETIMER_HEAP */
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -198,6 +380,14 @@ etimer_restart(struct etimer *et)
 void
 etimer_adjust(struct etimer *et, int timediff)
 {
+#if ETIMER_HEAP
+  if(in_heap(et)) {
+    heap_remove(et);
+    et->timer.start += timediff;
+    timerlist = meld(timerlist, et);
+    return;
+  }
+#endif /* ETIMER_HEAP */
   et->timer.start += timediff;
   update_time();
 }
@@ -229,12 +419,21 @@ etimer_pending(void)
 clock_time_t
 etimer_next_expiration_time(void)
 {
+#if ETIMER_HEAP
+  return etimer_pending() ? etimer_expiration_time(timerlist) : 0;
+#else /* ETIMER_HEAP */
   return etimer_pending() ? next_expiration : 0;
+#endif /* ETIMER_HEAP */
 }
 /*---------------------------------------------------------------------------*/
 void
 etimer_stop(struct etimer *et)
 {
+#if ETIMER_HEAP
+  if(in_heap(et)) {
+    heap_remove(et);
+  }
+#else /* ETIMER_HEAP */
   struct etimer *t;
 
   /* First check if et is the first event timer on the list. */
@@ -258,6 +457,7 @@ etimer_stop(struct etimer *et)
 
   /* Remove the next pointer from the item to be removed. */
   et->next = NULL;
+#endif /* ETIMER_HEAP */
   /* Set the timer as expired */
   et->p = PROCESS_NONE;
 }
@@ -12,6 +12,14 @@
  * to the event timer is made by a pointer to the declared event
  * timer.
  *
+ * By default, pending event timers are kept in an unordered list,
+ * so that setting or stopping a timer takes time proportional to the
+ * number of pending timers. If ETIMER_CONF_HEAP is set to 1, pending
+ * timers are instead kept in a pairing heap ordered by expiration
+ * time. This makes etimer_next_expiration_time() run in constant
+ * time and setting and stopping timers in logarithmic (amortized)
+ * time, at the cost of two extra pointers per event timer.
+ *
  * \sa \ref timer "Simple timer library"
  * \sa \ref clock "Clock library" (used by the timer library)
  *
@@ -66,6 +74,12 @@
 #include "sys/timer.h"
 #include "sys/process.h"
 
+#ifdef ETIMER_CONF_HEAP
+#define ETIMER_HEAP ETIMER_CONF_HEAP
+#else
+#define ETIMER_HEAP 0
+#endif /* ETIMER_CONF_HEAP */
+
 /**
  * A timer.
  *
@@ -78,6 +92,14 @@ struct etimer {
   struct timer timer;
   struct etimer *next;
   struct process *p;
+#if ETIMER_HEAP
+  /* With the heap backend, next points to the next sibling, child to
+     the first child, and prev to the previous sibling or, for a first
+     child, to the parent. prev is NULL for timers that are not in the
+     heap. */
+  struct etimer *prev;
+  struct etimer *child;
+#endif /* ETIMER_HEAP */
 };
 
 /**
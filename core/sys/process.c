@@ -45,6 +45,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "sys/process.h"
 #include "sys/arg.h"
@@ -64,13 +65,35 @@ struct event_data {
   process_event_t ev;
   process_data_t data;
   struct process *p;
+#if PROCESS_PRIORITIES > 1
+  process_num_events_t next;
+#endif /* PROCESS_PRIORITIES > 1 */
 };
 
-static process_num_events_t nevents, fevent;
+static process_num_events_t nevents;
 static struct event_data events[PROCESS_CONF_NUMEVENTS];
 
+#if PROCESS_PRIORITIES > 1
+/*
+ * With several priority levels, the event slots are linked into one
+ * FIFO queue per level and a list of free slots.
+ */
+#define EVENT_NONE PROCESS_CONF_NUMEVENTS
+static process_num_events_t fevent[PROCESS_PRIORITIES];
+static process_num_events_t levent[PROCESS_PRIORITIES];
+static process_num_events_t freeevent;
+#define EVENT_PRIORITY(p) ((p) == PROCESS_BROADCAST ?                  \
+                           PROCESS_PRIORITY_DEFAULT :                  \
+                           ((p)->priority < PROCESS_PRIORITIES ?       \
+                            (p)->priority : PROCESS_PRIORITIES - 1))
+#else /* PROCESS_PRIORITIES > 1 */
+static process_num_events_t fevent;
+#define EVENT_PRIORITY(p) PROCESS_PRIORITY_DEFAULT
+#endif /* PROCESS_PRIORITIES > 1 */
+
 #if PROCESS_CONF_STATS
 process_num_events_t process_maxevents;
+unsigned short process_overflows[PROCESS_PRIORITIES];
 #endif
 
 static volatile unsigned char poll_requested;
@@ -210,9 +233,25 @@ process_init(void)
 {
   lastevent = PROCESS_EVENT_MAX;
 
-  nevents = fevent = 0;
+  nevents = 0;
+#if PROCESS_PRIORITIES > 1
+  {
+    process_num_events_t i;
+
+    for(i = 0; i < PROCESS_PRIORITIES; i++) {
+      fevent[i] = levent[i] = EVENT_NONE;
+    }
+    for(i = 0; i < PROCESS_CONF_NUMEVENTS; i++) {
+      events[i].next = i + 1;
+    }
+    freeevent = 0;
+  }
+#else /* PROCESS_PRIORITIES > 1 */
+  fevent = 0;
+#endif /* PROCESS_PRIORITIES > 1 */
 #if PROCESS_CONF_STATS
   process_maxevents = 0;
+  memset(process_overflows, 0, sizeof(process_overflows));
 #endif /* PROCESS_CONF_STATS */
 
   process_current = process_list = NULL;
@@ -250,6 +289,10 @@ do_event(void)
   static process_data_t data;
   static struct process *receiver;
   static struct process *p;
+#if PROCESS_PRIORITIES > 1
+  static process_num_events_t e;
+  static unsigned char prio;
+#endif /* PROCESS_PRIORITIES > 1 */
   
   /*
    * If there are any events in the queue, take the first one and walk
@@ -261,6 +304,26 @@ do_event(void)
 
   if(nevents > 0) {
     
+#if PROCESS_PRIORITIES > 1
+    /* Take the first event of the highest priority level that has
+       any events. */
+    for(prio = PROCESS_PRIORITIES - 1; fevent[prio] == EVENT_NONE; --prio);
+    e = fevent[prio];
+
+    ev = events[e].ev;
+    data = events[e].data;
+    receiver = events[e].p;
+
+    /* Unlink the event from its queue and put its slot back on the
+       free list. */
+    fevent[prio] = events[e].next;
+    if(fevent[prio] == EVENT_NONE) {
+      levent[prio] = EVENT_NONE;
+    }
+    events[e].next = freeevent;
+    freeevent = e;
+    --nevents;
+#else /* PROCESS_PRIORITIES > 1 */
     /* There are events that we should deliver. */
     ev = events[fevent].ev;
     
@@ -271,6 +334,7 @@ do_event(void)
        and decrese the number of events. */
     fevent = (fevent + 1) % PROCESS_CONF_NUMEVENTS;
     --nevents;
+#endif /* PROCESS_PRIORITIES > 1 */
 
     /* If this is a broadcast event, we deliver it to all events, in
        order of their priority. */
@@ -302,6 +366,21 @@ do_event(void)
 int
 process_run(void)
 {
+#if PROCESS_EVENT_BATCH > 1
+  unsigned char i;
+
+  /* Process a bounded batch of events from the queue, and call the
+     poll handlers before each of them. */
+  for(i = 0; i < PROCESS_EVENT_BATCH; i++) {
+    if(poll_requested) {
+      do_poll();
+    }
+    if(nevents == 0) {
+      break;
+    }
+    do_event();
+  }
+#else /* PROCESS_EVENT_BATCH > 1 */
   /* Process poll events. */
   if(poll_requested) {
     do_poll();
@@ -309,6 +388,7 @@ process_run(void)
 
   /* Process one event from the queue */
   do_event();
+#endif /* PROCESS_EVENT_BATCH > 1 */
 
   return nevents + poll_requested;
 }
@@ -323,6 +403,9 @@ int
 process_post(struct process *p, process_event_t ev, process_data_t data)
 {
   static process_num_events_t snum;
+#if PROCESS_PRIORITIES > 1
+  static unsigned char prio;
+#endif /* PROCESS_PRIORITIES > 1 */
 
   if(PROCESS_CURRENT() == NULL) {
     PRINTF("process_post: NULL process posts event %d to process '%s', nevents %d\n",
@@ -333,7 +416,13 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
 	   p == PROCESS_BROADCAST? "<broadcast>": PROCESS_NAME_STRING(p), nevents);
   }
   
+#if PROCESS_PRIORITIES > 1
+  prio = EVENT_PRIORITY(p);
+  if(nevents >= PROCESS_CONF_NUMEVENTS -
+     (PROCESS_PRIORITIES - 1 - prio) * PROCESS_EVENT_RESERVE) {
+#else /* PROCESS_PRIORITIES > 1 */
   if(nevents == PROCESS_CONF_NUMEVENTS) {
+#endif /* PROCESS_PRIORITIES > 1 */
 #if DEBUG
     if(p == PROCESS_BROADCAST) {
       printf("soft panic: event queue is full when broadcast event %d was posted from %s\n", ev, PROCESS_NAME_STRING(process_current));
@@ -341,13 +430,33 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
       printf("soft panic: event queue is full when event %d was posted to %s frpm %s\n", ev, PROCESS_NAME_STRING(p), PROCESS_NAME_STRING(process_current));
     }
 #endif /* DEBUG */
+#if PROCESS_CONF_STATS
+    ++process_overflows[EVENT_PRIORITY(p)];
+#endif /* PROCESS_CONF_STATS */
     return PROCESS_ERR_FULL;
   }
   
+#if PROCESS_PRIORITIES > 1
+  /* Take a free slot and append it to the queue of the priority
+     level of the receiver. */
+  snum = freeevent;
+  freeevent = events[snum].next;
+  events[snum].ev = ev;
+  events[snum].data = data;
+  events[snum].p = p;
+  events[snum].next = EVENT_NONE;
+  if(levent[prio] == EVENT_NONE) {
+    fevent[prio] = snum;
+  } else {
+    events[levent[prio]].next = snum;
+  }
+  levent[prio] = snum;
+#else /* PROCESS_PRIORITIES > 1 */
   snum = (process_num_events_t)(fevent + nevents) % PROCESS_CONF_NUMEVENTS;
   events[snum].ev = ev;
   events[snum].data = data;
   events[snum].p = p;
+#endif /* PROCESS_PRIORITIES > 1 */
   ++nevents;
 
 #if PROCESS_CONF_STATS
@@ -89,6 +89,55 @@ typedef unsigned char process_num_events_t;
 #define PROCESS_CONF_NUMEVENTS 32 //MAX numero di eventi che si possono gestire
 #endif /* PROCESS_CONF_NUMEVENTS */
 
+/*
+ * The number of event priority levels. With more than one level,
+ * events posted to a process declared with PROCESS_PRIO() are
+ * delivered before all pending events of lower priority. All levels
+ * share the PROCESS_CONF_NUMEVENTS event slots.
+ */
+#ifdef PROCESS_CONF_PRIORITIES
+#define PROCESS_PRIORITIES PROCESS_CONF_PRIORITIES
+#else
+#define PROCESS_PRIORITIES 1
+#endif /* PROCESS_CONF_PRIORITIES */
+
+/*
+ * The maximum number of events delivered by each call to
+ * process_run(). Poll requests are serviced between events.
+ */
+#ifdef PROCESS_CONF_EVENT_BATCH
+#define PROCESS_EVENT_BATCH PROCESS_CONF_EVENT_BATCH
+#else
+#define PROCESS_EVENT_BATCH 1
+#endif /* PROCESS_CONF_EVENT_BATCH */
+
+/*
+ * The number of event slots that are reserved for each priority
+ * level above the lowest one, so that a burst of low-priority events
+ * cannot prevent events to higher-priority processes from being
+ * posted.
+ */
+#ifdef PROCESS_CONF_EVENT_RESERVE
+#define PROCESS_EVENT_RESERVE PROCESS_CONF_EVENT_RESERVE
+#elif PROCESS_PRIORITIES > 1
+#define PROCESS_EVENT_RESERVE 2
+#else
+#define PROCESS_EVENT_RESERVE 0
+#endif /* PROCESS_CONF_EVENT_RESERVE */
+
+/* The priority of processes declared with PROCESS(), and of
+   broadcast events. */
+#define PROCESS_PRIORITY_DEFAULT 0
+
+/* The priority of the network stack and radio driver processes. With
+   a single priority level it is the default priority, so that
+   PROCESS_PRIO() declarations collapse to PROCESS(). */
+#ifdef PROCESS_CONF_PRIORITY_NETWORK
+#define PROCESS_PRIORITY_NETWORK PROCESS_CONF_PRIORITY_NETWORK
+#else
+#define PROCESS_PRIORITY_NETWORK (PROCESS_PRIORITIES - 1)
+#endif /* PROCESS_CONF_PRIORITY_NETWORK */
+
 #define PROCESS_EVENT_NONE            0x80
 #define PROCESS_EVENT_INIT            0x81
 #define PROCESS_EVENT_POLL            0x82
@@ -311,6 +360,42 @@ static PT_THREAD(process_thread_##name(struct pt *process_pt,	\
                           process_thread_##name }
 #endif
 
+/**
+ * Declare a process with an event priority.
+ *
+ * This macro declares a process like PROCESS(), but events posted to
+ * the process are queued at the given priority. Events of a higher
+ * priority are delivered before events of a lower priority, so that
+ * latency-sensitive processes, such as MAC and network processes, are
+ * not held up by a burst of events to other processes. If
+ * PROCESS_CONF_PRIORITIES is not larger than one, this macro is
+ * equivalent to PROCESS().
+ *
+ * \param name The variable name of the process structure.
+ * \param strname The string representation of the process' name.
+ * \param prio The priority, from PROCESS_PRIORITY_DEFAULT (lowest)
+ * to PROCESS_PRIORITIES - 1 (highest).
+ *
+ * \hideinitializer
+ */
+#if PROCESS_PRIORITIES > 1
+#if PROCESS_CONF_NO_PROCESS_NAMES
+#define PROCESS_PRIO(name, strname, prio)		\
+  PROCESS_THREAD(name, ev, data);			\
+  struct process name = { NULL,		        \
+                          process_thread_##name,	\
+                          {0}, 0, 0, prio }
+#else
+#define PROCESS_PRIO(name, strname, prio)		\
+  PROCESS_THREAD(name, ev, data);			\
+  struct process name = { NULL, strname,		\
+                          process_thread_##name,	\
+                          {0}, 0, 0, prio }
+#endif
+#else /* PROCESS_PRIORITIES > 1 */
+#define PROCESS_PRIO(name, strname, prio) PROCESS(name, strname)
+#endif /* PROCESS_PRIORITIES > 1 */
+
 /** @} */
 //Dichiarazione di un processo tramite la struct process
 struct process {
@@ -324,6 +409,9 @@ struct process {
   PT_THREAD((* thread)(struct pt *, process_event_t, process_data_t)); //descrive il protothread del processo. Vedi pt.h
   struct pt pt; //struttura per la gestione delle local continuations
   unsigned char state, needspoll; //state = descrive lo stato del processo; needspoll = segnala la presenza di eventi poll associati al processo
+#if PROCESS_PRIORITIES > 1
+  unsigned char priority;
+#endif /* PROCESS_PRIORITIES > 1 */
 };
 
 /**
@@ -490,7 +578,8 @@ void process_init(void);
  *
  * This function should be called repeatedly from the main() program
  * to actually run the Contiki system. It calls the necessary poll
- * handlers, and processes one event. The function returns the number
+ * handlers, and processes up to PROCESS_EVENT_BATCH events, highest
+ * priority first. The function returns the number
  * of events that are waiting in the event queue so that the caller
  * may choose to put the CPU to sleep when there are no pending
  * events.
@@ -520,6 +609,20 @@ CCIF int process_is_running(struct process *p);
  */
 int process_nevents(void);
 
+#if PROCESS_CONF_STATS
+/**
+ * The largest number of events that have been waiting in the event
+ * queue at the same time.
+ */
+extern process_num_events_t process_maxevents;
+
+/**
+ * The number of events that could not be posted because the event
+ * queue was full, per priority level.
+ */
+extern unsigned short process_overflows[PROCESS_PRIORITIES];
+#endif /* PROCESS_CONF_STATS */
+
 /** @} */
 
 CCIF extern struct process *process_list;
@@ -102,7 +102,7 @@ uint8_t rf_error = 0;
 
 /*---------------------------------------------------------------------------*/
 #if !NETSTACK_CONF_SHORTCUTS
-PROCESS(cc2430_rf_process, "CC2430 RF driver");
+PROCESS_PRIO(cc2430_rf_process, "CC2430 RF driver", PROCESS_PRIORITY_NETWORK);
 #endif
 /*---------------------------------------------------------------------------*/
 static uint8_t __data rf_flags;
@@ -40,11 +40,12 @@
 #endif /* UIP_CONF_IPV6 */
 
 #include "tapdev-drv.h"
+#include "select-loop.h"
 
 #define BUF ((struct uip_eth_hdr *)&uip_buf[0])
 #define IPBUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
 
-PROCESS(tapdev_process, "TAP driver");
+PROCESS_PRIO(tapdev_process, "TAP driver", PROCESS_PRIORITY_NETWORK);
 
 /*---------------------------------------------------------------------------*/
 #if !UIP_CONF_IPV6
@@ -57,34 +58,72 @@ tapdev_output(void)
 }
 #endif
 /*---------------------------------------------------------------------------*/
+#if SELECT_EPOLL
+/* The main loop sleeps until the tap device is readable, so the driver
+   does not have to poll itself. */
+static int
+set_fd(fd_set *rset, fd_set *wset)
+{
+  FD_SET(tapdev_fd(), rset);
+  return 1;
+}
 static void
-pollhandler(void)
+handle_fd(fd_set *rset, fd_set *wset)
+{
+  if(FD_ISSET(tapdev_fd(), rset)) {
+    process_poll(&tapdev_process);
+  }
+}
+static const struct select_callback tapdev_callback = { set_fd, handle_fd };
+static uint8_t selected;
+#else /* SELECT_EPOLL */
+#define selected 0
+#endif /* SELECT_EPOLL */
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
 {
-  process_poll(&tapdev_process);
-  uip_len = tapdev_poll();
-
-  if(uip_len > 0) {
 #if UIP_CONF_IPV6
-    if(BUF->type == uip_htons(UIP_ETHTYPE_IPV6)) {
-      tcpip_input();
-    } else
+  if(BUF->type == uip_htons(UIP_ETHTYPE_IPV6)) {
+    tcpip_input();
+  } else
 #endif /* UIP_CONF_IPV6 */
-    if(BUF->type == uip_htons(UIP_ETHTYPE_IP)) {
-      uip_len -= sizeof(struct uip_eth_hdr);
-      tcpip_input();
-    } else if(BUF->type == uip_htons(UIP_ETHTYPE_ARP)) {
+  if(BUF->type == uip_htons(UIP_ETHTYPE_IP)) {
+    uip_len -= sizeof(struct uip_eth_hdr);
+    tcpip_input();
+  } else if(BUF->type == uip_htons(UIP_ETHTYPE_ARP)) {
 #if !UIP_CONF_IPV6 //math
-       uip_arp_arpin();
-       /* If the above function invocation resulted in data that
-	  should be sent out on the network, the global variable
-	  uip_len is set to a value > 0. */
-       if(uip_len > 0) {
-	  tapdev_send();
-       }
+     uip_arp_arpin();
+     /* If the above function invocation resulted in data that
+	should be sent out on the network, the global variable
+	uip_len is set to a value > 0. */
+     if(uip_len > 0) {
+	tapdev_send();
+     }
 #endif              
-    } else {
-      uip_len = 0;
+  } else {
+    uip_len = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+pollhandler(void)
+{
+  int i;
+
+  if(!selected) {
+    process_poll(&tapdev_process);
+  }
+  for(i = 0; i < TAPDEV_BATCH; i++) {
+    uip_len = tapdev_poll();
+    if(uip_len == 0) {
+      return;
     }
+    input();
+  }
+  if(selected) {
+    /* Come back for the rest of the frames in the device queue. */
+    process_poll(&tapdev_process);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -100,10 +139,19 @@ PROCESS_THREAD(tapdev_process, ev, data)
 #else
   tcpip_set_outputfunc(tapdev_send);
 #endif
+#if SELECT_EPOLL
+  selected = tapdev_fd() >= 0 &&
+    select_set_callback(tapdev_fd(), &tapdev_callback);
+#endif /* SELECT_EPOLL */
   process_poll(&tapdev_process);
 
   PROCESS_WAIT_UNTIL(ev == PROCESS_EVENT_EXIT);
 
+#if SELECT_EPOLL
+  if(selected) {
+    select_set_callback(tapdev_fd(), NULL);
+  }
+#endif /* SELECT_EPOLL */
   tapdev_exit();
 
   PROCESS_END();
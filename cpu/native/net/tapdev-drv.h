@@ -36,6 +36,15 @@
 
 #include "contiki.h"
 
+/* The number of frames the driver reads from the tap device each time
+   it is polled. With more than one, the IPv6 tap device is also made
+   non-blocking so that it is read without a select() per frame. */
+#ifdef TAPDEV_CONF_BATCH
+#define TAPDEV_BATCH TAPDEV_CONF_BATCH
+#else /* TAPDEV_CONF_BATCH */
+#define TAPDEV_BATCH 1
+#endif /* TAPDEV_CONF_BATCH */
+
 PROCESS_NAME(tapdev_process);
 
 uint8_t tapdev_output(void);
@@ -150,6 +150,12 @@ tapdev_poll(void)
   return ret;
 }
 /*---------------------------------------------------------------------------*/
+int
+tapdev_fd(void)
+{
+  return fd > 0 ? fd : -1;
+}
+/*---------------------------------------------------------------------------*/
 void
 tapdev_send(void)
 {
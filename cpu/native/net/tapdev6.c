@@ -35,6 +35,7 @@
  */
 
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -59,6 +60,7 @@
 
 
 #include "tapdev6.h"
+#include "tapdev-drv.h"
 #include "contiki-net.h"
 
 #define DROP 0
@@ -90,6 +92,25 @@ uint8_t tapdev_send(uip_lladdr_t *lladdr);
 uint16_t
 tapdev_poll(void)
 {
+#if TAPDEV_BATCH > 1
+  int ret;
+
+  /* The device is non-blocking: an empty queue is an EAGAIN. */
+  if(fd <= 0) {
+    return 0;
+  }
+  ret = read(fd, uip_buf, UIP_BUFSIZE);
+
+  PRINTF("tapdev6: read %d bytes (max %d)\n", ret, UIP_BUFSIZE);
+
+  if(ret == -1) {
+    if(errno != EAGAIN && errno != EWOULDBLOCK) {
+      perror("tapdev_poll: read");
+    }
+    return 0;
+  }
+  return ret;
+#else /* TAPDEV_BATCH > 1 */
   fd_set fdset;
   struct timeval tv;
   int ret;
@@ -115,6 +136,13 @@ tapdev_poll(void)
     perror("tapdev_poll: read");
   }
   return ret;
+#endif /* TAPDEV_BATCH > 1 */
+}
+/*---------------------------------------------------------------------------*/
+int
+tapdev_fd(void)
+{
+  return fd > 0 ? fd : -1;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -140,6 +168,12 @@ tapdev_init(void)
   }
 #endif /* Linux */
 
+#if TAPDEV_BATCH > 1
+  if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1) {
+    perror("tapdev: tapdev_init: fcntl");
+  }
+#endif /* TAPDEV_BATCH > 1 */
+
   /* Linux (ubuntu)
      snprintf(buf, sizeof(buf), "ip link set tap0 up");
      system(buf);
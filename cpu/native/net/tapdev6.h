@@ -42,6 +42,7 @@
 void tapdev_init(void);
 uint8_t tapdev_send(uip_lladdr_t *lladdr);
 uint16_t tapdev_poll(void);
+int tapdev_fd(void);
 void tapdev_do_send(void);
 void tapdev_exit(void); //math
 #endif /* __TAPDEV_H__ */
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Internet checksum for the native platform
+ *
+ *         The checksum is computed on whole words in the byte order of
+ *         the host, and carries are only folded back at the end. The
+ *         one's complement sum does not depend on the byte order of
+ *         the words (RFC 1071), so the result only has to be swapped
+ *         back to the order that uIP expects. On x86, SSE2 or AVX2 is
+ *         used for large buffers when the CPU supports it.
+ */
+
+#include <string.h>
+
+#include "net/uip.h"
+#include "net/uip_arch.h"
+
+#if UIP_ARCH_CHKSUM
+
+/* The widest SIMD instruction set to use: 0 for none, 1 for SSE2 and
+   2 for AVX2. The instruction set is selected at run-time among those
+   supported by the CPU. */
+#ifdef UIP_ARCH_CONF_CHKSUM_SIMD
+#define CHKSUM_SIMD UIP_ARCH_CONF_CHKSUM_SIMD
+#else
+#define CHKSUM_SIMD 2
+#endif
+
+#if CHKSUM_SIMD && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CHKSUM_X86 1
+#else
+#define CHKSUM_X86 0
+#endif
+
+/* Buffers shorter than this are summed without SIMD. */
+#define SIMD_MIN_LEN 64
+
+#define BUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+/*---------------------------------------------------------------------------*/
+static uint64_t
+sum_words(const uint8_t *data, uint16_t len, uint64_t acc)
+{
+  uint32_t w[4];
+  uint16_t w16;
+  uint8_t last[2];
+
+  /* 32-bit words added to a 64-bit accumulator cannot overflow it
+     for any buffer uIP can hold. */
+  while(len >= sizeof(w)) {
+    memcpy(w, data, sizeof(w));
+    acc += (uint64_t)w[0] + w[1] + w[2] + w[3];
+    data += sizeof(w);
+    len -= sizeof(w);
+  }
+  while(len >= 2) {
+    memcpy(&w16, data, 2);
+    acc += w16;
+    data += 2;
+    len -= 2;
+  }
+  if(len > 0) {
+    last[0] = *data;
+    last[1] = 0;
+    memcpy(&w16, last, 2);
+    acc += w16;
+  }
+  return acc;
+}
+/*---------------------------------------------------------------------------*/
+#if CHKSUM_X86
+__attribute__((target("sse2")))
+static uint64_t
+sum_sse2(const uint8_t *data, uint16_t len, uint64_t acc)
+{
+  __m128i zero, sum, v;
+  uint32_t lanes[4];
+  int i;
+
+  /* Each 32-bit lane gets two 16-bit words per iteration, so it
+     cannot overflow for buffers shorter than 64 kbytes. */
+  zero = _mm_setzero_si128();
+  sum = zero;
+  while(len >= 16) {
+    v = _mm_loadu_si128((const __m128i *)data);
+    sum = _mm_add_epi32(sum, _mm_unpacklo_epi16(v, zero));
+    sum = _mm_add_epi32(sum, _mm_unpackhi_epi16(v, zero));
+    data += 16;
+    len -= 16;
+  }
+  _mm_storeu_si128((__m128i *)lanes, sum);
+  for(i = 0; i < 4; i++) {
+    acc += lanes[i];
+  }
+  return sum_words(data, len, acc);
+}
+/*---------------------------------------------------------------------------*/
+#if CHKSUM_SIMD >= 2
+__attribute__((target("avx2")))
+static uint64_t
+sum_avx2(const uint8_t *data, uint16_t len, uint64_t acc)
+{
+  __m256i zero, sum, v;
+  uint32_t lanes[8];
+  int i;
+
+  zero = _mm256_setzero_si256();
+  sum = zero;
+  while(len >= 32) {
+    v = _mm256_loadu_si256((const __m256i *)data);
+    sum = _mm256_add_epi32(sum, _mm256_unpacklo_epi16(v, zero));
+    sum = _mm256_add_epi32(sum, _mm256_unpackhi_epi16(v, zero));
+    data += 32;
+    len -= 32;
+  }
+  _mm256_storeu_si256((__m256i *)lanes, sum);
+  for(i = 0; i < 8; i++) {
+    acc += lanes[i];
+  }
+  return sum_words(data, len, acc);
+}
+#endif /* CHKSUM_SIMD >= 2 */
+/*---------------------------------------------------------------------------*/
+static uint64_t sum_select(const uint8_t *data, uint16_t len, uint64_t acc);
+
+static uint64_t (*sum_simd)(const uint8_t *data, uint16_t len, uint64_t acc) =
+  sum_select;
+
+static uint64_t
+sum_select(const uint8_t *data, uint16_t len, uint64_t acc)
+{
+  __builtin_cpu_init();
+#if CHKSUM_SIMD >= 2
+  if(__builtin_cpu_supports("avx2")) {
+    sum_simd = sum_avx2;
+  } else
+#endif /* CHKSUM_SIMD >= 2 */
+  if(__builtin_cpu_supports("sse2")) {
+    sum_simd = sum_sse2;
+  } else {
+    sum_simd = sum_words;
+  }
+  return sum_simd(data, len, acc);
+}
+#endif /* CHKSUM_X86 */
+/*---------------------------------------------------------------------------*/
+static uint16_t
+chksum(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  uint64_t acc;
+
+  acc = uip_htons(sum);
+#if CHKSUM_X86
+  if(len >= SIMD_MIN_LEN) {
+    acc = sum_simd(data, len, acc);
+  } else
+#endif /* CHKSUM_X86 */
+  {
+    acc = sum_words(data, len, acc);
+  }
+
+  /* Fold the carries back into 16 bits. */
+  while(acc >> 16) {
+    acc = (acc >> 16) + (acc & 0xffff);
+  }
+
+  /* Return sum in host byte order. */
+  return uip_ntohs((uint16_t)acc);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum(uint16_t *data, uint16_t len)
+{
+  return uip_htons(chksum(0, (uint8_t *)data, len));
+}
+/*---------------------------------------------------------------------------*/
+#ifndef UIP_ARCH_IPCHKSUM
+uint16_t
+uip_ipchksum(void)
+{
+  uint16_t sum;
+
+  sum = chksum(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
+  return (sum == 0) ? 0xffff : uip_htons(sum);
+}
+#endif /* UIP_ARCH_IPCHKSUM */
+/*---------------------------------------------------------------------------*/
+static uint16_t
+upper_layer_chksum(uint8_t proto)
+{
+  uint16_t upper_layer_len;
+  uint16_t sum;
+
+#if UIP_CONF_IPV6
+  upper_layer_len = (((uint16_t)(BUF->len[0]) << 8) + BUF->len[1]) - uip_ext_len;
+#else /* UIP_CONF_IPV6 */
+  upper_layer_len = (((uint16_t)(BUF->len[0]) << 8) + BUF->len[1]) - UIP_IPH_LEN;
+#endif /* UIP_CONF_IPV6 */
+
+  /* First sum pseudoheader. */
+  /* IP protocol and length fields. This addition cannot carry. */
+  sum = upper_layer_len + proto;
+  /* Sum IP source and destination addresses. */
+  sum = chksum(sum, (uint8_t *)&BUF->srcipaddr, 2 * sizeof(uip_ipaddr_t));
+
+  /* Sum upper layer header and data. */
+#if UIP_CONF_IPV6
+  sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN + uip_ext_len],
+               upper_layer_len);
+#else /* UIP_CONF_IPV6 */
+  sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN], upper_layer_len);
+#endif /* UIP_CONF_IPV6 */
+
+  return (sum == 0) ? 0xffff : uip_htons(sum);
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_CONF_IPV6
+uint16_t
+uip_icmp6chksum(void)
+{
+  return upper_layer_chksum(UIP_PROTO_ICMP6);
+}
+#endif /* UIP_CONF_IPV6 */
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_tcpchksum(void)
+{
+  return upper_layer_chksum(UIP_PROTO_TCP);
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_UDP_CHECKSUMS
+uint16_t
+uip_udpchksum(void)
+{
+  return upper_layer_chksum(UIP_PROTO_UDP);
+}
+#endif /* UIP_UDP_CHECKSUMS */
+/*---------------------------------------------------------------------------*/
+#endif /* UIP_ARCH_CHKSUM */
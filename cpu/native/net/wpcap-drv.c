@@ -61,7 +61,7 @@
 #define FALLBACK_HAS_ETHERNET_HEADERS  1
 #endif
 
-PROCESS(wpcap_process, "WinPcap driver");
+PROCESS_PRIO(wpcap_process, "WinPcap driver", PROCESS_PRIORITY_NETWORK);
 
 /*---------------------------------------------------------------------------*/
 #if !UIP_CONF_IPV6
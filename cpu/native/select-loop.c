@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         File descriptor multiplexing for the main loop of the
+ *         native and minimal-net platforms
+ *
+ *         Drivers register a select_callback for their file descriptor.
+ *         In every round of the main loop, set_fd() tells which of read
+ *         and write the driver waits for, and handle_fd() is called
+ *         with the file descriptors that are ready.
+ *
+ *         The select() backend polls all callbacks and sleeps at most a
+ *         millisecond. The epoll backend keeps the file descriptors in
+ *         an epoll set, only calls the handlers of the ready ones, and
+ *         sleeps on a timerfd until the next etimer expires.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#include "contiki.h"
+#include "select-loop.h"
+
+#if SELECT_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif /* SELECT_EPOLL */
+
+#if SELECT_MAX > FD_SETSIZE
+#error SELECT_CONF_MAX must not be larger than FD_SETSIZE
+#endif
+
+static const struct select_callback *select_callback[SELECT_MAX];
+static int select_max = 0;
+
+#if SELECT_EPOLL
+/* Max number of ready file descriptors handled per round */
+#define EPOLL_EVENTS 64
+
+/* Events a file descriptor is registered for in the epoll set, or
+   ALWAYS_READY for file descriptors that epoll does not support, such
+   as regular files. select() reports those as always ready. */
+#define ALWAYS_READY 0x80000000U
+
+static uint32_t registered[SELECT_MAX];
+static int epfd = -1;
+static int timerfd = -1;
+#endif /* SELECT_EPOLL */
+/*---------------------------------------------------------------------------*/
+int
+select_set_callback(int fd, const struct select_callback *callback)
+{
+  int i;
+  if(fd >= 0 && fd < SELECT_MAX) {
+    /* Check that the callback functions are set */
+    if(callback != NULL &&
+       (callback->set_fd == NULL || callback->handle_fd == NULL)) {
+      callback = NULL;
+    }
+
+    select_callback[fd] = callback;
+
+#if SELECT_EPOLL
+    /* The file descriptor may be a new one with a reused number, so
+       it is added again by the next round. */
+    if(registered[fd] != 0 && epfd >= 0) {
+      epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    registered[fd] = 0;
+#endif /* SELECT_EPOLL */
+
+    /* Update fd max */
+    if(callback != NULL) {
+      if(fd > select_max) {
+        select_max = fd;
+      }
+    } else {
+      select_max = 0;
+      for(i = SELECT_MAX - 1; i > 0; i--) {
+        if(select_callback[i] != NULL) {
+          select_max = i;
+          break;
+        }
+      }
+    }
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+select_wait(int pending)
+{
+  fd_set fdr;
+  fd_set fdw;
+  int maxfd;
+  int i;
+  int retval;
+  struct timeval tv;
+
+  tv.tv_sec = 0;
+  tv.tv_usec = pending ? 1 : 1000;
+
+  FD_ZERO(&fdr);
+  FD_ZERO(&fdw);
+  maxfd = 0;
+  for(i = 0; i <= select_max; i++) {
+    if(select_callback[i] != NULL && select_callback[i]->set_fd(&fdr, &fdw)) {
+      maxfd = i;
+    }
+  }
+
+  retval = select(maxfd + 1, &fdr, &fdw, NULL, &tv);
+  if(retval < 0) {
+    if(errno != EINTR) {
+      perror("select");
+    }
+  } else if(retval > 0) {
+    /* timeout => retval == 0 */
+    for(i = 0; i <= maxfd; i++) {
+      if(select_callback[i] != NULL) {
+        select_callback[i]->handle_fd(&fdr, &fdw);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if SELECT_EPOLL
+static int
+epoll_init(void)
+{
+  struct epoll_event ev;
+
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if(epfd < 0) {
+    perror("epoll_create1");
+    return 0;
+  }
+  timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if(timerfd < 0) {
+    perror("timerfd_create");
+    close(epfd);
+    epfd = -1;
+    return 0;
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = timerfd;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &ev);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Bring the epoll set in line with what the callbacks wait for. Returns
+   non-zero if a file descriptor outside the set is waited for. */
+static int
+epoll_update(fd_set *fdr, fd_set *fdw)
+{
+  struct epoll_event ev;
+  uint32_t events;
+  int i, always;
+
+  FD_ZERO(fdr);
+  FD_ZERO(fdw);
+  for(i = 0; i <= select_max; i++) {
+    if(select_callback[i] != NULL) {
+      select_callback[i]->set_fd(fdr, fdw);
+    }
+  }
+
+  always = 0;
+  for(i = 0; i <= select_max; i++) {
+    if(select_callback[i] == NULL) {
+      continue;
+    }
+    events = (FD_ISSET(i, fdr) ? EPOLLIN : 0) | (FD_ISSET(i, fdw) ? EPOLLOUT : 0);
+    if(registered[i] & ALWAYS_READY) {
+      always |= events != 0;
+      continue;
+    }
+    if(events == registered[i]) {
+      continue;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = i;
+    if(registered[i] == 0) {
+      if(epoll_ctl(epfd, EPOLL_CTL_ADD, i, &ev) < 0) {
+        if(errno == EPERM) {
+          registered[i] = ALWAYS_READY;
+          always |= events != 0;
+        } else {
+          perror("epoll_ctl");
+        }
+        continue;
+      }
+    } else if(events == 0) {
+      epoll_ctl(epfd, EPOLL_CTL_DEL, i, NULL);
+    } else if(epoll_ctl(epfd, EPOLL_CTL_MOD, i, &ev) < 0 && errno == ENOENT) {
+      /* Closed and reopened behind our back */
+      epoll_ctl(epfd, EPOLL_CTL_ADD, i, &ev);
+    }
+    registered[i] = events;
+  }
+  return always;
+}
+/*---------------------------------------------------------------------------*/
+static void
+epoll_wait_events(int pending)
+{
+  static struct epoll_event events[EPOLL_EVENTS];
+  fd_set fdr, fdw, readyr, readyw;
+  struct itimerspec its;
+  clock_time_t now, next, wait;
+  uint64_t expirations;
+  int i, n, fd, timeout;
+
+  timeout = -1;
+  if(epoll_update(&fdr, &fdw) || pending) {
+    timeout = 0;
+  } else {
+    wait = SELECT_MAX_WAIT;
+    if(etimer_pending()) {
+      now = clock_time();
+      next = etimer_next_expiration_time();
+      if((long)(next - now) <= 0) {
+        wait = 0;
+      } else if(next - now < wait) {
+        wait = next - now;
+      }
+    }
+    if(wait == 0) {
+      timeout = 0;
+    } else {
+      memset(&its, 0, sizeof(its));
+      its.it_value.tv_sec = wait / CLOCK_SECOND;
+      its.it_value.tv_nsec = (long)(wait % CLOCK_SECOND) *
+        (1000000000L / CLOCK_SECOND);
+      timerfd_settime(timerfd, 0, &its, NULL);
+    }
+  }
+
+  n = epoll_wait(epfd, events, EPOLL_EVENTS, timeout);
+  if(n < 0) {
+    if(errno != EINTR) {
+      perror("epoll_wait");
+    }
+    n = 0;
+  }
+
+  /* Hand the ready file descriptors to their callbacks in the same
+     form as select() would. */
+  FD_ZERO(&readyr);
+  FD_ZERO(&readyw);
+  for(i = 0; i < n; i++) {
+    fd = events[i].data.fd;
+    if(fd == timerfd) {
+      if(read(timerfd, &expirations, sizeof(expirations)) < 0) {
+        /* Already read, nothing to do */
+      }
+      continue;
+    }
+    if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR) && FD_ISSET(fd, &fdr)) {
+      FD_SET(fd, &readyr);
+    }
+    if(events[i].events & (EPOLLOUT | EPOLLERR) && FD_ISSET(fd, &fdw)) {
+      FD_SET(fd, &readyw);
+    }
+  }
+  for(fd = 0; fd <= select_max; fd++) {
+    if(registered[fd] & ALWAYS_READY) {
+      if(FD_ISSET(fd, &fdr)) {
+        FD_SET(fd, &readyr);
+      }
+      if(FD_ISSET(fd, &fdw)) {
+        FD_SET(fd, &readyw);
+      }
+    }
+  }
+
+  for(i = 0; i < n; i++) {
+    fd = events[i].data.fd;
+    if(fd != timerfd && select_callback[fd] != NULL &&
+       !(registered[fd] & ALWAYS_READY)) {
+      select_callback[fd]->handle_fd(&readyr, &readyw);
+    }
+  }
+  for(fd = 0; fd <= select_max; fd++) {
+    if((registered[fd] & ALWAYS_READY) && select_callback[fd] != NULL &&
+       (FD_ISSET(fd, &readyr) || FD_ISSET(fd, &readyw))) {
+      select_callback[fd]->handle_fd(&readyr, &readyw);
+    }
+  }
+}
+#endif /* SELECT_EPOLL */
+/*---------------------------------------------------------------------------*/
+void
+select_loop_wait(int pending)
+{
+#if SELECT_EPOLL
+  if(epfd >= 0 || epoll_init()) {
+    epoll_wait_events(pending);
+    return;
+  }
+#endif /* SELECT_EPOLL */
+  select_wait(pending);
+}
+/*---------------------------------------------------------------------------*/
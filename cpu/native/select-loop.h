@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         File descriptor multiplexing for the main loop of the
+ *         native and minimal-net platforms
+ */
+
+#ifndef __SELECT_LOOP_H__
+#define __SELECT_LOOP_H__
+
+#include "contiki-conf.h"
+
+/* Wait with epoll(7) and a timerfd instead of polling with select().
+   The epoll loop sleeps until a file descriptor is ready or the next
+   etimer expires, instead of waking up every millisecond. */
+#ifdef SELECT_CONF_EPOLL
+#define SELECT_EPOLL SELECT_CONF_EPOLL
+#else
+#define SELECT_EPOLL 0
+#endif
+
+/* The highest file descriptor number plus one that can get a callback. */
+#ifdef SELECT_CONF_MAX
+#define SELECT_MAX SELECT_CONF_MAX
+#elif SELECT_EPOLL
+#define SELECT_MAX FD_SETSIZE
+#else
+#define SELECT_MAX 8
+#endif
+
+/* The longest time, in clock ticks, that the epoll loop sleeps when no
+   etimer is pending. It bounds the delay of callbacks whose interest
+   depends on something else than a file descriptor or an etimer, such
+   as a plain timer. */
+#ifdef SELECT_CONF_MAX_WAIT
+#define SELECT_MAX_WAIT SELECT_CONF_MAX_WAIT
+#else
+#define SELECT_MAX_WAIT CLOCK_SECOND
+#endif
+
+/**
+ * Wait until a file descriptor with a callback is ready, or until
+ * the next etimer expires, and call the handlers of the ready file
+ * descriptors.
+ *
+ * \param pending Non-zero if events are pending, as returned by
+ * process_run(), in which case the function does not sleep.
+ */
+void select_loop_wait(int pending);
+
+#endif /* __SELECT_LOOP_H__ */
@@ -239,7 +239,7 @@ static void RELEASE_LOCK(void) {
 }
 static volatile uint8_t is_transmit_ack;
 /*---------------------------------------------------------------------------*/
-PROCESS(stm32w_radio_process, "STM32W radio driver");
+PROCESS_PRIO(stm32w_radio_process, "STM32W radio driver", PROCESS_PRIORITY_NETWORK);
 /*---------------------------------------------------------------------------*/
 
 static int stm32w_radio_init(void);
@@ -137,7 +137,6 @@ PROCESS_THREAD(query_process, ev, data)
   static db_handle_t handle;
   db_result_t result;
   static tuple_id_t matching;
-  static tuple_id_t processed;
 #if !PREPARE_DB
   static struct etimer sampling_timer;
 #endif
@@ -200,7 +199,6 @@ PROCESS_THREAD(query_process, ev, data)
       db_print_header(&handle);
 
       matching = 0;
-      processed = 0;
 
       while(db_processing(&handle)) {
 	PROCESS_PAUSE();
@@ -217,17 +215,15 @@ PROCESS_THREAD(query_process, ev, data)
         if(result == DB_GOT_ROW) {
 	  /* The processed tuple matched the condition in the query. */
 	  matching++;
-	  processed++;
 	  db_print_tuple(&handle);
 	} else if(result == DB_OK) {
-	  /* A tuple was processed, but did not match the condition. */
-	  processed++;
+	  /* Tuples were processed, but did not match the condition. */
 	  continue;
 	} else {
 	  if(result == DB_FINISHED) {
 	    /* The processing has finished. Wait for a new command. */
 	    buffer_db_data("[%ld tuples returned; %ld tuples processed]\n",
-			   (long)matching, (long)processed);
+			   (long)matching, (long)handle.processed_rows);
 	    buffer_db_data("OK\n");
 	  } else if(DB_ERROR(result)) {
 	    buffer_db_data("Processing error: %s\n",
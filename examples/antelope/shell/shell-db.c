@@ -49,7 +49,6 @@ PROCESS_THREAD(db_shell, ev, data)
   static db_handle_t handle;
   db_result_t result;
   static tuple_id_t matching;
-  static tuple_id_t processed;
 
   PROCESS_BEGIN();
 
@@ -67,6 +66,11 @@ PROCESS_THREAD(db_shell, ev, data)
     }
 
     if(!db_processing(&handle)) {
+#if DB_FEATURE_EXPLAIN
+      if(handle.plan.flags & DB_PLAN_FLAG_EXPLAIN) {
+        db_print_plan(&handle);
+      }
+#endif /* DB_FEATURE_EXPLAIN */
       printf("OK\n");
       continue;
     }
@@ -74,7 +78,6 @@ PROCESS_THREAD(db_shell, ev, data)
     db_print_header(&handle);
 
     matching = 0;
-    processed = 0;
 
     while(db_processing(&handle)) {
       PROCESS_PAUSE();
@@ -83,17 +86,20 @@ PROCESS_THREAD(db_shell, ev, data)
       case DB_GOT_ROW:
         /* The processed tuple matched the condition in the query. */
         matching++;
-        processed++;
         db_print_tuple(&handle);
         break;
       case DB_OK:
-        /* A tuple was processed, but did not match the condition. */
-        processed++;
+        /* Tuples were processed, but did not match the condition. */
         continue;
       case DB_FINISHED:
         /* The processing has finished. Wait for a new command. */
         printf("[%ld tuples returned; %ld tuples processed]\n",
-               (long)matching, (long)processed);
+               (long)matching, (long)handle.processed_rows);
+#if DB_FEATURE_EXPLAIN
+        if(handle.plan.flags & DB_PLAN_FLAG_ANALYZE) {
+          db_print_plan(&handle);
+        }
+#endif /* DB_FEATURE_EXPLAIN */
         printf("OK\n");
       default:
         if(DB_ERROR(result)) {
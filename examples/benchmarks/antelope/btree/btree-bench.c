@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of the B+-tree index of Antelope against the
+ *         max-heap index on Coffee on the native platform. 100000 keys
+ *         are inserted into each index, and are then looked up. The
+ *         range scans, the deletions and the reloading of the index
+ *         are only tested on the B+-tree, because the max-heap index
+ *         supports neither range queries nor deletions.
+ *
+ *         Build with "make TARGET=native", with "NODESIZE=n" for nodes
+ *         of n bytes, or with "NODECACHE=n" for a cache of n nodes,
+ *         after a "make clean".
+ */
+
+#include "contiki.h"
+#include "cfs/cfs-coffee.h"
+
+#include "antelope.h"
+#include "index.h"
+#include "bench.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEYS        100000UL
+#define LOOKUPS     10000UL
+#define DELETIONS   10000UL
+#define KEY_SPACE   65536UL
+#define RANGE_MIN   1000
+#define RANGE_MAX   1999
+
+/* The keys are a permutation of 0..KEY_SPACE-1 that repeats after
+   KEY_SPACE rows, so each key occurs at most twice. */
+#define KEY(i)      (((i) * 7919UL) % KEY_SPACE)
+
+static uint8_t occurrences[KEY_SPACE];
+
+PROCESS(btree_bench_process, "Antelope B+-tree benchmark");
+AUTOSTART_PROCESSES(&btree_bench_process);
+/*---------------------------------------------------------------------------*/
+static index_t *
+create_index(char *relation, const char *type)
+{
+  relation_t *rel;
+  attribute_t *attr;
+
+  db_query(NULL, "REMOVE RELATION %s;", relation);
+  db_query(NULL, "CREATE RELATION %s;", relation);
+  db_query(NULL, "CREATE ATTRIBUTE k DOMAIN INT IN %s;", relation);
+  if(DB_ERROR(db_query(NULL, "CREATE INDEX %s.k TYPE %s;",
+                       relation, type))) {
+    printf("FAIL creation of a %s index\n", type);
+    exit(1);
+  }
+
+  rel = relation_load(relation);
+  attr = rel == NULL ? NULL : relation_attribute_get(rel, "k");
+  if(attr == NULL || attr->index == NULL) {
+    printf("FAIL loading of the %s index\n", type);
+    exit(1);
+  }
+  return attr->index;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_value(attribute_value_t *value, long key)
+{
+  value->domain = DOMAIN_INT;
+  VALUE_INT(value) = key;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+bench_insert(const char *what, index_t *index)
+{
+  attribute_value_t value;
+  unsigned long i, start, usecs, failed;
+
+  start = bench_usec_now();
+  for(i = failed = 0; i < KEYS; i++) {
+    set_value(&value, KEY(i));
+    if(DB_ERROR(index_insert(index, &value, i))) {
+      failed++;
+    }
+  }
+  usecs = bench_usec_now() - start;
+
+  printf("%-8s insert %6lu keys %9lu us, %lu failed\n",
+         what, KEYS, usecs, failed);
+  return failed;
+}
+/*---------------------------------------------------------------------------*/
+/* Iterate over a range of keys, and return the number of keys found.
+   The keys must come in ascending order if the index is ordered. */
+static unsigned long
+scan(index_t *index, long min, long max, int ordered)
+{
+  index_iterator_t iterator;
+  attribute_value_t min_value, max_value;
+  unsigned long found, key, last_key;
+  tuple_id_t id;
+
+  set_value(&min_value, min);
+  set_value(&max_value, max);
+  if(DB_ERROR(index_get_iterator(&iterator, index,
+                                 &min_value, &max_value))) {
+    return ULONG_MAX;
+  }
+
+  found = last_key = 0;
+  while((id = index_get_next(&iterator)) != INVALID_TUPLE) {
+    key = KEY(id);
+    if(key < min || key > max || (ordered && key < last_key)) {
+      printf("FAIL key %lu of row %lu in the range (%ld,%ld)\n",
+             key, (unsigned long)id, min, max);
+      bench_errors++;
+    }
+    last_key = key;
+    found++;
+  }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_lookup(const char *what, index_t *index, int verify)
+{
+  unsigned long i, key, start, usecs, found, missing;
+
+  start = bench_usec_now();
+  for(i = found = missing = 0; i < LOOKUPS; i++) {
+    key = KEY(random() % KEYS);
+    found = scan(index, key, key, 0);
+    if(found != occurrences[key]) {
+      missing++;
+    }
+  }
+  usecs = bench_usec_now() - start;
+
+  printf("%-8s lookup %6lu keys %9lu us, %lu incomplete\n",
+         what, LOOKUPS, usecs, missing);
+  if(verify) {
+    bench_check("incomplete lookups", missing, 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+count_range(long min, long max)
+{
+  unsigned long count;
+  long key;
+
+  for(count = 0, key = min; key <= max; key++) {
+    count += occurrences[key];
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_range(const char *what, index_t *index, long min, long max)
+{
+  unsigned long start, usecs, found;
+
+  start = bench_usec_now();
+  found = scan(index, min, max, 1);
+  usecs = bench_usec_now() - start;
+
+  if(found == ULONG_MAX) {
+    printf("%-8s range  (%ld,%ld) unsupported\n", what, min, max);
+    return;
+  }
+  printf("%-8s range  (%ld,%ld) %6lu keys %9lu us\n",
+         what, min, max, found, usecs);
+  bench_check("keys in the range", found, count_range(min, max));
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_delete(const char *what, index_t *index)
+{
+  attribute_value_t value;
+  unsigned long i, key, start, usecs;
+
+  start = bench_usec_now();
+  for(i = 0; i < DELETIONS; i++) {
+    key = KEY(i);
+    set_value(&value, key);
+    if(DB_ERROR(index_delete(index, &value))) {
+      printf("%-8s delete unsupported\n", what);
+      return;
+    }
+    occurrences[key] = 0;
+  }
+  usecs = bench_usec_now() - start;
+
+  printf("%-8s delete %6lu keys %9lu us\n", what, DELETIONS, usecs);
+
+  for(i = 0; i < DELETIONS; i++) {
+    bench_check("keys found after the deletion", scan(index, KEY(i), KEY(i), 0), 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(btree_bench_process, ev, data)
+{
+  index_t *btree;
+  index_t *maxheap;
+  relation_t *rel;
+  attribute_t *attr;
+  unsigned long i;
+
+  PROCESS_BEGIN();
+
+  printf("B+-tree nodes of %u bytes, %u cached nodes\n",
+         (unsigned)DB_BTREE_NODE_SIZE, (unsigned)DB_BTREE_CACHE_LIMIT);
+
+  cfs_coffee_format();
+  db_init();
+  srandom(1);
+
+  for(i = 0; i < KEYS; i++) {
+    occurrences[KEY(i)]++;
+  }
+
+  btree = create_index("keys", "BTREE");
+  bench_check("failed B+-tree insertions", bench_insert("btree", btree), 0);
+  bench_lookup("btree", btree, 1);
+  bench_range("btree", btree, RANGE_MIN, RANGE_MAX);
+  bench_range("btree", btree, 0, KEY_SPACE - 1);
+
+  maxheap = create_index("heapkeys", "MAXHEAP");
+  bench_insert("maxheap", maxheap);
+  bench_lookup("maxheap", maxheap, 0);
+  bench_range("maxheap", maxheap, RANGE_MIN, RANGE_MAX);
+  bench_delete("maxheap", maxheap);
+
+  bench_delete("btree", btree);
+  bench_range("btree", btree, 0, KEY_SPACE - 1);
+
+  /* Write back the cached nodes, and read the tree from storage. */
+  rel = btree->rel;
+  attr = btree->attr;
+  if(DB_ERROR(index_release(btree)) || DB_ERROR(index_load(rel, attr))) {
+    printf("FAIL reloading of the B+-tree\n");
+    exit(1);
+  }
+  btree = attr->index;
+  bench_range("reloaded", btree, 0, KEY_SPACE - 1);
+
+  bench_report("results");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
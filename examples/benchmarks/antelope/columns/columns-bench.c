@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of the row storage and the column storage of
+ *         Antelope on Coffee on the native platform. A relation of five
+ *         attributes and 10000 rows is queried with a narrow projection,
+ *         a projection of all attributes, a narrow projection with a
+ *         condition on the attribute that the rows are sorted on, and a
+ *         narrow projection with a condition on an unsorted attribute.
+ *         Finally, the rows after the first 9000 are removed, which
+ *         checks that the removal reads the chunks that the condition
+ *         would let a selection skip.
+ *
+ *         Build with "make TARGET=native" for the row storage, or with
+ *         "COLUMNS=1" for the column storage, and optionally with
+ *         "SCANBUF=n" for a scan buffer of n bytes, after a "make clean".
+ */
+
+#include "contiki.h"
+#include "cfs/cfs-coffee.h"
+
+#include "antelope.h"
+#include "relation.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROWS    10000UL
+#define BATCH   50
+#define SENSORS 16
+#define RECENT  500UL
+#define KEPT    9000UL
+
+static attribute_value_t values[BATCH][5];
+static unsigned char labels[BATCH][14];
+static unsigned long value_sum;
+static unsigned long recent_sum;
+static unsigned long kept_sum;
+static unsigned long sensor_rows;
+static unsigned long sensor_sum;
+
+PROCESS(columns_bench_process, "Antelope column storage benchmark");
+AUTOSTART_PROCESSES(&columns_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what, unsigned long rows, unsigned long usecs)
+{
+  printf("%-24s %6lu rows %9lu us %9lu rows/s\n", what, rows, usecs,
+         usecs ? (unsigned long)(rows * 1000000ULL / usecs) : 0);
+}
+/*---------------------------------------------------------------------------*/
+/* The rows are sorted on the time t, whereas the sensors and the values
+   are random. The attributes x and label are only read by the query
+   that projects all attributes. */
+static void
+populate(void)
+{
+  relation_t *rel;
+  unsigned long i, start;
+  unsigned j, sensor, value;
+
+  db_query(NULL, "REMOVE RELATION w;");
+  db_query(NULL, "CREATE RELATION w;");
+  db_query(NULL, "CREATE ATTRIBUTE t DOMAIN LONG IN w;");
+  db_query(NULL, "CREATE ATTRIBUTE sensor DOMAIN INT IN w;");
+  db_query(NULL, "CREATE ATTRIBUTE value DOMAIN INT IN w;");
+  db_query(NULL, "CREATE ATTRIBUTE x DOMAIN LONG IN w;");
+  db_query(NULL, "CREATE ATTRIBUTE label DOMAIN STRING(14) IN w;");
+
+  rel = relation_load("w");
+  if(rel == NULL) {
+    printf("FAIL loading of the relation\n");
+    exit(1);
+  }
+
+  start = bench_usec_now();
+  for(i = 0; i < ROWS; i += BATCH) {
+    for(j = 0; j < BATCH; j++) {
+      sensor = random() % SENSORS;
+      value = random() % 1000;
+      value_sum += value;
+      if(i + j < RECENT) {
+        recent_sum += value;
+      }
+      if(i + j < KEPT) {
+        kept_sum += value;
+      }
+      if(sensor == 3) {
+        sensor_rows++;
+        sensor_sum += value;
+      }
+
+      values[j][0].domain = DOMAIN_LONG;
+      VALUE_LONG(&values[j][0]) = i + j;
+      values[j][1].domain = DOMAIN_INT;
+      VALUE_INT(&values[j][1]) = sensor;
+      values[j][2].domain = DOMAIN_INT;
+      VALUE_INT(&values[j][2]) = value;
+      values[j][3].domain = DOMAIN_LONG;
+      VALUE_LONG(&values[j][3]) = random();
+      snprintf((char *)labels[j], sizeof(labels[j]), "row %lu", i + j);
+      values[j][4].domain = DOMAIN_STRING;
+      VALUE_STRING(&values[j][4]) = labels[j];
+    }
+    if(DB_ERROR(relation_insert_rows(rel, values[0], BATCH))) {
+      printf("FAIL insertion of the batch at row %lu\n", i);
+      exit(1);
+    }
+  }
+  report("insert", ROWS, bench_usec_now() - start);
+  relation_release(rel);
+}
+/*---------------------------------------------------------------------------*/
+/* Run a query, and check the number of rows and the sum of the value
+   attribute in the given column of the result. */
+static void
+bench_select(const char *what, const char *query, int column,
+             unsigned long rows, unsigned long sum)
+{
+  static db_handle_t handle;
+  attribute_value_t value;
+  unsigned long start, usecs, found;
+  db_result_t result;
+
+  start = bench_usec_now();
+  result = db_query(&handle, query);
+  if(DB_ERROR(result)) {
+    printf("FAIL query \"%s\": %s\n", query, db_get_result_message(result));
+    exit(1);
+  }
+  found = 0;
+  while(db_processing(&handle)) {
+    result = db_process(&handle);
+    if(result == DB_GOT_ROW) {
+      db_get_value(&value, &handle, column);
+      found += db_value_to_long(&value);
+    } else if(result == DB_FINISHED) {
+      break;
+    } else if(DB_ERROR(result)) {
+      printf("FAIL processing of \"%s\": %s\n", query,
+             db_get_result_message(result));
+      exit(1);
+    }
+  }
+  usecs = bench_usec_now() - start;
+
+  report(what, (unsigned long)handle.current_row, usecs);
+  printf("%-24s %6lu rows processed\n", "",
+         (unsigned long)handle.processed_rows);
+  bench_check("selected rows", handle.current_row, rows);
+  bench_check("sum of the values", found, sum);
+  db_free(&handle);
+}
+/*---------------------------------------------------------------------------*/
+/* Remove the rows after the first KEPT ones, and check the rest. */
+static void
+bench_remove(void)
+{
+  static db_handle_t handle;
+  unsigned long start, usecs;
+  db_result_t result;
+
+  start = bench_usec_now();
+  result = db_query(&handle, "REMOVE FROM w WHERE t > %lu;", KEPT - 1);
+  if(DB_ERROR(result)) {
+    printf("FAIL removal: %s\n", db_get_result_message(result));
+    exit(1);
+  }
+  while(db_processing(&handle)) {
+    result = db_process(&handle);
+    if(result == DB_FINISHED) {
+      break;
+    } else if(DB_ERROR(result)) {
+      printf("FAIL processing of the removal: %s\n",
+             db_get_result_message(result));
+      exit(1);
+    }
+  }
+  usecs = bench_usec_now() - start;
+  db_free(&handle);
+
+  report("removal", ROWS - KEPT, usecs);
+  bench_select("after the removal", "SELECT value FROM w;",
+               0, KEPT, kept_sum);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(columns_bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+#if DB_FEATURE_COLUMNS
+  printf("column storage, chunks of %u rows, scan buffer of %u bytes\n",
+         (unsigned)DB_COLUMN_CHUNK_ROWS, (unsigned)STORAGE_SCAN_BUFFER_SIZE);
+#else
+  printf("row storage, scan buffer of %u bytes\n",
+         (unsigned)STORAGE_SCAN_BUFFER_SIZE);
+#endif /* DB_FEATURE_COLUMNS */
+
+  cfs_coffee_format();
+  db_init();
+  srandom(1);
+
+  populate();
+
+  bench_select("narrow projection", "SELECT value FROM w;",
+               0, ROWS, value_sum);
+  bench_select("all attributes",
+               "SELECT t, sensor, value, x, label FROM w;",
+               2, ROWS, value_sum);
+  bench_select("sorted condition",
+               "SELECT value FROM w WHERE t < 500;",
+               0, RECENT, recent_sum);
+  bench_select("unsorted condition",
+               "SELECT value FROM w WHERE sensor = 3;",
+               0, sensor_rows, sensor_sum);
+  bench_remove();
+
+  bench_report("results");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
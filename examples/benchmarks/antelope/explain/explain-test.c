@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Test of EXPLAIN and EXPLAIN ANALYZE in Antelope on the native
+ *         platform. The plans printed by db_print_plan() are captured
+ *         and compared with the expected access paths and attribute
+ *         ranges. A join that is only explained must not leave join
+ *         partitions behind.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs-coffee.h"
+
+#include "antelope.h"
+#include "bench.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROWS 1000U
+
+static char plan[512];
+static size_t plan_length;
+
+PROCESS(explain_test_process, "Antelope EXPLAIN test");
+AUTOSTART_PROCESSES(&explain_test_process);
+/*---------------------------------------------------------------------------*/
+static int
+capture(const char *format, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start(ap, format);
+  n = vsnprintf(plan + plan_length, sizeof(plan) - plan_length, format, ap);
+  va_end(ap);
+  if(n > 0) {
+    plan_length += n;
+    if(plan_length >= sizeof(plan)) {
+      plan_length = sizeof(plan) - 1;
+    }
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+create(const char *relation, const char *value, int indexed)
+{
+  unsigned i;
+
+  db_query(NULL, "REMOVE RELATION %s;", relation);
+  db_query(NULL, "CREATE RELATION %s;", relation);
+  db_query(NULL, "CREATE ATTRIBUTE id DOMAIN INT IN %s;", relation);
+  db_query(NULL, "CREATE ATTRIBUTE %s DOMAIN INT IN %s;", value, relation);
+  if(indexed) {
+    /* The inline index is ready at once when the relation is empty. */
+    db_query(NULL, "CREATE INDEX %s.id TYPE INLINE;", relation);
+  }
+  for(i = 0; i < ROWS; i++) {
+    if(DB_ERROR(db_query(NULL, "INSERT (%u, %u) INTO %s;",
+                         i, i, relation))) {
+      printf("FAIL insert into %s\n", relation);
+      exit(1);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Run a query, process it if it is analyzed, and compare the first
+ * line of its plan with the expected one. The last line has the
+ * times of the phases of the query.
+ */
+static void
+check_plan(const char *query, const char *expected, tuple_id_t rows)
+{
+  static db_handle_t handle;
+  db_result_t result;
+  unsigned long parse, planning, execute, second;
+  char *line;
+
+  result = db_query(&handle, query);
+  if(DB_ERROR(result)) {
+    printf("FAIL query \"%s\": %s\n", query, db_get_result_message(result));
+    bench_errors++;
+    return;
+  }
+
+  while(db_processing(&handle)) {
+    result = db_process(&handle);
+    if(result == DB_FINISHED) {
+      break;
+    } else if(DB_ERROR(result)) {
+      printf("FAIL processing of \"%s\": %s\n", query,
+             db_get_result_message(result));
+      bench_errors++;
+      break;
+    }
+  }
+
+  plan_length = 0;
+  plan[0] = '\0';
+  db_set_output_function(capture);
+  db_print_plan(&handle);
+  db_set_output_function(printf);
+  db_free(&handle);
+  printf("%s\n%s", query, plan);
+
+  if(strncmp(plan, expected, strlen(expected)) != 0 ||
+     plan[strlen(expected)] != '\n') {
+    printf("FAIL plan of \"%s\", expected %s\n", query, expected);
+    bench_errors++;
+  }
+
+  line = strstr(plan, "[time = ");
+  if(line == NULL ||
+     sscanf(line, "[time = parse %lu, plan %lu, execute %lu ticks of 1/%lu s]",
+            &parse, &planning, &execute, &second) != 4) {
+    printf("FAIL times of \"%s\"\n", query);
+    bench_errors++;
+  } else {
+    bench_check("clock frequency", second, 1000000UL);
+    BENCH_ASSERT(parse + planning > 0);
+  }
+
+  if(rows != 0) {
+    bench_check("returned rows", handle.current_row, rows);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(explain_test_process, ev, data)
+{
+  int fd;
+
+  PROCESS_BEGIN();
+
+  cfs_coffee_format();
+  db_init();
+
+  create("l", "a", 0);
+  create("r", "b", 1);
+
+  check_plan("EXPLAIN SELECT a FROM l;", "[access = scan]", 0);
+  check_plan("EXPLAIN SELECT a FROM l WHERE a > 10;",
+             "[access = scan, ranges = a in [11, inf)]", 0);
+  check_plan("EXPLAIN SELECT a FROM l WHERE a < 10 AND id > 2;",
+             "[access = scan, ranges = id in [3, inf), a in (-inf, 9]]", 0);
+  check_plan("EXPLAIN SELECT b FROM r WHERE id >= 100 AND id <= 199;",
+             "[access = inline index on id, ranges = id in [100, 199]]", 0);
+  check_plan("EXPLAIN ANALYZE SELECT b FROM r WHERE id >= 100 AND id <= 199;",
+             "[access = inline index on id, ranges = id in [100, 199]]\n"
+             "[rows = 100 returned, 100 examined; index steps = 101]", 100);
+
+  /* The relations are too large for the join memory, so the hash join
+     would partition them if it were run. */
+  check_plan("EXPLAIN JOIN l, r ON id PROJECT a, b;",
+             "[access = hash join on id in 8 partitions]", 0);
+  fd = cfs_open(JOIN_PARTITION_FILE ".b0", CFS_READ);
+  if(fd >= 0) {
+    cfs_close(fd);
+    printf("FAIL EXPLAIN of a hash join created its partitions\n");
+    bench_errors++;
+  }
+  check_plan("EXPLAIN ANALYZE JOIN l, r ON id PROJECT a, b;",
+             "[access = hash join on id in 8 partitions]", ROWS);
+
+  bench_report("plans");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of grouped aggregation in Antelope on Coffee on the
+ *         native platform. The count and the sum of the values of each
+ *         group in a relation of 5000 rows are computed with one
+ *         aggregating query per group, and with a single GROUP BY query
+ *         on an unindexed relation and on a relation with an inline
+ *         index on the group attribute.
+ *
+ *         Build with "make TARGET=native", with "GROUPMEM=n" for n bytes
+ *         of group memory, or with "GROUP=0" to run only the queries
+ *         per group, after a "make clean".
+ */
+
+#include "contiki.h"
+#include "cfs/cfs-coffee.h"
+
+#include "antelope.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROWS      5000U
+#define GROUPS    100U
+#define MAX_VALUE 500U
+
+struct group {
+  unsigned long count;
+  unsigned long sum;
+};
+
+static struct group expected[GROUPS];
+static struct group found[GROUPS];
+
+PROCESS(group_bench_process, "Antelope grouping benchmark");
+AUTOSTART_PROCESSES(&group_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+create(const char *relation)
+{
+  db_query(NULL, "REMOVE RELATION %s;", relation);
+  db_query(NULL, "CREATE RELATION %s;", relation);
+  db_query(NULL, "CREATE ATTRIBUTE g DOMAIN INT IN %s;", relation);
+  db_query(NULL, "CREATE ATTRIBUTE v DOMAIN INT IN %s;", relation);
+}
+/*---------------------------------------------------------------------------*/
+static void
+insert(const char *relation, unsigned group, unsigned value)
+{
+  if(DB_ERROR(db_query(NULL, "INSERT (%u, %u) INTO %s;",
+                       group, value, relation))) {
+    printf("FAIL insert into %s\n", relation);
+    exit(1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The rows of relation "m" come in random group order, whereas the
+ * rows of relation "s" are sorted on the group attribute, which has an
+ * inline index. Both relations hold the same rows.
+ */
+static void
+populate(void)
+{
+  unsigned i, group, value;
+
+  create("m");
+  create("s");
+  db_query(NULL, "CREATE INDEX s.g TYPE INLINE;");
+
+  for(i = 0; i < ROWS; i++) {
+    group = random() % GROUPS;
+    value = random() % MAX_VALUE;
+    insert("m", group, value);
+    expected[group].count++;
+    expected[group].sum += value;
+  }
+
+  for(group = 0; group < GROUPS; group++) {
+    for(i = 0; i < expected[group].count; i++) {
+      insert("s", group, expected[group].sum / expected[group].count);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Run a query, and store the count and the sum of the value of each
+   row in the group given by the column "group_column", or in the group
+   "group" if the query has no such column. */
+static unsigned long
+run(const char *query, int group_column, unsigned group)
+{
+  static db_handle_t handle;
+  attribute_value_t value;
+  unsigned long calls;
+  db_result_t result;
+  int column;
+
+  result = db_query(&handle, query);
+  if(DB_ERROR(result)) {
+    printf("FAIL query \"%s\": %s\n", query, db_get_result_message(result));
+    exit(1);
+  }
+
+  for(calls = 0; db_processing(&handle); calls++) {
+    result = db_process(&handle);
+    if(result == DB_GOT_ROW) {
+      column = 0;
+      if(group_column) {
+        db_get_value(&value, &handle, column++);
+        group = db_value_to_long(&value);
+        if(group >= GROUPS) {
+          printf("FAIL group %u\n", group);
+          exit(1);
+        }
+      }
+      db_get_value(&value, &handle, column++);
+      found[group].count += db_value_to_long(&value);
+      db_get_value(&value, &handle, column);
+      found[group].sum += db_value_to_long(&value);
+    } else if(result == DB_FINISHED) {
+      break;
+    } else if(DB_ERROR(result)) {
+      printf("FAIL processing of \"%s\": %s\n", query,
+             db_get_result_message(result));
+      exit(1);
+    }
+  }
+  db_free(&handle);
+
+  return calls;
+}
+/*---------------------------------------------------------------------------*/
+static void
+verify(int sorted)
+{
+  unsigned group;
+  unsigned long sum;
+
+  for(group = 0; group < GROUPS; group++) {
+    bench_check("rows in a group", found[group].count, expected[group].count);
+    sum = expected[group].sum;
+    if(sorted) {
+      sum -= sum % expected[group].count;
+    }
+    bench_check("sum of a group", found[group].sum, sum);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_per_group(void)
+{
+  char query[64];
+  unsigned long start, usecs, calls;
+  unsigned group;
+
+  memset(found, 0, sizeof(found));
+  start = bench_usec_now();
+  for(group = calls = 0; group < GROUPS; group++) {
+    snprintf(query, sizeof(query),
+             "SELECT COUNT(v), SUM(v) FROM m WHERE g = %u;", group);
+    calls += run(query, 0, group);
+  }
+  usecs = bench_usec_now() - start;
+
+  printf("%-24s %4u groups %9lu us %7lu db_process calls\n",
+         "query per group", GROUPS, usecs, calls);
+  verify(0);
+}
+/*---------------------------------------------------------------------------*/
+#if DB_FEATURE_GROUP
+static void
+bench_group_by(const char *what, const char *relation, int sorted)
+{
+  char query[64];
+  unsigned long start, usecs, calls;
+
+  snprintf(query, sizeof(query),
+           "SELECT g, COUNT(v), SUM(v) FROM %s GROUP BY g;", relation);
+
+  memset(found, 0, sizeof(found));
+  start = bench_usec_now();
+  calls = run(query, 1, 0);
+  usecs = bench_usec_now() - start;
+
+  printf("%-24s %4u groups %9lu us %7lu db_process calls\n",
+         what, GROUPS, usecs, calls);
+  verify(sorted);
+}
+/*---------------------------------------------------------------------------*/
+static int
+spill_file_exists(void)
+{
+  int fd;
+
+  fd = cfs_open(GROUP_SPILL_FILE ".0", CFS_READ);
+  if(fd < 0) {
+    return 0;
+  }
+  cfs_close(fd);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Free a grouping once it has spilled rows, as an application that
+   stops reading the result would. The spill files must be removed. */
+static void
+abandon_group_by(void)
+{
+  static db_handle_t handle;
+  unsigned long calls;
+
+  if(DB_ERROR(db_query(&handle,
+                       "SELECT g, COUNT(v), SUM(v) FROM m GROUP BY g;"))) {
+    printf("FAIL GROUP BY query\n");
+    exit(1);
+  }
+  for(calls = 0; calls < ROWS && db_processing(&handle) &&
+        !spill_file_exists(); calls++) {
+    if(DB_ERROR(db_process(&handle))) {
+      break;
+    }
+  }
+  if(!spill_file_exists()) {
+    printf("grouping did not spill, nothing to abandon\n");
+    db_free(&handle);
+    return;
+  }
+  db_free(&handle);
+  if(spill_file_exists()) {
+    printf("FAIL an abandoned GROUP BY left its spill files behind\n");
+    bench_errors++;
+  }
+}
+#endif /* DB_FEATURE_GROUP */
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(group_bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+#if DB_FEATURE_GROUP
+  printf("group memory of %u bytes\n", (unsigned)DB_GROUP_MEMORY_SIZE);
+#else
+  printf("grouping disabled\n");
+#endif /* DB_FEATURE_GROUP */
+
+  cfs_coffee_format();
+  db_init();
+  srandom(1);
+
+  populate();
+
+  bench_per_group();
+#if DB_FEATURE_GROUP
+  bench_group_by("GROUP BY", "m", 0);
+  bench_group_by("GROUP BY on inline index", "s", 1);
+  abandon_group_by();
+  /* The grouping after the abandoned one must start afresh. */
+  bench_group_by("GROUP BY again", "m", 0);
+#endif /* DB_FEATURE_GROUP */
+
+  bench_report("results");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
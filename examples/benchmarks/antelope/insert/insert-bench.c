@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of bulk insertion into Antelope relations on Coffee
+ *         on the native platform. Rows are inserted one at a time with
+ *         relation_insert() and in batches with relation_insert_rows(),
+ *         into relations without an index, with a max-heap index and
+ *         with a B+-tree index. The AQL INSERT of one row per query is
+ *         also compared with the INSERT of several rows per query.
+ *         For the max-heap, the bucket loads and writes show the flash
+ *         accesses that the sorted index build saves.
+ *
+ *         Build with "make TARGET=native", or with "BULKSIZE=n" for a
+ *         bulk buffer of n bytes, after a "make clean".
+ */
+
+#include "contiki.h"
+#include "cfs/cfs-coffee.h"
+
+#include "antelope.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROWS        5000U
+#define BATCH       100U
+#define QUERY_ROWS  5U
+#define KEYS        1000U
+
+#define KEY(i)      (((i) * 7919UL) % KEYS)
+
+static attribute_value_t values[BATCH][2];
+
+PROCESS(insert_bench_process, "Antelope insertion benchmark");
+AUTOSTART_PROCESSES(&insert_bench_process);
+/*---------------------------------------------------------------------------*/
+static relation_t *
+create(const char *relation, const char *index)
+{
+  relation_t *rel;
+
+  db_query(NULL, "REMOVE RELATION %s;", relation);
+  db_query(NULL, "CREATE RELATION %s;", relation);
+  db_query(NULL, "CREATE ATTRIBUTE k DOMAIN INT IN %s;", relation);
+  db_query(NULL, "CREATE ATTRIBUTE v DOMAIN LONG IN %s;", relation);
+  if(index != NULL &&
+     DB_ERROR(db_query(NULL, "CREATE INDEX %s.k TYPE %s;", relation, index))) {
+    printf("FAIL creation of a %s index\n", index);
+    exit(1);
+  }
+
+  rel = relation_load((char *)relation);
+  if(rel == NULL) {
+    printf("FAIL loading of %s\n", relation);
+    exit(1);
+  }
+  return rel;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_row(attribute_value_t *row, unsigned long i)
+{
+  row[0].domain = DOMAIN_INT;
+  VALUE_INT(&row[0]) = KEY(i);
+  row[1].domain = DOMAIN_LONG;
+  VALUE_LONG(&row[1]) = i;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what, unsigned long rows, unsigned long usecs)
+{
+  printf("%-26s %6lu rows %9lu us %8lu rows/s\n", what, rows, usecs,
+         usecs ? rows * 1000000UL / usecs : 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+report_buckets(const char *index, struct index_cache_stats *before)
+{
+  struct index_cache_stats after;
+
+  if(index == NULL || strcmp(index, "MAXHEAP") != 0) {
+    return;
+  }
+  index_maxheap_cache_stats(&after);
+  printf("%-26s %6lu bucket loads %6lu bucket writes\n", "",
+         after.misses - before->misses, after.writes - before->writes);
+}
+/*---------------------------------------------------------------------------*/
+/* Count the rows of a key, and check that the index finds them all. */
+static void
+verify(const char *relation, unsigned long rows)
+{
+  static db_handle_t handle;
+  unsigned long found;
+  db_result_t result;
+
+  if(DB_ERROR(db_query(&handle, "SELECT v FROM %s WHERE k = %u;",
+                       relation, (unsigned)KEY(1)))) {
+    printf("FAIL selection from %s\n", relation);
+    exit(1);
+  }
+  found = 0;
+  while(db_processing(&handle)) {
+    result = db_process(&handle);
+    if(result == DB_GOT_ROW) {
+      found++;
+    } else if(result == DB_FINISHED) {
+      break;
+    } else if(DB_ERROR(result)) {
+      printf("FAIL processing: %s\n", db_get_result_message(result));
+      exit(1);
+    }
+  }
+  db_free(&handle);
+  bench_check("rows with the key", found, rows / KEYS);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_single(const char *what, const char *relation, const char *index)
+{
+  struct index_cache_stats stats;
+  relation_t *rel;
+  unsigned long i, start, usecs;
+
+  rel = create(relation, index);
+  index_maxheap_cache_stats(&stats);
+  start = bench_usec_now();
+  for(i = 0; i < ROWS; i++) {
+    set_row(values[0], i);
+    if(DB_ERROR(relation_insert(rel, values[0]))) {
+      printf("FAIL insertion of row %lu\n", i);
+      exit(1);
+    }
+  }
+  usecs = bench_usec_now() - start;
+  report(what, ROWS, usecs);
+  bench_check("cardinality", relation_cardinality(rel), ROWS);
+  relation_release(rel);
+  report_buckets(index, &stats);
+  verify(relation, ROWS);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_bulk(const char *what, const char *relation, const char *index)
+{
+  struct index_cache_stats stats;
+  relation_t *rel;
+  unsigned long i, j, start, usecs;
+
+  rel = create(relation, index);
+  index_maxheap_cache_stats(&stats);
+  start = bench_usec_now();
+  for(i = 0; i < ROWS; i += BATCH) {
+    for(j = 0; j < BATCH; j++) {
+      set_row(values[j], i + j);
+    }
+    if(DB_ERROR(relation_insert_rows(rel, values[0], BATCH))) {
+      printf("FAIL insertion of the batch at row %lu\n", i);
+      exit(1);
+    }
+  }
+  usecs = bench_usec_now() - start;
+  report(what, ROWS, usecs);
+  bench_check("cardinality", relation_cardinality(rel), ROWS);
+  relation_release(rel);
+  report_buckets(index, &stats);
+  verify(relation, ROWS);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_query(const char *what, unsigned rows_per_query)
+{
+  char query[AQL_MAX_QUERY_LENGTH];
+  unsigned long i, start, usecs;
+  unsigned j;
+  int length;
+
+  relation_release(create("r", NULL));
+  start = bench_usec_now();
+  for(i = 0; i < ROWS; i += rows_per_query) {
+    length = snprintf(query, sizeof(query), "INSERT ");
+    for(j = 0; j < rows_per_query; j++) {
+      length += snprintf(query + length, sizeof(query) - length,
+                         "%s(%lu, %lu)", j > 0 ? ", " : "",
+                         KEY(i + j), i + j);
+    }
+    snprintf(query + length, sizeof(query) - length, " INTO r;");
+    if(DB_ERROR(db_query(NULL, "%s", query))) {
+      printf("FAIL query \"%s\"\n", query);
+      exit(1);
+    }
+  }
+  usecs = bench_usec_now() - start;
+  report(what, ROWS, usecs);
+  verify("r", ROWS);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(insert_bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("bulk buffer of %u bytes, %u rows per batch\n",
+         (unsigned)DB_BULK_INSERT_SIZE, BATCH);
+
+  cfs_coffee_format();
+  db_init();
+
+  bench_single("single, no index", "r", NULL);
+  bench_bulk("bulk, no index", "r", NULL);
+  bench_single("single, B+-tree", "r", "BTREE");
+  bench_bulk("bulk, B+-tree", "r", "BTREE");
+  bench_query("AQL, 1 row per query", 1);
+  bench_query("AQL, 5 rows per query", QUERY_ROWS);
+  bench_single("single, max-heap", "r", "MAXHEAP");
+  bench_bulk("bulk, max-heap", "r", "MAXHEAP");
+
+  bench_report("results");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
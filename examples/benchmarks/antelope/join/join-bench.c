@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of joins in Antelope on Coffee on the native
+ *         platform. Two unindexed relations of 10000 rows are joined
+ *         with a hash join, an unindexed relation is joined with a
+ *         relation that has an inline index, and two sorted relations
+ *         with inline indexes are joined with a merge join. Without the
+ *         hash join, only the joins with an indexed right relation run,
+ *         as index joins.
+ *
+ *         Build with "make TARGET=native", with "JOINMEM=n" for n bytes
+ *         of join memory, or with "HASHJOIN=0" to compare with the
+ *         index join, after a "make clean".
+ */
+
+#include "contiki.h"
+#include "cfs/cfs-coffee.h"
+
+#include "antelope.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROWS      10000U
+#define LEFT_KEYS (ROWS / 2)
+#define MAX_KEY   8000U
+
+struct expected {
+  unsigned long rows;
+  unsigned long sum;
+};
+
+static struct expected unsorted;
+static struct expected sorted;
+
+PROCESS(join_bench_process, "Antelope join benchmark");
+AUTOSTART_PROCESSES(&join_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+insert(const char *relation, unsigned key, unsigned value)
+{
+  if(DB_ERROR(db_query(NULL, "INSERT (%u, %u) INTO %s;",
+                       key, value, relation))) {
+    printf("FAIL insert into %s\n", relation);
+    exit(1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+create(const char *relation, const char *value)
+{
+  db_query(NULL, "REMOVE RELATION %s;", relation);
+  db_query(NULL, "CREATE RELATION %s;", relation);
+  db_query(NULL, "CREATE ATTRIBUTE id DOMAIN INT IN %s;", relation);
+  db_query(NULL, "CREATE ATTRIBUTE %s DOMAIN INT IN %s;", value, relation);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The left relations have each key in 0..LEFT_KEYS-1 twice, in row
+ * order. Each right row with key k thus matches the left rows 2k and
+ * 2k+1, whose values sum to 4k+1.
+ */
+static void
+populate(void)
+{
+  unsigned i, key;
+
+  create("l", "a");
+  create("r", "b");
+  create("ls", "c");
+  create("rs", "d");
+
+  /* The inline indexes are ready at once when the relations are
+     empty. */
+  db_query(NULL, "CREATE INDEX ls.id TYPE INLINE;");
+  db_query(NULL, "CREATE INDEX rs.id TYPE INLINE;");
+
+  for(i = 0; i < ROWS; i++) {
+    insert("l", i / 2, i);
+    insert("ls", i / 2, i);
+
+    key = random() % MAX_KEY;
+    insert("r", key, i);
+    if(key < LEFT_KEYS) {
+      unsorted.rows += 2;
+      unsorted.sum += 4 * key + 1 + 2 * i;
+    }
+
+    /* The inline index finds only one of the rows with the same key,
+       so the keys of the indexed right relation are unique. */
+    insert("rs", i, i);
+    if(i < LEFT_KEYS) {
+      sorted.rows += 2;
+      sorted.sum += 4 * i + 1 + 2 * i;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* A finished or freed join must not leave partition files behind. */
+static void
+check_partitions_removed(const char *what)
+{
+  int fd;
+
+  fd = cfs_open(JOIN_PARTITION_FILE ".b0", CFS_READ);
+  if(fd >= 0) {
+    cfs_close(fd);
+    printf("FAIL %s left the join partitions behind\n", what);
+    bench_errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_join(const char *what, const char *query, struct expected *expected)
+{
+  static db_handle_t handle;
+  attribute_value_t value;
+  unsigned long start, usecs, calls, sum;
+  db_result_t result;
+
+  start = bench_usec_now();
+  result = db_query(&handle, query);
+  if(DB_ERROR(result)) {
+    printf("%-24s %s\n", what, db_get_result_message(result));
+    db_free(&handle);
+    return;
+  }
+
+  sum = 0;
+  for(calls = 0; db_processing(&handle); calls++) {
+    result = db_process(&handle);
+    if(result == DB_GOT_ROW) {
+      db_get_value(&value, &handle, 0);
+      sum += db_value_to_long(&value);
+      db_get_value(&value, &handle, 1);
+      sum += db_value_to_long(&value);
+    } else if(result == DB_FINISHED) {
+      break;
+    } else if(DB_ERROR(result)) {
+      printf("FAIL processing of \"%s\": %s\n", query,
+             db_get_result_message(result));
+      exit(1);
+    }
+  }
+  usecs = bench_usec_now() - start;
+
+  printf("%-24s %8lu rows %9lu us %6lu db_process calls\n", what,
+         (unsigned long)handle.current_row, usecs, calls);
+  bench_check("joined rows", handle.current_row, expected->rows);
+  bench_check("sum of the joined values", sum, expected->sum);
+  db_free(&handle);
+  check_partitions_removed(what);
+}
+/*---------------------------------------------------------------------------*/
+/* Free a join after a few processing steps, as an application that
+   stops reading the result would. */
+static void
+abandon_join(const char *query)
+{
+  static db_handle_t handle;
+  int i;
+
+  if(DB_ERROR(db_query(&handle, query))) {
+    db_free(&handle);
+    return;
+  }
+  for(i = 0; i < 100 && db_processing(&handle); i++) {
+    if(DB_ERROR(db_process(&handle))) {
+      break;
+    }
+  }
+  db_free(&handle);
+  check_partitions_removed("an abandoned join");
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(join_bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("join memory of %u bytes, hash join %s\n",
+         (unsigned)DB_JOIN_MEMORY_SIZE,
+         DB_FEATURE_HASH_JOIN ? "enabled" : "disabled");
+
+  cfs_coffee_format();
+  db_init();
+  srandom(1);
+
+  populate();
+
+  bench_join("unindexed", "JOIN l, r ON id PROJECT a, b;", &unsorted);
+  bench_join("indexed right", "JOIN l, rs ON id PROJECT a, d;", &sorted);
+  bench_join("sorted with inline", "JOIN ls, rs ON id PROJECT c, d;",
+             &sorted);
+  abandon_join("JOIN l, r ON id PROJECT a, b;");
+
+  bench_report("results");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
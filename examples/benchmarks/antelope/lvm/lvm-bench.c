@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of the evaluation of predicates by the logic engine
+ *         of Antelope on the native platform. Each predicate is
+ *         evaluated on the same random rows by interpreting its byte
+ *         code after setting the variables by name, as relation.c does
+ *         without the compiler, and by running the compiled program on
+ *         the rows. Both evaluations must give the same results.
+ *
+ *         Build with "make TARGET=native", or with "COMPILER=0" to run
+ *         only the interpreter, after a "make clean".
+ */
+
+#include "contiki.h"
+
+#include "lvm.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROWS        1000U
+#define ROUNDS      1000U
+#define ROW_LENGTH  8
+
+/* The rows hold two INT attributes, a and b, and a LONG attribute c. */
+static unsigned char rows[ROWS][ROW_LENGTH];
+static unsigned char code[DB_VM_BYTECODE_SIZE];
+static lvm_status_t interpreted[ROWS];
+static lvm_instance_t p;
+
+PROCESS(lvm_bench_process, "LVM benchmark");
+AUTOSTART_PROCESSES(&lvm_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+populate(void)
+{
+  unsigned i;
+  unsigned long c;
+
+  for(i = 0; i < ROWS; i++) {
+    rows[i][0] = random() % 4;
+    rows[i][1] = random();
+    rows[i][2] = 0;
+    rows[i][3] = random() % 8;
+    c = random() % 100000;
+    rows[i][4] = c >> 24;
+    rows[i][5] = c >> 16;
+    rows[i][6] = c >> 8;
+    rows[i][7] = c;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_predicate(void)
+{
+  lvm_reset(&p, code, sizeof(code));
+  lvm_register_variable("a", LVM_LONG);
+  lvm_register_variable("b", LVM_LONG);
+  lvm_register_variable("c", LVM_LONG);
+}
+/*---------------------------------------------------------------------------*/
+/* Set the variables by name, as relation.c does for the interpreter. */
+static void
+set_variables(unsigned char *row)
+{
+  operand_value_t value;
+
+  value.l = row[0] << 8 | row[1];
+  lvm_set_variable_value("a", value);
+  value.l = row[2] << 8 | row[3];
+  lvm_set_variable_value("b", value);
+  value.l = (uint32_t)row[4] << 24 | (uint32_t)row[5] << 16 |
+            (uint32_t)row[6] << 8 | row[7];
+  lvm_set_variable_value("c", value);
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what, unsigned long usecs, unsigned long matches)
+{
+  printf("%-12s %9lu us %6lu.%01lu M evaluations/s %5lu matches\n",
+         what, usecs,
+         usecs ? (unsigned long)ROWS * ROUNDS / usecs : 0,
+         usecs ? (unsigned long)ROWS * ROUNDS * 10 / usecs % 10 : 0,
+         matches);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(const char *what)
+{
+  unsigned long start, usecs, matches;
+  unsigned i, round;
+
+  printf("%s\n", what);
+
+  matches = 0;
+  start = bench_usec_now();
+  for(round = 0; round < ROUNDS; round++) {
+    for(i = 0; i < ROWS; i++) {
+      set_variables(rows[i]);
+      interpreted[i] = lvm_execute(&p);
+      matches += interpreted[i] == TRUE;
+    }
+  }
+  usecs = bench_usec_now() - start;
+  report("interpreted", usecs, matches / ROUNDS);
+
+#if DB_FEATURE_LVM_COMPILER
+  lvm_bind_variable("a", 0, 2);
+  lvm_bind_variable("b", 2, 2);
+  lvm_bind_variable("c", 4, 4);
+  if(LVM_ERROR(lvm_compile(&p))) {
+    printf("FAIL compilation\n");
+    bench_errors++;
+    return;
+  }
+
+  matches = 0;
+  start = bench_usec_now();
+  for(round = 0; round < ROUNDS; round++) {
+    for(i = 0; i < ROWS; i++) {
+      matches += lvm_execute_row(&p, rows[i]) == TRUE;
+    }
+  }
+  usecs = bench_usec_now() - start;
+  report("compiled", usecs, matches / ROUNDS);
+
+  for(i = 0; i < ROWS; i++) {
+    if(lvm_execute_row(&p, rows[i]) != interpreted[i]) {
+      printf("FAIL row %u: compiled %d interpreted %d\n", i,
+             (int)lvm_execute_row(&p, rows[i]), (int)interpreted[i]);
+      bench_errors++;
+      break;
+    }
+  }
+#endif /* DB_FEATURE_LVM_COMPILER */
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(lvm_bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  srandom(1);
+  populate();
+
+  start_predicate();
+  lvm_set_relation(&p, LVM_GE);
+  lvm_set_variable(&p, "a");
+  lvm_set_long(&p, 500);
+  bench("a > 500");
+
+  start_predicate();
+  lvm_set_relation(&p, LVM_GEQ);
+  lvm_set_long(&p, 50000);
+  lvm_set_variable(&p, "c");
+  bench("50000 >= c");
+
+  start_predicate();
+  lvm_set_relation(&p, LVM_AND);
+  lvm_set_relation(&p, LVM_GE);
+  lvm_set_variable(&p, "a");
+  lvm_set_long(&p, 100);
+  lvm_set_relation(&p, LVM_LE);
+  lvm_set_variable(&p, "a");
+  lvm_set_long(&p, 900);
+  bench("a > 100 AND a < 900");
+
+  start_predicate();
+  lvm_set_relation(&p, LVM_OR);
+  lvm_set_relation(&p, LVM_GE);
+  lvm_set_op(&p, LVM_MUL);
+  lvm_set_op(&p, LVM_ADD);
+  lvm_set_variable(&p, "a");
+  lvm_set_variable(&p, "b");
+  lvm_set_long(&p, 40);
+  lvm_set_op(&p, LVM_SUB);
+  lvm_set_variable(&p, "c");
+  lvm_set_long(&p, 10);
+  lvm_set_relation(&p, LVM_NOT);
+  lvm_set_relation(&p, LVM_EQ);
+  lvm_set_variable(&p, "b");
+  lvm_set_long(&p, 7);
+  bench("(a + b) * 40 > c - 10 OR NOT b = 7");
+
+  /* The division fails on the rows where b is 0. */
+  start_predicate();
+  lvm_set_relation(&p, LVM_AND);
+  lvm_set_relation(&p, LVM_LE);
+  lvm_set_variable(&p, "a");
+  lvm_set_long(&p, 512);
+  lvm_set_relation(&p, LVM_GE);
+  lvm_set_op(&p, LVM_DIV);
+  lvm_set_variable(&p, "a");
+  lvm_set_variable(&p, "b");
+  lvm_set_long(&p, 100);
+  bench("a < 512 AND a / b > 100");
+
+  bench_report("results");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of the bucket cache of the max-heap index of Antelope
+ *         on Coffee on the native platform. 100000 keys are inserted
+ *         into the index, which holds at most 511 buckets of 128 keys,
+ *         so the insertions that do not fit are counted and left out of
+ *         the lookups. The keys are then looked up in random order, and
+ *         in a round robin over a few keys in different buckets. Finally,
+ *         the index is released and loaded again to check that the
+ *         cached buckets have been written back.
+ *
+ *         Build with "make TARGET=native HEAPCACHE=n" for a cache of n
+ *         buckets after a "make clean", e.g.
+ *
+ *         for n in 1 2 4 8 16 32; do
+ *           make clean; make TARGET=native HEAPCACHE=$n;
+ *           ./maxheap-bench.native;
+ *         done
+ */
+
+#include "contiki.h"
+#include "cfs/cfs-coffee.h"
+
+#include "antelope.h"
+#include "index.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEYS        100000UL
+#define LOOKUPS     10000UL
+#define HOT_KEYS    2
+#define KEY_SPACE   65536UL
+
+/* The keys are a permutation of 0..KEY_SPACE-1 that repeats after
+   KEY_SPACE rows, so each key occurs at most twice. The index stores
+   16-bit tuple ids, and takes a zero key with a zero id for an empty
+   slot, so the row of key i is stored as i + 1. */
+#define KEY(i)      (((i) * 7919UL) % KEY_SPACE)
+#define ROW_ID(i)   ((i) + 1)
+
+static uint8_t occurrences[KEY_SPACE];
+
+PROCESS(maxheap_bench_process, "Antelope max-heap benchmark");
+AUTOSTART_PROCESSES(&maxheap_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what, unsigned long operations, unsigned long usecs,
+       struct index_cache_stats *before)
+{
+  struct index_cache_stats after;
+  unsigned long hits, misses;
+
+  index_maxheap_cache_stats(&after);
+  hits = after.hits - before->hits;
+  misses = after.misses - before->misses;
+  printf("%-12s %6lu ops %9lu us %6lu ns/op, hit rate %3lu%%, "
+         "%lu writes\n", what, operations, usecs,
+         operations ? usecs * 1000 / operations : 0,
+         hits + misses ? hits * 100 / (hits + misses) : 0,
+         after.writes - before->writes);
+}
+/*---------------------------------------------------------------------------*/
+static index_t *
+create_index(char *relation)
+{
+  relation_t *rel;
+  attribute_t *attr;
+
+  db_query(NULL, "REMOVE RELATION %s;", relation);
+  db_query(NULL, "CREATE RELATION %s;", relation);
+  db_query(NULL, "CREATE ATTRIBUTE k DOMAIN INT IN %s;", relation);
+  if(DB_ERROR(db_query(NULL, "CREATE INDEX %s.k TYPE MAXHEAP;",
+                       relation))) {
+    printf("FAIL creation of the max-heap index\n");
+    exit(1);
+  }
+
+  rel = relation_load(relation);
+  attr = rel == NULL ? NULL : relation_attribute_get(rel, "k");
+  if(attr == NULL || attr->index == NULL) {
+    printf("FAIL loading of the max-heap index\n");
+    exit(1);
+  }
+  return attr->index;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_value(attribute_value_t *value, long key)
+{
+  value->domain = DOMAIN_INT;
+  VALUE_INT(value) = key;
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_insert(index_t *index)
+{
+  struct index_cache_stats stats;
+  attribute_value_t value;
+  unsigned long i, start, usecs, failed;
+
+  index_maxheap_cache_stats(&stats);
+  start = bench_usec_now();
+  for(i = failed = 0; i < KEYS; i++) {
+    set_value(&value, KEY(i));
+    if(DB_ERROR(index_insert(index, &value, ROW_ID(i)))) {
+      failed++;
+    } else {
+      occurrences[KEY(i)]++;
+    }
+  }
+  usecs = bench_usec_now() - start;
+
+  report("insert", KEYS, usecs, &stats);
+  printf("%-12s %6lu keys did not fit in the index\n", "", failed);
+}
+/*---------------------------------------------------------------------------*/
+/* Look up a key, and check that all of its rows are found. */
+static void
+lookup(index_t *index, unsigned long key)
+{
+  index_iterator_t iterator;
+  attribute_value_t value;
+  unsigned long found;
+  tuple_id_t id;
+
+  set_value(&value, key);
+  if(DB_ERROR(index_get_iterator(&iterator, index, &value, &value))) {
+    printf("FAIL iteration over key %lu\n", key);
+    exit(1);
+  }
+
+  found = 0;
+  while((id = index_get_next(&iterator)) != INVALID_TUPLE) {
+    if(KEY(id - 1) != key) {
+      printf("FAIL row %lu found for key %lu\n", (unsigned long)id, key);
+      bench_errors++;
+    }
+    found++;
+  }
+  bench_check("rows found for a key", found, occurrences[key]);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_lookup(const char *what, index_t *index, int hot)
+{
+  struct index_cache_stats stats;
+  unsigned long i, start, usecs;
+  unsigned long hot_keys[HOT_KEYS];
+
+  for(i = 0; i < HOT_KEYS; i++) {
+    hot_keys[i] = KEY(random() % KEYS);
+  }
+
+  index_maxheap_cache_stats(&stats);
+  start = bench_usec_now();
+  for(i = 0; i < LOOKUPS; i++) {
+    lookup(index, hot ? hot_keys[i % HOT_KEYS] : KEY(random() % KEYS));
+  }
+  usecs = bench_usec_now() - start;
+
+  report(what, LOOKUPS, usecs, &stats);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(maxheap_bench_process, ev, data)
+{
+  index_t *index;
+  relation_t *rel;
+  attribute_t *attr;
+
+  PROCESS_BEGIN();
+
+  printf("max-heap cache of %u buckets\n", (unsigned)DB_HEAP_CACHE_LIMIT);
+
+  cfs_coffee_format();
+  db_init();
+  srandom(1);
+
+  index = create_index("keys");
+  bench_insert(index);
+  bench_lookup("lookup", index, 0);
+  bench_lookup("hot lookup", index, 1);
+
+  /* Write back the cached buckets, and read the index from storage. */
+  rel = index->rel;
+  attr = index->attr;
+  if(DB_ERROR(index_release(index)) || DB_ERROR(index_load(rel, attr))) {
+    printf("FAIL reloading of the max-heap index\n");
+    exit(1);
+  }
+  bench_lookup("reloaded", attr->index, 0);
+
+  bench_report("results");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of sequential scans in Antelope on Coffee on the
+ *         native platform. A relation of 100000 rows is read row by row
+ *         with storage_get_row(), read with a scan cursor, and queried
+ *         with full-relation selects.
+ *
+ *         Build with "make TARGET=native", or with "SCANBUF=n" for a
+ *         scan buffer of n bytes, after a "make clean".
+ */
+
+#include "contiki.h"
+#include "cfs/cfs-coffee.h"
+
+#include "antelope.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROWS    100000UL
+#define SENSORS 16
+
+static unsigned long value_sum;
+static unsigned long matching_rows;
+
+PROCESS(scan_bench_process, "Antelope scan benchmark");
+AUTOSTART_PROCESSES(&scan_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what, unsigned long rows, unsigned long usecs)
+{
+  printf("%-28s %8lu rows %8lu us %10lu rows/s\n", what, rows, usecs,
+         usecs ? (unsigned long)(rows * 1000000ULL / usecs) : 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+populate(void)
+{
+  unsigned long i, start;
+  unsigned value;
+
+  db_query(NULL, "REMOVE RELATION samples;");
+  db_query(NULL, "CREATE RELATION samples;");
+  db_query(NULL, "CREATE ATTRIBUTE sensor DOMAIN INT IN samples;");
+  db_query(NULL, "CREATE ATTRIBUTE value DOMAIN INT IN samples;");
+
+  start = bench_usec_now();
+  for(i = 0; i < ROWS; i++) {
+    value = random() % 1000;
+    value_sum += value;
+    if(value >= 900) {
+      matching_rows++;
+    }
+    if(DB_ERROR(db_query(NULL, "INSERT (%u, %u) INTO samples;",
+                         (unsigned)(i % SENSORS), value))) {
+      printf("FAIL insert of row %lu\n", i);
+      exit(1);
+    }
+  }
+  report("insert", ROWS, bench_usec_now() - start);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+row_value(storage_row_t row)
+{
+  return row[2] << 8 | row[3];
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_storage(void)
+{
+  relation_t *rel;
+  storage_scan_t scan;
+  unsigned char row[4];
+  storage_row_t row_ptr;
+  tuple_id_t tuple_id;
+  unsigned long rows, sum, start;
+
+  rel = relation_load("samples");
+  if(rel == NULL) {
+    printf("FAIL load of the relation\n");
+    exit(1);
+  }
+
+  start = bench_usec_now();
+  sum = 0;
+  for(tuple_id = 0; storage_get_row(rel, &tuple_id, row) == DB_OK;
+      tuple_id++) {
+    sum += row_value(row);
+  }
+  report("storage_get_row", tuple_id, bench_usec_now() - start);
+  bench_check("storage_get_row rows", tuple_id, ROWS);
+  bench_check("storage_get_row sum", sum, value_sum);
+
+  start = bench_usec_now();
+  sum = rows = 0;
+  if(storage_scan_init(&scan, rel) != DB_OK) {
+    printf("FAIL scan initialization\n");
+    exit(1);
+  }
+  while(storage_scan_next(&scan, &tuple_id, &row_ptr) == DB_OK) {
+    bench_check("scan tuple ID", tuple_id, rows);
+    sum += row_value(row_ptr);
+    rows++;
+  }
+  report("storage_scan_next", rows, bench_usec_now() - start);
+  bench_check("scan rows", rows, ROWS);
+  bench_check("scan sum", sum, value_sum);
+
+  relation_release(rel);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_select(const char *what, const char *query, unsigned long expected)
+{
+  static db_handle_t handle;
+  unsigned long start, calls;
+  db_result_t result;
+
+  start = bench_usec_now();
+  result = db_query(&handle, query);
+  if(DB_ERROR(result)) {
+    printf("FAIL query \"%s\": %s\n", query, db_get_result_message(result));
+    exit(1);
+  }
+  for(calls = 0; db_processing(&handle); calls++) {
+    result = db_process(&handle);
+    if(result == DB_FINISHED) {
+      break;
+    } else if(DB_ERROR(result)) {
+      printf("FAIL processing of \"%s\": %s\n", query,
+             db_get_result_message(result));
+      exit(1);
+    }
+  }
+  report(what, handle.processed_rows, bench_usec_now() - start);
+  printf("%-28s %8lu returned, %lu db_process calls\n", "",
+         (unsigned long)handle.current_row, calls);
+  bench_check("selected rows", handle.current_row, expected);
+  bench_check("processed rows", handle.processed_rows, ROWS);
+  db_free(&handle);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(scan_bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("scan buffer of %u bytes\n", (unsigned)STORAGE_SCAN_BUFFER_SIZE);
+
+  cfs_coffee_format();
+  db_init();
+  srandom(1);
+
+  populate();
+  bench_storage();
+  bench_select("select all", "SELECT sensor, value FROM samples;", ROWS);
+  bench_select("select value >= 900",
+               "SELECT sensor, value FROM samples WHERE value >= 900;",
+               matching_rows);
+  bench_select("select sensor = 3",
+               "SELECT sensor, value FROM samples WHERE sensor = 3;",
+               ROWS / SENSORS);
+
+  bench_report("results");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Timing and result checks shared by the benchmarks on the
+ *         native platform.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+/** The number of failed checks so far. */
+extern int bench_errors;
+
+/**
+ * \brief      The time in microseconds, from an arbitrary start.
+ */
+unsigned long bench_usec_now(void);
+
+/**
+ * \brief      Count an error if a result differs from the expected one.
+ * \param what A description of the result.
+ * \param got  The result.
+ * \param expected The expected result.
+ */
+void bench_check(const char *what, unsigned long got,
+                 unsigned long expected);
+
+/**
+ * \brief      Count an error if a condition does not hold.
+ *
+ *             BENCH_ASSERT() passes the text and the line of the
+ *             condition.
+ */
+void bench_assert(int cond, const char *what, int line);
+
+#define BENCH_ASSERT(cond) bench_assert((cond), #cond, __LINE__)
+
+/**
+ * \brief      Exit with status 1 if any check failed.
+ * \param what What was checked, for the message when none failed.
+ */
+void bench_report(const char *what);
+
+#endif /* BENCH_H */
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of small-record reads and writes through CFS, in
+ *         the patterns of the Antelope storage: appends and reads of
+ *         whole files, random reads, and appends and reads that open
+ *         and close the file for each record.
+ *
+ *         Build with "make TARGET=native" for cfs-posix, or with
+ *         "CFS=mmap" for the memory-mapped backend after a "make
+ *         clean", optionally with "READAHEAD=n" bytes of read-ahead.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define FILENAME    "record-bench.dat"
+#define RECORD_SIZE 32
+#define RECORDS     100000
+#define REOPENS     20000
+
+static char record[RECORD_SIZE];
+
+PROCESS(record_bench_process, "CFS record benchmark");
+AUTOSTART_PROCESSES(&record_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what, unsigned long records, unsigned long usec)
+{
+  printf("%-22s %7lu records in %8lu us, %6lu krecords/s\n",
+         what, records, usec, usec ? records * 1000 / usec : 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+fill(unsigned long i)
+{
+  memset(record, i & 0xff, sizeof(record));
+  memcpy(record, &i, sizeof(i));
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(unsigned long i)
+{
+  unsigned long stored;
+
+  memcpy(&stored, record, sizeof(stored));
+  if(stored != i || (unsigned char)record[RECORD_SIZE - 1] != (i & 0xff)) {
+    if(bench_errors++ == 0) {
+      printf("FAIL record %lu\n", i);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* A closed file must have its exact size on disk, so that no padding
+   is left if the program is stopped before it exits. */
+static void
+check_disk_size(unsigned long records)
+{
+  struct stat st;
+
+  if(stat(FILENAME, &st) < 0 ||
+     (unsigned long)st.st_size != records * RECORD_SIZE) {
+    printf("FAIL size on disk after %lu records\n", records);
+    bench_errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(void)
+{
+  unsigned long start, i, r;
+  int fd;
+
+  cfs_remove(FILENAME);
+  start = bench_usec_now();
+  fd = cfs_open(FILENAME, CFS_WRITE | CFS_APPEND);
+  for(i = 0; i < RECORDS; i++) {
+    fill(i);
+    cfs_write(fd, record, sizeof(record));
+  }
+  cfs_close(fd);
+  report("append", RECORDS, bench_usec_now() - start);
+  check_disk_size(RECORDS);
+
+  start = bench_usec_now();
+  fd = cfs_open(FILENAME, CFS_READ);
+  for(i = 0; i < RECORDS; i++) {
+    if(cfs_read(fd, record, sizeof(record)) != sizeof(record)) {
+      bench_errors++;
+    }
+    check(i);
+  }
+  cfs_close(fd);
+  report("sequential read", RECORDS, bench_usec_now() - start);
+
+  start = bench_usec_now();
+  fd = cfs_open(FILENAME, CFS_READ);
+  for(i = 0; i < RECORDS; i++) {
+    r = random() % RECORDS;
+    cfs_seek(fd, r * RECORD_SIZE, CFS_SEEK_SET);
+    cfs_read(fd, record, sizeof(record));
+    check(r);
+  }
+  cfs_close(fd);
+  report("random read", RECORDS, bench_usec_now() - start);
+
+  start = bench_usec_now();
+  for(i = 0; i < REOPENS; i++) {
+    r = random() % RECORDS;
+    fd = cfs_open(FILENAME, CFS_READ);
+    cfs_seek(fd, r * RECORD_SIZE, CFS_SEEK_SET);
+    cfs_read(fd, record, sizeof(record));
+    cfs_close(fd);
+    check(r);
+  }
+  report("open, read, close", REOPENS, bench_usec_now() - start);
+
+  start = bench_usec_now();
+  for(i = RECORDS; i < RECORDS + REOPENS; i++) {
+    fill(i);
+    fd = cfs_open(FILENAME, CFS_WRITE | CFS_APPEND);
+    cfs_write(fd, record, sizeof(record));
+    cfs_close(fd);
+  }
+  report("open, append, close", REOPENS, bench_usec_now() - start);
+  check_disk_size(RECORDS + REOPENS);
+
+  /* The file must have its exact size after the last close. */
+  fd = cfs_open(FILENAME, CFS_READ);
+  if(cfs_seek(fd, 0, CFS_SEEK_END) !=
+     (cfs_offset_t)(RECORDS + REOPENS) * RECORD_SIZE) {
+    printf("FAIL file size\n");
+    bench_errors++;
+  }
+  cfs_seek(fd, (cfs_offset_t)(RECORDS + REOPENS - 1) * RECORD_SIZE,
+           CFS_SEEK_SET);
+  cfs_read(fd, record, sizeof(record));
+  check(RECORDS + REOPENS - 1);
+  cfs_close(fd);
+  cfs_remove(FILENAME);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(record_bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  srandom(1);
+  bench();
+  bench_report("records");
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
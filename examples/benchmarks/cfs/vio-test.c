@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Conformance test of vectored and asynchronous CFS I/O, and
+ *         benchmark of records written as several buffers with
+ *         cfs_write() against cfs_writev().
+ *
+ *         Build with "make TARGET=native" for the file system of the
+ *         host, or with "CFS=coffee" or "CFS=ram" after a "make clean".
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-async.h"
+#if VIO_TEST_COFFEE
+#include "cfs/cfs-coffee.h"
+#endif
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILENAME   "vio-test.dat"
+/* The RAM file system holds a single file of 4096 bytes. */
+#define TEST_SIZE  2000
+#define BAD_FD     100
+#define RECORDS    150
+#define ROUNDS     200
+
+static char src[TEST_SIZE];
+static char dst[TEST_SIZE + 100];
+static unsigned ticks;
+
+static const unsigned write_lens[] = {0, 1, 7, 100, 0, 256, 600, 1036};
+static const unsigned read_lens[] = {13, 0, 987, 500, 500, 100};
+
+PROCESS(vio_test_process, "Vectored I/O test");
+PROCESS(ticker_process, "Ticker");
+AUTOSTART_PROCESSES(&vio_test_process);
+/*---------------------------------------------------------------------------*/
+static int
+split(struct cfs_iovec *iov, char *buf, const unsigned *lens, int count)
+{
+  int i;
+
+  for(i = 0; i < count; i++) {
+    iov[i].base = buf;
+    iov[i].len = lens[i];
+    buf += lens[i];
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+static int
+open_new(void)
+{
+  cfs_remove(FILENAME);
+  return cfs_open(FILENAME, CFS_READ | CFS_WRITE);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_vectored(void)
+{
+  struct cfs_iovec iov[8];
+  char a[10], b[20];
+  int fd, n;
+
+  fd = open_new();
+  BENCH_ASSERT(fd >= 0);
+
+  n = split(iov, src, write_lens, 8);
+  BENCH_ASSERT(cfs_writev(fd, iov, n) == TEST_SIZE);
+  BENCH_ASSERT(cfs_seek(fd, 0, CFS_SEEK_SET) == 0);
+  memset(dst, 0, sizeof(dst));
+  BENCH_ASSERT(cfs_read(fd, dst, TEST_SIZE) == TEST_SIZE);
+  BENCH_ASSERT(memcmp(src, dst, TEST_SIZE) == 0);
+
+  /* The last buffer is only partly filled at the end of the file. */
+  BENCH_ASSERT(cfs_seek(fd, 0, CFS_SEEK_SET) == 0);
+  memset(dst, 0x55, sizeof(dst));
+  n = split(iov, dst, read_lens, 6);
+  BENCH_ASSERT(cfs_readv(fd, iov, n) == TEST_SIZE);
+  BENCH_ASSERT(memcmp(src, dst, TEST_SIZE) == 0);
+  BENCH_ASSERT(dst[TEST_SIZE] == 0x55);
+
+  /* Overwrite a part in the middle of the file. */
+  memset(a, 'a', sizeof(a));
+  memset(b, 'b', sizeof(b));
+  memcpy(&src[500], a, sizeof(a));
+  memcpy(&src[510], b, sizeof(b));
+  iov[0].base = a;
+  iov[0].len = sizeof(a);
+  iov[1].base = b;
+  iov[1].len = sizeof(b);
+  BENCH_ASSERT(cfs_seek(fd, 500, CFS_SEEK_SET) == 500);
+  BENCH_ASSERT(cfs_writev(fd, iov, 2) == sizeof(a) + sizeof(b));
+  BENCH_ASSERT(cfs_seek(fd, 0, CFS_SEEK_SET) == 0);
+  n = split(iov, dst, read_lens, 5);
+  BENCH_ASSERT(cfs_readv(fd, iov, n) == TEST_SIZE);
+  BENCH_ASSERT(memcmp(src, dst, TEST_SIZE) == 0);
+
+  BENCH_ASSERT(cfs_readv(fd, iov, 0) == 0);
+  BENCH_ASSERT(cfs_writev(fd, iov, 0) == 0);
+  cfs_close(fd);
+
+  BENCH_ASSERT(cfs_readv(BAD_FD, iov, 1) == -1);
+  BENCH_ASSERT(cfs_writev(BAD_FD, iov, 1) == -1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(void)
+{
+  static char payload[16];
+  uint32_t seq;
+  uint16_t crc;
+  struct cfs_iovec iov[3];
+  unsigned long start, t_write, t_writev;
+  int fd, i, j;
+
+  iov[0].base = &seq;
+  iov[0].len = sizeof(seq);
+  iov[1].base = payload;
+  iov[1].len = sizeof(payload);
+  iov[2].base = &crc;
+  iov[2].len = sizeof(crc);
+  crc = 0;
+
+  /* Alternate the rounds, so that both see the same garbage
+     collections in Coffee. */
+  t_write = t_writev = 0;
+  for(i = 0; i < ROUNDS; i++) {
+    start = bench_usec_now();
+    fd = open_new();
+    for(j = 0; j < RECORDS; j++) {
+      seq = j;
+      cfs_write(fd, &seq, sizeof(seq));
+      cfs_write(fd, payload, sizeof(payload));
+      cfs_write(fd, &crc, sizeof(crc));
+    }
+    cfs_close(fd);
+    t_write += bench_usec_now() - start;
+
+    start = bench_usec_now();
+    fd = open_new();
+    for(j = 0; j < RECORDS; j++) {
+      seq = j;
+      cfs_writev(fd, iov, 3);
+    }
+    cfs_close(fd);
+    t_writev += bench_usec_now() - start;
+  }
+
+  printf("%d records of 3 buffers: cfs_write %lu us, cfs_writev %lu us\n",
+         ROUNDS * RECORDS, t_write, t_writev);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(ticker_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_PAUSE();
+    ticks++;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(vio_test_process, ev, data)
+{
+  static struct cfs_async req1, req2;
+  static struct cfs_iovec iov[8];
+  static int fd, n, cancelled;
+
+  PROCESS_BEGIN();
+
+#if VIO_TEST_COFFEE
+  printf("Coffee\n");
+  cfs_coffee_format();
+#endif
+
+  for(n = 0; n < TEST_SIZE; n++) {
+    src[n] = n * 7 + (n >> 8);
+  }
+
+  test_vectored();
+
+  /* Other processes run while a request is carried out. */
+  for(n = 0; n < TEST_SIZE; n++) {
+    src[n] = n * 3 + 1;
+  }
+  fd = open_new();
+  BENCH_ASSERT(fd >= 0);
+  process_start(&ticker_process, NULL);
+  n = split(iov, src, write_lens, 8);
+  cfs_async_write(&req1, fd, iov, n);
+  CFS_ASYNC_WAIT(&req1);
+  process_exit(&ticker_process);
+  BENCH_ASSERT(req1.result == TEST_SIZE);
+  BENCH_ASSERT(ticks >= TEST_SIZE / CFS_ASYNC_STEP_SIZE);
+
+  BENCH_ASSERT(cfs_seek(fd, 0, CFS_SEEK_SET) == 0);
+  memset(dst, 0x55, sizeof(dst));
+  n = split(iov, dst, read_lens, 6);
+  cfs_async_read(&req1, fd, iov, n);
+  CFS_ASYNC_WAIT(&req1);
+  BENCH_ASSERT(req1.result == TEST_SIZE);
+  BENCH_ASSERT(memcmp(src, dst, TEST_SIZE) == 0);
+  BENCH_ASSERT(dst[TEST_SIZE] == 0x55);
+
+  /* Requests complete in the order in which they were submitted. */
+  BENCH_ASSERT(cfs_seek(fd, 0, CFS_SEEK_SET) == 0);
+  memset(dst, 0, sizeof(dst));
+  iov[0].base = dst;
+  iov[0].len = 100;
+  iov[1].base = dst + 1000;
+  iov[1].len = 100;
+  cfs_async_read(&req1, fd, &iov[0], 1);
+  cfs_async_read(&req2, fd, &iov[1], 1);
+  CFS_ASYNC_WAIT(&req1);
+  BENCH_ASSERT(req2.result == 0);
+  CFS_ASYNC_WAIT(&req2);
+  BENCH_ASSERT(req1.result == 100 && req2.result == 100);
+  BENCH_ASSERT(memcmp(src, dst, 100) == 0);
+  BENCH_ASSERT(memcmp(src + 100, dst + 1000, 100) == 0);
+
+  /* A cancelled request does not complete. */
+  cancelled = 0;
+  cfs_async_read(&req1, fd, &iov[0], 1);
+  cfs_async_cancel(&req1);
+  cfs_async_read(&req2, fd, &iov[1], 1);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == cfs_async_event);
+    if(data == &req1) {
+      cancelled++;
+    } else if(data == &req2) {
+      break;
+    }
+  }
+  PROCESS_PAUSE();
+  BENCH_ASSERT(cancelled == 0);
+
+  /* Errors are reported in the result. */
+  cfs_async_read(&req1, BAD_FD, iov, 1);
+  CFS_ASYNC_WAIT(&req1);
+  BENCH_ASSERT(req1.result == -1);
+  cfs_close(fd);
+
+  bench_report("vectored and asynchronous I/O");
+
+  bench();
+  cfs_remove(FILENAME);
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Test and benchmark of the Internet checksum of the native
+ *         platform against the portable byte-at-a-time version of uip.c,
+ *         and of the incremental checksum updates of uiplib.
+ *
+ *         Build with "make TARGET=native SIMD=0", "SIMD=1" (SSE2) or
+ *         "SIMD=2" (AVX2, the default) after a "make clean".
+ */
+
+#include "contiki.h"
+#include "net/uip.h"
+#include "net/uiplib.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROUNDS       200000
+#define RANDOM_TESTS 20000
+#define MAX_LEN      1500
+
+#define BUF ((struct uip_udpip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+static uint8_t testbuf[MAX_LEN + 32];
+
+PROCESS(chksum_test_process, "checksum test");
+AUTOSTART_PROCESSES(&chksum_test_process);
+/*---------------------------------------------------------------------------*/
+/* The portable checksum of uip.c. */
+static uint16_t
+ref_chksum(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  uint16_t t;
+  const uint8_t *dataptr;
+  const uint8_t *last_byte;
+
+  dataptr = data;
+  last_byte = data + len - 1;
+
+  while(dataptr < last_byte) {
+    t = (dataptr[0] << 8) + dataptr[1];
+    sum += t;
+    if(sum < t) {
+      sum++;
+    }
+    dataptr += 2;
+  }
+
+  if(dataptr == last_byte) {
+    t = (dataptr[0] << 8) + 0;
+    sum += t;
+    if(sum < t) {
+      sum++;
+    }
+  }
+  return sum;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(const char *what, unsigned got, unsigned expected, unsigned len)
+{
+  if(got != expected) {
+    printf("FAIL %s len %u: got 0x%04x expected 0x%04x\n",
+           what, len, got, expected);
+    bench_errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_random(void)
+{
+  int i;
+  uint16_t len, offset;
+
+  for(i = 0; i < RANDOM_TESTS; i++) {
+    len = random() % (MAX_LEN + 1);
+    offset = random() % 32;
+    memset(testbuf, random() & 1 ? 0xff : 0x00, sizeof(testbuf));
+    if(random() % 4) {
+      int j;
+      for(j = 0; j < len; j++) {
+        testbuf[offset + j] = random();
+      }
+    }
+    check("uip_chksum",
+          uip_chksum((uint16_t *)&testbuf[offset], len),
+          uip_htons(ref_chksum(0, &testbuf[offset], len)), len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+setup_udp(uint16_t len)
+{
+  int i;
+
+  memset(uip_buf, 0, UIP_LLH_LEN + UIP_IPUDPH_LEN);
+  BUF->vhl = 0x45;
+  BUF->len[0] = (UIP_IPUDPH_LEN + len) >> 8;
+  BUF->len[1] = (UIP_IPUDPH_LEN + len) & 0xff;
+  BUF->ttl = 64;
+  BUF->proto = UIP_PROTO_UDP;
+  uip_ipaddr(&BUF->srcipaddr, 192, 168, 1, 2);
+  uip_ipaddr(&BUF->destipaddr, 10, 0, 0, 1);
+  BUF->srcport = UIP_HTONS(1234);
+  BUF->destport = UIP_HTONS(5678);
+  BUF->udplen = UIP_HTONS(UIP_UDPH_LEN + len);
+  for(i = 0; i < len; i++) {
+    uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN + i] = random();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_packets(void)
+{
+  uint16_t len, sum;
+  uip_ipaddr_t addr;
+  int i;
+
+  for(i = 0; i < 1000; i++) {
+    len = random() % (UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN);
+    setup_udp(len);
+
+    sum = ref_chksum(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
+    check("uip_ipchksum", uip_ipchksum(),
+          (sum == 0) ? 0xffff : uip_htons(sum), len);
+
+#if UIP_UDP_CHECKSUMS
+    sum = UIP_UDPH_LEN + len + UIP_PROTO_UDP;
+    sum = ref_chksum(sum, (uint8_t *)&BUF->srcipaddr,
+                     2 * sizeof(uip_ipaddr_t));
+    sum = ref_chksum(sum, &uip_buf[UIP_LLH_LEN + UIP_IPH_LEN],
+                     UIP_UDPH_LEN + len);
+    check("uip_udpchksum", uip_udpchksum(),
+          (sum == 0) ? 0xffff : uip_htons(sum), len);
+#endif /* UIP_UDP_CHECKSUMS */
+
+    /* Incremental updates must give a header that sums to 0xffff. */
+    BUF->ipchksum = ~(uip_ipchksum());
+    BUF->ipchksum = uiplib_chksum_update16(BUF->ipchksum,
+                                           UIP_HTONS(BUF->ttl << 8),
+                                           UIP_HTONS((BUF->ttl - 1) << 8));
+    BUF->ttl--;
+    check("uiplib_chksum_update16", uip_ipchksum(), 0xffff, len);
+
+    uip_ipaddr(&addr, random(), random(), random(), random());
+    BUF->ipchksum = uiplib_chksum_update(BUF->ipchksum, &BUF->srcipaddr,
+                                         &addr, sizeof(addr));
+    uip_ipaddr_copy(&BUF->srcipaddr, &addr);
+    check("uiplib_chksum_update", uip_ipchksum(), 0xffff, len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(uint16_t len)
+{
+  unsigned long start, ref_time, arch_time;
+  volatile uint16_t sink;
+  int i;
+
+  for(i = 0; i < len; i++) {
+    testbuf[i] = random();
+  }
+
+  start = bench_usec_now();
+  for(i = 0; i < ROUNDS; i++) {
+    sink = ref_chksum(i, testbuf, len);
+  }
+  ref_time = bench_usec_now() - start;
+
+  start = bench_usec_now();
+  for(i = 0; i < ROUNDS; i++) {
+    sink = uip_chksum((uint16_t *)testbuf, len);
+  }
+  arch_time = bench_usec_now() - start;
+  (void)sink;
+
+  printf("len %4u: reference %lu us, native %lu us (%lu.%02lux)\n",
+         len, ref_time, arch_time,
+         arch_time ? ref_time / arch_time : 0,
+         arch_time ? (ref_time * 100 / arch_time) % 100 : 0);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(chksum_test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+#ifdef UIP_ARCH_CONF_CHKSUM_SIMD
+  printf("uip_arch checksum, SIMD level %d\n", UIP_ARCH_CONF_CHKSUM_SIMD);
+#else
+  printf("uip_arch checksum, default SIMD level\n");
+#endif
+
+  srandom(1);
+  test_random();
+  test_packets();
+  bench_report("checksums");
+
+  bench(20);
+  bench(64);
+  bench(576);
+  bench(1280);
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of file reservations in Coffee on the native
+ *         platform while its storage of 1 Mbyte is filled with
+ *         thousands of files of mixed sizes. The storage is first
+ *         filled until a hundred reservations in a row fail, and the
+ *         share of the storage that was reserved shows how much space
+ *         the allocation leaves unused. The reservation times are
+ *         reported for each quarter of the storage. Then the storage
+ *         is formatted and half filled, and files are removed and
+ *         created at random, so that the garbage collector must run.
+ *         The first bytes of every file are checked after each phase.
+ *
+ *         Build with "make TARGET=native BESTFIT=1" to reserve files
+ *         in the smallest free extent after a "make clean", or with
+ *         "BESTFIT=0" to scan the file headers for the first one.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "cfs-coffee-arch.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FILES      4096
+#define MAX_FAILURES   100
+#define CHURN_ROUNDS   4000
+#define SIGNATURE_SIZE 16
+
+struct live_file {
+  unsigned id;
+  unsigned size;
+};
+
+static struct live_file files[MAX_FILES];
+static unsigned file_count;
+static unsigned next_id;
+static unsigned long reserved_bytes;
+
+struct latency {
+  unsigned long max;
+  unsigned long total;
+  unsigned long count;
+  unsigned long failed;
+};
+
+static struct latency latency;
+
+PROCESS(fill_bench_process, "Coffee fill benchmark");
+AUTOSTART_PROCESSES(&fill_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+print_latency(const char *what)
+{
+  printf("%-6s %5lu reservations, %4lu failed, "
+         "worst %5lu us, average %3lu.%02lu us\n", what,
+         latency.count, latency.failed, latency.max,
+         latency.count ? latency.total / latency.count : 0,
+         latency.count ? (latency.total * 100 / latency.count) % 100 : 0);
+  memset(&latency, 0, sizeof(latency));
+}
+/*---------------------------------------------------------------------------*/
+/* Most files are small, and a few are large. */
+static unsigned
+random_size(void)
+{
+  unsigned r;
+
+  r = random() % 50;
+  if(r < 40) {
+    return 16 + random() % 200;
+  } else if(r < 49) {
+    return 512 + random() % 1536;
+  }
+  return 4096 + random() % 12288;
+}
+/*---------------------------------------------------------------------------*/
+static void
+file_name(char *name, unsigned id)
+{
+  sprintf(name, "f%u", id);
+}
+/*---------------------------------------------------------------------------*/
+/* The signature is padded with a non-zero byte, since Coffee takes
+   trailing zero bytes to be unwritten when it finds the end of a file
+   that is not cached in the directory. */
+static void
+signature(char *buf, unsigned id)
+{
+  int n;
+
+  n = snprintf(buf, SIGNATURE_SIZE, "file %u", id);
+  memset(buf + n, '.', SIGNATURE_SIZE - n);
+}
+/*---------------------------------------------------------------------------*/
+static int
+create_file(void)
+{
+  char name[16];
+  char buf[SIGNATURE_SIZE];
+  unsigned long start, t;
+  unsigned size;
+  int fd;
+
+  if(file_count == MAX_FILES) {
+    return -1;
+  }
+
+  file_name(name, next_id);
+  size = random_size();
+
+  start = bench_usec_now();
+  if(cfs_coffee_reserve(name, size) < 0) {
+    latency.failed++;
+    return -1;
+  }
+  t = bench_usec_now() - start;
+  if(t > latency.max) {
+    latency.max = t;
+  }
+  latency.total += t;
+  latency.count++;
+
+  signature(buf, next_id);
+  fd = cfs_open(name, CFS_WRITE);
+  if(fd < 0 || cfs_write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+    printf("FAIL write %s\n", name);
+    bench_errors++;
+  }
+  cfs_close(fd);
+
+  files[file_count].id = next_id++;
+  files[file_count].size = size;
+  file_count++;
+  reserved_bytes += size;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_file(unsigned i)
+{
+  char name[16];
+
+  file_name(name, files[i].id);
+  if(cfs_remove(name) < 0) {
+    printf("FAIL remove %s\n", name);
+    bench_errors++;
+  }
+  reserved_bytes -= files[i].size;
+  files[i] = files[--file_count];
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_files(void)
+{
+  char name[16];
+  char buf[SIGNATURE_SIZE];
+  char expected[SIGNATURE_SIZE];
+  unsigned i;
+  int fd;
+
+  for(i = 0; i < file_count; i++) {
+    file_name(name, files[i].id);
+    signature(expected, files[i].id);
+    fd = cfs_open(name, CFS_READ);
+    if(fd < 0 || cfs_read(fd, buf, sizeof(buf)) != sizeof(buf) ||
+       memcmp(buf, expected, sizeof(buf)) != 0) {
+      printf("FAIL content of %s\n", name);
+      bench_errors++;
+    }
+    cfs_close(fd);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_usage(void)
+{
+  printf("       %u files of %lu kbytes, %lu%% of the storage\n",
+         file_count, reserved_bytes / 1024,
+         reserved_bytes * 100 / COFFEE_SIZE);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(fill_bench_process, ev, data)
+{
+  static unsigned failures, round;
+  static char what[8];
+  unsigned quarter;
+
+  PROCESS_BEGIN();
+
+  printf("Coffee fill benchmark, %s\n", COFFEE_BEST_FIT ?
+         "best fit from the sector page counts" :
+         "first fit from the file headers");
+
+  cfs_coffee_format();
+  srandom(1);
+
+  quarter = 1;
+  for(failures = 0; failures < MAX_FAILURES && file_count < MAX_FILES;) {
+    if(create_file() < 0) {
+      failures++;
+    } else {
+      failures = 0;
+    }
+    if(reserved_bytes * 4 >= quarter * COFFEE_SIZE) {
+      sprintf(what, "%u%%", quarter * 25);
+      print_latency(what);
+      quarter++;
+    }
+  }
+  print_latency("full");
+  print_usage();
+  check_files();
+
+  /* Replace files one at a time in a half full storage. */
+  cfs_coffee_format();
+  file_count = 0;
+  reserved_bytes = 0;
+  while(reserved_bytes * 2 < COFFEE_SIZE) {
+    create_file();
+  }
+  memset(&latency, 0, sizeof(latency));
+  for(round = 0; round < CHURN_ROUNDS; round++) {
+    remove_file(random() % file_count);
+    create_file();
+    PROCESS_PAUSE();
+  }
+  print_latency("churn");
+  print_usage();
+  check_files();
+
+  bench_report("files");
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of the latency of file creation on Coffee on the
+ *         native platform when the storage is filled with obsolete
+ *         files. A set of files of random sizes is kept alive while
+ *         one of them at a time is replaced by a new file. The worst
+ *         and the average times of a reservation, an open and a write
+ *         are reported, together with the total run time and the number
+ *         of reservations that failed because no sector could be
+ *         erased. The contents of all files are checked at the end.
+ *
+ *         Build with "make TARGET=native GC=1" to collect garbage in a
+ *         process between the file operations after a "make clean", or
+ *         with "GC=0" to only collect garbage when a reservation fails.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "cfs-coffee-arch.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILES        96
+#define ROUNDS       6000
+#define MIN_SIZE     1024
+#define MAX_SIZE     8192
+#define CHUNK_SIZE   256
+
+struct live_file {
+  unsigned id;
+  unsigned size;		/* 0 if the reservation failed. */
+};
+
+static struct live_file files[FILES];
+static unsigned next_id;
+static unsigned failed_reserves;
+
+struct latency {
+  unsigned long max;
+  unsigned long total;
+  unsigned long count;
+};
+
+static struct latency reserve_latency, open_latency, write_latency;
+
+PROCESS(gc_bench_process, "Coffee GC benchmark");
+AUTOSTART_PROCESSES(&gc_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+account(struct latency *l, unsigned long start)
+{
+  unsigned long t;
+
+  t = bench_usec_now() - start;
+  if(t > l->max) {
+    l->max = t;
+  }
+  l->total += t;
+  l->count++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_latency(const char *what, struct latency *l)
+{
+  printf("%-8s worst %6lu us, average %4lu.%02lu us\n", what, l->max,
+         l->count ? l->total / l->count : 0,
+         l->count ? (l->total * 100 / l->count) % 100 : 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+file_name(char *name, unsigned slot)
+{
+  sprintf(name, "slot%u", slot);
+}
+/*---------------------------------------------------------------------------*/
+static void
+fill_chunk(char *buf, unsigned id, unsigned offset, unsigned len)
+{
+  unsigned i;
+
+  for(i = 0; i < len; i++) {
+    buf[i] = (id * 31 + offset + i) & 0xff;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+create_file(unsigned slot)
+{
+  char name[16];
+  char buf[CHUNK_SIZE];
+  unsigned long start;
+  unsigned offset, len;
+  int fd;
+
+  file_name(name, slot);
+  files[slot].id = next_id++;
+  files[slot].size = MIN_SIZE + random() % (MAX_SIZE - MIN_SIZE + 1);
+
+  start = bench_usec_now();
+  if(cfs_coffee_reserve(name, files[slot].size) < 0) {
+    files[slot].size = 0;
+    failed_reserves++;
+    return;
+  }
+  account(&reserve_latency, start);
+
+  start = bench_usec_now();
+  fd = cfs_open(name, CFS_WRITE);
+  account(&open_latency, start);
+  if(fd < 0) {
+    printf("FAIL open %s\n", name);
+    bench_errors++;
+    return;
+  }
+
+  for(offset = 0; offset < files[slot].size; offset += len) {
+    len = files[slot].size - offset;
+    if(len > CHUNK_SIZE) {
+      len = CHUNK_SIZE;
+    }
+    fill_chunk(buf, files[slot].id, offset, len);
+    start = bench_usec_now();
+    if(cfs_write(fd, buf, len) != len) {
+      printf("FAIL write %s\n", name);
+      bench_errors++;
+      break;
+    }
+    account(&write_latency, start);
+  }
+  cfs_close(fd);
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_file(unsigned slot)
+{
+  char name[16];
+  char buf[CHUNK_SIZE];
+  char expected[CHUNK_SIZE];
+  unsigned offset, len;
+  int fd;
+
+  file_name(name, slot);
+  fd = cfs_open(name, CFS_READ);
+  if(files[slot].size == 0) {
+    if(fd >= 0) {
+      printf("FAIL %s exists after a failed reservation\n", name);
+      bench_errors++;
+      cfs_close(fd);
+    }
+    return;
+  }
+  if(fd < 0) {
+    printf("FAIL open %s for reading\n", name);
+    bench_errors++;
+    return;
+  }
+  for(offset = 0; offset < files[slot].size; offset += len) {
+    len = files[slot].size - offset;
+    if(len > CHUNK_SIZE) {
+      len = CHUNK_SIZE;
+    }
+    fill_chunk(expected, files[slot].id, offset, len);
+    if(cfs_read(fd, buf, len) != len || memcmp(buf, expected, len) != 0) {
+      printf("FAIL content of %s at offset %u\n", name, offset);
+      bench_errors++;
+      break;
+    }
+  }
+  if(cfs_read(fd, buf, 1) != 0) {
+    printf("FAIL size of %s\n", name);
+    bench_errors++;
+  }
+  cfs_close(fd);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(gc_bench_process, ev, data)
+{
+  static unsigned long start;
+  static unsigned round;
+  char name[16];
+  unsigned slot;
+
+  PROCESS_BEGIN();
+
+  printf("Coffee GC benchmark, %s garbage collection\n",
+         COFFEE_INCREMENTAL_GC ? "incremental" : "synchronous");
+
+  cfs_coffee_format();
+  srandom(1);
+
+  for(slot = 0; slot < FILES; slot++) {
+    create_file(slot);
+  }
+
+  memset(&reserve_latency, 0, sizeof(reserve_latency));
+  memset(&open_latency, 0, sizeof(open_latency));
+  memset(&write_latency, 0, sizeof(write_latency));
+
+  start = bench_usec_now();
+  for(round = 0; round < ROUNDS && bench_errors == 0; round++) {
+    slot = random() % FILES;
+    file_name(name, slot);
+    if(cfs_remove(name) < 0 && files[slot].size > 0) {
+      printf("FAIL remove %s\n", name);
+      bench_errors++;
+    }
+    create_file(slot);
+
+    /* Let the other processes run between the file operations. */
+    PROCESS_PAUSE();
+  }
+  printf("%u files replaced in %lu ms, %u reservations failed\n",
+         round, (bench_usec_now() - start) / 1000, failed_reserves);
+  print_latency("reserve", &reserve_latency);
+  print_latency("open", &open_latency);
+  print_latency("write", &write_latency);
+
+  for(slot = 0; slot < FILES; slot++) {
+    check_file(slot);
+  }
+
+  bench_report("files");
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
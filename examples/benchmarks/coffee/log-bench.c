@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of small writes that modify files in Coffee on the
+ *         native platform. Sensor records are appended to a file whose
+ *         header record is updated now and then, and a file is
+ *         rewritten in short writes. The bytes written to micro log
+ *         records and copied when merging the logs are reported in
+ *         relation to the bytes written by the application, and the
+ *         files are checked against copies in memory. Finally, a file
+ *         is modified through two file descriptors and read through a
+ *         third, which must see the buffered writes of the others.
+ *         With write buffers, buffered data that cannot be written
+ *         because the storage is full must be reported by
+ *         cfs_coffee_sync() and cfs_close(), and must be kept until
+ *         the storage has room again.
+ *
+ *         Build with "make TARGET=native WBUF=n" for write buffers of
+ *         n bytes after a "make clean", with n = 0 to write one log
+ *         record per cfs_write().
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "cfs-coffee-arch.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILE_SIZE     (32 * 1024U)
+#define RECORD_SIZE   12
+#define RECORDS       2000
+#define HEADER_EVERY  100
+#define REWRITE_CHUNK 16
+
+static char shadow[FILE_SIZE];
+static unsigned long written;
+
+PROCESS(log_bench_process, "Coffee log benchmark");
+AUTOSTART_PROCESSES(&log_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+write_at(int fd, cfs_offset_t offset, const char *buf, unsigned size)
+{
+  if(cfs_seek(fd, offset, CFS_SEEK_SET) != offset ||
+     cfs_write(fd, buf, size) != size) {
+    printf("FAIL write of %u bytes at %lu\n", size, (unsigned long)offset);
+    bench_errors++;
+    return;
+  }
+  memcpy(&shadow[offset], buf, size);
+  written += size;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_file(const char *name, cfs_offset_t size)
+{
+  static char buf[FILE_SIZE];
+  int fd;
+
+  fd = cfs_open(name, CFS_READ);
+  if(fd < 0) {
+    printf("FAIL open %s\n", name);
+    bench_errors++;
+    return;
+  }
+  if(cfs_read(fd, buf, size) != size || memcmp(buf, shadow, size) != 0) {
+    printf("FAIL content of %s\n", name);
+    bench_errors++;
+  }
+  cfs_close(fd);
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what, unsigned long start)
+{
+  unsigned long t, log_bytes;
+
+  t = bench_usec_now() - start;
+  printf("%-8s %6lu bytes written in %6lu us\n", what, written, t);
+#if COFFEE_STATS
+  log_bytes = cfs_coffee_stats.log_records * COFFEE_PAGE_SIZE;
+  printf("         %6lu log records, %lu merges of %lu bytes, "
+         "%lu.%02lu bytes per byte written\n",
+         cfs_coffee_stats.log_records, cfs_coffee_stats.merges,
+         cfs_coffee_stats.merged_bytes,
+         (log_bytes + cfs_coffee_stats.merged_bytes) / written,
+         (log_bytes + cfs_coffee_stats.merged_bytes) * 100 / written % 100);
+  memset(&cfs_coffee_stats, 0, sizeof(cfs_coffee_stats));
+#else
+  (void)log_bytes;
+#endif
+  written = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sensor_log(void)
+{
+  char record[RECORD_SIZE];
+  unsigned long start;
+  cfs_offset_t end;
+  unsigned i;
+  int fd;
+
+  if(cfs_coffee_reserve("sensors", FILE_SIZE) < 0) {
+    printf("FAIL reserve sensors\n");
+    bench_errors++;
+    return;
+  }
+  fd = cfs_open("sensors", CFS_READ | CFS_WRITE);
+  if(fd < 0) {
+    printf("FAIL open sensors\n");
+    bench_errors++;
+    return;
+  }
+
+  start = bench_usec_now();
+  end = RECORD_SIZE;
+  memset(record, 0, sizeof(record));
+  write_at(fd, 0, record, sizeof(record));
+  for(i = 0; i < RECORDS && end + RECORD_SIZE <= FILE_SIZE; i++) {
+    if(i % HEADER_EVERY == 0) {
+      /* The header holds the number of records. */
+      snprintf(record, sizeof(record), "count %u", i);
+      write_at(fd, 0, record, sizeof(record));
+    }
+    snprintf(record, sizeof(record), "r%u:%ld", i, random() % 1000);
+    write_at(fd, end, record, sizeof(record));
+    end += RECORD_SIZE;
+  }
+  cfs_close(fd);
+  report("sensors", start);
+
+  check_file("sensors", end);
+}
+/*---------------------------------------------------------------------------*/
+static void
+rewrite(void)
+{
+  char chunk[REWRITE_CHUNK];
+  unsigned long start;
+  cfs_offset_t offset;
+  unsigned i;
+  int fd;
+
+  fd = cfs_open("rewrite", CFS_WRITE);
+  if(fd < 0) {
+    printf("FAIL open rewrite\n");
+    bench_errors++;
+    return;
+  }
+  memset(shadow, 'a', sizeof(shadow));
+  if(cfs_write(fd, shadow, sizeof(shadow)) != sizeof(shadow)) {
+    printf("FAIL write rewrite\n");
+    bench_errors++;
+  }
+  cfs_close(fd);
+
+  fd = cfs_open("rewrite", CFS_READ | CFS_WRITE);
+  start = bench_usec_now();
+  for(offset = 0; offset < FILE_SIZE; offset += REWRITE_CHUNK) {
+    for(i = 0; i < REWRITE_CHUNK; i++) {
+      chunk[i] = 'b' + (offset / REWRITE_CHUNK + i) % 20;
+    }
+    write_at(fd, offset, chunk, sizeof(chunk));
+  }
+  cfs_close(fd);
+  report("rewrite", start);
+
+  check_file("rewrite", FILE_SIZE);
+}
+/*---------------------------------------------------------------------------*/
+static void
+shared_fds(void)
+{
+  char chunk[8];
+  cfs_offset_t offset;
+  unsigned i;
+  int fds[2];
+  int fd;
+
+  fd = cfs_open("shared", CFS_WRITE);
+  memset(shadow, 'a', 4096);
+  if(fd < 0 || cfs_write(fd, shadow, 4096) != 4096) {
+    printf("FAIL write shared\n");
+    bench_errors++;
+  }
+  cfs_close(fd);
+
+  fds[0] = cfs_open("shared", CFS_READ | CFS_WRITE);
+  fds[1] = cfs_open("shared", CFS_READ | CFS_WRITE);
+  for(i = 1; i <= 400; i++) {
+    offset = random() % (4096 - sizeof(chunk));
+    memset(chunk, 'b' + i % 20, sizeof(chunk));
+    write_at(fds[random() % 2], offset, chunk, sizeof(chunk));
+    if(i % 50 == 0) {
+      check_file("shared", 4096);
+    }
+  }
+  cfs_close(fds[0]);
+  cfs_close(fds[1]);
+  written = 0;
+
+  check_file("shared", 4096);
+}
+/*---------------------------------------------------------------------------*/
+#if COFFEE_WRITE_BUFFER_SIZE
+#define FILL_FILES 64
+#define FULL_RECORD_SIZE 16
+
+static unsigned fill_files;
+
+/* Reserve files until not even a page is left for a log. */
+static void
+fill_storage(void)
+{
+  char name[8];
+  cfs_offset_t size;
+
+  size = COFFEE_SECTOR_SIZE;
+  for(fill_files = 0; fill_files < FILL_FILES && size > 0;) {
+    snprintf(name, sizeof(name), "fill%u", fill_files);
+    if(cfs_coffee_reserve(name, size) < 0) {
+      size /= 2;
+    } else {
+      fill_files++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+empty_storage(void)
+{
+  char name[8];
+
+  while(fill_files > 0) {
+    snprintf(name, sizeof(name), "fill%u", --fill_files);
+    cfs_remove(name);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+full_storage(void)
+{
+  static const char *names[] = { "full0", "full1" };
+  char chunk[8];
+  unsigned i;
+  int fd;
+
+  memset(shadow, 'a', 4096);
+  for(i = 0; i < 2; i++) {
+    fd = cfs_open(names[i], CFS_WRITE);
+    /* Log records that fit in the smallest write buffers. */
+    if(fd < 0 || cfs_write(fd, shadow, 4096) != 4096 ||
+       cfs_coffee_configure_log(names[i], 8 * FULL_RECORD_SIZE,
+                                FULL_RECORD_SIZE) < 0) {
+      printf("FAIL write %s\n", names[i]);
+      bench_errors++;
+    }
+    cfs_close(fd);
+  }
+
+  /* A modification is buffered, and needs a log when it is written. */
+  memset(chunk, 'b', sizeof(chunk));
+  fill_storage();
+  fd = cfs_open(names[0], CFS_READ | CFS_WRITE);
+  write_at(fd, 100, chunk, sizeof(chunk));
+  bench_check("sync fails when full", cfs_coffee_sync() < 0, 1);
+  empty_storage();
+  bench_check("sync fails after removals", cfs_coffee_sync() < 0, 0);
+  bench_check("close fails", cfs_close(fd) < 0, 0);
+  check_file(names[0], 4096);
+
+  fill_storage();
+  fd = cfs_open(names[1], CFS_READ | CFS_WRITE);
+  write_at(fd, 100, chunk, sizeof(chunk));
+  bench_check("close fails when full", cfs_close(fd) < 0, 1);
+  empty_storage();
+  written = 0;
+}
+#endif /* COFFEE_WRITE_BUFFER_SIZE */
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(log_bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("Coffee log benchmark, write buffers of %u bytes\n",
+         (unsigned)COFFEE_WRITE_BUFFER_SIZE);
+
+  cfs_coffee_format();
+  srandom(1);
+#if COFFEE_STATS
+  memset(&cfs_coffee_stats, 0, sizeof(cfs_coffee_stats));
+#endif
+
+  sensor_log();
+  rewrite();
+  shared_fds();
+#if COFFEE_WRITE_BUFFER_SIZE
+  full_storage();
+#endif
+
+  bench_report("files");
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of cfs_open() on Coffee on the native platform as
+ *         the number of files grows. Each file takes one page and holds
+ *         a short record, which is checked after each open. Opens of
+ *         names that do not exist are timed separately, since they
+ *         must search the whole storage when no directory is kept.
+ *         Finally, half of the files are removed, and the remaining
+ *         files are checked after the file cache has been cycled.
+ *
+ *         Build with "make TARGET=native DIRECTORY=n" for a directory
+ *         of n entries after a "make clean", with n = 0 to search the
+ *         file headers on every open.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "cfs-coffee-arch.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FILES   2048
+#define OPENS       2000
+#define RECORD_SIZE 16
+
+static const unsigned file_counts[] = {16, 64, 256, 1024, MAX_FILES};
+
+PROCESS(open_bench_process, "Coffee open benchmark");
+AUTOSTART_PROCESSES(&open_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+file_name(char *name, unsigned i)
+{
+  sprintf(name, "file%u", i);
+}
+/*---------------------------------------------------------------------------*/
+static void
+file_record(char *record, unsigned i)
+{
+  memset(record, 0, RECORD_SIZE);
+  snprintf(record, RECORD_SIZE, "record %u", i);
+  record[RECORD_SIZE - 1] = '.';
+}
+/*---------------------------------------------------------------------------*/
+static void
+create_file(unsigned i)
+{
+  char name[16];
+  char record[RECORD_SIZE];
+  int fd;
+
+  file_name(name, i);
+  file_record(record, i);
+  if(cfs_coffee_reserve(name, RECORD_SIZE) < 0) {
+    printf("FAIL reserve %s\n", name);
+    bench_errors++;
+    return;
+  }
+  fd = cfs_open(name, CFS_WRITE);
+  if(fd < 0 || cfs_write(fd, record, sizeof(record)) != sizeof(record)) {
+    printf("FAIL write %s\n", name);
+    bench_errors++;
+  }
+  cfs_close(fd);
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_file(unsigned i)
+{
+  char name[16];
+  char expected[RECORD_SIZE];
+  char record[RECORD_SIZE];
+  int fd;
+  int r;
+
+  file_name(name, i);
+  file_record(expected, i);
+  fd = cfs_open(name, CFS_READ);
+  if(fd < 0) {
+    return -1;
+  }
+  r = 0;
+  if(cfs_seek(fd, 0, CFS_SEEK_END) != sizeof(record) ||
+     cfs_seek(fd, 0, CFS_SEEK_SET) != 0 ||
+     cfs_read(fd, record, sizeof(record)) != sizeof(record) ||
+     memcmp(record, expected, sizeof(record)) != 0) {
+    printf("FAIL content of %s\n", name);
+    bench_errors++;
+    r = -1;
+  }
+  cfs_close(fd);
+  return r;
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(unsigned files)
+{
+  unsigned long start, hit_time, miss_time;
+  char name[16];
+  unsigned i;
+  int fd;
+
+  start = bench_usec_now();
+  for(i = 0; i < OPENS; i++) {
+    if(check_file(random() % files) < 0) {
+      printf("FAIL open of an existing file\n");
+      bench_errors++;
+    }
+  }
+  hit_time = bench_usec_now() - start;
+
+  start = bench_usec_now();
+  for(i = 0; i < OPENS; i++) {
+    file_name(name, MAX_FILES + i);
+    fd = cfs_open(name, CFS_READ);
+    if(fd >= 0) {
+      printf("FAIL open of a missing file\n");
+      bench_errors++;
+      cfs_close(fd);
+    }
+  }
+  miss_time = bench_usec_now() - start;
+
+  printf("%5u files: open %6lu ns, missing file %8lu ns\n", files,
+         hit_time * 1000 / OPENS, miss_time * 1000 / OPENS);
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_removal(unsigned files)
+{
+  char name[16];
+  unsigned i;
+
+  for(i = 0; i < files; i += 2) {
+    file_name(name, i);
+    if(cfs_remove(name) < 0) {
+      printf("FAIL remove %s\n", name);
+      bench_errors++;
+    }
+  }
+
+  /* Open every file, so that no file remains in the file cache. */
+  for(i = 0; i < files; i++) {
+    if((check_file(i) == 0) != (i % 2 == 1)) {
+      printf("FAIL file %u after removal\n", i);
+      bench_errors++;
+    }
+  }
+
+  /* The space of the removed files can be reused under the same names. */
+  for(i = 0; i < files; i += 2) {
+    create_file(i);
+  }
+  for(i = 0; i < files; i++) {
+    if(check_file(i) < 0) {
+      printf("FAIL file %u after recreation\n", i);
+      bench_errors++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(open_bench_process, ev, data)
+{
+  static unsigned created;
+  unsigned i;
+
+  PROCESS_BEGIN();
+
+  printf("Coffee open benchmark, directory of %u entries\n",
+         (unsigned)COFFEE_DIRECTORY_SIZE);
+
+  cfs_coffee_format();
+  srandom(1);
+
+  for(created = 0, i = 0; i < sizeof(file_counts) / sizeof(file_counts[0]);
+      i++) {
+    while(created < file_counts[i]) {
+      create_file(created++);
+    }
+    bench(created);
+  }
+
+  check_removal(created);
+
+  bench_report("files");
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
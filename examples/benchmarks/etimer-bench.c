@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of event timers on the native platform.
+ *
+ *         Build with "make TARGET=native" for the list backend and
+ *         with "make TARGET=native HEAP=1" (after a "make clean") for
+ *         the heap backend, and compare the output.
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_TIMERS 10000
+#define ROUNDS     10000
+
+/* The timers are set far enough into the future not to expire while
+   the benchmark is running. */
+#define MIN_INTERVAL (60 * CLOCK_SECOND)
+
+static struct etimer timers[NUM_TIMERS];
+static volatile clock_time_t next_expiration;
+
+PROCESS(etimer_bench_process, "etimer benchmark");
+AUTOSTART_PROCESSES(&etimer_bench_process);
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+random_interval(void)
+{
+  return MIN_INTERVAL + random_rand() % (60 * CLOCK_SECOND);
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_next_expiration(void)
+{
+  clock_time_t next, now;
+  int i;
+
+  /* Other processes have timers of their own, so the next expiration
+     time must be no later than that of any of the benchmark timers. */
+  now = clock_time();
+  next = etimer_next_expiration_time();
+  for(i = 0; i < NUM_TIMERS; i++) {
+    if(!etimer_expired(&timers[i]) &&
+       etimer_expiration_time(&timers[i]) - now < next - now) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(etimer_bench_process, ev, data)
+{
+  static unsigned long start;
+  static int i, n;
+
+  PROCESS_BEGIN();
+
+  printf("etimer-bench: %s backend, %d timers\n",
+         ETIMER_HEAP ? "heap" : "list", NUM_TIMERS);
+
+  start = bench_usec_now();
+  for(i = 0; i < NUM_TIMERS; i++) {
+    etimer_set(&timers[i], random_interval());
+  }
+  printf("set:     %7lu ns/op\n", (bench_usec_now() - start) * 1000 / NUM_TIMERS);
+
+  start = bench_usec_now();
+  for(i = 0; i < ROUNDS; i++) {
+    n = random_rand() % NUM_TIMERS;
+    etimer_set(&timers[n], random_interval());
+  }
+  printf("re-set:  %7lu ns/op\n", (bench_usec_now() - start) * 1000 / ROUNDS);
+
+  start = bench_usec_now();
+  for(i = 0; i < ROUNDS; i++) {
+    n = random_rand() % NUM_TIMERS;
+    etimer_stop(&timers[n]);
+    etimer_set(&timers[n], random_interval());
+  }
+  printf("stop+set: %6lu ns/op\n", (bench_usec_now() - start) * 1000 / ROUNDS);
+
+  start = bench_usec_now();
+  for(i = 0; i < ROUNDS; i++) {
+    next_expiration = etimer_next_expiration_time();
+  }
+  printf("next:    %7lu ns/op\n", (bench_usec_now() - start) * 1000 / ROUNDS);
+
+  if(!check_next_expiration()) {
+    printf("etimer-bench: wrong next expiration time\n");
+    exit(1);
+  }
+
+  /* Let the event timer process handle a few expirations, then stop
+     all timers. */
+  for(i = 0; i < 10; i++) {
+    etimer_set(&timers[i], i);
+  }
+  for(i = 0; i < 10; i++) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+  }
+  if(!check_next_expiration()) {
+    printf("etimer-bench: wrong next expiration time after expiry\n");
+    exit(1);
+  }
+
+  for(i = 0; i < NUM_TIMERS; i++) {
+    etimer_stop(&timers[i]);
+  }
+  for(i = 0; i < NUM_TIMERS; i++) {
+    if(!etimer_expired(&timers[i])) {
+      printf("etimer-bench: timer pending after stop\n");
+      exit(1);
+    }
+  }
+  if(!check_next_expiration()) {
+    printf("etimer-bench: wrong next expiration time after stop\n");
+    exit(1);
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of the IPv6 forwarding lookups of uip-ds6 on the
+ *         native platform: a route lookup for the destination followed
+ *         by a neighbor cache lookup for the next hop.
+ *
+ *         Build with "make TARGET=native ds6-bench" for linear lookups
+ *         and with "make TARGET=native HASH=1 ds6-bench" (after a "make
+ *         clean") for hashed lookups, and compare the output. The
+ *         results are checked against a linear search of the tables,
+ *         also after routes have been removed and replaced.
+ */
+
+#include "contiki.h"
+#include "net/uip.h"
+#include "net/uip-ds6.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NEXTHOPS     (UIP_DS6_NBR_NB - 2)
+#define PREFIXES     ((UIP_DS6_ROUTE_NB) / 4)
+#define HOSTS        ((UIP_DS6_ROUTE_NB) - PREFIXES - 2)
+#define DESTINATIONS 1024
+#define ROUNDS       2000
+
+extern uip_ds6_route_t uip_ds6_routing_table[];
+
+static uip_ipaddr_t dest[DESTINATIONS];
+
+PROCESS(ds6_bench_process, "uip-ds6 benchmark");
+AUTOSTART_PROCESSES(&ds6_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+nexthop_addr(uip_ipaddr_t *addr, int n)
+{
+  uip_ip6addr(addr, 0xfe80, 0, 0, 0, 0, 0, 0x100, n + 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_routes(void)
+{
+  uip_ipaddr_t addr, nexthop;
+  int i;
+
+  /* Shorter prefixes first: uip_ds6_route_add() treats a route that
+     matches the first bits of an existing one as already present. */
+  nexthop_addr(&nexthop, 0);
+  uip_ip6addr(&addr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_route_add(&addr, 16, &nexthop, 0);
+  for(i = 0; i < PREFIXES; i++) {
+    nexthop_addr(&nexthop, i % NEXTHOPS);
+    uip_ip6addr(&addr, 0xaaaa, 2, 0, i, 0, 0, 0, 0);
+    uip_ds6_route_add(&addr, 64, &nexthop, 0);
+  }
+  for(i = 0; i < HOSTS; i++) {
+    nexthop_addr(&nexthop, i % NEXTHOPS);
+    uip_ip6addr(&addr, 0xaaaa, 1, 0, 0, 0, 0, i >> 8, i & 0xff);
+    uip_ds6_route_add(&addr, 128, &nexthop, 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_neighbors(void)
+{
+  uip_ipaddr_t addr;
+  uip_lladdr_t lladdr;
+  int i;
+
+  for(i = 0; i < NEXTHOPS; i++) {
+    nexthop_addr(&addr, i);
+    memset(&lladdr, i, sizeof(lladdr));
+    uip_ds6_nbr_add(&addr, &lladdr, 1, NBR_REACHABLE);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_destinations(void)
+{
+  int i, r;
+
+  for(i = 0; i < DESTINATIONS; i++) {
+    r = random();
+    switch(r % 4) {
+    case 0:
+    case 1:
+      uip_ip6addr(&dest[i], 0xaaaa, 1, 0, 0, 0, 0,
+                  (r >> 8) % HOSTS >> 8, (r >> 8) % HOSTS & 0xff);
+      break;
+    case 2:
+      uip_ip6addr(&dest[i], 0xaaaa, 2, 0, (r >> 8) % PREFIXES,
+                  0, 0, 0, r >> 16);
+      break;
+    default:
+      uip_ip6addr(&dest[i], (r & 8) ? 0xaaaa : 0xbbbb, 3, 0, 0,
+                  0, 0, 0, r >> 16);
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The linear search of the original uip_ds6_route_lookup(). */
+static uip_ds6_route_t *
+ref_route_lookup(uip_ipaddr_t *addr)
+{
+  uip_ds6_route_t *r, *found;
+  uint8_t longestmatch;
+
+  found = NULL;
+  longestmatch = 0;
+  for(r = uip_ds6_routing_table; r < uip_ds6_routing_table + UIP_DS6_ROUTE_NB;
+      r++) {
+    if(r->isused && r->length >= longestmatch &&
+       uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length)) {
+      longestmatch = r->length;
+      found = r;
+    }
+  }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_lookups(const char *what)
+{
+  uip_ds6_route_t *r;
+  int i;
+
+  for(i = 0; i < DESTINATIONS; i++) {
+    r = uip_ds6_route_lookup(&dest[i]);
+    if(r != ref_route_lookup(&dest[i])) {
+      printf("FAIL %s: route lookup %d\n", what, i);
+      bench_errors++;
+    } else if(r != NULL && uip_ds6_nbr_lookup(&r->nexthop) == NULL) {
+      printf("FAIL %s: neighbor lookup %d\n", what, i);
+      bench_errors++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+churn(void)
+{
+  uip_ipaddr_t addr, nexthop;
+  int i;
+
+  /* Remove and re-add some host routes. */
+  for(i = 0; i < HOSTS; i += 3) {
+    uip_ip6addr(&addr, 0xaaaa, 1, 0, 0, 0, 0, i >> 8, i & 0xff);
+    uip_ds6_route_rm(uip_ds6_route_lookup(&addr));
+  }
+  check_lookups("removed");
+  for(i = 0; i < HOSTS; i += 6) {
+    nexthop_addr(&nexthop, i % NEXTHOPS);
+    uip_ip6addr(&addr, 0xaaaa, 1, 0, 0, 0, 0, i >> 8, i & 0xff);
+    uip_ds6_route_add(&addr, 128, &nexthop, 0);
+  }
+  check_lookups("re-added");
+
+  /* Clear entries behind the back of uip-ds6, as RPL does, and reuse
+     their slots for other prefixes. */
+  for(i = 0; i < UIP_DS6_ROUTE_NB; i += 5) {
+    if(uip_ds6_routing_table[i].length == 64) {
+      uip_ds6_routing_table[i].isused = 0;
+    }
+  }
+  check_lookups("cleared");
+  for(i = 0; i < PREFIXES; i += 2) {
+    nexthop_addr(&nexthop, 1);
+    uip_ip6addr(&addr, 0xaaaa, 3, 0, i, 0, 0, 0, 0);
+    uip_ds6_route_add(&addr, 64, &nexthop, 0);
+  }
+  check_lookups("replaced");
+
+  nexthop_addr(&nexthop, 1);
+  uip_ds6_route_rm_by_nexthop(&nexthop);
+  check_lookups("removed by next hop");
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(ds6_bench_process, ev, data)
+{
+  unsigned long start, elapsed;
+  uip_ds6_route_t *r;
+  int i, j, found;
+
+  PROCESS_BEGIN();
+
+  printf("uip-ds6 %s lookups, %d routes, %d neighbors\n",
+         UIP_DS6_HASH ? "hashed" : "linear", UIP_DS6_ROUTE_NB,
+         UIP_DS6_NBR_NB);
+
+  srandom(1);
+  add_neighbors();
+  add_routes();
+  make_destinations();
+  check_lookups("initial");
+
+  found = 0;
+  start = bench_usec_now();
+  for(j = 0; j < ROUNDS; j++) {
+    for(i = 0; i < DESTINATIONS; i++) {
+      r = uip_ds6_route_lookup(&dest[i]);
+      if(r != NULL && uip_ds6_nbr_lookup(&r->nexthop) != NULL) {
+        found++;
+      }
+    }
+  }
+  elapsed = bench_usec_now() - start;
+  printf("%d forwarding lookups (%d routed) in %lu us, %lu per second\n",
+         ROUNDS * DESTINATIONS, found, elapsed,
+         (unsigned long)((double)ROUNDS * DESTINATIONS * 1000000 /
+                         (elapsed ? elapsed : 1)));
+
+  churn();
+
+  bench_report("lookups");
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Test of the 6lowpan reassembly on the native platform.
+ *
+ *         Fragments of datagrams from several senders are fed to
+ *         6lowpan interleaved, out of order and duplicated, and the
+ *         reassembled packets are checked. The reassembly counters
+ *         are checked when more senders than reassembly contexts are
+ *         active, and when a reassembly times out.
+ */
+
+#include "contiki.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/rime.h"
+#include "net/sicslowpan.h"
+#include "net/uip.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DATAGRAM_SIZE 200
+#define SENDERS       (SICSLOWPAN_REASS_CONTEXTS - 1)
+
+/* Bytes of the datagram carried by each fragment: the first one
+   carries the IPv6 header and 40 bytes of payload. */
+static const uint16_t frag_start[] = { 0, 80, 160 };
+static const uint16_t frag_end[] = { 80, 160, DATAGRAM_SIZE };
+#define FRAGS (sizeof(frag_start) / sizeof(frag_start[0]))
+static const int frag_order[] = { 2, 2, 0, 1 };
+
+static int received[SICSLOWPAN_REASS_CONTEXTS + 2];
+static int corrupt;
+
+PROCESS(reass_test_process, "6lowpan reassembly test");
+AUTOSTART_PROCESSES(&reass_test_process);
+/*---------------------------------------------------------------------------*/
+static uint8_t
+datagram_byte(int sender, uint16_t i)
+{
+  return (uint8_t)(sender * 31 + i);
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_input(void)
+{
+  uint8_t *p = &uip_buf[UIP_LLH_LEN];
+  int sender;
+  uint16_t i;
+
+  /* The sender is the last byte of the source address. */
+  sender = p[23];
+  if(uip_len != DATAGRAM_SIZE || sender > SICSLOWPAN_REASS_CONTEXTS + 1) {
+    corrupt++;
+    return;
+  }
+  for(i = UIP_IPH_LEN; i < DATAGRAM_SIZE; i++) {
+    if(p[i] != datagram_byte(sender, i)) {
+      corrupt++;
+      return;
+    }
+  }
+  received[sender]++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_output(int mac_status)
+{
+}
+/*---------------------------------------------------------------------------*/
+RIME_SNIFFER(sniffer, sniffer_input, sniffer_output);
+/*---------------------------------------------------------------------------*/
+static void
+input_fragment(int sender, uint16_t tag, int frag)
+{
+  uint8_t *p;
+  uint16_t i, len;
+  rimeaddr_t addr;
+
+  packetbuf_clear();
+  p = packetbuf_dataptr();
+  len = 0;
+  if(frag == 0) {
+    p[len++] = SICSLOWPAN_DISPATCH_FRAG1 | (DATAGRAM_SIZE >> 8);
+    p[len++] = DATAGRAM_SIZE & 0xff;
+    p[len++] = tag >> 8;
+    p[len++] = tag & 0xff;
+    p[len++] = SICSLOWPAN_DISPATCH_IPV6;
+    /* IPv6 header: no next header, to ff02::1 from fe80::<sender>. */
+    memset(&p[len], 0, UIP_IPH_LEN);
+    p[len] = 0x60;
+    p[len + 4] = (DATAGRAM_SIZE - UIP_IPH_LEN) >> 8;
+    p[len + 5] = (DATAGRAM_SIZE - UIP_IPH_LEN) & 0xff;
+    p[len + 6] = UIP_PROTO_NONE;
+    p[len + 7] = 64;
+    p[len + 8] = 0xfe;
+    p[len + 9] = 0x80;
+    p[len + 23] = sender;
+    p[len + 24] = 0xff;
+    p[len + 25] = 0x02;
+    p[len + 39] = 1;
+    len += UIP_IPH_LEN;
+    for(i = UIP_IPH_LEN; i < frag_end[0]; i++) {
+      p[len++] = datagram_byte(sender, i);
+    }
+  } else {
+    p[len++] = SICSLOWPAN_DISPATCH_FRAGN | (DATAGRAM_SIZE >> 8);
+    p[len++] = DATAGRAM_SIZE & 0xff;
+    p[len++] = tag >> 8;
+    p[len++] = tag & 0xff;
+    p[len++] = frag_start[frag] >> 3;
+    for(i = frag_start[frag]; i < frag_end[frag]; i++) {
+      p[len++] = datagram_byte(sender, i);
+    }
+  }
+  packetbuf_set_datalen(len);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.u8[RIMEADDR_SIZE - 1] = sender;
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &addr);
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+static int
+check(int cond, const char *what)
+{
+  printf("%s: %s\n", cond ? "ok" : "FAILED", what);
+  return cond;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(reass_test_process, ev, data)
+{
+  static struct etimer et;
+  static int ok;
+  int s, f;
+
+  PROCESS_BEGIN();
+
+  ok = 1;
+  rime_sniffer_add(&sniffer);
+
+  /* Interleave the fragments of one datagram per sender, out of
+     order, with a duplicate. All senders use the same tag. */
+  for(f = 0; f < FRAGS + 1; f++) {
+    for(s = 1; s <= SENDERS; s++) {
+      input_fragment(s, 42, frag_order[f]);
+    }
+  }
+  for(s = 1; s <= SENDERS; s++) {
+    ok &= check(received[s] == 1, "interleaved datagram reassembled");
+  }
+  ok &= check(corrupt == 0, "reassembled datagrams are intact");
+  ok &= check(sicslowpan_frag_stats.reassembled == SENDERS,
+              "reassembly counter");
+
+  /* Start one more reassembly than there are contexts. */
+  for(s = 1; s <= SICSLOWPAN_REASS_CONTEXTS + 1; s++) {
+    input_fragment(s, 43, 1);
+  }
+  ok &= check(sicslowpan_frag_stats.nocontext == 1,
+              "fragment dropped when all contexts are in use");
+
+  /* Let the reassemblies time out, then check that the contexts are
+     reusable. */
+  etimer_set(&et, (SICSLOWPAN_REASS_MAXAGE + 1) * CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  for(f = 0; f < FRAGS; f++) {
+    input_fragment(SICSLOWPAN_REASS_CONTEXTS + 1, 44, f);
+  }
+  ok &= check(sicslowpan_frag_stats.timeouts == SICSLOWPAN_REASS_CONTEXTS,
+              "timed out reassemblies counted");
+  ok &= check(received[SICSLOWPAN_REASS_CONTEXTS + 1] == 1,
+              "context reused after timeout");
+  ok &= check(corrupt == 0, "reassembled datagrams are intact");
+
+  printf("reassembled %lu timeouts %lu nocontext %lu dropped %lu\n",
+         sicslowpan_frag_stats.reassembled, sicslowpan_frag_stats.timeouts,
+         sicslowpan_frag_stats.nocontext, sicslowpan_frag_stats.dropped);
+
+  exit(ok ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
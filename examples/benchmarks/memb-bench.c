@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of the memb allocator on the native platform.
+ *
+ *         Build with "make TARGET=native" for the default allocator
+ *         and with "make TARGET=native FREELIST=1" (after a "make
+ *         clean") for the free-list allocator, and compare the output.
+ */
+
+#include "contiki.h"
+#include "lib/memb.h"
+#include "lib/random.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROUNDS 200000
+
+struct block {
+  unsigned long data[4];
+};
+
+MEMB(pool8, struct block, 8);
+MEMB(pool64, struct block, 64);
+MEMB(pool512, struct block, 512);
+MEMB(pool4096, struct block, 4096);
+
+static struct block *allocated[4096];
+
+PROCESS(memb_bench_process, "memb benchmark");
+AUTOSTART_PROCESSES(&memb_bench_process);
+/*---------------------------------------------------------------------------*/
+static int
+check_refcount(struct memb *m)
+{
+  struct block *b;
+
+  memb_init(m);
+  b = memb_alloc(m);
+  if(b == NULL || !memb_inmemb(m, b)) {
+    return 0;
+  }
+  /* Freeing an already free block must leave the reference count at
+     zero, and must not put the block on the free list twice. */
+  if(memb_free(m, b) != 0 || memb_free(m, b) != 0) {
+    return 0;
+  }
+  if(memb_free(m, (char *)b + 1) != -1) {
+    return 0;
+  }
+  return memb_alloc(m) == b && memb_alloc(m) != b;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(struct memb *m)
+{
+  unsigned long start, fill_time, churn_time;
+  int i, n, count;
+
+  memb_init(m);
+
+  /* Fill the pool to capacity. */
+  start = bench_usec_now();
+  for(i = 0; i < m->num; i++) {
+    allocated[i] = memb_alloc(m);
+    if(allocated[i] == NULL) {
+      printf("memb-bench: allocation %d of %u failed\n", i, m->num);
+      exit(1);
+    }
+  }
+  fill_time = bench_usec_now() - start;
+  if(memb_alloc(m) != NULL) {
+    printf("memb-bench: allocated beyond capacity\n");
+    exit(1);
+  }
+
+  /* Free half of the blocks, then repeatedly free and reallocate a
+     random block, which is how queuebufs and neighbor entries churn
+     in a running network stack. */
+  for(i = 0; i < m->num; i += 2) {
+    if(memb_free(m, allocated[i]) != 0) {
+      printf("memb-bench: free of block %d failed\n", i);
+      exit(1);
+    }
+  }
+  for(i = 1, count = 0; i < m->num; i += 2) {
+    allocated[count++] = allocated[i];
+  }
+
+  start = bench_usec_now();
+  for(i = 0; i < ROUNDS; i++) {
+    n = random_rand() % count;
+    memb_free(m, allocated[n]);
+    allocated[n] = memb_alloc(m);
+  }
+  churn_time = bench_usec_now() - start;
+
+  printf("pool %4u: fill %6lu ns/alloc, churn %6lu ns/(free+alloc)\n",
+         m->num, fill_time * 1000 / m->num, churn_time * 1000 / ROUNDS);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(memb_bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  printf("memb-bench: %s allocator\n",
+         MEMB_FREELIST ? "free-list" : "linear scan");
+
+  if(!check_refcount(&pool8)) {
+    printf("memb-bench: reference count check failed\n");
+    exit(1);
+  }
+
+  run(&pool8);
+  run(&pool64);
+  run(&pool512);
+  run(&pool4096);
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of the managed memory allocator on the native
+ *         platform.
+ *
+ *         Build with "make TARGET=native" for compaction on free and
+ *         with "make TARGET=native INCREMENTAL=1" (after a "make
+ *         clean") for incremental compaction, and compare the output.
+ */
+
+#include "contiki.h"
+#include "lib/mmem.h"
+#include "lib/random.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_HANDLES 48
+#define MAX_SIZE    160
+#define ROUNDS      100000
+
+static struct mmem handles[NUM_HANDLES];
+static unsigned char used[NUM_HANDLES];
+
+PROCESS(mmem_bench_process, "mmem benchmark");
+AUTOSTART_PROCESSES(&mmem_bench_process);
+/*---------------------------------------------------------------------------*/
+static int
+check_contents(void)
+{
+  unsigned char *p;
+  int i, j;
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    if(used[i]) {
+      p = (unsigned char *)MMEM_PTR(&handles[i]);
+      for(j = 0; j < handles[i].size; j++) {
+        if(p[j] != (unsigned char)(i + j)) {
+          return 0;
+        }
+      }
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mmem_bench_process, ev, data)
+{
+  static unsigned long alloc_time, free_time, max_alloc, max_free, failed;
+  static unsigned long t, start;
+  static struct mmem_stats stats;
+  static int i, n, size;
+
+  PROCESS_BEGIN();
+
+  mmem_init();
+
+  for(i = 0; i < ROUNDS; i++) {
+    n = random_rand() % NUM_HANDLES;
+    if(used[n]) {
+      start = bench_usec_now();
+      mmem_free(&handles[n]);
+      t = bench_usec_now() - start;
+      free_time += t;
+      if(t > max_free) {
+        max_free = t;
+      }
+      used[n] = 0;
+    } else {
+      size = 1 + random_rand() % MAX_SIZE;
+      start = bench_usec_now();
+      if(mmem_alloc(&handles[n], size)) {
+        t = bench_usec_now() - start;
+        alloc_time += t;
+        if(t > max_alloc) {
+          max_alloc = t;
+        }
+        for(size = 0; size < handles[n].size; size++) {
+          ((unsigned char *)MMEM_PTR(&handles[n]))[size] = n + size;
+        }
+        used[n] = 1;
+      } else {
+        failed++;
+      }
+    }
+
+    /* Let the background compaction run now and then. */
+    if(i % 16 == 0) {
+      PROCESS_PAUSE();
+    }
+  }
+
+  if(!check_contents()) {
+    printf("mmem-bench: memory contents were corrupted\n");
+    exit(1);
+  }
+  mmem_stats(&stats);
+
+#if MMEM_CONF_INCREMENTAL
+  printf("mmem-bench: incremental compaction\n");
+#else
+  printf("mmem-bench: compaction on free\n");
+#endif
+  printf("alloc: %lu ns avg, %lu us max\n",
+         alloc_time * 1000 / ROUNDS, max_alloc);
+  printf("free:  %lu ns avg, %lu us max\n",
+         free_time * 1000 / ROUNDS, max_free);
+  printf("failed allocations: %lu\n", failed);
+  printf("avail %u holes %u hole bytes %u largest hole %u\n",
+         stats.avail, stats.holes, stats.hole_bytes, stats.largest_hole);
+
+  while(mmem_compact(256));
+  if(!check_contents()) {
+    printf("mmem-bench: memory contents were corrupted by compaction\n");
+    exit(1);
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
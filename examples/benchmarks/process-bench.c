@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Event latency under an event storm on the native platform.
+ *
+ *         A storm process posts bursts of events to a set of bulk
+ *         processes faster than they can be delivered, while an
+ *         urgent process receives one event every URGENT_INTERVAL
+ *         bursts. The program
+ *         prints a histogram of the time from posting to delivery of
+ *         the urgent events.
+ *
+ *         Build with "make TARGET=native" for the single FIFO event
+ *         queue and with e.g. "make TARGET=native PRIORITIES=2
+ *         BATCH=4" (after a "make clean") for priority queues with
+ *         batch draining, and compare the output.
+ */
+
+#include "contiki.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SAMPLES     5000
+#define BUCKETS     12
+#define NUM_BULK    4
+#define BURST       4
+#define URGENT_INTERVAL 8
+
+/* The busy work done by a bulk process for each event. */
+#define BULK_WORK   500
+
+/* The times at which the pending urgent events were posted. */
+static unsigned long post_time[PROCESS_CONF_NUMEVENTS];
+static unsigned char post_first, post_last;
+static unsigned long histogram[BUCKETS];
+static unsigned long samples, failed_posts, bulk_events;
+static volatile unsigned long sink;
+
+PROCESS(storm_process, "Event storm");
+PROCESS_PRIO(urgent_process, "Urgent", PROCESS_PRIORITIES - 1);
+PROCESS(bulk_process0, "Bulk 0");
+PROCESS(bulk_process1, "Bulk 1");
+PROCESS(bulk_process2, "Bulk 2");
+PROCESS(bulk_process3, "Bulk 3");
+AUTOSTART_PROCESSES(&storm_process);
+
+static struct process * const bulk[NUM_BULK] = {
+  &bulk_process0, &bulk_process1, &bulk_process2, &bulk_process3
+};
+/*---------------------------------------------------------------------------*/
+static void
+print_results(void)
+{
+  int i;
+
+  printf("process-bench: %d priority level(s), batch %d, %d event slots\n",
+         PROCESS_PRIORITIES, PROCESS_EVENT_BATCH, PROCESS_CONF_NUMEVENTS);
+  printf("urgent event latency (us):\n");
+  for(i = 0; i < BUCKETS; i++) {
+    printf("  < %5lu: %6lu\n", 1UL << (i + 1), histogram[i]);
+  }
+  printf("urgent events: %lu delivered, %lu not posted\n",
+         samples, failed_posts);
+  printf("bulk events delivered: %lu\n", bulk_events);
+  printf("queue overflows per level:");
+  for(i = 0; i < PROCESS_PRIORITIES; i++) {
+    printf(" %u", process_overflows[i]);
+  }
+  printf("\n");
+}
+/*---------------------------------------------------------------------------*/
+#define BULK_THREAD(name)                                       \
+PROCESS_THREAD(name, ev, data)                                  \
+{                                                               \
+  static int i;                                                 \
+  PROCESS_BEGIN();                                              \
+  while(1) {                                                    \
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_CONTINUE);     \
+    for(i = 0; i < BULK_WORK; i++) {                            \
+      sink += i;                                                \
+    }                                                           \
+    bulk_events++;                                              \
+  }                                                             \
+  PROCESS_END();                                                \
+}
+BULK_THREAD(bulk_process0)
+BULK_THREAD(bulk_process1)
+BULK_THREAD(bulk_process2)
+BULK_THREAD(bulk_process3)
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(urgent_process, ev, data)
+{
+  unsigned long latency;
+  int i;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_CONTINUE);
+    latency = bench_usec_now() - post_time[post_first];
+    post_first = (post_first + 1) % PROCESS_CONF_NUMEVENTS;
+    for(i = 0; i < BUCKETS - 1 && latency >= (1UL << (i + 1)); i++);
+    histogram[i]++;
+    if(++samples == SAMPLES) {
+      print_results();
+      exit(0);
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(storm_process, ev, data)
+{
+  static int n, round;
+  unsigned long now;
+
+  PROCESS_BEGIN();
+
+  process_start(&urgent_process, NULL);
+  for(n = 0; n < NUM_BULK; n++) {
+    process_start(bulk[n], NULL);
+  }
+
+  while(1) {
+    /* Post an urgent event every few rounds, and a burst of events
+       to the bulk processes in every round. */
+    if(++round == URGENT_INTERVAL) {
+      round = 0;
+      now = bench_usec_now();
+      if(process_post(&urgent_process, PROCESS_EVENT_CONTINUE, NULL) ==
+         PROCESS_ERR_OK) {
+        post_time[post_last] = now;
+        post_last = (post_last + 1) % PROCESS_CONF_NUMEVENTS;
+      } else {
+        failed_posts++;
+      }
+    }
+    for(n = 0; n < BURST; n++) {
+      process_post(bulk[n % NUM_BULK], PROCESS_EVENT_CONTINUE, NULL);
+    }
+
+    process_poll(&storm_process);
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of the packetbuf to queuebuf path on the native
+ *         platform, modelled on the retransmissions of a MAC layer.
+ *
+ *         Build with "make TARGET=native" for copying queuebufs and
+ *         with "make TARGET=native ZEROCOPY=1" (after a "make clean")
+ *         for zero-copy queuebufs, and compare the output.
+ */
+
+#include "contiki.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUEUED      4
+#define DATA_LEN    100
+#define HDR_LEN     12
+#define ACK_LEN     5
+#define ROUNDS      20000
+#define ATTEMPTS    4
+
+static struct queuebuf *queue[QUEUED];
+
+PROCESS(queuebuf_bench_process, "queuebuf benchmark");
+AUTOSTART_PROCESSES(&queuebuf_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+create_packet(int n)
+{
+  uint8_t *p;
+  int i;
+
+  packetbuf_clear();
+  p = packetbuf_dataptr();
+  for(i = 0; i < DATA_LEN; i++) {
+    p[i] = n + i;
+  }
+  packetbuf_set_datalen(DATA_LEN);
+  packetbuf_set_attr(PACKETBUF_ATTR_PACKET_ID, n);
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_packet(int n, const uint8_t *p, int len)
+{
+  int i;
+
+  if(len != DATA_LEN) {
+    return 0;
+  }
+  for(i = 0; i < DATA_LEN; i++) {
+    if(p[i] != (uint8_t)(n + i)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* What the MAC layer does to transmit a queued packet: restore it,
+   prepend a header, hand header and data to the radio, and listen for
+   an acknowledgement. */
+static unsigned
+transmit(struct queuebuf *q)
+{
+  uint8_t *p;
+  unsigned sum;
+
+  queuebuf_to_packetbuf(q);
+  if(!packetbuf_hdralloc(HDR_LEN)) {
+    return 0;
+  }
+  memset(packetbuf_hdrptr(), 0xaa, HDR_LEN);
+
+  /* The radio driver copies the frame to its own buffer. */
+  p = packetbuf_hdrptr();
+  sum = p[0] + p[packetbuf_totlen() - 1];
+
+  packetbuf_clear();
+  memset(packetbuf_dataptr(), 0x55, ACK_LEN);
+  packetbuf_set_datalen(ACK_LEN);
+  return sum;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(queuebuf_bench_process, ev, data)
+{
+  static unsigned long start, t, sum;
+  int i, j, n;
+  uint8_t *p;
+
+  PROCESS_BEGIN();
+
+  /* A layer that snapshots the packetbuf, lets a lower layer use it,
+     restores it, and then modifies it in place must not modify the
+     packets queued by the lower layer. */
+  create_packet(1);
+  queue[0] = queuebuf_new_from_packetbuf();
+  queue[1] = queuebuf_new_from_packetbuf();
+  transmit(queue[1]);
+  queuebuf_to_packetbuf(queue[0]);
+  queuebuf_free(queue[0]);
+  packetbuf_unshare();
+  p = packetbuf_dataptr();
+  memset(p, 0, DATA_LEN);
+  if(!check_packet(1, queuebuf_dataptr(queue[1]),
+                   queuebuf_datalen(queue[1]))) {
+    printf("queuebuf-bench: queued packet modified through packetbuf\n");
+    exit(1);
+  }
+  queuebuf_free(queue[1]);
+
+  start = bench_usec_now();
+  sum = 0;
+  for(i = 0; i < ROUNDS; i++) {
+    n = i % QUEUED;
+    create_packet(n);
+    queue[n] = queuebuf_new_from_packetbuf();
+    if(queue[n] == NULL) {
+      printf("queuebuf-bench: out of queuebufs\n");
+      exit(1);
+    }
+    for(j = 0; j < ATTEMPTS; j++) {
+      sum += transmit(queue[n]);
+    }
+    if(!check_packet(n, queuebuf_dataptr(queue[n]),
+                     queuebuf_datalen(queue[n])) ||
+       queuebuf_attr(queue[n], PACKETBUF_ATTR_PACKET_ID) != n) {
+      printf("queuebuf-bench: queued packet corrupted\n");
+      exit(1);
+    }
+    queuebuf_free(queue[n]);
+  }
+  t = bench_usec_now() - start;
+
+#if QUEUEBUF_ZEROCOPY
+  printf("queuebuf-bench: zero-copy queuebufs\n");
+#else
+  printf("queuebuf-bench: copying queuebufs\n");
+#endif
+  printf("%d packets, %d transmissions each: %lu ns per transmission (sum %lu)\n",
+         ROUNDS, ATTEMPTS, t * 1000 / ROUNDS / ATTEMPTS, sum);
+  printf("packetbuf copies: from %lu to %lu unshare %lu, shared %lu\n",
+         packetbuf_stats.copyfrom, packetbuf_stats.copyto,
+         packetbuf_stats.unshare, packetbuf_stats.shared);
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of the main loop of the native platform: the CPU
+ *         time used while mostly idle and the latency from a packet
+ *         being written to a file descriptor to its select callback
+ *         being called.
+ *
+ *         A child process sends time-stamped datagrams over a socket
+ *         pair at random intervals, while a number of idle pipes are
+ *         registered and a process runs a periodic etimer.
+ *
+ *         Build with "make TARGET=native select-bench" for the select()
+ *         loop and with "make TARGET=native EPOLL=1 select-bench" (after
+ *         a "make clean") for the epoll loop, and compare the output.
+ */
+
+#include "contiki.h"
+#include "select-loop.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#define PACKETS     500
+#define MAX_GAP_US  8000
+#define IDLE_FDS    100
+#define TICK        (CLOCK_SECOND / 20)
+
+static int sock[2];
+static int received;
+static unsigned long latency_sum, latency_max;
+static unsigned long start_usec;
+static struct rusage start_usage;
+
+PROCESS(select_bench_process, "select loop benchmark");
+AUTOSTART_PROCESSES(&select_bench_process);
+/*---------------------------------------------------------------------------*/
+static unsigned long
+usec_cpu(struct rusage *ru)
+{
+  return (ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000UL +
+    ru->ru_utime.tv_usec + ru->ru_stime.tv_usec;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(void)
+{
+  struct rusage usage;
+  unsigned long wall, cpu;
+
+  getrusage(RUSAGE_SELF, &usage);
+  wall = bench_usec_now() - start_usec;
+  cpu = usec_cpu(&usage) - usec_cpu(&start_usage);
+
+  printf("%s loop, %d idle fds\n", SELECT_EPOLL ? "epoll" : "select",
+         IDLE_FDS);
+  printf("%d packets, latency avg %lu us, max %lu us\n",
+         received, latency_sum / received, latency_max);
+  printf("cpu %lu us in %lu us wall (%lu.%lu%%)\n",
+         cpu, wall, cpu * 100 / wall, (cpu * 1000 / wall) % 10);
+}
+/*---------------------------------------------------------------------------*/
+static int
+sock_set_fd(fd_set *rset, fd_set *wset)
+{
+  FD_SET(sock[0], rset);
+  return 1;
+}
+static void
+sock_handle_fd(fd_set *rset, fd_set *wset)
+{
+  unsigned long sent, latency;
+
+  if(FD_ISSET(sock[0], rset)) {
+    if(read(sock[0], &sent, sizeof(sent)) != sizeof(sent)) {
+      printf("short read\n");
+      exit(1);
+    }
+    latency = bench_usec_now() - sent;
+    latency_sum += latency;
+    if(latency > latency_max) {
+      latency_max = latency;
+    }
+    if(++received == PACKETS) {
+      report();
+      exit(0);
+    }
+  }
+}
+static const struct select_callback sock_callback = {
+  sock_set_fd, sock_handle_fd
+};
+/*---------------------------------------------------------------------------*/
+static int idle_fd[IDLE_FDS];
+
+static int
+idle_set_fd(fd_set *rset, fd_set *wset)
+{
+  int i;
+
+  for(i = 0; i < IDLE_FDS; i++) {
+    FD_SET(idle_fd[i], rset);
+  }
+  return 1;
+}
+static void
+idle_handle_fd(fd_set *rset, fd_set *wset)
+{
+  int i;
+
+  for(i = 0; i < IDLE_FDS; i++) {
+    if(FD_ISSET(idle_fd[i], rset)) {
+      printf("idle fd %d ready\n", idle_fd[i]);
+      exit(1);
+    }
+  }
+}
+static const struct select_callback idle_callback = {
+  idle_set_fd, idle_handle_fd
+};
+/*---------------------------------------------------------------------------*/
+static void
+sender(void)
+{
+  unsigned long now;
+  int i;
+
+  srandom(getpid());
+  for(i = 0; i < PACKETS; i++) {
+    usleep(random() % MAX_GAP_US);
+    now = bench_usec_now();
+    if(write(sock[1], &now, sizeof(now)) != sizeof(now)) {
+      _exit(1);
+    }
+  }
+  _exit(0);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(select_bench_process, ev, data)
+{
+  static struct etimer et;
+  int i, p[2];
+
+  PROCESS_BEGIN();
+
+  /* Standard input may be a file, which is always readable. It is
+     registered by main() after the autostart processes are started. */
+  PROCESS_PAUSE();
+  select_set_callback(STDIN_FILENO, NULL);
+
+  for(i = 0; i < IDLE_FDS; i++) {
+    if(pipe(p) < 0) {
+      perror("pipe");
+      exit(1);
+    }
+    idle_fd[i] = p[0];
+    if(!select_set_callback(p[0], i == 0 ? &idle_callback : NULL)) {
+      printf("fd %d does not fit SELECT_CONF_MAX\n", p[0]);
+      exit(1);
+    }
+  }
+
+  if(socketpair(AF_UNIX, SOCK_DGRAM, 0, sock) < 0) {
+    perror("socketpair");
+    exit(1);
+  }
+  if(!select_set_callback(sock[0], &sock_callback)) {
+    printf("fd %d does not fit SELECT_CONF_MAX\n", sock[0]);
+    exit(1);
+  }
+
+  start_usec = bench_usec_now();
+  getrusage(RUSAGE_SELF, &start_usage);
+  if(fork() == 0) {
+    sender();
+  }
+
+  etimer_set(&et, TICK);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    etimer_reset(&et);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -66,7 +66,7 @@ int simRadioChannel = 26;
 
 static const void *pending_data;
 
-PROCESS(cooja_radio_process, "cooja radio process");
+PROCESS_PRIO(cooja_radio_process, "cooja radio process", PROCESS_PRIORITY_NETWORK);
 
 /*---------------------------------------------------------------------------*/
 void
@@ -36,6 +36,15 @@
 
 #include <inttypes.h>
 #include <limits.h>
+#ifndef WIN32_LEAN_AND_MEAN
+#include <sys/select.h>
+#endif
+
+struct select_callback {
+  int  (* set_fd)(fd_set *fdr, fd_set *fdw);
+  void (* handle_fd)(fd_set *fdr, fd_set *fdw);
+};
+int select_set_callback(int fd, const struct select_callback *callback);
 
 #define CC_CONF_REGISTER_ARGS          1
 #define CC_CONF_FUNCTION_POINTER_ARGS  1
@@ -168,6 +177,11 @@ typedef unsigned short uip_stats_t;
 #define UIP_CONF_DS6_AADDR_NBU   0
 #endif /* UIP_CONF_IPV6 */
 
+/* Internet checksum in cpu/native/net/uip_arch.c */
+#ifndef UIP_ARCH_CHKSUM
+#define UIP_ARCH_CHKSUM 1
+#endif /* UIP_ARCH_CHKSUM */
+
 typedef unsigned long clock_time_t;
 #define CLOCK_CONF_SECOND 1000
 #define INFINITE_TIME ULONG_MAX
@@ -50,6 +50,8 @@
 #include "net/tapdev-drv.h"
 #endif /* __CYGWIN__ */
 
+#include "select-loop.h"
+
 #ifdef __CYGWIN__
 PROCINIT(&etimer_process, &tcpip_process, &wpcap_process, &serial_line_process);
 #else /* __CYGWIN__ */
@@ -173,6 +175,26 @@ sprint_ip6(uip_ip6addr_t addr)
 }
 #endif /* UIP_CONF_IPV6 */
 /*---------------------------------------------------------------------------*/
+static int
+stdin_set_fd(fd_set *rset, fd_set *wset)
+{
+  FD_SET(STDIN_FILENO, rset);
+  return 1;
+}
+static void
+stdin_handle_fd(fd_set *rset, fd_set *wset)
+{
+  char c;
+  if(FD_ISSET(STDIN_FILENO, rset)) {
+    if(read(STDIN_FILENO, &c, 1) > 0) {
+      serial_line_input_byte(c);
+    }
+  }
+}
+const static struct select_callback stdin_fd = {
+  stdin_set_fd, stdin_handle_fd
+};
+/*---------------------------------------------------------------------------*/
 int
 main(void)
 {
@@ -301,25 +323,14 @@ main(void)
   }
 #endif
 
+  select_set_callback(STDIN_FILENO, &stdin_fd);
   while(1) {
-    fd_set fds;
     int n;
-    struct timeval tv;
-    
+
     n = process_run();
 
-    tv.tv_sec = 0;
-    tv.tv_usec = 1000;
-    FD_ZERO(&fds);
-    FD_SET(STDIN_FILENO, &fds);
-    select(1, &fds, NULL, NULL, &tv);
+    select_loop_wait(n);
 
-    if(FD_ISSET(STDIN_FILENO, &fds)) {
-      char c;
-      if(read(STDIN_FILENO, &c, 1) > 0) {
-	serial_line_input_byte(c);
-      }
-    }
     etimer_request_poll();
   }
   
@@ -46,7 +46,11 @@
 #define COFFEE_SECTOR_SIZE		65536UL
 #define COFFEE_PAGE_SIZE		256UL
 #define COFFEE_START			0
+#ifdef XMEM_CONF_SIZE
+#define COFFEE_SIZE			((unsigned long)XMEM_CONF_SIZE - COFFEE_START)
+#else
 #define COFFEE_SIZE			((1024UL * 1024UL) - COFFEE_START)
+#endif
 #define COFFEE_NAME_LENGTH		16
 #define COFFEE_DYN_SIZE			16384
 #define COFFEE_MAX_OPEN_FILES		6
@@ -54,8 +58,32 @@
 #define COFFEE_LOG_DIVISOR		4
 #define COFFEE_LOG_SIZE			8192
 #define COFFEE_LOG_TABLE_LIMIT		256
+#ifdef COFFEE_CONF_MICRO_LOGS
+#define COFFEE_MICRO_LOGS		COFFEE_CONF_MICRO_LOGS
+#else
 #define COFFEE_MICRO_LOGS		0
+#endif
+#ifdef COFFEE_CONF_WRITE_BUFFER_SIZE
+#define COFFEE_WRITE_BUFFER_SIZE	COFFEE_CONF_WRITE_BUFFER_SIZE
+#else
+#define COFFEE_WRITE_BUFFER_SIZE	COFFEE_PAGE_SIZE
+#endif
 #define COFFEE_IO_SEMANTICS		1
+#ifdef COFFEE_CONF_DIRECTORY_SIZE
+#define COFFEE_DIRECTORY_SIZE		COFFEE_CONF_DIRECTORY_SIZE
+#else
+#define COFFEE_DIRECTORY_SIZE		4096
+#endif
+#ifdef COFFEE_CONF_INCREMENTAL_GC
+#define COFFEE_INCREMENTAL_GC		COFFEE_CONF_INCREMENTAL_GC
+#else
+#define COFFEE_INCREMENTAL_GC		1
+#endif
+#ifdef COFFEE_CONF_BEST_FIT
+#define COFFEE_BEST_FIT			COFFEE_CONF_BEST_FIT
+#else
+#define COFFEE_BEST_FIT			1
+#endif
 
 #define COFFEE_WRITE(buf, size, offset)				\
 		xmem_pwrite((char *)(buf), (size), COFFEE_START + (offset))
@@ -166,6 +166,11 @@ typedef unsigned short uip_stats_t;
 
 #endif /* UIP_CONF_IPV6 */
 
+/* Internet checksum in cpu/native/net/uip_arch.c */
+#ifndef UIP_ARCH_CHKSUM
+#define UIP_ARCH_CHKSUM 1
+#endif /* UIP_ARCH_CHKSUM */
+
 typedef unsigned long clock_time_t;
 
 #define CLOCK_CONF_SECOND 1000
@@ -42,7 +42,11 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef XMEM_CONF_SIZE
+#define XMEM_SIZE XMEM_CONF_SIZE
+#else
 #define XMEM_SIZE 1024 * 1024
+#endif
 
 static unsigned char xmem[XMEM_SIZE];
 /*---------------------------------------------------------------------------*/
@@ -41,6 +41,7 @@
 #include <string.h>
 #include <time.h>
 #include <sys/types.h>
+#include <sys/time.h>
 
 #include <unistd.h>
 #include <errno.h>
@@ -64,6 +65,28 @@ uint16_t basedelay=0,delaymsec=0;
 uint32_t startsec,startmsec,delaystartsec,delaystartmsec;
 int timestamp = 0, flowcontrol=0;
 
+/* Largest packet read from tun or SLIP. */
+#define MAX_PACKET 2000
+/* Most packets moved from tun to SLIP per wakeup with -b, and most
+   queues of a multi-queue tap with -q. */
+#define MAX_BATCH  64
+#define MAX_QUEUES 8
+
+/* Packets moved per wakeup, 0 for one packet at a time. */
+int batch = 0;
+int tunqueues = 1;
+
+/* Traffic statistics, printed and cleared on SIGUSR1. Latency is the
+   time from reading a packet to having written it all to the other
+   side. */
+struct direction_stats {
+  unsigned long packets, bytes, wakeups;
+  unsigned long latency_sum, latency_max;
+};
+struct direction_stats tun_stats, slip_stats;
+unsigned long stats_start;
+static volatile sig_atomic_t got_sigusr1;
+
 int ssystem(const char *fmt, ...)
      __attribute__((__format__ (__printf__, 1, 2)));
 void write_to_serial(int outfd, void *inbuf, int len);
@@ -136,6 +159,57 @@ stamptime(void)
   }
 }
 
+unsigned long
+usec_now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+
+void
+stats_packet(struct direction_stats *s, int len, unsigned long start)
+{
+  unsigned long latency;
+
+  latency = usec_now() - start;
+  s->packets++;
+  s->bytes += len;
+  s->latency_sum += latency;
+  if(latency > s->latency_max) {
+    s->latency_max = latency;
+  }
+}
+
+void
+stats_print_direction(const char *name, struct direction_stats *s,
+                      unsigned long elapsed)
+{
+  fprintf(stderr, "*** %s: %lu packets, %lu bytes, %lu wakeups,"
+          " %lu bytes/s, %lu pkts/s, latency avg %lu us max %lu us\n",
+          name, s->packets, s->bytes, s->wakeups,
+          elapsed ? (unsigned long)(s->bytes * 1000000ULL / elapsed) : 0,
+          elapsed ? (unsigned long)(s->packets * 1000000ULL / elapsed) : 0,
+          s->packets ? s->latency_sum / s->packets : 0,
+          s->latency_max);
+  memset(s, 0, sizeof(*s));
+}
+
+void
+stats_print(void)
+{
+  unsigned long now;
+
+  now = usec_now();
+  if(timestamp) stamptime();
+  fprintf(stderr, "*** statistics for the last %lu ms\n",
+          (now - stats_start) / 1000);
+  stats_print_direction("tun->slip", &tun_stats, now - stats_start);
+  stats_print_direction("slip->tun", &slip_stats, now - stats_start);
+  stats_start = now;
+}
+
 int
 is_sensible_string(const unsigned char *s, int len)
 {
@@ -158,12 +232,14 @@ void
 serial_to_tun(FILE *inslip, int outfd)
 {
   static union {
-    unsigned char inbuf[2000];
+    unsigned char inbuf[MAX_PACKET];
   } uip;
   static int inbufptr = 0;
+  static unsigned long inbufstart;
   int ret,i;
   unsigned char c;
 
+  slip_stats.wakeups++;
 #ifdef linux
   ret = fread(&c, 1, 1, inslip);
   if(ret == -1 || ret == 0) err(1, "serial_to_tun: read");
@@ -269,6 +345,7 @@ serial_to_tun(FILE *inslip, int outfd)
 	if(write(outfd, uip.inbuf, inbufptr) != inbufptr) {
 	  err(1, "serial_to_tun: write");
 	}
+	stats_packet(&slip_stats, inbufptr, inbufstart);
       }
       inbufptr = 0;
     }
@@ -292,6 +369,9 @@ serial_to_tun(FILE *inslip, int outfd)
     }
     /* FALLTHROUGH */
   default:
+    if(inbufptr == 0) {
+      inbufstart = usec_now();
+    }
     uip.inbuf[inbufptr++] = c;
 
     /* Echo lines as they are received for verbose=2,3,5+ */
@@ -317,9 +397,19 @@ serial_to_tun(FILE *inslip, int outfd)
   goto read_more;
 }
 
-unsigned char slip_buf[2000];
+/* Room for a batch of packets that all need every byte escaped. */
+unsigned char slip_buf[MAX_BATCH * (2 * MAX_PACKET + 1) + 64];
 int slip_end, slip_begin;
 
+/* The end in slip_buf and the read time of each packet of the batch
+   being flushed, for the latency statistics. */
+struct {
+  int end;
+  int len;
+  unsigned long start;
+} slip_pending[MAX_BATCH];
+int slip_npending, slip_nflushed;
+
 void
 slip_send_char(int fd, unsigned char c)
 {
@@ -371,12 +461,27 @@ slip_flushbuf(int fd)
     PROGRESS("Q");		/* Outqueueis full! */
   } else {
     slip_begin += n;
+    while(slip_nflushed < slip_npending &&
+          slip_pending[slip_nflushed].end <= slip_begin) {
+      stats_packet(&tun_stats, slip_pending[slip_nflushed].len,
+                   slip_pending[slip_nflushed].start);
+      slip_nflushed++;
+    }
     if(slip_begin == slip_end) {
       slip_begin = slip_end = 0;
+      slip_npending = slip_nflushed = 0;
     }
   }
 }
 
+/* Whether a packet of any content fits in slip_buf. */
+int
+slip_room(void)
+{
+  return slip_npending < MAX_BATCH &&
+    slip_end + 2 * MAX_PACKET + 1 <= MAX_BATCH * (2 * MAX_PACKET + 1);
+}
+
 void
 write_to_serial(int outfd, void *inbuf, int len)
 {
@@ -428,20 +533,37 @@ write_to_serial(int outfd, void *inbuf, int len)
 
 
 /*
- * Read from tun, write to slip.
+ * Read from tun, write to slip. With -b, the tun device is
+ * non-blocking and is drained of up to a batch of packets, which are
+ * then flushed to slip together.
  */
 int
 tun_to_serial(int infd, int outfd)
 {
   struct {
-    unsigned char inbuf[2000];
+    unsigned char inbuf[MAX_PACKET];
   } uip;
-  int size;
-
-  if((size = read(infd, uip.inbuf, 2000)) == -1) err(1, "tun_to_serial: read");
+  int size, total, n;
+  unsigned long start;
+
+  total = 0;
+  for(n = 0; n < (batch ? batch : 1) && slip_room(); n++) {
+    start = usec_now();
+    if((size = read(infd, uip.inbuf, MAX_PACKET)) == -1) {
+      if(batch && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;
+      }
+      err(1, "tun_to_serial: read");
+    }
 
-  write_to_serial(outfd, uip.inbuf, size);
-  return size;
+    write_to_serial(outfd, uip.inbuf, size);
+    slip_pending[slip_npending].end = slip_end;
+    slip_pending[slip_npending].len = size;
+    slip_pending[slip_npending].start = start;
+    slip_npending++;
+    total += size;
+  }
+  return total;
 }
 
 #ifndef BAUDRATE
@@ -508,7 +630,7 @@ devopen(const char *dev, int flags)
 #include <linux/if_tun.h>
 
 int
-tun_alloc(char *dev, int tap)
+tun_alloc(char *dev, int tap, int multiqueue)
 {
   struct ifreq ifr;
   int fd, err;
@@ -525,6 +647,11 @@ tun_alloc(char *dev, int tap)
    *        IFF_NO_PI - Do not provide packet information
    */
   ifr.ifr_flags = (tap ? IFF_TAP : IFF_TUN) | IFF_NO_PI;
+#ifdef IFF_MULTI_QUEUE
+  if(multiqueue) {
+    ifr.ifr_flags |= IFF_MULTI_QUEUE;
+  }
+#endif
   if(*dev != 0)
     strncpy(ifr.ifr_name, dev, IFNAMSIZ);
 
@@ -537,7 +664,7 @@ tun_alloc(char *dev, int tap)
 }
 #else
 int
-tun_alloc(char *dev, int tap)
+tun_alloc(char *dev, int tap, int multiqueue)
 {
   return devopen(dev, O_RDWR);
 }
@@ -582,6 +709,12 @@ sigcleanup(int signo)
 
 static int got_sigalarm;
 
+void
+sigusr1(int signo)
+{
+  got_sigusr1 = 1;
+}
+
 void
 sigalarm(int signo)
 {
@@ -688,8 +821,9 @@ ifconf(const char *tundev, const char *ipaddr)
 int
 main(int argc, char **argv)
 {
-  int c;
+  int c, i;
   int tunfd, maxfd;
+  int tunfds[MAX_QUEUES];
   int ret;
   fd_set rset, wset;
   FILE *inslip;
@@ -704,7 +838,7 @@ main(int argc, char **argv)
   prog = argv[0];
   setvbuf(stdout, NULL, _IOLBF, 0); /* Line buffered output. */
 
-  while((c = getopt(argc, argv, "B:HLhs:t:v::d::a:p:T")) != -1) {
+  while((c = getopt(argc, argv, "B:HLhs:t:v::d::a:p:Tb::q:")) != -1) {
     switch(c) {
     case 'B':
       baudrate = atoi(optarg);
@@ -755,6 +889,21 @@ main(int argc, char **argv)
     case 'T':
       tap = 1;
       break;
+
+    case 'b':
+      batch = 16;
+      if (optarg) batch = atoi(optarg);
+      if (batch < 0 || batch > MAX_BATCH) {
+        err(1, "batch must be between 0 and %d", MAX_BATCH);
+      }
+      break;
+
+    case 'q':
+      tunqueues = atoi(optarg);
+      if (tunqueues < 1 || tunqueues > MAX_QUEUES) {
+        err(1, "queues must be between 1 and %d", MAX_QUEUES);
+      }
+      break;
  
     case '?':
     case 'h':
@@ -785,6 +934,10 @@ fprintf(stderr,"                Actual delay is basedelay*(#6LowPAN fragments) m
 fprintf(stderr,"                -d is equivalent to -d10.\n");
 fprintf(stderr," -a serveraddr  \n");
 fprintf(stderr," -p serverport  \n");
+fprintf(stderr," -b[batch]      Move up to batch packets (max %d) per wakeup.\n", MAX_BATCH);
+fprintf(stderr,"                -b is equivalent to -b16. Ignored with -d.\n");
+fprintf(stderr," -q queues      Open a multi-queue tun/tap interface (max %d).\n", MAX_QUEUES);
+fprintf(stderr,"Traffic statistics are printed on SIGUSR1.\n");
 exit(1);
       break;
     }
@@ -793,7 +946,7 @@ exit(1);
   argv += (optind - 1);
 
   if(argc != 2 && argc != 3) {
-    err(1, "usage: %s [-B baudrate] [-H] [-L] [-s siodev] [-t tundev] [-T] [-v verbosity] [-d delay] [-a serveraddress] [-p serverport] ipaddress", prog);
+    err(1, "usage: %s [-B baudrate] [-H] [-L] [-s siodev] [-t tundev] [-T] [-v verbosity] [-d delay] [-a serveraddress] [-p serverport] [-b batch] [-q queues] ipaddress", prog);
   }
   ipaddr = argv[1];
 
@@ -915,8 +1068,29 @@ exit(1);
   inslip = fdopen(slipfd, "r");
   if(inslip == NULL) err(1, "main: fdopen");
 
-  tunfd = tun_alloc(tundev, tap);
-  if(tunfd == -1) err(1, "main: open");
+  if(basedelay) {
+    /* The delay is between single packets. */
+    batch = 0;
+  }
+  if(batch) {
+    /* Read the serial line in larger blocks. */
+    setvbuf(inslip, NULL, _IOFBF, MAX_BATCH * MAX_PACKET);
+  }
+
+#ifndef IFF_MULTI_QUEUE
+  if(tunqueues > 1) {
+    warnx("multi-queue interfaces are not supported, using one queue");
+    tunqueues = 1;
+  }
+#endif
+  for(i = 0; i < tunqueues; i++) {
+    tunfds[i] = tun_alloc(tundev, tap, tunqueues > 1);
+    if(tunfds[i] == -1) err(1, "main: open");
+    if(batch && fcntl(tunfds[i], F_SETFL, O_NONBLOCK) == -1) {
+      err(1, "main: fcntl");
+    }
+  }
+  tunfd = tunfds[0];
   if (timestamp) stamptime();
   fprintf(stderr, "opened %s device ``/dev/%s''\n",
           tap ? "tap" : "tun", tundev);
@@ -926,13 +1100,20 @@ exit(1);
   signal(SIGTERM, sigcleanup);
   signal(SIGINT, sigcleanup);
   signal(SIGALRM, sigalarm);
+  signal(SIGUSR1, sigusr1);
   ifconf(tundev, ipaddr);
+  stats_start = usec_now();
 
   while(1) {
     maxfd = 0;
     FD_ZERO(&rset);
     FD_ZERO(&wset);
 
+    if(got_sigusr1) {
+      got_sigusr1 = 0;
+      stats_print();
+    }
+
 /* do not send IPA all the time... - add get MAC later... */
 /*     if(got_sigalarm) { */
 /*       /\* Send "?IPA". *\/ */
@@ -951,10 +1132,13 @@ exit(1);
     FD_SET(slipfd, &rset);	/* Read from slip ASAP! */
     if(slipfd > maxfd) maxfd = slipfd;
     
-    /* We only have one packet at a time queued for slip output. */
+    /* We only have one packet (or one batch with -b) at a time
+       queued for slip output. */
     if(slip_empty()) {
-      FD_SET(tunfd, &rset);
-      if(tunfd > maxfd) maxfd = tunfd;
+      for(i = 0; i < tunqueues; i++) {
+        FD_SET(tunfds[i], &rset);
+        if(tunfds[i] > maxfd) maxfd = tunfds[i];
+      }
     }
 
     ret = select(maxfd + 1, &rset, &wset, NULL, NULL);
@@ -980,10 +1164,15 @@ exit(1);
        if(dmsec<0) delaymsec=0;
        if(dmsec>delaymsec) delaymsec=0;
       }
-      if(delaymsec==0) {
-        int size;
-        if(slip_empty() && FD_ISSET(tunfd, &rset)) {
-          size=tun_to_serial(tunfd, slipfd);
+      if(delaymsec==0 && slip_empty()) {
+        int size = 0;
+        for(i = 0; i < tunqueues; i++) {
+          if(FD_ISSET(tunfds[i], &rset)) {
+            size += tun_to_serial(tunfds[i], slipfd);
+          }
+        }
+        if(!slip_empty()) {
+          tun_stats.wakeups++;
           slip_flushbuf(slipfd);
           sigalarm_reset();
           if(basedelay) {